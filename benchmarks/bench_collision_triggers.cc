@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <vector>
+
+#include "benchmark.h"
+#include "collision_world.h"
+#include "radix_sort.h"
+
+namespace G {
+namespace {
+
+using TriggerPair = CollisionWorld::TriggerPair;
+
+// A kSide x kSide grid where each trigger touches its 4 closest neighbours,
+// as in the ThousandsOfOverlappingTriggers test.
+constexpr uint32_t kSide = 64;
+
+// The broad-phase output for the grid: every pair, once from each side.
+std::vector<TriggerPair> GridCandidates() {
+  std::vector<TriggerPair> candidates;
+  for (uint32_t y = 0; y < kSide; ++y) {
+    for (uint32_t x = 0; x < kSide; ++x) {
+      const uint32_t i = y * kSide + x;
+      auto add = [&](uint32_t j) {
+        candidates.push_back({std::min(i, j), std::max(i, j)});
+      };
+      if (x > 0) add(i - 1);
+      if (x + 1 < kSide) add(i + 1);
+      if (y > 0) add(i - kSide);
+      if (y + 1 < kSide) add(i + kSide);
+    }
+  }
+  return candidates;
+}
+
+bool Contains(const std::vector<TriggerPair>& pairs, TriggerPair pair) {
+  for (const TriggerPair& p : pairs) {
+    if (p == pair) return true;
+  }
+  return false;
+}
+
+// What Update() did before the pairs were radix sorted: a linear lookup per
+// candidate to deduplicate, then each list searched for every entry of the
+// other.
+void QuadraticDiff(const std::vector<TriggerPair>& candidates,
+                   const std::vector<TriggerPair>& prev,
+                   std::vector<TriggerPair>* curr,
+                   std::vector<TriggerPair>* added,
+                   std::vector<TriggerPair>* lost) {
+  curr->clear();
+  for (const TriggerPair& pair : candidates) {
+    if (!Contains(*curr, pair)) curr->push_back(pair);
+  }
+  added->clear();
+  lost->clear();
+  for (const TriggerPair& pair : *curr) {
+    if (!Contains(prev, pair)) added->push_back(pair);
+  }
+  for (const TriggerPair& pair : prev) {
+    if (!Contains(*curr, pair)) lost->push_back(pair);
+  }
+}
+
+// The current Update(): sort, drop adjacent repeats, and merge the sorted
+// set with the previous one.
+void RadixDiff(const std::vector<TriggerPair>& candidates,
+               const std::vector<TriggerPair>& prev,
+               std::vector<TriggerPair>* sorted,
+               std::vector<TriggerPair>* scratch,
+               std::vector<TriggerPair>* curr,
+               std::vector<TriggerPair>* added,
+               std::vector<TriggerPair>* lost) {
+  *sorted = candidates;
+  scratch->resize(sorted->size());
+  RadixSort(sorted->data(), scratch->data(), sorted->size(),
+            [](const TriggerPair& p) { return p.key(); });
+  curr->clear();
+  for (size_t i = 0; i < sorted->size(); ++i) {
+    if (i > 0 && (*sorted)[i] == (*sorted)[i - 1]) continue;
+    curr->push_back((*sorted)[i]);
+  }
+  added->clear();
+  lost->clear();
+  size_t ci = 0, pi = 0;
+  while (ci < curr->size() && pi < prev.size()) {
+    if ((*curr)[ci] < prev[pi]) {
+      added->push_back((*curr)[ci++]);
+    } else if (prev[pi] < (*curr)[ci]) {
+      lost->push_back(prev[pi++]);
+    } else {
+      ci++;
+      pi++;
+    }
+  }
+  added->insert(added->end(), curr->begin() + ci, curr->end());
+  lost->insert(lost->end(), prev.begin() + pi, prev.end());
+}
+
+// Both diffs run on a steady frame: the previous set is the current one.
+BENCHMARK(TriggerPairDiffQuadratic) {
+  const std::vector<TriggerPair> candidates = GridCandidates();
+  std::vector<TriggerPair> prev, curr, added, lost;
+  QuadraticDiff(candidates, {}, &prev, &added, &lost);
+  for (int i = 0; i < iterations; ++i) {
+    QuadraticDiff(candidates, prev, &curr, &added, &lost);
+    DoNotOptimize(curr.data());
+  }
+}
+
+BENCHMARK(TriggerPairDiffRadix) {
+  const std::vector<TriggerPair> candidates = GridCandidates();
+  std::vector<TriggerPair> sorted, scratch, prev, curr, added, lost;
+  RadixDiff(candidates, {}, &sorted, &scratch, &prev, &added, &lost);
+  for (int i = 0; i < iterations; ++i) {
+    RadixDiff(candidates, prev, &sorted, &scratch, &curr, &added, &lost);
+    DoNotOptimize(curr.data());
+  }
+}
+
+// The whole Update(), broad and narrow phase included, on the same grid.
+BENCHMARK(CollisionWorldUpdateTriggerGrid) {
+  CollisionWorld world(64.0f, SystemAllocator::Instance());
+  const CollisionShape circle = MakeCircle(6);
+  for (uint32_t y = 0; y < kSide; ++y) {
+    for (uint32_t x = 0; x < kSide; ++x) {
+      world.Add(circle, FVec(x * 10.0f, y * 10.0f), {}, true, 0);
+    }
+  }
+  world.Update();
+  for (int i = 0; i < iterations; ++i) world.Update();
+  DoNotOptimize(world.new_trigger_count());
+}
+
+}  // namespace
+}  // namespace G
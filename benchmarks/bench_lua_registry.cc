@@ -0,0 +1,64 @@
+#include "benchmark.h"
+#include "lua.h"
+
+namespace G {
+namespace {
+
+struct Graphics {
+  int draws = 0;
+};
+
+// What Registry<T>::Retrieve did before the modules moved into LuaModules.
+char kRegistryKey = 'k';
+
+Graphics* RetrieveFromRegistryTable(lua_State* state) {
+  lua_pushlightuserdata(state, &kRegistryKey);
+  lua_gettable(state, LUA_REGISTRYINDEX);
+  auto* result = static_cast<Graphics*>(lua_touserdata(state, -1));
+  lua_pop(state, 1);
+  return result;
+}
+
+void* BenchLuaAlloc(void*, void* ptr, size_t osize, size_t nsize) {
+  Allocator* allocator = SystemAllocator::Instance();
+  if (nsize == 0) {
+    if (ptr != nullptr) allocator->Dealloc(ptr, osize);
+    return nullptr;
+  }
+  if (ptr == nullptr) return allocator->Alloc(nsize, /*align=*/1);
+  return allocator->Realloc(ptr, osize, nsize, /*align=*/1);
+}
+
+// A state with a Graphics module registered both ways.
+struct RegistryState {
+  RegistryState() : state(lua_newstate(&BenchLuaAlloc, &modules)) {
+    Registry<Graphics>::Register(state, &graphics);
+    lua_pushlightuserdata(state, &kRegistryKey);
+    lua_pushlightuserdata(state, &graphics);
+    lua_settable(state, LUA_REGISTRYINDEX);
+  }
+  ~RegistryState() { lua_close(state); }
+
+  LuaModules modules;
+  Graphics graphics;
+  lua_State* state;
+};
+
+BENCHMARK(LuaRegistryTableLookup) {
+  RegistryState s;
+  for (int i = 0; i < iterations; ++i) {
+    RetrieveFromRegistryTable(s.state)->draws++;
+  }
+  DoNotOptimize(s.graphics.draws);
+}
+
+BENCHMARK(LuaRegistryRetrieve) {
+  RegistryState s;
+  for (int i = 0; i < iterations; ++i) {
+    Registry<Graphics>::Retrieve(s.state)->draws++;
+  }
+  DoNotOptimize(s.graphics.draws);
+}
+
+}  // namespace
+}  // namespace G
@@ -0,0 +1,67 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "clock.h"
+#include "logging.h"
+
+namespace G {
+namespace {
+
+struct Entry {
+  const char* name;
+  BenchmarkFn fn;
+};
+
+constexpr int kMaxBenchmarks = 64;
+// Runs shorter than this are repeated with more iterations.
+constexpr double kMinRunSeconds = 0.5;
+
+// Function-local so that registrations in other files can run first.
+Entry* Entries(int** count) {
+  static Entry entries[kMaxBenchmarks];
+  static int entry_count = 0;
+  *count = &entry_count;
+  return entries;
+}
+
+}  // namespace
+
+BenchmarkRegistration::BenchmarkRegistration(const char* name,
+                                             BenchmarkFn fn) {
+  int* count;
+  Entry* entries = Entries(&count);
+  CHECK(*count < kMaxBenchmarks, "Too many benchmarks, raise kMaxBenchmarks");
+  entries[(*count)++] = Entry{name, fn};
+}
+
+}  // namespace G
+
+// Runs the benchmarks whose name contains argv[1], or all of them.
+int main(int argc, const char* argv[]) {
+  const char* filter = argc > 1 ? argv[1] : "";
+  int* count;
+  const G::Entry* entries = G::Entries(&count);
+  for (int i = 0; i < *count; ++i) {
+    const G::Entry& entry = entries[i];
+    if (std::strstr(entry.name, filter) == nullptr) continue;
+    int iterations = 1;
+    double elapsed = 0;
+    while (true) {
+      const G::Time start = G::Now();
+      entry.fn(iterations);
+      elapsed = G::ToSeconds(G::Now() - start);
+      if (elapsed >= G::kMinRunSeconds || iterations >= (1 << 30)) break;
+      // Aim a little past the minimum, growing at most 100x per run.
+      const double target =
+          elapsed > 0 ? 1.2 * G::kMinRunSeconds / elapsed : 100.0;
+      iterations = static_cast<int>(std::min(
+          iterations * std::clamp(target, 2.0, 100.0), double{1 << 30}));
+    }
+    std::printf("%-44s %14.1f ns/iter %12d iterations\n", entry.name,
+                elapsed * 1e9 / iterations, iterations);
+  }
+  return 0;
+}
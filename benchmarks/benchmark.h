@@ -0,0 +1,35 @@
+#pragma once
+#ifndef _GAME_BENCHMARK_H
+#define _GAME_BENCHMARK_H
+
+namespace G {
+
+// Runs its body `iterations` times. The runner raises the count until a run
+// is long enough to time, then prints the time per iteration. Nothing is
+// asserted: compare the numbers by hand, in an optimized build on an idle
+// machine.
+using BenchmarkFn = void (*)(int iterations);
+
+struct BenchmarkRegistration {
+  BenchmarkRegistration(const char* name, BenchmarkFn fn);
+};
+
+// Keeps the compiler from dropping a computation whose result is unused.
+template <typename T>
+void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static const void* volatile sink;
+  sink = &value;
+#endif
+}
+
+#define BENCHMARK(name)                                                \
+  void name(int iterations);                                           \
+  static ::G::BenchmarkRegistration name##_registration(#name, &name); \
+  void name(int iterations)
+
+}  // namespace G
+
+#endif  // _GAME_BENCHMARK_H
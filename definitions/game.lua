@@ -29,6 +29,12 @@ G = {}
 ---@class G.data
 G.data = {}
 
+---Packs a flat list of numbers into a byte buffer of fixed size records, for APIs such as G.graphics.draw_batch. Each character of the format is one field of a record: 'f' a 32-bit float, 'I' a 32-bit unsigned integer (an error outside 0-4294967295), 'B' a byte (clamped to 0-255). Spaces are ignored. The format repeats for as many records as the list holds.
+---@param format string the fields of one record, e.g. 'IfffBBBB'
+---@param values table the fields of every record, one after another
+---@return byte_buffer buffer the packed records
+function G.data.pack(format, values) end
+
 ---Computes a hash of a string or byte buffer
 ---@param data string a string or byte_buffer to hash
 ---@return number hash the hash value
@@ -184,7 +190,7 @@ function G.graphics.clear(r?, g?, b?, a?) end
 function G.graphics.take_screenshot(file?) end
 
 ---Draws a sprite by name to the screen
----@param sprite string the name of the sprite in any sprite sheet
+---@param sprite string|sprite_handle the name of the sprite in any sprite sheet, or a handle from G.assets.sprite_handle
 ---@param x number the x position (left-right) in screen coordinates where to draw the sprite
 ---@param y number the y position (top-bottom) in screen coordinates where to draw the sprite
 ---@param angle? number if provided, the angle to rotate the sprite
@@ -197,6 +203,17 @@ function G.graphics.draw_sprite(sprite, x, y, angle?) end
 ---@param angle? number if provided, the angle to rotate the image
 function G.graphics.draw_image(image, x, y, angle?) end
 
+---Draws many sprites of one texture in a single draw call, with the current color, transform and blend mode. Each sprite is 40 bytes: nine floats (center x and y, width, height, texture coordinates u0, v0 of the top-left and u1, v1 of the bottom-right corner, angle in radians) and four color bytes (r, g, b, a), as packed by G.data.pack('fffffffffBBBB', values).
+---@param texture string the name of an image or sprite sheet
+---@param sprites string a string or byte buffer with the packed sprites
+function G.graphics.draw_sprite_instances(texture, sprites) end
+
+---Draws many sprites or rectangles from packed records in one call. Format 'sprite' records are 20 bytes: sprite id (from G.assets.sprite_id), center x, y and angle, then r, g, b, a bytes, as packed by G.data.pack('IfffBBBB', values). Format 'rect' records are 24 bytes: x1, y1, x2, y2 and angle, then r, g, b, a bytes ('fffffBBBB'). Each record uses its own color; the current color is kept.
+---@param buffer byte_buffer a byte buffer or string with the records
+---@param count integer how many records to draw
+---@param format string 'sprite' or 'rect'
+function G.graphics.draw_batch(buffer, count, format) end
+
 ---Draws a solid rectangle to the screen, with the color provided by the global context
 ---@param x1 number the x coordinate for the top left of the rectangle
 ---@param y1 number the y position for the top left of the rectangle
@@ -381,13 +398,18 @@ function G.graphics.new_shader(shader?) end
 ---@param shader? string Shader to attach, if nothing is passed then pre_pass.frag will be passed
 function G.graphics.attach_shader(shader?) end
 
+---Returns a handle for a uniform name. Pass it instead of the name to send_uniform, has_uniform and send_as_uniform to skip hashing the name on every call.
+---@param name string Name of the uniform
+---@return integer handle Handle of the name
+function G.graphics.uniform(name) end
+
 ---Sends a uniform with the given name to the current shader
----@param name string Name of the uniform to send
+---@param name string|integer Name of the uniform to send, or its handle from uniform
 ---@param value number Value to send. Supported values are G.math.v2,v3,v4, G.math.m2x2, G.math.m3x3, G.math.m4x4, and floats
 function G.graphics.send_uniform(name, value) end
 
 ---Returns true if the current shader has a uniform with the given name
----@param name string Name of the uniform to check
+---@param name string|integer Name of the uniform to check, or its handle from uniform
 ---@return boolean exists Whether the uniform exists
 function G.graphics.has_uniform(name) end
 
@@ -421,6 +443,14 @@ function G.graphics.clear_stencil_test() end
 ---@param mode string Blend mode: 'alpha' (default), 'add' (additive), 'multiply', or 'replace'
 function G.graphics.set_blend_mode(mode) end
 
+---Set the layer for subsequent drawing operations. Only used when draw sorting is enabled: lower layers are drawn first.
+---@param layer integer Layer between -32768 and 32767 (default 0)
+function G.graphics.set_layer(layer) end
+
+---Enable or disable draw sorting. When enabled, sprites and shapes are drawn by layer and, within a layer, grouped by shader, blend mode and texture to reduce draw calls, so overlapping draws on the same layer may change order. Canvas, scissor, stencil, clear, line and particle calls keep their position.
+---@param enabled boolean Whether to sort draws
+function G.graphics.set_draw_sorting(enabled) end
+
 ---Sets the texture filter mode for newly loaded textures. Use 'nearest' for pixel art (crisp pixels) or 'linear' for smooth graphics.
 ---@param mode string 'nearest' or 'linear'
 function G.graphics.set_default_filter(mode) end
@@ -670,6 +700,27 @@ function G.math.angle(x1, y1, x2, y2) end
 ---@return number y y component
 function G.math.direction(angle, magnitude) end
 
+---Length of the 2D vector (x, y), without creating a vec2
+---@param x number x component
+---@param y number y component
+---@return number length length
+function G.math.length(x, y) end
+
+---Normalizes the 2D vector (x, y), without creating a vec2
+---@param x number x component
+---@param y number y component
+---@return number x normalized x
+---@return number y normalized y
+function G.math.normalize(x, y) end
+
+---Rotates the 2D vector (x, y) by an angle, without creating a vec2
+---@param x number x component
+---@param y number y component
+---@param angle number rotation in radians
+---@return number x rotated x
+---@return number y rotated y
+function G.math.rotate(x, y, angle) end
+
 ---Hermite smoothstep interpolation between edge0 and edge1
 ---@param edge0 number lower edge
 ---@param edge1 number upper edge
@@ -1141,6 +1192,10 @@ function G.system.get_real_dt() end
 ---@return number time unscaled elapsed time in seconds
 function G.system.get_real_time() end
 
+---Writes the call count and time of every G.* function called so far to bindings.tsv in the write directory. Needs a build with -DENABLE_BINDING_PROFILER=ON
+---@return boolean ok true if the file was written
+function G.system.dump_bindings() end
+
 ---@class G.clock
 G.clock = {}
 
@@ -1173,6 +1228,16 @@ G.assets = {}
 ---@return sprite_asset result A userdata ptr to a sprite object
 function G.assets.sprite(name) end
 
+---Resolves a sprite by name into a handle that G.graphics.draw_sprite draws without looking anything up. Handles go stale when sprite sheets are reloaded. Returns nil if the sprite does not exist.
+---@param name string name of the sprite
+---@return sprite_handle result A handle to the sprite
+function G.assets.sprite_handle(name) end
+
+---Resolves a sprite by name into the integer that identifies it in the records of G.graphics.draw_batch. Returns nil if the sprite does not exist.
+---@param name string name of the sprite
+---@return integer result The id of the sprite
+function G.assets.sprite_id(name) end
+
 ---Returns a table with width and height in pixels of a sprite.
 ---@param name string sprite object ptr or sprite name as string
 ---@return table result A table with two keys, width and height
@@ -1191,8 +1256,9 @@ G.collision = {}
 
 ---Creates a new collision world
 ---@param cell_size number? Spatial hash cell size in pixels (default 64)
+---@param capacity integer? Colliders to make room for up front; the world grows past it as needed (default 256)
 ---@return collision_world world The collision world
-function G.collision.new_world(cell_size) end
+function G.collision.new_world(cell_size, capacity) end
 
 ---Creates a circle collision shape
 ---@param radius number Circle radius in pixels
@@ -1525,6 +1591,46 @@ function vec2:reflect(normal) end
 ---@return vec2 result projected vector
 function vec2:project(onto) end
 
+---Overwrites x and y in place and returns self
+---@param x number x component
+---@param y number y component
+---@return vec2 self this vector
+function vec2:set(x, y) end
+
+---Adds another vector in place and returns self
+---@param other vec2 the other vector
+---@return vec2 self this vector
+function vec2:add_(other) end
+
+---Subtracts another vector in place and returns self
+---@param other vec2 the other vector
+---@return vec2 self this vector
+function vec2:sub_(other) end
+
+---Multiplies by a number in place and returns self
+---@param factor number the scale factor
+---@return vec2 self this vector
+function vec2:scale_(factor) end
+
+---Normalizes in place and returns self
+---@return vec2 self this vector
+function vec2:normalize_() end
+
+---Moves towards another vector in place and returns self
+---@param other vec2 target vector
+---@param t number interpolation factor (0-1)
+---@return vec2 self this vector
+function vec2:lerp_(other, t) end
+
+---Rotates in place and returns self
+---@param angle number rotation in radians
+---@return vec2 self this vector
+function vec2:rotate_(angle) end
+
+---Replaces the vector with (-y, x) and returns self
+---@return vec2 self this vector
+function vec2:perpendicular_() end
+
 ---A 3D floating-point vector
 ---@class vec3
 ---@operator add(vec3): vec3
@@ -1562,9 +1668,42 @@ function vec3:lerp(other, t) end
 function vec3:unpack() end
 
 ---Sends this value as a shader uniform. Errors if uniform not found.
----@param name string uniform name
+---@param name string|integer uniform name, or its handle from G.graphics.uniform
 function vec3:send_as_uniform(name) end
 
+---Overwrites the components in place and returns self
+---@param x number x component
+---@param y number y component
+---@param z number z component
+---@param w? number w component, vec4 only
+---@return vec3 self this vector
+function vec3:set(x, y, z, w?) end
+
+---Adds another vector in place and returns self
+---@param other vec3 the other vector
+---@return vec3 self this vector
+function vec3:add_(other) end
+
+---Subtracts another vector in place and returns self
+---@param other vec3 the other vector
+---@return vec3 self this vector
+function vec3:sub_(other) end
+
+---Multiplies by a number in place and returns self
+---@param factor number the scale factor
+---@return vec3 self this vector
+function vec3:scale_(factor) end
+
+---Normalizes in place and returns self
+---@return vec3 self this vector
+function vec3:normalize_() end
+
+---Moves towards another vector in place and returns self
+---@param other vec3 target vector
+---@param t number interpolation factor (0-1)
+---@return vec3 self this vector
+function vec3:lerp_(other, t) end
+
 ---A 4D floating-point vector
 ---@class vec4
 ---@operator add(vec4): vec4
@@ -1602,15 +1741,48 @@ function vec4:lerp(other, t) end
 function vec4:unpack() end
 
 ---Sends this value as a shader uniform. Errors if uniform not found.
----@param name string uniform name
+---@param name string|integer uniform name, or its handle from G.graphics.uniform
 function vec4:send_as_uniform(name) end
 
+---Overwrites the components in place and returns self
+---@param x number x component
+---@param y number y component
+---@param z number z component
+---@param w? number w component, vec4 only
+---@return vec4 self this vector
+function vec4:set(x, y, z, w?) end
+
+---Adds another vector in place and returns self
+---@param other vec4 the other vector
+---@return vec4 self this vector
+function vec4:add_(other) end
+
+---Subtracts another vector in place and returns self
+---@param other vec4 the other vector
+---@return vec4 self this vector
+function vec4:sub_(other) end
+
+---Multiplies by a number in place and returns self
+---@param factor number the scale factor
+---@return vec4 self this vector
+function vec4:scale_(factor) end
+
+---Normalizes in place and returns self
+---@return vec4 self this vector
+function vec4:normalize_() end
+
+---Moves towards another vector in place and returns self
+---@param other vec4 target vector
+---@param t number interpolation factor (0-1)
+---@return vec4 self this vector
+function vec4:lerp_(other, t) end
+
 ---A 2x2 floating-point matrix
 ---@class mat2x2
 local mat2x2 = {}
 
 ---Sends this matrix as a shader uniform. Errors if uniform not found.
----@param name string uniform name
+---@param name string|integer uniform name, or its handle from G.graphics.uniform
 function mat2x2:send_as_uniform(name) end
 
 ---A 3x3 floating-point matrix
@@ -1618,7 +1790,7 @@ function mat2x2:send_as_uniform(name) end
 local mat3x3 = {}
 
 ---Sends this matrix as a shader uniform. Errors if uniform not found.
----@param name string uniform name
+---@param name string|integer uniform name, or its handle from G.graphics.uniform
 function mat3x3:send_as_uniform(name) end
 
 ---A 4x4 floating-point matrix
@@ -1626,7 +1798,7 @@ function mat3x3:send_as_uniform(name) end
 local mat4x4 = {}
 
 ---Sends this matrix as a shader uniform. Errors if uniform not found.
----@param name string uniform name
+---@param name string|integer uniform name, or its handle from G.graphics.uniform
 function mat4x4:send_as_uniform(name) end
 
 ---An opaque handle to a physics body
@@ -1718,6 +1890,10 @@ local rng = {}
 ---@class sprite_asset
 local sprite_asset = {}
 
+---A sprite resolved by G.assets.sprite_handle
+---@class sprite_handle
+local sprite_handle = {}
+
 ---A collision detection world with spatial hashing
 ---@class collision_world
 local collision_world = {}
@@ -1771,6 +1947,14 @@ function collision_world:get_userdata(handle) end
 ---@return table contacts Array of contact info
 function collision_world:move_and_slide(handle, vx, vy) end
 
+---Moves many colliders with sliding collision resolution in one call
+---@param handles table Array of collider handles, each listed once
+---@param velocities table Flat array of velocities: vx1, vy1, vx2, vy2, ...
+---@param parallel boolean? Resolves all moves against the world as it was at the call, on the thread pool (default false)
+---@return table positions Flat array of final positions: x1, y1, x2, y2, ...
+---@return table contacts Arrays of contact info by handle index, for the colliders that hit something
+function collision_world:move_and_slide_batch(handles, velocities, parallel) end
+
 ---Moves a collider until first collision
 ---@param handle collision_handle Collider handle
 ---@param vx number X velocity
@@ -1848,7 +2032,7 @@ function collision_world:on_trigger_enter(fn) end
 ---@param fn function Callback function(handle_a, handle_b)
 function collision_world:on_trigger_exit(fn) end
 
----Updates the collision world (rebuilds broad phase, fires triggers)
+---Detects trigger overlaps and fires the enter and exit callbacks
 function collision_world:update() end
 
 ---An opaque handle to a collider in a collision world
@@ -2,8 +2,9 @@
 # game-profile: Build with in-engine profiler instrumentation and run
 # a scene.
 #
-# Uses the "profile" CMake preset (Debug + ENABLE_PROFILING=ON),
-# then runs the scene with Chrome Tracing instrumentation.
+# Uses the "profile" CMake preset (Debug + ENABLE_PROFILING=ON +
+# ENABLE_BINDING_PROFILER=ON), then runs the scene with Chrome Tracing
+# instrumentation and per-binding timing.
 # For CPU sampling profiles see game-samply instead.
 #
 # Arguments:
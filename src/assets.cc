@@ -28,11 +28,11 @@ void ReadBlobOrDie(std::string_view name, uint64_t blob_hash, uint8_t* buffer,
 void DbAssets::LoadScript(std::string_view filename, uint8_t* buffer,
                           size_t size, ChecksumType checksum,
                           uint64_t blob_hash) {
-  ReadBlobOrDie(filename, blob_hash, buffer, size);
+  DCHECK(buffer == nullptr);
   Script script;
   script.name = filename;
-  script.contents = buffer;
   script.size = size;
+  script.blob_hash = blob_hash;
   script.checksum = checksum;
   script_loader_.Load(&script);
 }
@@ -186,9 +186,11 @@ void DbAssets::Load() {
     std::string_view name;
     void (DbAssets::*load)(std::string_view, uint8_t*, size_t, ChecksumType,
                            uint64_t);
+    // Lazy loaders get no buffer and read the blob themselves when needed.
+    bool lazy = false;
   };
   static constexpr Loader kLoaders[] = {
-      {.name = "script", .load = &DbAssets::LoadScript},
+      {.name = "script", .load = &DbAssets::LoadScript, .lazy = true},
       {.name = "spritesheet", .load = &DbAssets::LoadSpritesheet},
       {.name = "image", .load = &DbAssets::LoadImage},
       {.name = "audio", .load = &DbAssets::LoadAudio},
@@ -198,9 +200,14 @@ void DbAssets::Load() {
       {.name = "proto", .load = &DbAssets::LoadProtoDescriptor},
       {.name = std::string_view(), .load = nullptr},
   };
+  // Packaged scripts may come with precompiled bytecode, which is loaded
+  // instead of the source: lua_load tells the two apart by their header.
   SqlStmt stmt(db_,
-               "SELECT name, type, size, hash, blob_hash FROM "
-               "asset_metadata ORDER BY processing_order, type");
+               "SELECT a.name, a.type, a.size, a.hash, a.blob_hash, "
+               "b.size, b.blob_hash FROM asset_metadata a "
+               "LEFT JOIN script_bytecode b "
+               "ON b.name = a.name AND b.source_hash = a.hash "
+               "ORDER BY a.processing_order, a.type");
   CHECK(stmt.ok(), "Failed to prepare asset_metadata query");
   while (MUST(stmt.Step())) {
     auto name = stmt.ColumnText(0);
@@ -213,12 +220,11 @@ void DbAssets::Load() {
     }
     TIMER("Loading asset ", name);
     auto type = stmt.ColumnText(1);
-    const size_t size = stmt.ColumnInt64(2);
-    const uint64_t blob_hash = static_cast<uint64_t>(stmt.ColumnInt64(4));
+    const bool bytecode = stmt.ColumnInt64(6) != 0;
+    const size_t size = stmt.ColumnInt64(bytecode ? 5 : 2);
+    const uint64_t blob_hash =
+        static_cast<uint64_t>(stmt.ColumnInt64(bytecode ? 6 : 4));
     std::string_view saved_name = InternedString(name);
-    auto* buf =
-        reinterpret_cast<uint8_t*>(allocator_->Alloc(size + 1, /*align=*/16));
-    CHECK(buf != nullptr, "Failed to allocate bytes for asset");
     for (const Loader& loader : kLoaders) {
       if (loader.name.empty()) {
         LOG("No loader for asset ", name, " with type ", type);
@@ -230,6 +236,12 @@ void DbAssets::Load() {
         LOG("While loading ", name, ": unimplemented asset type ", type);
         break;
       }
+      uint8_t* buf = nullptr;
+      if (!loader.lazy) {
+        buf = reinterpret_cast<uint8_t*>(
+            allocator_->Alloc(size + 1, /*align=*/16));
+        CHECK(buf != nullptr, "Failed to allocate bytes for asset");
+      }
       (this->*method)(saved_name, buf, size, db_checksum, blob_hash);
       Checksum c;
       c.asset = saved_name;
@@ -46,10 +46,12 @@ class DbAssets {
     size_t height;
   };
 
+  // Only metadata: the contents stay in the blob store until the script is
+  // first needed, and are read with ReadBlob(blob_hash, buffer, size).
   struct Script {
     std::string_view name;
     size_t size;
-    uint8_t* contents;
+    uint64_t blob_hash;
     ChecksumType checksum;
   };
 
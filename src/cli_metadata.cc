@@ -13,6 +13,7 @@ constexpr CliFlag kRunFlags[] = {
     {"clean", '\0', "", "Delete cached database and repack from scratch"},
     {"no-hotreload", '\0', "", "Disable the file watcher"},
     {"test", '\0', "", "Run in test mode"},
+    {"lua-profile", '\0', "", "Sample Lua stacks until exit"},
 };
 
 constexpr CliFlag kPackageFlags[] = {
@@ -21,6 +22,9 @@ constexpr CliFlag kPackageFlags[] = {
     {"engine-binary", '\0', "path",
      "Use a pre-built engine binary instead of self"},
     {"strip", '\0', "", "Strip debug symbols from the binary"},
+    {"bytecode", '\0', "", "Ship .lua scripts as precompiled bytecode"},
+    {"strip-bytecode", '\0', "",
+     "Like --bytecode, without line numbers in errors"},
     {"sfx", '\0', "", "Produce a self-extracting Windows .exe"},
     {"zip", '\0', "", "Produce a .zip archive"},
 };
@@ -53,17 +53,17 @@ void CopyRuntimeDlls(const char* src_binary, const char* output_dir) {
   }
 }
 
-// Writes every blob referenced by asset_metadata into a deterministic
-// assets.zip: entries are named by their 16-hex-char content hash and added
-// in ascending hash order, so packaging identical assets twice produces
-// byte-identical archives.
+// Writes every blob referenced by asset_metadata or script_bytecode into a
+// deterministic assets.zip: entries are named by their 16-hex-char content
+// hash and added in ascending hash order, so packaging identical assets
+// twice produces byte-identical archives.
 ErrorOr<void> BuildAssetZip(sqlite3* db, const char* blob_dir,
                             const char* zip_path, Allocator* scratch) {
   DynArray<uint64_t> hashes(scratch);
   {
     SqlStmt stmt(db,
-                 "SELECT DISTINCT blob_hash FROM asset_metadata "
-                 "WHERE blob_hash != 0");
+                 "SELECT blob_hash FROM asset_metadata WHERE blob_hash != 0 "
+                 "UNION SELECT blob_hash FROM script_bytecode");
     if (!stmt.ok()) return Error::Message("failed to query blob hashes");
     while (TRY(stmt.Step())) {
       hashes.Push(static_cast<uint64_t>(stmt.ColumnInt64(0)));
@@ -78,7 +78,9 @@ ErrorOr<void> BuildAssetZip(sqlite3* db, const char* blob_dir,
   // after a full repack the packer arena may not have hundreds of MB left.
   int64_t max_blob_size = 0;
   {
-    SqlStmt stmt(db, "SELECT COALESCE(MAX(size), 0) FROM asset_metadata");
+    SqlStmt stmt(db,
+                 "SELECT COALESCE(MAX(size), 0) FROM (SELECT size FROM "
+                 "asset_metadata UNION ALL SELECT size FROM script_bytecode)");
     if (!stmt.ok()) return Error::Message("failed to query max blob size");
     if (TRY(stmt.Step())) max_blob_size = stmt.ColumnInt64(0);
   }
@@ -290,6 +292,10 @@ void PrintHelp() {
       "self\n");
   printf("  --target <native|web> Package for desktop (default) or browser\n");
   printf("  --strip               Strip debug symbols from the binary\n");
+  printf("  --bytecode            Ship .lua scripts as precompiled bytecode\n");
+  printf(
+      "  --strip-bytecode      Like --bytecode, without line numbers in "
+      "errors\n");
   printf(
       "  --sfx                 Build a self-extracting archive (requires "
       "7z)\n");
@@ -305,6 +311,7 @@ int CmdPackage(Slice<const char*> args, Allocator* allocator) {
   const char* target = "native";
   bool strip = false;
   bool sfx = false;
+  ScriptBytecode bytecode = ScriptBytecode::kNone;
 
   for (size_t i = 1; i < args.size(); ++i) {
     std::string_view arg = args[i];
@@ -324,6 +331,10 @@ int CmdPackage(Slice<const char*> args, Allocator* allocator) {
       strip = true;
     } else if (arg == "--sfx") {
       sfx = true;
+    } else if (arg == "--bytecode") {
+      bytecode = ScriptBytecode::kDebugInfo;
+    } else if (arg == "--strip-bytecode") {
+      bytecode = ScriptBytecode::kStripped;
     } else if (arg[0] != '-') {
       source_directory = args[i];
     }
@@ -338,6 +349,11 @@ int CmdPackage(Slice<const char*> args, Allocator* allocator) {
     fprintf(stderr, "Error: --strip and --sfx do not apply to --target web.\n");
     return 1;
   }
+  // Lua bytecode encodes the size of size_t, which differs on wasm32.
+  if (web && bytecode != ScriptBytecode::kNone) {
+    fprintf(stderr, "Error: --bytecode does not apply to --target web.\n");
+    return 1;
+  }
 
   // Validate project.
   CmdBuffer conf_path(source_directory, "/conf.json");
@@ -403,6 +419,9 @@ int CmdPackage(Slice<const char*> args, Allocator* allocator) {
   executor.Start();
   MUST(WriteAssetsToDb(source_directory, db, &blobs, &packer_arena, &executor));
   executor.Shutdown();
+  const size_t compiled =
+      MUST(WriteScriptBytecode(db, &blobs, bytecode, &packer_arena));
+  if (compiled > 0) LOG("Precompiled ", compiled, " script(s) to bytecode");
 
   CmdBuffer zip_path(output_dir, "/assets.zip");
   MUST(BuildAssetZip(db, blobs.directory(), zip_path.str(), &packer_arena));
@@ -33,6 +33,7 @@ void PrintHelp() {
       "  --clean             Delete the cached asset database before "
       "running\n");
   printf("  --test              Run in test mode (implies --no-hotreload)\n");
+  printf("  --lua-profile       Sample Lua stacks until exit\n");
   printf("  --                  Pass remaining arguments to the game script\n");
 }
 
@@ -43,6 +44,7 @@ int CmdRun(Slice<const char*> args, Allocator* allocator) {
   bool hotreload = true;
   bool clean = false;
   bool test_mode = false;
+  bool lua_profile = false;
   Slice<const char*> game_args;
 
   // Parse arguments: game run [dir] [--flags] [-- game-args...]
@@ -63,6 +65,8 @@ int CmdRun(Slice<const char*> args, Allocator* allocator) {
     } else if (arg == "--test") {
       test_mode = true;
       hotreload = false;
+    } else if (arg == "--lua-profile") {
+      lua_profile = true;
     } else if (arg[0] != '-') {
       source_directory = args[i];
     }
@@ -127,6 +131,7 @@ int CmdRun(Slice<const char*> args, Allocator* allocator) {
   opts.blob_source = blobs_dir.str();
   opts.hotreload = hotreload;
   opts.test_mode = test_mode;
+  opts.lua_profile = lua_profile;
   opts.args = game_args;
   opts.all_args = args;
 
@@ -3,6 +3,12 @@
 #include <algorithm>
 #include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace G {
 namespace {
 
@@ -12,6 +18,118 @@ float Clamp(float v, float lo, float hi) {
   return v;
 }
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(__ARM_NEON)
+// Four candidates of OverlapShapes, one per lane. `extent_x` holds the
+// radius of circles and the half width of boxes, `extent_y` the half
+// height of boxes. `circle` is all ones in the lanes holding a circle.
+struct Lanes {
+  alignas(16) float x[4];
+  alignas(16) float y[4];
+  alignas(16) float extent_x[4];
+  alignas(16) float extent_y[4];
+  alignas(16) uint32_t circle[4];
+};
+
+// Returns bit i set if lane i overlaps `a`. Every comparison keeps the
+// sense of the scalar tests so that the answers match them, provided the
+// scalar products are not fused into multiply-adds (see CMakeLists.txt).
+uint32_t OverlapLanes(const CollisionShape& a, FVec2 pos_a,
+                      const Lanes& lanes) {
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128 bx = _mm_load_ps(lanes.x);
+  const __m128 by = _mm_load_ps(lanes.y);
+  const __m128 ex = _mm_load_ps(lanes.extent_x);
+  const __m128 ey = _mm_load_ps(lanes.extent_y);
+  const __m128 circle = _mm_castsi128_ps(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.circle)));
+  const __m128 ax = _mm_set1_ps(pos_a.x);
+  const __m128 ay = _mm_set1_ps(pos_a.y);
+  auto length2 = [](__m128 x, __m128 y) {
+    return _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+  };
+  auto clamp = [](__m128 v, __m128 lo, __m128 hi) {
+    return _mm_min_ps(_mm_max_ps(v, lo), hi);
+  };
+  __m128 with_circle, with_box;
+  if (a.type == CollisionShapeType::kCircle) {
+    const __m128 ar = _mm_set1_ps(a.circle.radius);
+    // TestCircleCircle.
+    const __m128 sum_r = _mm_add_ps(ar, ex);
+    with_circle =
+        _mm_cmpnge_ps(length2(_mm_sub_ps(bx, ax), _mm_sub_ps(by, ay)),
+                      _mm_mul_ps(sum_r, sum_r));
+    // TestCircleAABB with `a` as the circle.
+    const __m128 cx = clamp(ax, _mm_sub_ps(bx, ex), _mm_add_ps(bx, ex));
+    const __m128 cy = clamp(ay, _mm_sub_ps(by, ey), _mm_add_ps(by, ey));
+    with_box = _mm_cmpngt_ps(length2(_mm_sub_ps(ax, cx), _mm_sub_ps(ay, cy)),
+                             _mm_mul_ps(ar, ar));
+  } else {
+    const __m128 hw = _mm_set1_ps(a.aabb.half_w);
+    const __m128 hh = _mm_set1_ps(a.aabb.half_h);
+    // TestCircleAABB with `a` as the box.
+    const __m128 cx = clamp(bx, _mm_sub_ps(ax, hw), _mm_add_ps(ax, hw));
+    const __m128 cy = clamp(by, _mm_sub_ps(ay, hh), _mm_add_ps(ay, hh));
+    with_circle = _mm_cmpngt_ps(
+        length2(_mm_sub_ps(bx, cx), _mm_sub_ps(by, cy)), _mm_mul_ps(ex, ex));
+    // TestAABBAABB.
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 overlap_x = _mm_sub_ps(
+        _mm_add_ps(hw, ex), _mm_andnot_ps(sign, _mm_sub_ps(bx, ax)));
+    const __m128 overlap_y = _mm_sub_ps(
+        _mm_add_ps(hh, ey), _mm_andnot_ps(sign, _mm_sub_ps(by, ay)));
+    with_box = _mm_and_ps(_mm_cmpnle_ps(overlap_x, _mm_setzero_ps()),
+                          _mm_cmpnle_ps(overlap_y, _mm_setzero_ps()));
+  }
+  return static_cast<uint32_t>(_mm_movemask_ps(_mm_or_ps(
+      _mm_and_ps(circle, with_circle), _mm_andnot_ps(circle, with_box))));
+#else
+  const float32x4_t bx = vld1q_f32(lanes.x);
+  const float32x4_t by = vld1q_f32(lanes.y);
+  const float32x4_t ex = vld1q_f32(lanes.extent_x);
+  const float32x4_t ey = vld1q_f32(lanes.extent_y);
+  const uint32x4_t circle = vld1q_u32(lanes.circle);
+  const float32x4_t ax = vdupq_n_f32(pos_a.x);
+  const float32x4_t ay = vdupq_n_f32(pos_a.y);
+  auto length2 = [](float32x4_t x, float32x4_t y) {
+    return vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y));
+  };
+  auto clamp = [](float32x4_t v, float32x4_t lo, float32x4_t hi) {
+    return vminq_f32(vmaxq_f32(v, lo), hi);
+  };
+  uint32x4_t with_circle, with_box;
+  if (a.type == CollisionShapeType::kCircle) {
+    const float32x4_t ar = vdupq_n_f32(a.circle.radius);
+    const float32x4_t sum_r = vaddq_f32(ar, ex);
+    with_circle = vmvnq_u32(
+        vcgeq_f32(length2(vsubq_f32(bx, ax), vsubq_f32(by, ay)),
+                  vmulq_f32(sum_r, sum_r)));
+    const float32x4_t cx = clamp(ax, vsubq_f32(bx, ex), vaddq_f32(bx, ex));
+    const float32x4_t cy = clamp(ay, vsubq_f32(by, ey), vaddq_f32(by, ey));
+    with_box = vmvnq_u32(
+        vcgtq_f32(length2(vsubq_f32(ax, cx), vsubq_f32(ay, cy)),
+                  vmulq_f32(ar, ar)));
+  } else {
+    const float32x4_t hw = vdupq_n_f32(a.aabb.half_w);
+    const float32x4_t hh = vdupq_n_f32(a.aabb.half_h);
+    const float32x4_t cx = clamp(bx, vsubq_f32(ax, hw), vaddq_f32(ax, hw));
+    const float32x4_t cy = clamp(by, vsubq_f32(ay, hh), vaddq_f32(ay, hh));
+    with_circle = vmvnq_u32(
+        vcgtq_f32(length2(vsubq_f32(bx, cx), vsubq_f32(by, cy)),
+                  vmulq_f32(ex, ex)));
+    const float32x4_t overlap_x =
+        vsubq_f32(vaddq_f32(hw, ex), vabsq_f32(vsubq_f32(bx, ax)));
+    const float32x4_t overlap_y =
+        vsubq_f32(vaddq_f32(hh, ey), vabsq_f32(vsubq_f32(by, ay)));
+    with_box = vandq_u32(vmvnq_u32(vcleq_f32(overlap_x, vdupq_n_f32(0))),
+                         vmvnq_u32(vcleq_f32(overlap_y, vdupq_n_f32(0))));
+  }
+  const uint32x4_t hit = vbslq_u32(circle, with_circle, with_box);
+  return (vgetq_lane_u32(hit, 0) & 1) | (vgetq_lane_u32(hit, 1) & 2) |
+         (vgetq_lane_u32(hit, 2) & 4) | (vgetq_lane_u32(hit, 3) & 8);
+#endif
+}
+#endif
+
 }  // namespace
 
 CollisionResult TestCircleCircle(FVec2 pos_a, float radius_a, FVec2 pos_b,
@@ -271,4 +389,49 @@ bool PointInShape(FVec2 point, const CollisionShape& shape, FVec2 shape_pos) {
   return false;
 }
 
+uint32_t OverlapShapesScalar(const CollisionShape& a, FVec2 pos_a,
+                             const CollisionShape* shapes,
+                             const FVec2* positions, const uint32_t* ids,
+                             uint32_t count, uint32_t* hits) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint32_t id = ids[i];
+    if (TestShapes(a, pos_a, shapes[id], positions[id]).hit) hits[n++] = id;
+  }
+  return n;
+}
+
+uint32_t OverlapShapes(const CollisionShape& a, FVec2 pos_a,
+                       const CollisionShape* shapes, const FVec2* positions,
+                       const uint32_t* ids, uint32_t count, uint32_t* hits) {
+#if defined(__SSE2__) || defined(_M_X64) || defined(__ARM_NEON)
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < count; i += 4) {
+    // The ids of the group are read before any of its hits is written, so
+    // `hits` can be `ids`. Lanes past the end repeat the last candidate.
+    Lanes lanes;
+    uint32_t group[4];
+    for (uint32_t k = 0; k < 4; ++k) {
+      const uint32_t id = ids[std::min(i + k, count - 1)];
+      const CollisionShape& shape = shapes[id];
+      const bool circle = shape.type == CollisionShapeType::kCircle;
+      group[k] = id;
+      lanes.x[k] = positions[id].x;
+      lanes.y[k] = positions[id].y;
+      lanes.extent_x[k] = circle ? shape.circle.radius : shape.aabb.half_w;
+      lanes.extent_y[k] = circle ? 0.0f : shape.aabb.half_h;
+      lanes.circle[k] = circle ? UINT32_MAX : 0;
+    }
+    const uint32_t mask = OverlapLanes(a, pos_a, lanes);
+    const uint32_t lanes_used = std::min(4u, count - i);
+    for (uint32_t k = 0; k < lanes_used; ++k) {
+      if (mask & (1u << k)) hits[n++] = group[k];
+    }
+  }
+  return n;
+#else
+  return OverlapShapesScalar(a, pos_a, shapes, positions, ids, count, hits);
+#endif
+}
+
 }  // namespace G
@@ -103,6 +103,22 @@ CollisionResult TestCircleAABB(FVec2 circle_pos, float radius, FVec2 aabb_pos,
 CollisionResult TestShapes(const CollisionShape& a, FVec2 pos_a,
                            const CollisionShape& b, FVec2 pos_b);
 
+// Overlap tests of `a` at `pos_a` against shapes[ids[i]] at
+// positions[ids[i]] for i < count, four candidates at a time with SSE2 or
+// NEON. Each answer is meant to be TestShapes(...).hit, which the tests
+// check on x86; collision.cc is built without floating point contraction
+// so that holds on ARM too. Writes the ids that overlap to `hits`, in
+// order, and returns how many there are. `hits` may be `ids`.
+uint32_t OverlapShapes(const CollisionShape& a, FVec2 pos_a,
+                       const CollisionShape* shapes, const FVec2* positions,
+                       const uint32_t* ids, uint32_t count, uint32_t* hits);
+
+// OverlapShapes one candidate at a time: the fallback without SIMD.
+uint32_t OverlapShapesScalar(const CollisionShape& a, FVec2 pos_a,
+                             const CollisionShape* shapes,
+                             const FVec2* positions, const uint32_t* ids,
+                             uint32_t count, uint32_t* hits);
+
 struct RaycastResult {
   bool hit = false;
   float t;       // Parametric distance along ray
@@ -4,29 +4,55 @@
 #include <cmath>
 #include <cstring>
 
+#include "executor.h"
 #include "logging.h"
+#include "radix_sort.h"
 #include "zone_stats.h"
 
 namespace G {
+namespace {
+
+bool BoundsOverlap(const CollisionAABB& a, const CollisionAABB& b) {
+  return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y &&
+         b.min.y <= a.max.y;
+}
+
+template <typename T>
+T* ResizeArray(Allocator* allocator, T* array, size_t size, size_t new_size) {
+  if (array == nullptr) return allocator->NewArray<T>(new_size);
+  return static_cast<T*>(allocator->Realloc(
+      array, size * sizeof(T), new_size * sizeof(T), alignof(T)));
+}
+
+}  // namespace
 
 void SpatialHash::Init(float cell_size, size_t table_size,
-                       Allocator* allocator) {
+                       uint32_t entry_capacity, Allocator* allocator) {
   cell_size_ = cell_size;
   inv_cell_size_ = 1.0f / cell_size;
   table_size_ = table_size;
   allocator_ = allocator;
 
   bucket_heads_ = allocator_->NewArray<uint32_t>(table_size_);
-  entries_ = allocator_->NewArray<Entry>(kMaxEntries);
+  entry_capacity_ = std::max(entry_capacity, 1u);
+  entries_ = allocator_->NewArray<Entry>(entry_capacity_);
   Clear();
 }
 
 void SpatialHash::Destroy() {
   if (allocator_ == nullptr) return;
   allocator_->DeallocArray(bucket_heads_, table_size_);
-  allocator_->DeallocArray(entries_, kMaxEntries);
+  allocator_->DeallocArray(entries_, entry_capacity_);
   bucket_heads_ = nullptr;
   entries_ = nullptr;
+  entry_capacity_ = 0;
+}
+
+void SpatialHash::Resize(size_t table_size) {
+  allocator_->DeallocArray(bucket_heads_, table_size_);
+  table_size_ = table_size;
+  bucket_heads_ = allocator_->NewArray<uint32_t>(table_size_);
+  Clear();
 }
 
 void SpatialHash::Clear() {
@@ -34,6 +60,8 @@ void SpatialHash::Clear() {
     bucket_heads_[i] = kNone;
   }
   entry_count_ = 0;
+  used_entries_ = 0;
+  free_head_ = kNone;
 }
 
 size_t SpatialHash::Hash(int cx, int cy) const {
@@ -44,52 +72,82 @@ size_t SpatialHash::Hash(int cx, int cy) const {
   return h % table_size_;
 }
 
-void SpatialHash::Insert(uint32_t id, CollisionAABB bounds) {
-  int min_cx = static_cast<int>(std::floor(bounds.min.x * inv_cell_size_));
-  int min_cy = static_cast<int>(std::floor(bounds.min.y * inv_cell_size_));
-  int max_cx = static_cast<int>(std::floor(bounds.max.x * inv_cell_size_));
-  int max_cy = static_cast<int>(std::floor(bounds.max.y * inv_cell_size_));
+SpatialHash::CellRange SpatialHash::CellsFor(CollisionAABB bounds) const {
+  return {
+      .min_x = static_cast<int>(std::floor(bounds.min.x * inv_cell_size_)),
+      .min_y = static_cast<int>(std::floor(bounds.min.y * inv_cell_size_)),
+      .max_x = static_cast<int>(std::floor(bounds.max.x * inv_cell_size_)),
+      .max_y = static_cast<int>(std::floor(bounds.max.y * inv_cell_size_)),
+  };
+}
 
-  for (int cy = min_cy; cy <= max_cy; ++cy) {
-    for (int cx = min_cx; cx <= max_cx; ++cx) {
-      if (entry_count_ >= kMaxEntries) return;
-      size_t bucket = Hash(cx, cy);
-      uint32_t ei = entry_count_++;
-      entries_[ei].id = id;
-      entries_[ei].next = bucket_heads_[bucket];
+uint32_t SpatialHash::NewEntry() {
+  if (free_head_ != kNone) {
+    const uint32_t ei = free_head_;
+    free_head_ = entries_[ei].next;
+    return ei;
+  }
+  if (used_entries_ == entry_capacity_) {
+    // kNone is not a valid entry index.
+    CHECK(entry_capacity_ <= kNone / 2, "Spatial hash out of entries");
+    const uint32_t capacity = 2 * entry_capacity_;
+    entries_ = static_cast<Entry*>(allocator_->Realloc(
+        entries_, size_t{entry_capacity_} * sizeof(Entry),
+        size_t{capacity} * sizeof(Entry), alignof(Entry)));
+    CHECK(entries_ != nullptr, "Failed to grow the spatial hash to ",
+          capacity, " entries");
+    entry_capacity_ = capacity;
+  }
+  return used_entries_++;
+}
+
+uint32_t SpatialHash::Insert(uint32_t id, CellRange cells) {
+  uint32_t chain = kNone;
+  for (int cy = cells.min_y; cy <= cells.max_y; ++cy) {
+    for (int cx = cells.min_x; cx <= cells.max_x; ++cx) {
+      const uint32_t ei = NewEntry();
+      const uint32_t bucket = static_cast<uint32_t>(Hash(cx, cy));
+      Entry& e = entries_[ei];
+      e.id = id;
+      e.next = bucket_heads_[bucket];
+      e.prev = kNone;
+      e.bucket = bucket;
+      e.chain = chain;
+      if (e.next != kNone) entries_[e.next].prev = ei;
       bucket_heads_[bucket] = ei;
+      chain = ei;
+      entry_count_++;
     }
   }
+  return chain;
 }
 
-size_t SpatialHash::Query(CollisionAABB bounds, uint32_t* out,
-                          size_t out_capacity) const {
-  int min_cx = static_cast<int>(std::floor(bounds.min.x * inv_cell_size_));
-  int min_cy = static_cast<int>(std::floor(bounds.min.y * inv_cell_size_));
-  int max_cx = static_cast<int>(std::floor(bounds.max.x * inv_cell_size_));
-  int max_cy = static_cast<int>(std::floor(bounds.max.y * inv_cell_size_));
-
-  size_t count = 0;
-  for (int cy = min_cy; cy <= max_cy; ++cy) {
-    for (int cx = min_cx; cx <= max_cx; ++cx) {
-      size_t bucket = Hash(cx, cy);
-      uint32_t ei = bucket_heads_[bucket];
-      while (ei != kNone) {
-        if (count < out_capacity) {
-          out[count++] = entries_[ei].id;
-        }
-        ei = entries_[ei].next;
-      }
+void SpatialHash::Remove(uint32_t chain) {
+  while (chain != kNone) {
+    const uint32_t ei = chain;
+    Entry& e = entries_[ei];
+    chain = e.chain;
+    if (e.prev == kNone) {
+      bucket_heads_[e.bucket] = e.next;
+    } else {
+      entries_[e.prev].next = e.next;
     }
+    if (e.next != kNone) entries_[e.next].prev = e.prev;
+    e.next = free_head_;
+    free_head_ = ei;
+    entry_count_--;
   }
-  return count;
 }
 
-size_t SpatialHash::QueryRay(FVec2 origin, FVec2 direction, float max_dist,
-                             uint32_t* out, size_t out_capacity) const {
+void SpatialHash::Query(CollisionAABB bounds, Candidates* out) const {
+  ForEach(CellsFor(bounds), [out](uint32_t id) { out->Push(id); });
+}
+
+void SpatialHash::QueryRay(FVec2 origin, FVec2 direction, float max_dist,
+                           Candidates* out) const {
   // DDA-style grid traversal.
   float len = std::sqrt(direction.Dot(direction));
-  if (len < 1e-8f) return 0;
+  if (len < 1e-8f) return;
   FVec2 dir = direction * (1.0f / len);
 
   int cx = static_cast<int>(std::floor(origin.x * inv_cell_size_));
@@ -119,15 +177,13 @@ size_t SpatialHash::QueryRay(FVec2 origin, FVec2 direction, float max_dist,
     t_delta_y = cell_size_ / std::abs(dir.y);
   }
 
-  size_t count = 0;
   float t = 0;
-  while (t <= max_dist && count < out_capacity) {
+  while (t <= max_dist) {
     // Collect all entries in current cell.
     size_t bucket = Hash(cx, cy);
-    uint32_t ei = bucket_heads_[bucket];
-    while (ei != kNone && count < out_capacity) {
-      out[count++] = entries_[ei].id;
-      ei = entries_[ei].next;
+    for (uint32_t ei = bucket_heads_[bucket]; ei != kNone;
+         ei = entries_[ei].next) {
+      out->Push(entries_[ei].id);
     }
 
     // Step to next cell.
@@ -141,77 +197,132 @@ size_t SpatialHash::QueryRay(FVec2 origin, FVec2 direction, float max_dist,
       cy += step_y;
     }
   }
-  return count;
 }
 
-CollisionWorld::CollisionWorld(float cell_size, Allocator* allocator)
+CollisionWorld* CollisionWorld::first_world_ = nullptr;
+
+CollisionWorld::CollisionWorld(float cell_size, Allocator* allocator,
+                               uint32_t capacity)
     : allocator_(allocator) {
-  colliders_ = allocator_->NewArray<Collider>(kMaxColliders);
-  for (uint32_t i = 0; i < kMaxColliders; ++i) {
-    colliders_[i] = Collider{};
-  }
+  // Most colliders are smaller than a cell and cover at most 4 of them.
+  capacity = std::max(capacity, 1u);
+  spatial_hash_.Init(cell_size, /*table_size=*/std::max(capacity, 1024u),
+                     /*entry_capacity=*/4 * capacity, allocator);
+  first_free_ = UINT32_MAX;
+  Grow(capacity);
+
+  next_world_ = first_world_;
+  if (next_world_ != nullptr) next_world_->prev_world_ = this;
+  first_world_ = this;
+}
 
-  // Build initial free list.
-  for (uint32_t i = 0; i < kMaxColliders; ++i) {
-    colliders_[i].active = false;
-    colliders_[i].generation = 0;
-    colliders_[i].next_free = i + 1;
+CollisionWorld::~CollisionWorld() {
+  if (prev_world_ != nullptr) {
+    prev_world_->next_world_ = next_world_;
+  } else {
+    first_world_ = next_world_;
   }
-  colliders_[kMaxColliders - 1].next_free = UINT32_MAX;
-  first_free_ = 0;
+  if (next_world_ != nullptr) next_world_->prev_world_ = prev_world_;
 
-  spatial_hash_.Init(cell_size, /*table_size=*/1024, allocator);
+  if (allocator_ == nullptr) return;
+  allocator_->DeallocArray(shapes_, capacity_);
+  allocator_->DeallocArray(positions_, capacity_);
+  allocator_->DeallocArray(bounds_, capacity_);
+  allocator_->DeallocArray(filters_, capacity_);
+  allocator_->DeallocArray(colliders_, capacity_);
+  allocator_->DeallocArray(active_, capacity_);
+  spatial_hash_.Destroy();
+  FreePairs(&prev_triggers_);
+  FreePairs(&curr_triggers_);
+  FreePairs(&new_triggers_);
+  FreePairs(&lost_triggers_);
+  FreePairs(&candidate_pairs_);
+  FreePairs(&sort_scratch_);
+}
 
-  prev_triggers_.pairs = allocator_->NewArray<TriggerPair>(kMaxTriggerPairs);
-  curr_triggers_.pairs = allocator_->NewArray<TriggerPair>(kMaxTriggerPairs);
-  new_triggers_.pairs = allocator_->NewArray<TriggerPair>(kMaxTriggerPairs);
-  lost_triggers_.pairs = allocator_->NewArray<TriggerPair>(kMaxTriggerPairs);
+void CollisionWorld::Grow(uint32_t capacity) {
+  DCHECK(capacity > capacity_);
+  shapes_ = ResizeArray(allocator_, shapes_, capacity_, capacity);
+  positions_ = ResizeArray(allocator_, positions_, capacity_, capacity);
+  bounds_ = ResizeArray(allocator_, bounds_, capacity_, capacity);
+  filters_ = ResizeArray(allocator_, filters_, capacity_, capacity);
+  colliders_ = ResizeArray(allocator_, colliders_, capacity_, capacity);
+  active_ = ResizeArray(allocator_, active_, capacity_, capacity);
+
+  // Chain the new slots in front of the free list.
+  for (uint32_t i = capacity_; i < capacity; ++i) {
+    colliders_[i] = Collider{};
+    colliders_[i].next_free = i + 1 < capacity ? i + 1 : first_free_;
+  }
+  first_free_ = capacity_;
+  capacity_ = capacity;
+
+  // Keep chains short by having a bucket per collider at least.
+  if (capacity_ > spatial_hash_.table_size()) {
+    spatial_hash_.Resize(capacity_);
+    for (uint32_t n = 0; n < count_; ++n) {
+      colliders_[active_[n]].hash_chain = SpatialHash::kNone;
+      Rebucket(active_[n]);
+    }
+  }
 }
 
-CollisionWorld::~CollisionWorld() {
-  if (allocator_ == nullptr) return;
-  allocator_->DeallocArray(colliders_, kMaxColliders);
-  spatial_hash_.Destroy();
-  allocator_->DeallocArray(prev_triggers_.pairs, kMaxTriggerPairs);
-  allocator_->DeallocArray(curr_triggers_.pairs, kMaxTriggerPairs);
-  allocator_->DeallocArray(new_triggers_.pairs, kMaxTriggerPairs);
-  allocator_->DeallocArray(lost_triggers_.pairs, kMaxTriggerPairs);
+bool CollisionWorld::ReservePairs(TriggerPairList* list, uint32_t n) {
+  if (n <= list->capacity) return true;
+  if (n > kMaxTriggerPairs) {
+    if (!pair_budget_logged_) {
+      LOG("Collision world over its budget of ", kMaxTriggerPairs,
+          " trigger pairs, dropping the rest");
+      pair_budget_logged_ = true;
+    }
+    return false;
+  }
+  uint32_t capacity = std::max(list->capacity, kInitialTriggerPairs);
+  while (capacity < n) capacity *= 2;
+  capacity = std::min(capacity, kMaxTriggerPairs);
+  if (list->pairs == nullptr) {
+    list->pairs = allocator_->NewArray<TriggerPair>(capacity);
+  } else {
+    list->pairs = static_cast<TriggerPair*>(allocator_->Realloc(
+        list->pairs, list->capacity * sizeof(TriggerPair),
+        capacity * sizeof(TriggerPair), alignof(TriggerPair)));
+  }
+  list->capacity = capacity;
+  return true;
 }
 
-const CollisionWorld::Collider& CollisionWorld::GetCollider(
-    ColliderHandle handle) const {
-  DCHECK(handle.index < kMaxColliders);
-  const Collider& c = colliders_[handle.index];
-  DCHECK(c.active);
-  DCHECK(c.generation == handle.generation);
-  return c;
+void CollisionWorld::FreePairs(TriggerPairList* list) {
+  if (list->pairs != nullptr) {
+    allocator_->DeallocArray(list->pairs, list->capacity);
+  }
+  *list = {};
 }
 
-CollisionWorld::Collider& CollisionWorld::GetColliderMut(
-    ColliderHandle handle) {
-  DCHECK(handle.index < kMaxColliders);
-  Collider& c = colliders_[handle.index];
-  DCHECK(c.active);
-  DCHECK(c.generation == handle.generation);
-  return c;
+uint32_t CollisionWorld::SlotOf(ColliderHandle handle) const {
+  DCHECK(IsValid(handle));
+  return handle.index;
 }
 
 ColliderHandle CollisionWorld::Add(CollisionShape shape, FVec2 position,
                                    CollisionFilter filter, bool is_trigger,
                                    uintptr_t userdata) {
-  DCHECK(first_free_ != UINT32_MAX, "Collision world is full");
+  if (first_free_ == UINT32_MAX) Grow(2 * capacity_);
   uint32_t index = first_free_;
   Collider& c = colliders_[index];
   first_free_ = c.next_free;
 
-  c.shape = shape;
-  c.position = position;
-  c.filter = filter;
+  shapes_[index] = shape;
+  positions_[index] = position;
+  filters_[index] = filter;
   c.is_trigger = is_trigger;
   c.active = true;
   c.userdata = userdata;
   // generation was already set (either 0 for fresh, or incremented on Remove)
-  count_++;
+  c.cells = {};
+  c.hash_chain = SpatialHash::kNone;
+  c.active_index = count_;
+  active_[count_++] = index;
+  Rebucket(index);
 
   return {index, c.generation};
 }
@@ -219,6 +330,12 @@ ColliderHandle CollisionWorld::Add(CollisionShape shape, FVec2 position,
 void CollisionWorld::Remove(ColliderHandle handle) {
   DCHECK(IsValid(handle));
   Collider& c = colliders_[handle.index];
+  spatial_hash_.Remove(c.hash_chain);
+  c.hash_chain = SpatialHash::kNone;
+  // Swap the last active collider into the hole.
+  const uint32_t last = active_[count_ - 1];
+  active_[c.active_index] = last;
+  colliders_[last].active_index = c.active_index;
   c.active = false;
   c.generation++;  // Invalidate existing handles
   c.next_free = first_free_;
@@ -227,42 +344,77 @@ void CollisionWorld::Remove(ColliderHandle handle) {
 }
 
 bool CollisionWorld::IsValid(ColliderHandle handle) const {
-  if (handle.index >= kMaxColliders) return false;
+  if (handle.index >= capacity_) return false;
   const Collider& c = colliders_[handle.index];
   return c.active && c.generation == handle.generation;
 }
 
 void CollisionWorld::SetPosition(ColliderHandle handle, FVec2 position) {
-  GetColliderMut(handle).position = position;
+  positions_[SlotOf(handle)] = position;
+  Rebucket(handle.index);
 }
 
 void CollisionWorld::SetShape(ColliderHandle handle, CollisionShape shape) {
-  GetColliderMut(handle).shape = shape;
+  shapes_[SlotOf(handle)] = shape;
+  Rebucket(handle.index);
 }
 
 void CollisionWorld::SetFilter(ColliderHandle handle, CollisionFilter filter) {
-  GetColliderMut(handle).filter = filter;
+  filters_[SlotOf(handle)] = filter;
 }
 
 FVec2 CollisionWorld::GetPosition(ColliderHandle handle) const {
-  return GetCollider(handle).position;
+  return positions_[SlotOf(handle)];
 }
 
 uintptr_t CollisionWorld::GetUserdata(ColliderHandle handle) const {
-  return GetCollider(handle).userdata;
+  return colliders_[SlotOf(handle)].userdata;
+}
+
+CollisionWorld::Stats CollisionWorld::stats() const {
+  const size_t slot_bytes = sizeof(CollisionShape) + sizeof(FVec2) +
+                            sizeof(CollisionAABB) + sizeof(CollisionFilter) +
+                            sizeof(Collider) + sizeof(uint32_t);
+  size_t pair_capacity = 0;
+  for (const TriggerPairList* list :
+       {&prev_triggers_, &curr_triggers_, &new_triggers_, &lost_triggers_,
+        &candidate_pairs_, &sort_scratch_}) {
+    pair_capacity += list->capacity;
+  }
+  return {
+      .colliders = count_,
+      .collider_capacity = capacity_,
+      .hash_entries = spatial_hash_.entry_count(),
+      .hash_entry_capacity = spatial_hash_.entry_capacity(),
+      .hash_buckets = spatial_hash_.table_size(),
+      .trigger_pairs = curr_triggers_.count,
+      .bytes = capacity_ * slot_bytes + spatial_hash_.bytes() +
+               pair_capacity * sizeof(TriggerPair),
+  };
+}
+
+void CollisionWorld::Rebucket(uint32_t index) {
+  Collider& c = colliders_[index];
+  bounds_[index] = ComputeAABB(shapes_[index], positions_[index]);
+  const SpatialHash::CellRange cells = spatial_hash_.CellsFor(bounds_[index]);
+  // Most moves stay within the same cells.
+  if (cells == c.cells && c.hash_chain != SpatialHash::kNone) return;
+  spatial_hash_.Remove(c.hash_chain);
+  c.hash_chain = spatial_hash_.Insert(index, cells);
+  c.cells = cells;
 }
 
 uint32_t CollisionWorld::Deduplicate(uint32_t* ids, uint32_t count,
                                      uint32_t exclude_index,
                                      uint16_t mask) const {
   // Simple O(n^2) dedup — fine for small candidate sets from broad phase.
+  // The spatial hash only holds active colliders.
   uint32_t out = 0;
   for (uint32_t i = 0; i < count; ++i) {
     uint32_t id = ids[i];
     if (id == exclude_index) continue;
-    if (id >= kMaxColliders || !colliders_[id].active) continue;
-    if (mask != 0xFFFF && (colliders_[id].filter.category & mask) == 0)
-      continue;
+    DCHECK(id < capacity_ && colliders_[id].active);
+    if (mask != 0xFFFF && (filters_[id].category & mask) == 0) continue;
 
     // Check for duplicate.
     bool dup = false;
@@ -280,36 +432,105 @@ uint32_t CollisionWorld::Deduplicate(uint32_t* ids, uint32_t count,
 CollisionWorld::MoveResult CollisionWorld::MoveAndSlide(ColliderHandle handle,
                                                         FVec2 velocity) {
   ZONE("Collision::MoveAndSlide");
+  const uint32_t index = SlotOf(handle);
+  MoveResult result = Slide(index, velocity, allocator_);
+  positions_[index] = result.position;
+  Rebucket(index);
+  return result;
+}
+
+void CollisionWorld::MoveAndSlideBatch(const ColliderHandle* handles,
+                                       const FVec2* velocities,
+                                       MoveResult* results, uint32_t count,
+                                       Executor* executor) {
+  ZONE("Collision::MoveAndSlideBatch");
+  const uint32_t stamp = ++batch_stamp_;
+  for (uint32_t i = 0; i < count; ++i) {
+    CHECK(IsValid(handles[i]), "Invalid collider handle at batch index ", i);
+    Collider& c = colliders_[handles[i].index];
+    CHECK(c.batch_stamp != stamp, "Collider listed twice in a batch, index ",
+          i);
+    c.batch_stamp = stamp;
+  }
+  if (executor == nullptr) {
+    for (uint32_t i = 0; i < count; ++i) {
+      results[i] = MoveAndSlide(handles[i], velocities[i]);
+    }
+    return;
+  }
+
+  struct Context {
+    const CollisionWorld* world;
+    const ColliderHandle* handles;
+    const FVec2* velocities;
+    MoveResult* results;
+  };
+  Context context = {.world = this,
+                     .handles = handles,
+                     .velocities = velocities,
+                     .results = results};
+  auto slide = [](int start, int end, void* userdata) {
+    const auto* ctx = static_cast<const Context*>(userdata);
+    // The world's allocator is not shared across threads.
+    Allocator* scratch = SystemAllocator::Instance();
+    for (int i = start; i < end; ++i) {
+      ctx->results[i] = ctx->world->Slide(ctx->handles[i].index,
+                                          ctx->velocities[i], scratch);
+    }
+  };
+  executor->ParallelFor(static_cast<int>(count), /*min_batch=*/32, slide,
+                        &context);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    positions_[handles[i].index] = results[i].position;
+    Rebucket(handles[i].index);
+  }
+}
+
+CollisionWorld::MoveResult CollisionWorld::Slide(uint32_t index,
+                                                 FVec2 velocity,
+                                                 Allocator* scratch) const {
   MoveResult result = {};
-  Collider& c = GetColliderMut(handle);
+  const CollisionShape& shape = shapes_[index];
+  const CollisionFilter filter = filters_[index];
+  FVec2 position = positions_[index];
   FVec2 remaining = velocity;
+  SpatialHash::Candidates query(scratch);
 
   for (uint32_t iter = 0; iter < kMoveIterations; ++iter) {
     if (remaining.Length2() < 1e-8f) break;
 
-    c.position = c.position + remaining;
+    position = position + remaining;
 
     // Query broad phase at new position.
-    CollisionAABB bounds = ComputeAABB(c.shape, c.position);
-    uint32_t candidates[256];
-    size_t num_cand = spatial_hash_.Query(bounds, candidates, 256);
-    uint32_t num_unique =
-        Deduplicate(candidates, static_cast<uint32_t>(num_cand), handle.index,
-                    c.filter.mask);
+    CollisionAABB bounds = ComputeAABB(shape, position);
+    query.Clear();
+    spatial_hash_.Query(bounds, &query);
+    uint32_t* candidates = query.data();
+    uint32_t num_unique = Deduplicate(
+        candidates, static_cast<uint32_t>(query.size()), index, filter.mask);
 
     // Find deepest collision (ignoring triggers).
+    uint32_t num_solid = 0;
+    for (uint32_t i = 0; i < num_unique; ++i) {
+      uint32_t idx = candidates[i];
+      if (!BoundsOverlap(bounds, bounds_[idx])) continue;
+      if (!ShouldCollide(filter, filters_[idx])) continue;
+      if (colliders_[idx].is_trigger) continue;
+      candidates[num_solid++] = idx;
+    }
+    const uint32_t num_hits =
+        OverlapShapes(shape, position, shapes_, positions_, candidates,
+                      num_solid, candidates);
+
     float max_depth = 0;
     CollisionResult deepest = {};
     uint32_t deepest_idx = UINT32_MAX;
 
-    for (uint32_t i = 0; i < num_unique; ++i) {
+    for (uint32_t i = 0; i < num_hits; ++i) {
       uint32_t idx = candidates[i];
-      const Collider& other = colliders_[idx];
-      if (other.is_trigger) continue;
-      if (!ShouldCollide(c.filter, other.filter)) continue;
-
       CollisionResult cr =
-          TestShapes(c.shape, c.position, other.shape, other.position);
+          TestShapes(shape, position, shapes_[idx], positions_[idx]);
       if (cr.hit && cr.depth > max_depth) {
         max_depth = cr.depth;
         deepest = cr;
@@ -320,7 +541,7 @@ CollisionWorld::MoveResult CollisionWorld::MoveAndSlide(ColliderHandle handle,
     if (!deepest.hit) break;
 
     // Push out along collision normal.
-    c.position = c.position + deepest.normal * deepest.depth;
+    position = position + deepest.normal * deepest.depth;
 
     if (result.contact_count < kMaxContacts) {
       Contact& contact = result.contacts[result.contact_count++];
@@ -339,36 +560,46 @@ CollisionWorld::MoveResult CollisionWorld::MoveAndSlide(ColliderHandle handle,
     }
   }
 
-  result.position = c.position;
+  result.position = position;
   return result;
 }
 
 CollisionWorld::MoveResult CollisionWorld::MoveAndCollide(ColliderHandle handle,
                                                           FVec2 velocity) {
   MoveResult result = {};
-  Collider& c = GetColliderMut(handle);
+  const uint32_t index = SlotOf(handle);
+  const CollisionShape& shape = shapes_[index];
+  const CollisionFilter filter = filters_[index];
+  FVec2& position = positions_[index];
 
-  FVec2 target = c.position + velocity;
-  c.position = target;
+  position = position + velocity;
 
-  CollisionAABB bounds = ComputeAABB(c.shape, c.position);
-  uint32_t candidates[256];
-  size_t num_cand = spatial_hash_.Query(bounds, candidates, 256);
-  uint32_t num_unique = Deduplicate(candidates, static_cast<uint32_t>(num_cand),
-                                    handle.index, c.filter.mask);
+  CollisionAABB bounds = ComputeAABB(shape, position);
+  SpatialHash::Candidates query(allocator_);
+  spatial_hash_.Query(bounds, &query);
+  uint32_t* candidates = query.data();
+  uint32_t num_unique = Deduplicate(
+      candidates, static_cast<uint32_t>(query.size()), index, filter.mask);
+
+  uint32_t num_solid = 0;
+  for (uint32_t i = 0; i < num_unique; ++i) {
+    uint32_t idx = candidates[i];
+    if (!BoundsOverlap(bounds, bounds_[idx])) continue;
+    if (!ShouldCollide(filter, filters_[idx])) continue;
+    if (colliders_[idx].is_trigger) continue;
+    candidates[num_solid++] = idx;
+  }
+  const uint32_t num_hits = OverlapShapes(
+      shape, position, shapes_, positions_, candidates, num_solid, candidates);
 
   float max_depth = 0;
   CollisionResult deepest = {};
   uint32_t deepest_idx = UINT32_MAX;
 
-  for (uint32_t i = 0; i < num_unique; ++i) {
+  for (uint32_t i = 0; i < num_hits; ++i) {
     uint32_t idx = candidates[i];
-    const Collider& other = colliders_[idx];
-    if (other.is_trigger) continue;
-    if (!ShouldCollide(c.filter, other.filter)) continue;
-
     CollisionResult cr =
-        TestShapes(c.shape, c.position, other.shape, other.position);
+        TestShapes(shape, position, shapes_[idx], positions_[idx]);
     if (cr.hit && cr.depth > max_depth) {
       max_depth = cr.depth;
       deepest = cr;
@@ -377,7 +608,7 @@ CollisionWorld::MoveResult CollisionWorld::MoveAndCollide(ColliderHandle handle,
   }
 
   if (deepest.hit) {
-    c.position = c.position + deepest.normal * deepest.depth;
+    position = position + deepest.normal * deepest.depth;
     Contact& contact = result.contacts[result.contact_count++];
     contact.other = HandleFor(deepest_idx);
     contact.normal = deepest.normal;
@@ -385,55 +616,63 @@ CollisionWorld::MoveResult CollisionWorld::MoveAndCollide(ColliderHandle handle,
     contact.depth = max_depth;
   }
 
-  result.position = c.position;
+  result.position = position;
+  Rebucket(index);
   return result;
 }
 
 uint32_t CollisionWorld::GetOverlaps(ColliderHandle handle, OverlapResult* out,
                                      uint32_t capacity) {
-  const Collider& c = GetCollider(handle);
-  CollisionAABB bounds = ComputeAABB(c.shape, c.position);
-
-  uint32_t candidates[256];
-  size_t num_cand = spatial_hash_.Query(bounds, candidates, 256);
-  uint32_t num_unique = Deduplicate(candidates, static_cast<uint32_t>(num_cand),
-                                    handle.index, c.filter.mask);
-
-  uint32_t result_count = 0;
-  for (uint32_t i = 0; i < num_unique && result_count < capacity; ++i) {
+  const uint32_t index = SlotOf(handle);
+  const CollisionShape& shape = shapes_[index];
+  const FVec2 position = positions_[index];
+  const CollisionFilter filter = filters_[index];
+  const CollisionAABB& bounds = bounds_[index];
+
+  SpatialHash::Candidates query(allocator_);
+  spatial_hash_.Query(bounds, &query);
+  uint32_t* candidates = query.data();
+  uint32_t num_unique = Deduplicate(
+      candidates, static_cast<uint32_t>(query.size()), index, filter.mask);
+
+  uint32_t num_near = 0;
+  for (uint32_t i = 0; i < num_unique; ++i) {
     uint32_t idx = candidates[i];
-    const Collider& other = colliders_[idx];
-    if (!ShouldCollide(c.filter, other.filter)) continue;
+    if (!BoundsOverlap(bounds, bounds_[idx])) continue;
+    if (!ShouldCollide(filter, filters_[idx])) continue;
+    candidates[num_near++] = idx;
+  }
+  const uint32_t num_hits = std::min(
+      OverlapShapes(shape, position, shapes_, positions_, candidates,
+                    num_near, candidates),
+      capacity);
 
+  for (uint32_t i = 0; i < num_hits; ++i) {
+    uint32_t idx = candidates[i];
     CollisionResult cr =
-        TestShapes(c.shape, c.position, other.shape, other.position);
-    if (cr.hit) {
-      out[result_count].handle = HandleFor(idx);
-      out[result_count].normal = cr.normal;
-      out[result_count].depth = cr.depth;
-      result_count++;
-    }
+        TestShapes(shape, position, shapes_[idx], positions_[idx]);
+    out[i].handle = HandleFor(idx);
+    out[i].normal = cr.normal;
+    out[i].depth = cr.depth;
   }
-  return result_count;
+  return num_hits;
 }
 
 bool CollisionWorld::Raycast(FVec2 origin, FVec2 direction, float max_dist,
                              uint16_t mask, RaycastHit* out) {
-  uint32_t candidates[256];
-  size_t num_cand =
-      spatial_hash_.QueryRay(origin, direction, max_dist, candidates, 256);
-  uint32_t num_unique = Deduplicate(candidates, static_cast<uint32_t>(num_cand),
-                                    UINT32_MAX, mask);
+  SpatialHash::Candidates query(allocator_);
+  spatial_hash_.QueryRay(origin, direction, max_dist, &query);
+  uint32_t* candidates = query.data();
+  uint32_t num_unique = Deduplicate(
+      candidates, static_cast<uint32_t>(query.size()), UINT32_MAX, mask);
 
   float closest_t = max_dist + 1.0f;
   bool found = false;
 
   for (uint32_t i = 0; i < num_unique; ++i) {
     uint32_t idx = candidates[i];
-    const Collider& c = colliders_[idx];
-
-    RaycastResult r =
-        RaycastShape(origin, direction, max_dist, c.shape, c.position);
+    RaycastResult r = RaycastShape(origin, direction, max_dist, shapes_[idx],
+                                   positions_[idx]);
     if (r.hit && r.t < closest_t) {
       closest_t = r.t;
       out->handle = HandleFor(idx);
@@ -450,19 +689,17 @@ uint32_t CollisionWorld::RaycastAll(FVec2 origin, FVec2 direction,
                                     float max_dist, uint16_t mask,
                                     RaycastHit* out, uint32_t capacity) {
   ZONE("Collision::RaycastAll");
-  uint32_t candidates[256];
-  size_t num_cand =
-      spatial_hash_.QueryRay(origin, direction, max_dist, candidates, 256);
-  uint32_t num_unique = Deduplicate(candidates, static_cast<uint32_t>(num_cand),
-                                    UINT32_MAX, mask);
+  SpatialHash::Candidates query(allocator_);
+  spatial_hash_.QueryRay(origin, direction, max_dist, &query);
+  uint32_t* candidates = query.data();
+  uint32_t num_unique = Deduplicate(
+      candidates, static_cast<uint32_t>(query.size()), UINT32_MAX, mask);
 
   uint32_t count = 0;
   for (uint32_t i = 0; i < num_unique && count < capacity; ++i) {
     uint32_t idx = candidates[i];
-    const Collider& c = colliders_[idx];
-
-    RaycastResult r =
-        RaycastShape(origin, direction, max_dist, c.shape, c.position);
+    RaycastResult r = RaycastShape(origin, direction, max_dist, shapes_[idx],
+                                   positions_[idx]);
     if (r.hit) {
       out[count].handle = HandleFor(idx);
       out[count].point = origin + direction * r.t;
@@ -481,16 +718,16 @@ uint32_t CollisionWorld::RaycastAll(FVec2 origin, FVec2 direction,
 uint32_t CollisionWorld::QueryPoint(FVec2 point, uint16_t mask,
                                     ColliderHandle* out, uint32_t capacity) {
   CollisionAABB bounds = {point, point};
-  uint32_t candidates[256];
-  size_t num_cand = spatial_hash_.Query(bounds, candidates, 256);
-  uint32_t num_unique = Deduplicate(candidates, static_cast<uint32_t>(num_cand),
-                                    UINT32_MAX, mask);
+  SpatialHash::Candidates query(allocator_);
+  spatial_hash_.Query(bounds, &query);
+  uint32_t* candidates = query.data();
+  uint32_t num_unique = Deduplicate(
+      candidates, static_cast<uint32_t>(query.size()), UINT32_MAX, mask);
 
   uint32_t count = 0;
   for (uint32_t i = 0; i < num_unique && count < capacity; ++i) {
     uint32_t idx = candidates[i];
-    const Collider& c = colliders_[idx];
-    if (PointInShape(point, c.shape, c.position)) {
+    if (PointInShape(point, shapes_[idx], positions_[idx])) {
       out[count++] = HandleFor(idx);
     }
   }
@@ -500,10 +737,11 @@ uint32_t CollisionWorld::QueryPoint(FVec2 point, uint16_t mask,
 uint32_t CollisionWorld::QueryRect(FVec2 min, FVec2 max, uint16_t mask,
                                    ColliderHandle* out, uint32_t capacity) {
   CollisionAABB query_bounds = {min, max};
-  uint32_t candidates[256];
-  size_t num_cand = spatial_hash_.Query(query_bounds, candidates, 256);
-  uint32_t num_unique = Deduplicate(candidates, static_cast<uint32_t>(num_cand),
-                                    UINT32_MAX, mask);
+  SpatialHash::Candidates query(allocator_);
+  spatial_hash_.Query(query_bounds, &query);
+  uint32_t* candidates = query.data();
+  uint32_t num_unique = Deduplicate(
+      candidates, static_cast<uint32_t>(query.size()), UINT32_MAX, mask);
 
   // Use AABB-shape overlap for precise test.
   FVec2 center = FVec((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f);
@@ -511,15 +749,18 @@ uint32_t CollisionWorld::QueryRect(FVec2 min, FVec2 max, uint16_t mask,
   float hh = (max.y - min.y) * 0.5f;
   CollisionShape query_shape = MakeAABB(hw * 2.0f, hh * 2.0f);
 
-  uint32_t count = 0;
-  for (uint32_t i = 0; i < num_unique && count < capacity; ++i) {
+  uint32_t num_near = 0;
+  for (uint32_t i = 0; i < num_unique; ++i) {
     uint32_t idx = candidates[i];
-    const Collider& c = colliders_[idx];
-    CollisionResult cr = TestShapes(query_shape, center, c.shape, c.position);
-    if (cr.hit) {
-      out[count++] = HandleFor(idx);
+    if (BoundsOverlap(query_bounds, bounds_[idx])) {
+      candidates[num_near++] = idx;
     }
   }
+  const uint32_t count =
+      std::min(OverlapShapes(query_shape, center, shapes_, positions_,
+                             candidates, num_near, candidates),
+               capacity);
+  for (uint32_t i = 0; i < count; ++i) out[i] = HandleFor(candidates[i]);
   return count;
 }
 
@@ -527,110 +768,108 @@ uint32_t CollisionWorld::QueryCircle(FVec2 center, float radius, uint16_t mask,
                                      ColliderHandle* out, uint32_t capacity) {
   CollisionAABB query_bounds = {FVec(center.x - radius, center.y - radius),
                                 FVec(center.x + radius, center.y + radius)};
-  uint32_t candidates[256];
-  size_t num_cand = spatial_hash_.Query(query_bounds, candidates, 256);
-  uint32_t num_unique = Deduplicate(candidates, static_cast<uint32_t>(num_cand),
-                                    UINT32_MAX, mask);
+  SpatialHash::Candidates query(allocator_);
+  spatial_hash_.Query(query_bounds, &query);
+  uint32_t* candidates = query.data();
+  uint32_t num_unique = Deduplicate(
+      candidates, static_cast<uint32_t>(query.size()), UINT32_MAX, mask);
 
   CollisionShape query_shape = MakeCircle(radius);
 
-  uint32_t count = 0;
-  for (uint32_t i = 0; i < num_unique && count < capacity; ++i) {
+  uint32_t num_near = 0;
+  for (uint32_t i = 0; i < num_unique; ++i) {
     uint32_t idx = candidates[i];
-    const Collider& c = colliders_[idx];
-    CollisionResult cr = TestShapes(query_shape, center, c.shape, c.position);
-    if (cr.hit) {
-      out[count++] = HandleFor(idx);
+    if (BoundsOverlap(query_bounds, bounds_[idx])) {
+      candidates[num_near++] = idx;
     }
   }
+  const uint32_t count =
+      std::min(OverlapShapes(query_shape, center, shapes_, positions_,
+                             candidates, num_near, candidates),
+               capacity);
+  for (uint32_t i = 0; i < count; ++i) out[i] = HandleFor(candidates[i]);
   return count;
 }
 
 void CollisionWorld::Update() {
   ZONE("Collision::Update");
-  // Rebuild spatial hash.
-  spatial_hash_.Clear();
-  for (uint32_t i = 0; i < kMaxColliders; ++i) {
-    if (!colliders_[i].active) continue;
-    CollisionAABB bounds =
-        ComputeAABB(colliders_[i].shape, colliders_[i].position);
-    spatial_hash_.Insert(i, bounds);
-  }
-
   // Swap trigger pair buffers.
   std::swap(prev_triggers_, curr_triggers_);
-  uint32_t prev_count = prev_triggers_.count;
   curr_triggers_.count = 0;
 
-  // Find all current trigger overlapping pairs.
-  for (uint32_t i = 0; i < kMaxColliders; ++i) {
-    if (!colliders_[i].active) continue;
+  // Broad phase: every pair with a trigger whose bounds overlap, in any
+  // order and repeated once per shared cell.
+  candidate_pairs_.count = 0;
+  for (uint32_t n = 0; n < count_; ++n) {
+    const uint32_t i = active_[n];
     if (!colliders_[i].is_trigger) continue;
 
-    CollisionAABB bounds =
-        ComputeAABB(colliders_[i].shape, colliders_[i].position);
-    uint32_t candidates[256];
-    size_t num_cand = spatial_hash_.Query(bounds, candidates, 256);
-
-    for (size_t ci = 0; ci < num_cand; ++ci) {
-      uint32_t j = candidates[ci];
-      if (j == i) continue;
-      if (j >= kMaxColliders || !colliders_[j].active) continue;
-      if (!ShouldCollide(colliders_[i].filter, colliders_[j].filter)) continue;
-
-      // Avoid duplicates: only store pairs where a < b.
-      uint32_t a = i < j ? i : j;
-      uint32_t b = i < j ? j : i;
-
-      // Check if already in curr_triggers_.
-      bool already = false;
-      for (uint32_t k = 0; k < curr_triggers_.count; ++k) {
-        if (curr_triggers_.pairs[k].a == a && curr_triggers_.pairs[k].b == b) {
-          already = true;
-          break;
-        }
-      }
-      if (already) continue;
+    spatial_hash_.ForEach(colliders_[i].cells, [&](uint32_t j) {
+      if (j == i) return;
+      if (!BoundsOverlap(bounds_[i], bounds_[j])) return;
+      if (!ShouldCollide(filters_[i], filters_[j])) return;
+      // Two triggers find each other: keep the pair from the lower one.
+      if (j < i && colliders_[j].is_trigger) return;
+      PushPair(&candidate_pairs_, {std::min(i, j), std::max(i, j)});
+    });
+  }
 
-      // Narrow-phase confirm.
-      CollisionResult cr =
-          TestShapes(colliders_[a].shape, colliders_[a].position,
-                     colliders_[b].shape, colliders_[b].position);
-      if (cr.hit && curr_triggers_.count < kMaxTriggerPairs) {
-        curr_triggers_.pairs[curr_triggers_.count++] = {a, b};
-      }
+  // Sort so that repeats are adjacent, and narrow-phase each pair once.
+  // The overlapping pairs come out sorted too.
+  if (ReservePairs(&sort_scratch_, candidate_pairs_.count)) {
+    RadixSort(candidate_pairs_.pairs, sort_scratch_.pairs,
+              candidate_pairs_.count,
+              [](const TriggerPair& p) { return p.key(); });
+  } else {
+    std::sort(candidate_pairs_.pairs,
+              candidate_pairs_.pairs + candidate_pairs_.count);
+  }
+  // Pairs sharing their first collider are tested together.
+  constexpr uint32_t kGroup = 256;
+  uint32_t others[kGroup];
+  for (uint32_t i = 0; i < candidate_pairs_.count;) {
+    const uint32_t a = candidate_pairs_.pairs[i].a;
+    uint32_t num_others = 0;
+    for (; i < candidate_pairs_.count && num_others < kGroup &&
+           candidate_pairs_.pairs[i].a == a;
+         ++i) {
+      const TriggerPair pair = candidate_pairs_.pairs[i];
+      if (i > 0 && pair == candidate_pairs_.pairs[i - 1]) continue;
+      others[num_others++] = pair.b;
+    }
+    const uint32_t num_hits = OverlapShapes(
+        shapes_[a], positions_[a], shapes_, positions_, others, num_others,
+        others);
+    for (uint32_t k = 0; k < num_hits; ++k) {
+      PushPair(&curr_triggers_, {a, others[k]});
     }
   }
 
-  // Diff: find new pairs (in curr but not prev) and lost pairs (in prev but
-  // not curr).
+  // Merge the sorted sets: pairs only in curr are new, pairs only in prev
+  // are lost.
   new_triggers_.count = 0;
   lost_triggers_.count = 0;
-
-  for (uint32_t i = 0; i < curr_triggers_.count; ++i) {
-    bool found = false;
-    for (uint32_t j = 0; j < prev_count; ++j) {
-      if (curr_triggers_.pairs[i] == prev_triggers_.pairs[j]) {
-        found = true;
-        break;
-      }
-    }
-    if (!found && new_triggers_.count < kMaxTriggerPairs) {
-      new_triggers_.pairs[new_triggers_.count++] = curr_triggers_.pairs[i];
+  uint32_t ci = 0;
+  uint32_t pi = 0;
+  while (ci < curr_triggers_.count && pi < prev_triggers_.count) {
+    const TriggerPair curr = curr_triggers_.pairs[ci];
+    const TriggerPair prev = prev_triggers_.pairs[pi];
+    if (curr < prev) {
+      PushPair(&new_triggers_, curr);
+      ci++;
+    } else if (prev < curr) {
+      PushPair(&lost_triggers_, prev);
+      pi++;
+    } else {
+      ci++;
+      pi++;
     }
   }
-
-  for (uint32_t i = 0; i < prev_count; ++i) {
-    bool found = false;
-    for (uint32_t j = 0; j < curr_triggers_.count; ++j) {
-      if (prev_triggers_.pairs[i] == curr_triggers_.pairs[j]) {
-        found = true;
-        break;
-      }
-    }
-    if (!found && lost_triggers_.count < kMaxTriggerPairs) {
-      lost_triggers_.pairs[lost_triggers_.count++] = prev_triggers_.pairs[i];
-    }
+  for (; ci < curr_triggers_.count; ++ci) {
+    PushPair(&new_triggers_, curr_triggers_.pairs[ci]);
+  }
+  for (; pi < prev_triggers_.count; ++pi) {
+    PushPair(&lost_triggers_, prev_triggers_.pairs[pi]);
   }
 }
 
@@ -7,28 +7,89 @@
 
 #include "allocators.h"
 #include "collision.h"
+#include "inlined_array.h"
 #include "vec.h"
 
 namespace G {
 
-// Spatial hash grid for broad-phase collision detection.
-// Persistent allocation — Clear() and rebuild each frame.
+class Executor;
+
+// Spatial hash grid for broad-phase collision detection. Each id owns a
+// chain of entries, one per covered cell, which is replaced only when the
+// cells it covers change.
 class SpatialHash {
  public:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  // Cells covered by an AABB, inclusive.
+  struct CellRange {
+    int min_x = 0;
+    int min_y = 0;
+    int max_x = -1;
+    int max_y = -1;
+
+    bool operator==(const CellRange& o) const {
+      return min_x == o.min_x && min_y == o.min_y && max_x == o.max_x &&
+             max_y == o.max_y;
+    }
+    bool operator!=(const CellRange& o) const { return !(*this == o); }
+  };
+
   SpatialHash() = default;
-  void Init(float cell_size, size_t table_size, Allocator* allocator);
+  // The entry pool starts with `entry_capacity` entries and doubles as
+  // needed.
+  void Init(float cell_size, size_t table_size, uint32_t entry_capacity,
+            Allocator* allocator);
   void Destroy();
 
   void Clear();
-  void Insert(uint32_t id, CollisionAABB bounds);
 
-  // Query: fills out with IDs whose cells overlap the query AABB.
-  // May contain duplicates. Returns count written.
-  size_t Query(CollisionAABB bounds, uint32_t* out, size_t out_capacity) const;
+  // Replaces the bucket table with one of `table_size` buckets. Like Clear,
+  // this drops every entry: the caller inserts them again.
+  void Resize(size_t table_size);
+
+  float cell_size() const { return cell_size_; }
+  size_t table_size() const { return table_size_; }
+  uint32_t entry_count() const { return entry_count_; }
+  uint32_t entry_capacity() const { return entry_capacity_; }
+  size_t bytes() const {
+    return table_size_ * sizeof(uint32_t) + entry_capacity_ * sizeof(Entry);
+  }
+
+  CellRange CellsFor(CollisionAABB bounds) const;
+
+  // Adds `id` to every cell in `cells` and returns the chain of entries to
+  // pass to Remove, or kNone.
+  uint32_t Insert(uint32_t id, CellRange cells);
+
+  // Removes the chain of entries returned by Insert. kNone is a no-op.
+  void Remove(uint32_t chain);
+
+  // Broad-phase results: inline for typical queries, spilling to the
+  // allocator for crowded ones.
+  using Candidates = InlinedArray<uint32_t, 256>;
+
+  // Query: appends the IDs whose cells overlap the query AABB to `out`.
+  // May contain duplicates.
+  void Query(CollisionAABB bounds, Candidates* out) const;
+
+  // Like Query, but calls `fn(id)` for every ID instead of stopping at a
+  // capacity.
+  template <typename Fn>
+  void ForEach(CellRange cells, Fn&& fn) const {
+    for (int cy = cells.min_y; cy <= cells.max_y; ++cy) {
+      for (int cx = cells.min_x; cx <= cells.max_x; ++cx) {
+        for (uint32_t ei = bucket_heads_[Hash(cx, cy)]; ei != kNone;
+             ei = entries_[ei].next) {
+          fn(entries_[ei].id);
+        }
+      }
+    }
+  }
 
   // Ray query using DDA grid traversal.
-  size_t QueryRay(FVec2 origin, FVec2 direction, float max_dist, uint32_t* out,
-                  size_t out_capacity) const;
+  void QueryRay(FVec2 origin, FVec2 direction, float max_dist,
+                Candidates* out) const;
 
  private:
   size_t Hash(int cx, int cy) const;
@@ -38,17 +99,23 @@ class SpatialHash {
   size_t table_size_ = 0;
   Allocator* allocator_ = nullptr;
 
-  static constexpr uint32_t kMaxEntries = 16384;
-  static constexpr uint32_t kNone = UINT32_MAX;
-
   struct Entry {
     uint32_t id;
-    uint32_t next;  // index into entries_ or kNone
+    uint32_t next;    // Next in the bucket (or free list), or kNone.
+    uint32_t prev;    // Previous in the bucket, kNone for the head.
+    uint32_t bucket;  // Bucket the entry is linked into.
+    uint32_t chain;   // Next entry of the same Insert call, or kNone.
   };
 
+  // Returns a free entry, growing the pool if needed.
+  uint32_t NewEntry();
+
   uint32_t* bucket_heads_ = nullptr;  // table_size_ entries
-  Entry* entries_ = nullptr;          // kMaxEntries capacity
-  uint32_t entry_count_ = 0;
+  Entry* entries_ = nullptr;          // entry_capacity_ entries
+  uint32_t entry_capacity_ = 0;
+  uint32_t entry_count_ = 0;          // Entries linked into buckets.
+  uint32_t used_entries_ = 0;         // Entries ever handed out.
+  uint32_t free_head_ = kNone;        // Removed entries, linked by next.
 };
 
 // Handle to a collider in a CollisionWorld.
@@ -64,22 +131,16 @@ struct ColliderHandle {
 
 class CollisionWorld {
  public:
-  static constexpr uint32_t kMaxColliders = 4096;
+  // Colliders a world has room for at first. The capacity doubles whenever
+  // the world is full.
+  static constexpr uint32_t kDefaultCapacity = 256;
   static constexpr uint32_t kMaxContacts = 8;
   static constexpr uint32_t kMaxQueryResults = 64;
   static constexpr uint32_t kMoveIterations = 4;
-  static constexpr uint32_t kMaxTriggerPairs = 1024;
-
-  struct Collider {
-    CollisionShape shape;
-    FVec2 position;
-    CollisionFilter filter;
-    bool is_trigger;
-    bool active;
-    uintptr_t userdata;
-    uint32_t generation;
-    uint32_t next_free;
-  };
+  // Trigger pair lists start with kInitialTriggerPairs entries and double
+  // up to this budget; pairs past it are dropped.
+  static constexpr uint32_t kMaxTriggerPairs = 1 << 18;
+  static constexpr uint32_t kInitialTriggerPairs = 256;
 
   struct Contact {
     ColliderHandle other;
@@ -107,9 +168,24 @@ class CollisionWorld {
     float t;
   };
 
-  CollisionWorld(float cell_size, Allocator* allocator);
+  // Capacity and memory use, for the debug UI.
+  struct Stats {
+    uint32_t colliders;
+    uint32_t collider_capacity;
+    uint32_t hash_entries;
+    uint32_t hash_entry_capacity;
+    size_t hash_buckets;
+    uint32_t trigger_pairs;
+    size_t bytes;
+  };
+
+  CollisionWorld(float cell_size, Allocator* allocator,
+                 uint32_t capacity = kDefaultCapacity);
   ~CollisionWorld();
 
+  CollisionWorld(const CollisionWorld&) = delete;
+  CollisionWorld& operator=(const CollisionWorld&) = delete;
+
   // Collider management
   ColliderHandle Add(CollisionShape shape, FVec2 position,
                      CollisionFilter filter, bool is_trigger,
@@ -127,6 +203,17 @@ class CollisionWorld {
   MoveResult MoveAndSlide(ColliderHandle handle, FVec2 velocity);
   MoveResult MoveAndCollide(ColliderHandle handle, FVec2 velocity);
 
+  // MoveAndSlide for `count` movers, each listed at most once: invalid or
+  // repeated handles fail a CHECK. Without an executor the movers are moved
+  // in order, each one seeing the earlier ones at their new positions. With
+  // one, every mover is resolved against the world as it was at the call,
+  // split across the executor, and the new positions are committed in order
+  // afterwards: movers don't see each other's moves, and the results don't
+  // depend on the number of threads.
+  void MoveAndSlideBatch(const ColliderHandle* handles,
+                         const FVec2* velocities, MoveResult* results,
+                         uint32_t count, Executor* executor = nullptr);
+
   // Overlap queries
   uint32_t GetOverlaps(ColliderHandle handle, OverlapResult* out,
                        uint32_t capacity);
@@ -143,7 +230,9 @@ class CollisionWorld {
   uint32_t QueryCircle(FVec2 center, float radius, uint16_t mask,
                        ColliderHandle* out, uint32_t capacity);
 
-  // Must be called each frame to rebuild broad phase and detect triggers.
+  // Must be called each frame to detect triggers. The broad phase needs no
+  // rebuild: every call that adds, moves or reshapes a collider rebuckets
+  // it when its cells change, so queries are exact between updates.
   void Update();
 
   // Trigger callback Lua registry refs (managed by lua_collision.cc).
@@ -153,13 +242,20 @@ class CollisionWorld {
   int trigger_exit_ref = kNoRef;
 
   // For __gc cleanup
-  uint32_t collider_capacity() const { return kMaxColliders; }
+  uint32_t collider_capacity() const { return capacity_; }
   bool IsActiveSlot(uint32_t index) const { return colliders_[index].active; }
   uintptr_t GetSlotUserdata(uint32_t index) const {
     return colliders_[index].userdata;
   }
   uint32_t active_count() const { return count_; }
 
+  Stats stats() const;
+
+  // Live worlds, most recently created first. Worlds are created and
+  // destroyed on the main thread only.
+  static const CollisionWorld* first_world() { return first_world_; }
+  const CollisionWorld* next_world() const { return next_world_; }
+
   // Trigger pair tracking for Lua callbacks
   struct TriggerPair {
     uint32_t a, b;  // slot indices, a < b
@@ -167,6 +263,8 @@ class CollisionWorld {
     bool operator<(const TriggerPair& o) const {
       return a < o.a || (a == o.a && b < o.b);
     }
+    // Orders pairs like operator<.
+    uint64_t key() const { return static_cast<uint64_t>(a) << 32 | b; }
   };
 
   const TriggerPair* new_trigger_pairs() const { return new_triggers_.pairs; }
@@ -179,32 +277,93 @@ class CollisionWorld {
   }
 
  private:
-  const Collider& GetCollider(ColliderHandle handle) const;
-  Collider& GetColliderMut(ColliderHandle handle);
+  // The data queries don't read. Shapes, positions, bounds and filters are
+  // kept in arrays of their own so that queries stream through them.
+  struct Collider {
+    bool is_trigger;
+    bool active;
+    uintptr_t userdata;
+    uint32_t generation;
+    uint32_t next_free;
+    // Broad-phase state: the cells the collider is bucketed in, its entry
+    // chain in the spatial hash and its position in the active list.
+    SpatialHash::CellRange cells;
+    uint32_t hash_chain;
+    uint32_t active_index;
+    // Last MoveAndSlideBatch that listed the collider, see batch_stamp_.
+    uint32_t batch_stamp;
+  };
+
+  // Returns the slot of a valid handle.
+  uint32_t SlotOf(ColliderHandle handle) const;
+
+  // Grows every per-collider array to `capacity` slots.
+  void Grow(uint32_t capacity);
+
+  // Moves the collider to the cells its current AABB covers.
+  void Rebucket(uint32_t index);
+
+  // Resolves a MoveAndSlide without changing the world. Crowded queries
+  // spill to `scratch`.
+  MoveResult Slide(uint32_t index, FVec2 velocity, Allocator* scratch) const;
 
   // Deduplicate broad-phase query results and apply filters.
   uint32_t Deduplicate(uint32_t* ids, uint32_t count, uint32_t exclude_index,
                        uint16_t mask) const;
 
+  // Per-slot arrays of capacity_ entries. bounds_ caches the world AABB
+  // of shapes_ at positions_.
+  CollisionShape* shapes_ = nullptr;
+  FVec2* positions_ = nullptr;
+  CollisionAABB* bounds_ = nullptr;
+  CollisionFilter* filters_ = nullptr;
   Collider* colliders_ = nullptr;
+  // Slots of the active colliders, in no particular order.
+  uint32_t* active_ = nullptr;
+  uint32_t capacity_ = 0;
   uint32_t first_free_ = 0;
   uint32_t count_ = 0;
+  // Bumped by every MoveAndSlideBatch to find repeated handles.
+  uint32_t batch_stamp_ = 0;
   Allocator* allocator_ = nullptr;
   SpatialHash spatial_hash_;
 
-  // Trigger pair tracking: each frame, Update() builds the set of currently
-  // overlapping trigger pairs (curr) and diffs it against the previous frame
-  // (prev) to produce new (entered this frame) and lost (exited this frame)
-  // lists. Lua callbacks fire for new/lost pairs.
+  static CollisionWorld* first_world_;
+  CollisionWorld* prev_world_ = nullptr;
+  CollisionWorld* next_world_ = nullptr;
+
+  // Trigger pair tracking: each frame, Update() builds the sorted set of
+  // currently overlapping trigger pairs (curr) and merges it with the
+  // previous frame's (prev) to produce new (entered this frame) and lost
+  // (exited this frame) lists, also sorted. Lua callbacks fire for new/lost
+  // pairs.
   struct TriggerPairList {
     TriggerPair* pairs = nullptr;
     uint32_t count = 0;
+    uint32_t capacity = 0;
   };
 
+  // Makes room for `n` pairs within the kMaxTriggerPairs budget. Returns
+  // false, logging once, if `n` is over it.
+  bool ReservePairs(TriggerPairList* list, uint32_t n);
+
+  void PushPair(TriggerPairList* list, TriggerPair pair) {
+    if (list->count == list->capacity && !ReservePairs(list, list->count + 1)) {
+      return;
+    }
+    list->pairs[list->count++] = pair;
+  }
+
+  void FreePairs(TriggerPairList* list);
+
   TriggerPairList prev_triggers_;
   TriggerPairList curr_triggers_;
   TriggerPairList new_triggers_;
   TriggerPairList lost_triggers_;
+  // Broad-phase pairs of the current Update, and scratch to sort them.
+  TriggerPairList candidate_pairs_;
+  TriggerPairList sort_scratch_;
+  bool pair_budget_logged_ = false;
 };
 
 }  // namespace G
@@ -61,6 +61,16 @@ void LoadConfig(std::string_view json_configuration, GameConfig* config,
       config->enable_debug_rendering = yyjson_get_bool(value);
     } else if (k == "nearest_filter") {
       config->nearest_filter = yyjson_get_bool(value);
+    } else if (k == "texture_slots") {
+      config->texture_slots = yyjson_get_bool(value);
+    } else if (k == "cpu_transforms") {
+      config->cpu_transforms = yyjson_get_bool(value);
+    } else if (k == "packed_vertices") {
+      config->packed_vertices = yyjson_get_bool(value);
+    } else if (k == "render_thread") {
+      config->render_thread = yyjson_get_bool(value);
+    } else if (k == "lua_gc_budget_ms") {
+      config->lua_gc_budget_ms = yyjson_get_num(value);
     } else if (k == "title") {
       CopyString(YyjsonStrView(value), config->window_title,
                  sizeof(config->window_title));
@@ -24,6 +24,12 @@ struct GameConfig {
   bool enable_joystick = false;
   bool enable_debug_rendering = true;
   bool nearest_filter = false;  // Use GL_NEAREST for pixel art.
+  bool texture_slots = true;    // Batch sprites across textures.
+  bool cpu_transforms = true;   // Transform vertices on the CPU.
+  bool packed_vertices = true;  // Upload batches in the compact format.
+  bool render_thread = false;   // Submit frames on a render thread.
+  // Cap on the Lua collector time per frame; 0 leaves it automatic.
+  double lua_gc_budget_ms = 0;
   char org_name[512] = {0};
   char app_name[512] = {0};
   struct Version {
@@ -11,6 +11,7 @@
 #include <cstring>
 #include <string_view>
 
+#include "collision_world.h"
 #include "engine.h"
 #include "libraries/sqlite3.h"
 #include "lua.h"
@@ -276,6 +277,11 @@ void DebugUI::DrawMenuBar(const FrameContext& /*ctx*/) {
       if (ImGui::MenuItem("Screenshot (F12)")) screenshot_requested_ = true;
       if (ImGui::MenuItem("Hot Reload")) hot_reload_requested_ = true;
       if (ImGui::MenuItem("Run GC")) engine_->lua.RunGc();
+      if (ImGui::MenuItem(engine_->lua_profiler.running()
+                              ? "Stop Lua Profiler"
+                              : "Start Lua Profiler")) {
+        engine_->lua_profiler.Toggle(engine_->lua.state());
+      }
 #ifdef GAME_WITH_PROFILING
       {
         Profiler* p = GetProfiler();
@@ -53,6 +53,10 @@ class DebugUI {
   // Forwards an SDL event to ImGui for input handling.
   void ProcessEvent(const SDL_Event* event);
 
+  // Returns true if any overlay needs an ImGui frame. Frames then have to be
+  // drawn on the thread that owns the GL context.
+  bool NeedsImGuiFrame() const;
+
   // Starts a new ImGui frame. Call after the engine's batch renderer
   // finishes but before SwapWindow.
   void BeginFrame();
@@ -112,6 +116,8 @@ class DebugUI {
     size_t cmd_buf_used;
     size_t cmd_buf_capacity;
     FrameBreakdown breakdown;
+    bool lua_gc_paced;
+    Lua::GcStats lua_gc;
   };
 
   // Draws the menu bar and all enabled panels. Call between Begin/EndFrame.
@@ -199,6 +205,8 @@ class DebugUI {
   void DrawMiniHud(const FrameContext& ctx);
   // Draws the hot zones profiler panel.
   void DrawZonesPanel();
+  // Draws the per-function table of the binding profiler, if built in.
+  void DrawBindingProfiles();
   // Draws the tilemap debug panel.
   void DrawTilemapPanel();
   // Draws physics debug overlay and handles click/drag interaction.
@@ -207,9 +215,6 @@ class DebugUI {
   void EvalReplCode(std::string_view code);
   // Draws the drop-down REPL overlay.
   void DrawDropDownRepl();
-  // Returns true if any overlay needs an ImGui frame.
-  bool NeedsImGuiFrame() const;
-
   bool visible_ = false;
   bool initialized_ = false;
   bool window_centered_ = false;
@@ -390,6 +395,7 @@ class DebugUI {
   void SetBlobStore(BlobStore*) {}
   void SetWindowCentered(bool) {}
   void ProcessEvent(const SDL_Event*) {}
+  bool NeedsImGuiFrame() const { return false; }
   void BeginFrame() {}
   void EndFrame() {}
   void Toggle() {}
@@ -418,6 +424,8 @@ class DebugUI {
     size_t cmd_buf_used;
     size_t cmd_buf_capacity;
     FrameBreakdown breakdown;
+    bool lua_gc_paced;
+    Lua::GcStats lua_gc;
   };
   void DrawAll(const FrameContext&) {}
   bool ConsumeScreenshotRequest() { return false; }
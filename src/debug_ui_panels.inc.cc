@@ -440,6 +440,32 @@ void DebugUI::DrawPhysicsPanel() {
   }
   ImGui::Separator();
 
+  if (ImGui::CollapsingHeader("Collision Worlds")) {
+    int n = 0;
+    for (const CollisionWorld* world = CollisionWorld::first_world();
+         world != nullptr; world = world->next_world(), ++n) {
+      const CollisionWorld::Stats stats = world->stats();
+      SmallBuffer bytes;
+      FormatBytes(&bytes, stats.bytes);
+      ImGui::PushID(n);
+      ImGui::Text("World %d: %s", n, bytes.str());
+      const float ratio = static_cast<float>(stats.colliders) /
+                          static_cast<float>(stats.collider_capacity);
+      SmallBuffer overlay;
+      overlay.AppendF("%u / %u colliders", stats.colliders,
+                      stats.collider_capacity);
+      ImGui::PushStyleColor(ImGuiCol_PlotHistogram, RatioColor(ratio));
+      ImGui::ProgressBar(ratio, ImVec2(-1, 0), overlay.str());
+      ImGui::PopStyleColor();
+      ImGui::Text("Hash entries: %u / %u in %zu buckets", stats.hash_entries,
+                  stats.hash_entry_capacity, stats.hash_buckets);
+      ImGui::Text("Trigger pairs: %u", stats.trigger_pairs);
+      ImGui::PopID();
+    }
+    if (n == 0) ImGui::TextDisabled("No collision worlds");
+  }
+  ImGui::Separator();
+
   // Selected body details.
   if (selected_body_ != nullptr) {
     if (ImGui::CollapsingHeader("Selected Body",
@@ -26,6 +26,9 @@ void DebugUI::DrawPerformancePanel(const FrameContext& ctx) {
     ImGui::Text("Draw calls: %d", fs.draw_calls);
     ImGui::Text("Vertices:   %d", fs.vertices);
     ImGui::Text("Commands:   %d", fs.commands);
+    ImGui::Text("Fill tasks: %d", fs.fill_chunks);
+    ImGui::Text("Meshes:     %d", fs.static_meshes);
+    ImGui::Text("Instances:  %d", fs.sprite_instances);
     if (ImGui::TreeNode("Flush Reasons")) {
       ImGui::Text("Texture:   %d", fs.flush_texture);
       ImGui::Text("Transform: %d", fs.flush_transform);
@@ -47,6 +50,20 @@ void DebugUI::DrawPerformancePanel(const FrameContext& ctx) {
       ImGui::Text("Blend:      %d", fs.redundant_blend);
       ImGui::Text("Line width: %d", fs.redundant_line_width);
       ImGui::Text("SDF outline:%d", fs.redundant_sdf_outline);
+      ImGui::Text("Uniforms:   %d", fs.redundant_uniform);
+      ImGui::Text("Tex slots:  %d", fs.texture_slot_hits);
+      ImGui::Text("CPU xforms: %d", fs.cpu_transforms);
+      ImGui::TreePop();
+    }
+    if (fs.draws_before_sort > 0) {
+      ImGui::Text("Sorted:     %d -> %d runs", fs.draws_before_sort,
+                  fs.draws_after_sort);
+    }
+    if (ImGui::TreeNode("Uploads")) {
+      ImGui::Text("Uploaded: %.1f KB", fs.bytes_uploaded / 1024.0);
+      ImGui::Text("Stalls:   %d", fs.upload_stalls);
+      ImGui::Text("Orphans:  %d", fs.upload_orphans);
+      ImGui::Text("Packed:   %d", fs.packed_batches);
       ImGui::TreePop();
     }
   }
@@ -55,6 +72,15 @@ void DebugUI::DrawPerformancePanel(const FrameContext& ctx) {
 
   // Lua memory graph.
   PlotCircularBuffer("Lua Memory", lua_memory_samples_, "KB", ImVec2(0, 60));
+  if (ctx.lua_gc_paced) {
+    const auto& gc = ctx.lua_gc;
+    ImGui::Text("GC pause:   %.2f / %.2f ms (%d steps)", gc.last_ms,
+                gc.budget_ms, gc.steps);
+    ImGui::Text("GC max:     %.2f ms", gc.max_ms);
+    ImGui::Text("GC cycles:  %d (%d forced)", gc.cycles, gc.forced);
+  } else {
+    ImGui::TextDisabled("GC: automatic");
+  }
 
   DrawFrameBreakdown(ctx);
 
@@ -15,6 +15,8 @@ void DebugUI::DrawZonesPanel() {
   ImGui::SameLine();
   ImGui::Text("%d zones", zs->zone_count());
 
+  DrawBindingProfiles();
+
   if (zs->zone_count() == 0) {
     ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f),
                        "No zones recorded yet.");
@@ -87,3 +89,53 @@ void DebugUI::DrawZonesPanel() {
 
   ImGui::End();
 }
+
+void DebugUI::DrawBindingProfiles() {
+  Lua& lua = engine_->lua;
+  const auto& profiles = lua.binding_profiles();
+  if (profiles.empty()) return;
+  if (!ImGui::CollapsingHeader("Lua bindings")) return;
+  if (ImGui::Button("Reset##bindings")) lua.ResetBindingProfiles();
+  ImGui::SameLine();
+  if (ImGui::Button("Dump to bindings.tsv")) lua.DumpBindingProfiles();
+
+  // Keeps the most expensive bindings of the last frame, by time.
+  constexpr int kShown = 32;
+  const Lua::BindingProfile* top[kShown];
+  int count = 0;
+  for (const Lua::BindingProfile& profile : profiles) {
+    if (profile.last_frame_calls == 0) continue;
+    int i = count < kShown ? count++ : kShown;
+    for (; i > 0 && top[i - 1]->last_frame_ms < profile.last_frame_ms; --i) {
+      if (i < kShown) top[i] = top[i - 1];
+    }
+    if (i < kShown) top[i] = &profile;
+  }
+
+  if (ImGui::BeginTable("##bindings", 5,
+                        ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                            ImGuiTableFlags_ScrollY,
+                        ImVec2(0, 200))) {
+    ImGui::TableSetupColumn("Function", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed, 55);
+    ImGui::TableSetupColumn("Frame ms", ImGuiTableColumnFlags_WidthFixed, 65);
+    ImGui::TableSetupColumn("Avg us", ImGuiTableColumnFlags_WidthFixed, 55);
+    ImGui::TableSetupColumn("Max ms", ImGuiTableColumnFlags_WidthFixed, 55);
+    ImGui::TableHeadersRow();
+    for (int i = 0; i < count; ++i) {
+      const Lua::BindingProfile& p = *top[i];
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%s.%s", p.library, p.name);
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", p.last_frame_calls);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", p.last_frame_ms);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", p.total_ms * 1000.0 / p.calls);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", p.max_ms);
+    }
+    ImGui::EndTable();
+  }
+}
@@ -44,6 +44,7 @@ Engine::Engine(Slice<const char*> args, sqlite3* db_, DbAssets* db_assets,
       filesystem(allocator),
       save(allocator),
       window(sdl_window),
+      render_thread(sdl_window),
       shaders(allocator),
       batch_renderer(GetWindowViewport(sdl_window), &shaders, allocator),
       keyboard(allocator),
@@ -53,6 +54,7 @@ Engine::Engine(Slice<const char*> args, sqlite3* db_, DbAssets* db_assets,
       renderer(*db_assets, &batch_renderer, db, allocator),
       lua_allocator(allocator->Alloc(kLuaArenaSize, kMaxAlign), kLuaArenaSize),
       lua(args, db, db_assets, &lua_allocator),
+      lua_profiler(allocator),
       physics(FVec(config.window_width, config.window_height),
               Physics::kPixelsPerMeter, allocator),
       network(allocator),
@@ -62,6 +64,20 @@ Engine::Engine(Slice<const char*> args, sqlite3* db_, DbAssets* db_assets,
   if (config.nearest_filter) {
     batch_renderer.SetDefaultFilter(GL_NEAREST, GL_NEAREST);
   }
+  batch_renderer.SetTextureSlotBatching(config.texture_slots);
+  batch_renderer.SetCpuTransforms(config.cpu_transforms);
+  batch_renderer.SetPackedVertices(config.packed_vertices);
+  batch_renderer.SetExecutor(&pool);
+  lua.SetExecutor(&pool);
+  lua.SetGcPacing(config.lua_gc_budget_ms > 0);
+#ifndef GAME_WEB
+  // Started by the caller once the GL context is ready; web builds are
+  // single-threaded.
+  if (config.render_thread) {
+    shaders.SetRenderThread(&render_thread);
+    batch_renderer.SetRenderThread(&render_thread);
+  }
+#endif
 }
 
 void Engine::Initialize() {
@@ -15,9 +15,11 @@
 #include "hot_reload.h"
 #include "input.h"
 #include "lua.h"
+#include "lua_profiler.h"
 #include "mimalloc_allocator.h"
 #include "network.h"
 #include "physics.h"
+#include "render_thread.h"
 #include "renderer.h"
 #include "save.h"
 #include "shaders.h"
@@ -60,6 +62,8 @@ struct Engine {
   Filesystem filesystem;
   Save save;
   SDL_Window* window;
+  // Only started with the render_thread config option.
+  RenderThread render_thread;
   Shaders shaders;
   BatchRenderer batch_renderer;
   Keyboard keyboard;
@@ -72,6 +76,7 @@ struct Engine {
   Camera camera;
   MimallocAllocator lua_allocator;
   Lua lua;
+  LuaProfiler lua_profiler;
   TimerSystem timers;
   Physics physics;
   Network network;
@@ -153,6 +153,10 @@ struct Game {
   // Renders a frame, including debug overlay and screenshots.
   void Render();
 
+  // Draws the recorded frame on the render thread. Returns false if the
+  // frame has to be drawn on this thread instead.
+  bool SubmitToRenderThread();
+
   // Renders the debug UI overlay and processes its action requests.
   void RenderDebugUI();
 
@@ -238,6 +242,15 @@ Game::FrameResult Game::RunFrame() {
     {
       Render();
     }
+    if (engine->lua.gc_paced()) {
+      // Collect in the time left before the next step is due, but always
+      // make some progress so slow frames do not starve the collector.
+      ZONE("Lua::GC");
+      const double cap_ms = config->lua_gc_budget_ms;
+      const double remaining_ms = kStep * 1000.0 - ElapsedMs(frame_start);
+      engine->lua.StepGc(std::clamp(remaining_ms, cap_ms / 4, cap_ms));
+    }
+    engine->lua.EndBindingFrame();
     double frame_ms = ToSeconds(Now() - frame_start) * 1000.0;
     PROFILE_COUNTER("Frame Time (ms)", frame_ms);
     PROFILE_COUNTER("Lua Memory (KB)", engine->lua.MemoryUsage() / 1024.0);
@@ -458,13 +471,16 @@ void Game::Render() {
     screenshot_requested = false;
     TakeScreenshotToClipboard(&engine->batch_renderer, allocator);
   }
-  // Render phase: flush commands and submit to GPU.
+  {
+    ZONE("FlushFrame");
+    engine->renderer.FlushFrame();
+  }
+  if (SubmitToRenderThread()) return;
+  // Render phase: submit the commands to the GPU.
   {
     const Time render_start = Now();
-    {
-      ZONE("FlushFrame");
-      engine->renderer.FlushFrame();
-    }
+    engine->render_thread.Claim();
+    engine->batch_renderer.SwapFrames();
     {
       ZONE("Render");
       engine->batch_renderer.Render();
@@ -478,6 +494,31 @@ void Game::Render() {
   }
 }
 
+bool Game::SubmitToRenderThread() {
+  // The debug overlay is drawn with GL on this thread, on top of the frame.
+  if (!engine->render_thread.running() || debug_ui->NeedsImGuiFrame()) {
+    return false;
+  }
+  {
+    // Frame N-1 must be done before its command buffer is recorded into.
+    ZONE("WaitRenderThread");
+    engine->render_thread.Wait();
+  }
+  engine->batch_renderer.SwapFrames();
+  last_breakdown_.render_ms = engine->render_thread.last_frame_ms();
+  // Only bookkeeping without an ImGui frame: reads the stats of the frame
+  // that just finished.
+  RenderDebugUI();
+  engine->render_thread.Submit(
+      [](void* userdata) {
+        auto* game = static_cast<Game*>(userdata);
+        game->engine->batch_renderer.Render();
+        SDL_GL_SwapWindow(game->sdl->window);
+      },
+      this);
+  return true;
+}
+
 void Game::RenderDebugUI() {
   const Time dbgui_start = Now();
   ZONE("DebugUI");
@@ -489,6 +530,8 @@ void Game::RenderDebugUI() {
   ctx.cmd_buf_used = engine->batch_renderer.GetCommandBufferUsed();
   ctx.cmd_buf_capacity = engine->batch_renderer.GetCommandBufferCapacity();
   ctx.breakdown = last_breakdown_;
+  ctx.lua_gc_paced = engine->lua.gc_paced();
+  ctx.lua_gc = engine->lua.gc_stats();
   debug_ui->DrawAll(ctx);
   debug_ui->EndFrame();
   last_breakdown_.debug_ui_ms = ElapsedMs(dbgui_start);
@@ -654,6 +697,8 @@ GameContext* SetupGame(const GameOptions& opts, sqlite3* db,
         /*audio_channels=*/2,
         /*audio_buffer_samples=*/8192, ctx->sdl.window, allocator);
     ctx->audio_ctx->sound = &ctx->engine->sound;
+    // Started before Initialize, which compiles Fennel scripts on it.
+    ctx->engine->pool.Start();
     if (ctx->opts.test_mode) {
       ctx->engine->keyboard.SetTestMode(true);
       ctx->engine->mouse.SetTestMode(true);
@@ -661,16 +706,23 @@ GameContext* SetupGame(const GameOptions& opts, sqlite3* db,
       ctx->engine->touch.SetTestMode(true);
     }
     ctx->engine->Initialize();
+    if (ctx->opts.lua_profile) {
+      ctx->engine->lua_profiler.StartSession(ctx->engine->lua.state());
+    }
     ctx->engine->lua.Init();
     if (ctx->opts.test_mode) {
       ctx->engine->lua.StartTestCoroutine();
     }
   }
 
-  // Start the thread pool and, in dev mode only, the hot-reload watcher.
-  // Packaged games never watch files, and the manager reserves a 128 MB
-  // repacking arena that packaged builds should not pay for.
-  ctx->engine->pool.Start();
+#ifndef GAME_WEB
+  if (ctx->config.render_thread) {
+    ctx->engine->render_thread.Start(ctx->sdl.gl_context);
+  }
+#endif
+  // Start the hot-reload watcher in dev mode only. Packaged games never
+  // watch files, and the manager reserves a 128 MB repacking arena that
+  // packaged builds should not pay for.
   if (ctx->opts.source_directory != nullptr) {
     ctx->hot_reload = allocator->New<HotReloadManager>(
         ctx->opts.source_directory, db, ctx->blob_store, &ctx->engine->pool,
@@ -693,7 +745,12 @@ GameContext* SetupGame(const GameOptions& opts, sqlite3* db,
 // Shuts every subsystem down and returns the process exit code. Never runs
 // on web: the browser tab closing is the teardown.
 int TeardownGame(GameContext* ctx, ArenaAllocator* allocator) {
+  // Finishes the last frame and hands the GL context back to this thread.
+  ctx->engine->render_thread.Stop();
   ctx->debug_ui.Shutdown();
+  if (ctx->engine->lua_profiler.running()) {
+    ctx->engine->lua_profiler.StopSession();
+  }
   // Tear down in reverse order: hot-reload watcher, thread pool, audio
   // stream (before Engine, which owns the Sound mutex), then Engine.
   int exit_code = ctx->opts.test_mode ? ctx->engine->lua.TestExitCode() : 0;
@@ -19,6 +19,9 @@ struct GameOptions {
   // The engine exits with code 0 if the coroutine returns normally, 1 on
   // assertion failure or Lua error.
   bool test_mode = false;
+  // Sample the Lua stack from startup until exit, then write lua.folded and
+  // trace.json to the write directory.
+  bool lua_profile = false;
   // Arguments forwarded to the game scripts (everything after '--').
   Slice<const char*> args;
   // All command-line arguments (for logging after SDL logger is set up).
@@ -1,9 +1,17 @@
 #include "lua.h"
 
+#include <physfs.h>
+
 #include <cstdio>
+#include <mutex>
 
+#include "blob_store.h"
+#include "defer.h"
+#include "executor.h"
 #include "lua_scene.h"
 #include "sqlite_helpers.h"
+#include "thread.h"
+#include "zone_stats.h"
 
 namespace G {
 namespace {
@@ -146,8 +154,10 @@ constexpr struct luaL_Reg kBasicLibs[] = {
     {"docs",
      [](lua_State* state) {
        lua_getglobal(state, "_Docs");
-       lua_CFunction func = lua_tocfunction(state, 1);
-       lua_pushlightuserdata(state, reinterpret_cast<void*>(func));
+       // Keyed by the function object: with the binding profiler every
+       // binding shares the same C function.
+       lua_pushlightuserdata(state,
+                             const_cast<void*>(lua_topointer(state, 1)));
        LUA_LOG_VALUE(state, -1, "Ptr = ");
        lua_gettable(state, -2);
        LUA_LOG_VALUE(state, -1, "Value = ");
@@ -195,6 +205,17 @@ int ForwardIndexToMetatable(lua_State* state) {
   return 1;
 }
 
+// Pushes field `name` of the table on top of the stack, creating an empty
+// table there first if needed, so several modules can add to one library.
+void PushOrCreateTable(lua_State* state, const char* name) {
+  lua_getfield(state, -1, name);
+  if (lua_istable(state, -1)) return;
+  lua_pop(state, 1);
+  lua_newtable(state);
+  lua_pushvalue(state, -1);
+  lua_setfield(state, -3, name);
+}
+
 std::string_view Trim(std::string_view s) {
   size_t i = 0, j = s.size() - 1;
   auto is_whitespace = [&](size_t p) {
@@ -209,6 +230,113 @@ int PackageLoaderShim(lua_State* state) {
   return Registry<Lua>::Retrieve(state)->PackageLoader();
 }
 
+struct FennelJob {
+  std::string_view name;
+  std::string_view source;
+  // Owned by the worker VM that compiled it; empty if compilation failed.
+  std::string_view output;
+};
+
+struct FennelCompileContext {
+  std::string_view compiler;
+  FennelJob* jobs;
+  // The compiler VMs allocate from the engine allocator under this lock,
+  // since the allocator itself is not thread-safe.
+  Allocator* allocator;
+  std::mutex allocator_mu;
+  // Every compiler VM created, closed once the output has been copied out.
+  // A batch reuses an idle VM when there is one, so there are never more
+  // VMs than batches running at once.
+  lua_State** states;
+  int state_count = 0;
+  lua_State** idle;
+  int idle_count = 0;
+  std::mutex states_mu;
+};
+
+void* FennelAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+  auto* ctx = static_cast<FennelCompileContext*>(ud);
+  LockMutex l(ctx->allocator_mu);
+  if (nsize == 0) {
+    if (ptr != nullptr) ctx->allocator->Dealloc(ptr, osize);
+    return nullptr;
+  }
+  if (ptr == nullptr) return ctx->allocator->Alloc(nsize, /*align=*/1);
+  return ctx->allocator->Realloc(ptr, osize, nsize, /*align=*/1);
+}
+
+// Stack slot of fennel.compileString in a compiler VM. The outputs are
+// pushed above it.
+constexpr int kCompileStringSlot = 2;
+
+// Returns an idle compiler VM, or a new one with the compiler loaded. Null
+// if the compiler does not load.
+lua_State* AcquireFennelCompiler(FennelCompileContext* ctx) {
+  {
+    LockMutex l(ctx->states_mu);
+    if (ctx->idle_count > 0) return ctx->idle[--ctx->idle_count];
+  }
+  lua_State* state = lua_newstate(FennelAlloc, ctx);
+  CHECK(state != nullptr, "Failed to create a Fennel compiler state");
+  {
+    LockMutex l(ctx->states_mu);
+    ctx->states[ctx->state_count++] = state;
+  }
+  luaL_openlibs(state);
+  if (luaL_loadbuffer(state, ctx->compiler.data(), ctx->compiler.size(),
+                      "@fennel.lua") != 0 ||
+      lua_pcall(state, 0, 1, 0) != 0) {
+    LOG("Could not load the Fennel compiler: ", lua_tostring(state, -1));
+    return nullptr;
+  }
+  lua_getfield(state, -1, "compileString");
+  DCHECK(lua_gettop(state) == kCompileStringSlot);
+  return state;
+}
+
+void CompileFennelBatch(int start, int end, void* ud) {
+  auto* ctx = static_cast<FennelCompileContext*>(ud);
+  lua_State* state = AcquireFennelCompiler(ctx);
+  if (state == nullptr) return;
+  for (int i = start; i < end; ++i) {
+    FennelJob& job = ctx->jobs[i];
+    CHECK(lua_checkstack(state, 4), "Out of stack compiling ", job.name);
+    lua_pushvalue(state, kCompileStringSlot);
+    lua_pushlstring(state, job.source.data(), job.source.size());
+    lua_newtable(state);
+    lua_pushlstring(state, job.name.data(), job.name.size());
+    lua_setfield(state, -2, "filename");
+    if (lua_pcall(state, 2, 1, 0) != 0) {
+      LOG("Deferring ", job.name, " to the main state: ",
+          lua_tostring(state, -1));
+      lua_pop(state, 1);
+      continue;
+    }
+    // Left on the stack so it lives as long as the VM.
+    size_t size = 0;
+    const char* output = lua_tolstring(state, -1, &size);
+    job.output = std::string_view(output, size);
+  }
+  LockMutex l(ctx->states_mu);
+  ctx->idle[ctx->idle_count++] = state;
+}
+
+#ifdef GAME_WITH_BINDING_PROFILER
+int ProfiledBinding(lua_State* state) {
+  auto* profile = static_cast<Lua::BindingProfile*>(
+      lua_touserdata(state, lua_upvalueindex(1)));
+  const Time start = Now();
+  const int results = profile->func(state);
+  const double ms = ToSeconds(Now() - start) * 1000.0;
+  profile->calls++;
+  profile->total_ms += ms;
+  profile->max_ms = std::max(profile->max_ms, ms);
+  profile->frame_calls++;
+  profile->frame_ms += ms;
+  return results;
+}
+#endif
+
 }  // namespace
 
 void* Lua::Alloc(void* ptr, size_t osize, size_t nsize) {
@@ -230,7 +358,8 @@ Lua::Lua(Slice<const char*> args, sqlite3* db, DbAssets* assets,
       assets_(assets),
       scripts_by_name_(allocator),
       scripts_(allocator),
-      compilation_cache_(allocator) {}
+      compilation_cache_(allocator),
+      binding_profiles_(allocator) {}
 
 void Lua::Crash() {
   std::string_view message = GetLuaString(state_, 1);
@@ -264,16 +393,14 @@ void Lua::AddLibrary(const char* name, Slice<const luaL_Reg> funcs) {
   LUA_CHECK_STACK(state_);
   LOG("Adding library ", name);
   lua_getglobal(state_, "G");
-  lua_newtable(state_);
+  PushOrCreateTable(state_, name);
   for (size_t i = 0; i < funcs.size(); ++i) {
     CHECK(funcs[i].name != nullptr, "Invalid entry for library ", name, ": ",
           i);
-    const auto* func = &funcs[i];
-    lua_pushcfunction(state_, func->func);
-    lua_setfield(state_, -2, func->name);
+    PushBinding(name, funcs[i].name, funcs[i].func);
+    lua_setfield(state_, -2, funcs[i].name);
   }
-  lua_setfield(state_, -2, name);
-  lua_pop(state_, 1);
+  lua_pop(state_, 2);
 }
 
 void Lua::AddLibraryWithMetadata(const char* name,
@@ -281,20 +408,18 @@ void Lua::AddLibraryWithMetadata(const char* name,
   LUA_CHECK_STACK(state_);
   LOG("Adding library ", name);
   lua_getglobal(state_, "G");
-  lua_newtable(state_);
+  PushOrCreateTable(state_, name);
   for (size_t i = 0; i < funcs.size(); ++i) {
     LUA_CHECK_STACK(state_);
     CHECK(funcs[i].name != nullptr, "Invalid entry for library ", name, ": ",
           i);
-    const auto* func = &funcs[i];
-    lua_pushcfunction(state_, func->func);
-    lua_setfield(state_, -2, func->name);
+    PushBinding(name, funcs[i].name, funcs[i].func);
+    lua_setfield(state_, -2, funcs[i].name);
   }
-  lua_setfield(state_, -2, name);
-  lua_pop(state_, 1);
+  lua_pop(state_, 2);
   // Add the docs.
   lua_getglobal(state_, "_Docs");
-  lua_newtable(state_);
+  PushOrCreateTable(state_, name);
   for (size_t i = 0; i < funcs.size(); ++i) {
     LUA_CHECK_STACK(state_);
     // Create a table with docstring, and args fields.
@@ -323,7 +448,7 @@ void Lua::AddLibraryWithMetadata(const char* name,
     lua_setfield(state_, -2, "returns");
     lua_setfield(state_, -2, funcs[i].name);
   }
-  lua_setfield(state_, -2, name);
+  lua_pop(state_, 1);
   // Add the functions in the library with a link to the
   // corresponding entry as a light user data.
   for (size_t i = 0; i < funcs.size(); ++i) {
@@ -335,8 +460,8 @@ void Lua::AddLibraryWithMetadata(const char* name,
     lua_getfield(state_, -1, name);
     lua_pushstring(state_, funcs[i].name);
     lua_gettable(state_, -2);
-    auto* ptr = lua_tocfunction(state_, -1);
-    lua_pushlightuserdata(state_, reinterpret_cast<void*>(ptr));
+    lua_pushlightuserdata(state_,
+                          const_cast<void*>(lua_topointer(state_, -1)));
     lua_pushvalue(state_, -5);
     lua_settable(state_, -8);
     lua_pop(state_, 5);
@@ -344,6 +469,79 @@ void Lua::AddLibraryWithMetadata(const char* name,
   lua_pop(state_, 1);
 }
 
+void Lua::PushBinding(const char* library, const char* name,
+                      lua_CFunction func) {
+#ifdef GAME_WITH_BINDING_PROFILER
+  BindingProfile* profile = binding_profiles_.Push(
+      BindingProfile{.library = library, .name = name, .func = func});
+  lua_pushlightuserdata(state_, profile);
+  lua_pushcclosure(state_, ProfiledBinding, 1);
+#else
+  (void)library;
+  (void)name;
+  lua_pushcfunction(state_, func);
+#endif
+}
+
+void Lua::ResetBindingProfiles() {
+  for (BindingProfile& profile : binding_profiles_) {
+    profile = BindingProfile{
+        .library = profile.library, .name = profile.name, .func = profile.func};
+  }
+}
+
+void Lua::EndBindingFrame() {
+  if (binding_profiles_.empty()) return;
+  double frame_ms = 0;
+  for (BindingProfile& profile : binding_profiles_) {
+    frame_ms += profile.frame_ms;
+    profile.last_frame_calls = profile.frame_calls;
+    profile.last_frame_ms = profile.frame_ms;
+    profile.frame_calls = 0;
+    profile.frame_ms = 0;
+  }
+  GetZoneStats()->Record("Lua bindings", frame_ms);
+}
+
+bool Lua::DumpBindingProfiles() {
+  if (binding_profiles_.empty()) {
+    LOG("Binding profiler is disabled (build with "
+        "-DENABLE_BINDING_PROFILER=ON)");
+    return false;
+  }
+  const char* write_dir = PHYSFS_getWriteDir();
+  if (write_dir == nullptr) {
+    LOG("Binding profiler: no PhysFS write directory set");
+    return false;
+  }
+  FixedArray<const BindingProfile*> called(binding_profiles_.size(),
+                                           allocator_);
+  for (const BindingProfile& profile : binding_profiles_) {
+    if (profile.calls > 0) called.Push(&profile);
+  }
+  std::sort(called.begin(), called.end(),
+            [](const BindingProfile* a, const BindingProfile* b) {
+              return a->total_ms > b->total_ms;
+            });
+  FixedStringBuffer<kMaxPathLength> path(write_dir, "bindings.tsv");
+  FILE* f = fopen(path.str(), "w");
+  if (f == nullptr) {
+    LOG("Binding profiler: failed to open ", path.str(), " for writing");
+    return false;
+  }
+  DEFER([f] { fclose(f); });
+  fputs("function\tcalls\ttotal_ms\tavg_us\tmax_ms\n", f);
+  for (const BindingProfile* profile : called) {
+    fprintf(f, "G.%s.%s\t%llu\t%.3f\t%.3f\t%.3f\n", profile->library,
+            profile->name, static_cast<unsigned long long>(profile->calls),
+            profile->total_ms, profile->total_ms * 1000.0 / profile->calls,
+            profile->max_ms);
+  }
+  LOG("Binding profiler: wrote ", called.size(), " functions to ",
+      path.str());
+  return true;
+}
+
 int Lua::LoadLuaAsset(std::string_view filename,
                       std::string_view script_contents, int traceback_handler) {
   FixedStringBuffer<kMaxPathLength + 1> buf("@", filename);
@@ -389,7 +587,7 @@ bool Lua::CompileFennelAsset(std::string_view name,
       return false;
     }
     // Fennel is not loaded. Load it.
-    LoadLuaAsset(fennel_script->name, fennel_script->contents);
+    LoadLuaAsset(fennel_script->name, ScriptContents(fennel_script));
     CHECK(lua_istable(state_, -1), "Invalid fennel compilation result");
     lua_pushvalue(state_, -1);
     lua_pushvalue(state_, -1);
@@ -436,14 +634,13 @@ bool Lua::CompileFennelAsset(std::string_view name,
   return true;
 }
 
-int Lua::LoadFennelAsset(std::string_view name,
-                         std::string_view script_contents,
-                         int traceback_handler) {
+int Lua::LoadFennelAsset(Script* fennel_script, int traceback_handler) {
+  const std::string_view name = fennel_script->name;
   LOG("Loading script ", name);
-  auto* lua = Registry<Lua>::Retrieve(state_);
-  if (!lua->LoadFromCache(name, state_)) {
+  if (!LoadFromCache(name, state_)) {
     LOG("Could not load script ", name, " from the cache. Compiling again");
-    if (!lua->CompileFennelAsset(name, script_contents, traceback_handler)) {
+    if (!CompileFennelAsset(name, ScriptContents(fennel_script),
+                            traceback_handler)) {
       LOG("Failed to compile asset ", name);
       return 0;
     }
@@ -582,7 +779,7 @@ void Lua::FlushCompilationCache() {
       break;
     }
     const auto checksum = assets_->GetChecksum(script.name);
-    if (checksum != cached_script.checksum) {
+    if (checksum != cached_script.checksum || !cached_script.in_db) {
       LOG(script.name, " is dirty");
       dirty = true;
       break;
@@ -597,18 +794,18 @@ void Lua::FlushCompilationCache() {
                "INSERT OR REPLACE INTO compilation_cache "
                "(source_name, source_hash, compiled) VALUES (?, ?, ?)");
   CHECK(stmt.ok(), "Failed to prepare compilation cache insert");
-  for (const auto& script : scripts_) {
+  for (auto& script : scripts_) {
     CachedScript cached_script;
     if (script.language == Script::kLuaScript) continue;
     const auto checksum = assets_->GetChecksum(script.name);
     if (compilation_cache_.Lookup(script.name, &cached_script)) {
-      if (checksum == cached_script.checksum) {
+      if (checksum == cached_script.checksum && cached_script.in_db) {
         LOG("Skipping ", script.name, " since it has not changed");
         continue;
       }
     } else {
       int top = lua_gettop(state_);
-      if (!CompileFennelAsset(script.name, script.contents)) {
+      if (!CompileFennelAsset(script.name, ScriptContents(&script))) {
         LUA_ERROR(state_, "Failed to compile ", script.name, ": \n",
                   GetLuaString(state_, -1));
         return;
@@ -658,7 +855,7 @@ void Lua::LoadMetatable(const char* metatable_name, const luaL_Reg* registers,
 
 void Lua::LoadLibraries() {
   if (state_ != nullptr) lua_close(state_);
-  state_ = lua_newstate(&Lua::LuaAlloc, this);
+  state_ = lua_newstate(&Lua::LuaAlloc, static_cast<LuaModules*>(this));
   lua_atpanic(state_, [](lua_State* state) {
     auto* lua = Registry<Lua>::Retrieve(state);
     lua->Crash();
@@ -667,6 +864,8 @@ void Lua::LoadLibraries() {
   });
   READY();
   Register(this);
+  if (gc_paced_) lua_gc(state_, LUA_GCSTOP, /*data=*/0);
+  gc_live_bytes_ = 0;
   // Create basic initial state.
   AddBasicLibs(state_);
   // Create the global namespace table (G) so functions live under it (e.g.
@@ -690,6 +889,23 @@ void Lua::LoadLibraries() {
   lua_setglobal(state_, "print");
 }
 
+std::string_view Lua::ScriptContents(Script* script) {
+  if (script->contents.data() != nullptr) return script->contents;
+  TIMER("Reading script ", script->name);
+  // Sized, not NUL-terminated: packaged scripts may be bytecode.
+  auto* buffer = static_cast<char*>(allocator_->Alloc(script->size + 1, 1));
+  auto result = ReadBlob(script->blob_hash, reinterpret_cast<uint8_t*>(buffer),
+                         script->size);
+  if (result.is_error()) {
+    allocator_->Dealloc(buffer, script->size + 1);
+    LUA_ERROR(state_, "Could not read ", script->name, ": ",
+              result.error().message());
+    return {};
+  }
+  script->contents = std::string_view(buffer, script->size);
+  return script->contents;
+}
+
 void Lua::LoadScript(const DbAssets::Script& script) {
   LUA_CHECK_STACK(state_);
   READY();
@@ -701,9 +917,9 @@ void Lua::LoadScript(const DbAssets::Script& script) {
   } else if (ConsumeSuffix(&asset_name, ".fnl")) {
     saved_script.language = Script::kFennelScript;
   }
-  saved_script.contents =
-      allocator_->StrDup(reinterpret_cast<const char*>(script.contents));
   saved_script.name = script.name;
+  saved_script.size = script.size;
+  saved_script.blob_hash = script.blob_hash;
   scripts_.Push(saved_script);
   scripts_by_name_.Insert(asset_name, &scripts_.back());
   // Set the package.
@@ -767,23 +983,72 @@ void Lua::BuildCompilationCache() {
     CachedScript script;
     script.contents = std::string_view(buffer, blob.size());
     script.checksum = stmt.ColumnInt64(2);
+    script.in_db = true;
     LOG("Loading ", name, " into compilation cache");
     compilation_cache_.Insert(name, script);
   }
 }
 
+void Lua::PrecompileFennel() {
+  Script* fennel = nullptr;
+  if (executor_ == nullptr || !scripts_by_name_.Lookup("fennel", &fennel)) {
+    return;
+  }
+  DynArray<FennelJob> jobs(allocator_);
+  scripts_by_name_.ForEach([&](std::string_view, Script* script) {
+    if (script->language != Script::kFennelScript) return;
+    CachedScript cached;
+    if (compilation_cache_.Lookup(script->name, &cached) &&
+        cached.checksum == assets_->GetChecksum(script->name)) {
+      return;
+    }
+    jobs.Push(FennelJob{.name = script->name, .source = {}, .output = {}});
+  });
+  // A single script compiles just as fast on the main state, which already
+  // has the compiler loaded.
+  if (jobs.size() < 2) return;
+  TIMER("Compiling ", jobs.size(), " Fennel scripts in parallel");
+  // Sources are read here: the blob store is not safe to use from workers.
+  for (FennelJob& job : jobs) {
+    std::string_view asset_name = job.name;
+    ConsumeSuffix(&asset_name, ".fnl");
+    Script* script = nullptr;
+    CHECK(scripts_by_name_.Lookup(asset_name, &script));
+    job.source = ScriptContents(script);
+  }
+  DynArray<lua_State*> states(jobs.size(), allocator_);
+  DynArray<lua_State*> idle(jobs.size(), allocator_);
+  FennelCompileContext ctx;
+  ctx.compiler = ScriptContents(fennel);
+  ctx.jobs = jobs.data();
+  ctx.allocator = allocator_;
+  ctx.states = states.data();
+  ctx.idle = idle.data();
+  executor_->ParallelFor(static_cast<int>(jobs.size()), /*min_batch=*/1,
+                         CompileFennelBatch, &ctx);
+  for (const FennelJob& job : jobs) {
+    if (job.output.empty()) continue;
+    CachedScript script;
+    script.checksum = assets_->GetChecksum(job.name);
+    script.contents = allocator_->StrDup(job.output);
+    compilation_cache_.Insert(job.name, script);
+  }
+  for (int i = 0; i < ctx.state_count; ++i) lua_close(ctx.states[i]);
+}
+
 void Lua::LoadMain() {
   LUA_CHECK_STACK(state_);
   READY();
+  PrecompileFennel();
   Script* main = nullptr;
   // Reset the _Game var.
   lua_pushnil(state_);
   lua_setglobal(state_, "_Game");
   CHECK(scripts_by_name_.Lookup("main", &main), "Unknown script main.lua");
   if (main->language == Script::kLuaScript) {
-    LoadLuaAsset(main->name, main->contents, traceback_handler_);
+    LoadLuaAsset(main->name, ScriptContents(main), traceback_handler_);
   } else {
-    LoadFennelAsset(main->name, main->contents, traceback_handler_);
+    LoadFennelAsset(main, traceback_handler_);
   }
   if (!lua_istable(state_, -1)) {
     LUA_ERROR(state_, "Expected main.lua to return a table");
@@ -810,9 +1075,9 @@ int Lua::PackageLoader() {
   }
   int result = 0;
   if (script->language == Script::kLuaScript) {
-    result = LoadLuaAsset(script->name, script->contents);
+    result = LoadLuaAsset(script->name, ScriptContents(script));
   } else {
-    result = LoadFennelAsset(script->name, script->contents);
+    result = LoadFennelAsset(script);
   }
   if (result == 0) {
     LOG("Failed to load ", modname);
@@ -871,6 +1136,38 @@ void Lua::Init() {
   }
 }
 
+void Lua::SetGcPacing(bool paced) {
+  gc_paced_ = paced;
+  if (state_ == nullptr) return;
+  lua_gc(state_, paced ? LUA_GCSTOP : LUA_GCRESTART, /*data=*/0);
+}
+
+void Lua::StepGc(double budget_ms) {
+  if (!gc_paced_) return;
+  const Time start = Now();
+  const bool force = gc_live_bytes_ > 0 &&
+                     MemoryUsage() > kGcForceFactor * gc_live_bytes_;
+  int steps = 0;
+  do {
+    ++steps;
+    // Each step collects in proportion to the step multiplier, the same
+    // unit of work the automatic collector does per allocation threshold.
+    if (lua_gc(state_, LUA_GCSTEP, /*data=*/0)) {
+      gc_stats_.cycles++;
+      if (force) gc_stats_.forced++;
+      gc_live_bytes_ = MemoryUsage();
+      break;
+    }
+  } while (force || ElapsedMs(start) < budget_ms);
+  // Stepping re-arms the automatic collector.
+  lua_gc(state_, LUA_GCSTOP, /*data=*/0);
+  if (gc_live_bytes_ == 0) gc_live_bytes_ = MemoryUsage();
+  gc_stats_.last_ms = ElapsedMs(start);
+  gc_stats_.max_ms = std::max(gc_stats_.max_ms, gc_stats_.last_ms);
+  gc_stats_.budget_ms = budget_ms;
+  gc_stats_.steps = steps;
+}
+
 void Lua::Update(float t, float dt) {
   LUA_CHECK_STACK(state_);
 
@@ -20,6 +20,7 @@ extern "C" {
 #include "libraries/sqlite3.h"
 #include "mat.h"
 #include "segmented_list.h"
+#include "string_table.h"
 #include "stringlib.h"
 #include "vec.h"
 
@@ -57,21 +58,38 @@ constexpr const char* Typename() {
   return __PRETTY_FUNCTION__;
 }
 
+// Subsystem pointers of a Lua state, one slot per type used with Registry.
+// Lives in the userdata of the state's allocator, which every coroutine of
+// the state shares, so finding a subsystem is a load from this array rather
+// than a lookup in the Lua registry table.
+struct LuaModules {
+  inline static constexpr size_t kMaxModules = 64;
+
+  static LuaModules* Of(lua_State* state) {
+    void* ud = nullptr;
+    lua_getallocf(state, &ud);
+    return static_cast<LuaModules*>(ud);
+  }
+
+  static size_t NextSlot() {
+    static size_t next = 0;
+    CHECK(next < kMaxModules, "Too many Lua module types");
+    return next++;
+  }
+
+  void* modules[kMaxModules] = {};
+};
+
 template <typename T>
 class Registry {
  public:
   static void Register(lua_State* state, T* ptr) {
-    lua_pushlightuserdata(state, static_cast<void*>(&kKey));
-    lua_pushlightuserdata(state, static_cast<void*>(ptr));
-    lua_settable(state, LUA_REGISTRYINDEX);
+    LuaModules::Of(state)->modules[kSlot] = ptr;
   }
 
   static T* Retrieve(lua_State* state) {
-    lua_pushlightuserdata(state, static_cast<void*>(&kKey));
-    lua_gettable(state, LUA_REGISTRYINDEX);
-    auto* result = static_cast<T*>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-    if (result == nullptr) {
+    auto* result = static_cast<T*>(LuaModules::Of(state)->modules[kSlot]);
+    if (result == nullptr) [[unlikely]] {
       luaL_error(state, "Could not find a module for %s", Typename<T>());
       return nullptr;
     }
@@ -79,12 +97,14 @@ class Registry {
   }
 
  private:
-  inline static char kKey = 'k';
+  inline static const size_t kSlot = LuaModules::NextSlot();
 };
 
 // Forward declare for the userdata name.
+class Executor;
 struct ByteBuffer;
 struct Canvas;
+struct SpriteHandle;
 
 template <typename T>
 struct UserdataName;
@@ -104,6 +124,7 @@ USERDATA_ENTRY(FMat4x4, "fmat4x4");
 USERDATA_ENTRY(DbAssets::Sprite, "asset_sprite_ptr");
 USERDATA_ENTRY(ByteBuffer, "byte_buffer");
 USERDATA_ENTRY(Canvas, "canvas");
+USERDATA_ENTRY(SpriteHandle, "sprite_handle");
 
 #undef USERDATA_ENTRY
 
@@ -188,6 +209,20 @@ inline Color CheckColor(lua_State* state, int index) {
                c(luaL_checknumber(state, index + 3))};
 }
 
+// Reads a StringIntern handle: either an integer handle, or a string that
+// is interned on every call.
+inline uint32_t CheckStringHandle(lua_State* state, int index) {
+  if (lua_type(state, index) == LUA_TNUMBER) {
+    const lua_Integer handle = lua_tointeger(state, index);
+    if (handle < 0 || handle > UINT32_MAX ||
+        !StringTable::Instance().Contains(static_cast<uint32_t>(handle))) {
+      luaL_argerror(state, index, "unknown string handle");
+    }
+    return static_cast<uint32_t>(handle);
+  }
+  return StringIntern(GetLuaString(state, index));
+}
+
 // Pushes an FVec2 as two return values.
 inline void PushVec2(lua_State* state, FVec2 v) {
   lua_pushnumber(state, v.x);
@@ -312,7 +347,8 @@ struct LuaLibraryDef {
   size_t type_count;
 };
 
-class Lua {
+// The allocator userdata of the Lua state is the LuaModules base.
+class Lua : private LuaModules {
  public:
   Lua(Slice<const char*> args, sqlite3* db, DbAssets* assets,
       Allocator* allocator);
@@ -327,8 +363,15 @@ class Lua {
 
   void LoadScript(const DbAssets::Script& script);
 
+  // Loads main.lua or main.fnl. Fennel scripts missing from the
+  // compilation cache are first compiled in parallel on the executor.
   void LoadMain();
 
+  // Executor for Fennel compilation. Without one, scripts are compiled on
+  // the main state as they are required.
+  void SetExecutor(Executor* executor) { executor_ = executor; }
+  Executor* executor() const { return executor_; }
+
   void Init();
 
   void Update(float t, float dt);
@@ -431,8 +474,70 @@ class Lua {
   void RunGc() {
     TIMER("GC");
     lua_gc(state_, LUA_GCCOLLECT, /*data=*/0);
+    // A full collection re-arms the automatic collector.
+    if (gc_paced_) lua_gc(state_, LUA_GCSTOP, /*data=*/0);
+  }
+
+  // Collector work done by StepGc.
+  struct GcStats {
+    double last_ms = 0;    // Time spent in the last StepGc call.
+    double max_ms = 0;     // Longest StepGc call.
+    double budget_ms = 0;  // Budget passed to the last StepGc call.
+    int steps = 0;         // Incremental steps in the last StepGc call.
+    int cycles = 0;        // Collection cycles finished while paced.
+    int forced = 0;        // Cycles finished over budget to bound memory.
+  };
+
+  // Paced collection: stops Lua's automatic collector, which would
+  // otherwise run whenever an allocation crosses its threshold, and leaves
+  // the work to StepGc. Disabled by default.
+  void SetGcPacing(bool paced);
+  bool gc_paced() const { return gc_paced_; }
+
+  // Runs incremental collector steps for up to `budget_ms`. Finishes the
+  // current cycle regardless of the budget if memory has grown past
+  // kGcForceFactor times the size left by the last finished cycle. No-op
+  // unless pacing is enabled.
+  void StepGc(double budget_ms);
+
+  const GcStats& gc_stats() const { return gc_stats_; }
+
+  // Calls into one function registered with AddLibrary. Only collected
+  // when the engine is built with -DENABLE_BINDING_PROFILER=ON, in which
+  // case every G.* function is wrapped in a closure that times it. Times
+  // are inclusive of any Lua the function calls back into, and calls that
+  // raise a Lua error are not counted.
+  struct BindingProfile {
+    const char* library;
+    const char* name;
+    lua_CFunction func;
+    uint64_t calls = 0;
+    double total_ms = 0;
+    double max_ms = 0;
+    // Accumulated since the last EndBindingFrame.
+    uint32_t frame_calls = 0;
+    double frame_ms = 0;
+    // Totals of the last finished frame.
+    uint32_t last_frame_calls = 0;
+    double last_frame_ms = 0;
+  };
+
+  // Empty unless built with GAME_WITH_BINDING_PROFILER.
+  const SegmentedList<BindingProfile>& binding_profiles() const {
+    return binding_profiles_;
   }
 
+  // Zeroes the counters of every binding.
+  void ResetBindingProfiles();
+
+  // Closes the frame of every binding and records the time spent in all of
+  // them as the "Lua bindings" zone.
+  void EndBindingFrame();
+
+  // Writes the bindings with at least one call, by descending total time,
+  // to bindings.tsv in the write directory.
+  bool DumpBindingProfiles();
+
   bool HotloadRequested() {
     const bool result = hotload_requested_;
     hotload_requested_ = false;
@@ -476,10 +581,6 @@ class Lua {
   int LoadLuaAsset(std::string_view filename, std::string_view script_contents,
                    int traceback_handler = INT_MAX);
 
-  int LoadFennelAsset(std::string_view filename,
-                      std::string_view script_contents,
-                      int traceback_handler = INT_MAX);
-
   // Compiles the fennel asset and leaves the result in the top of the Lua
   // stack.
   bool CompileFennelAsset(std::string_view filename,
@@ -494,7 +595,8 @@ class Lua {
   void* Alloc(void* ptr, size_t osize, size_t nsize);
 
   static void* LuaAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
-    return static_cast<Lua*>(ud)->Alloc(ptr, osize, nsize);
+    return static_cast<Lua*>(static_cast<LuaModules*>(ud))
+        ->Alloc(ptr, osize, nsize);
   }
 
   void AddLibrary(const char* name, Slice<const luaL_Reg> funcs);
@@ -528,6 +630,8 @@ class Lua {
   struct CachedScript {
     DbAssets::ChecksumType checksum;
     std::string_view contents;
+    // False until FlushCompilationCache has written the entry.
+    bool in_db = false;
   };
 
   struct Script {
@@ -535,9 +639,28 @@ class Lua {
 
     Language language;
     std::string_view name;
+    size_t size;
+    uint64_t blob_hash;
+    // Read from the blob store by ScriptContents on first use.
     std::string_view contents;
   };
 
+  // Returns the source of the script, reading it on first use.
+  std::string_view ScriptContents(Script* script);
+
+  // Only reads the script if it is not in the compilation cache.
+  int LoadFennelAsset(Script* script, int traceback_handler = INT_MAX);
+
+  // Compiles the Fennel scripts whose cache entry is missing or stale on the
+  // executor, with one compiler VM per worker, and adds the output to the
+  // cache.
+  // Scripts that fail there (for instance because they require macro
+  // modules, which only the main state can find) are left to
+  // LoadFennelAsset, which reports the error.
+  void PrecompileFennel();
+
+  Executor* executor_ = nullptr;
+
   Dictionary<Script*> scripts_by_name_;
   // Grows one entry per loaded script. Segmented so the pointers held by
   // scripts_by_name_ stay stable as it grows.
@@ -552,6 +675,21 @@ class Lua {
 
   bool hotload_requested_ = false;
 
+  // Memory growth over the live size after the last cycle at which StepGc
+  // stops honoring its budget.
+  inline static constexpr size_t kGcForceFactor = 4;
+
+  bool gc_paced_ = false;
+  size_t gc_live_bytes_ = 0;
+  GcStats gc_stats_;
+
+  // Pushes `func` as G.`library`.`name`, wrapped in a timing closure when
+  // built with GAME_WITH_BINDING_PROFILER.
+  void PushBinding(const char* library, const char* name, lua_CFunction func);
+
+  // Segmented so the closures can hold pointers to their entry.
+  SegmentedList<BindingProfile> binding_profiles_;
+
   // Coroutine running _Game.test_inputs in test mode. nullptr when test
   // mode is disabled or after the coroutine has finished or errored.
   lua_State* test_co_ = nullptr;
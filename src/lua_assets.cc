@@ -23,6 +23,39 @@ const struct LuaApiFunction kAssetsLib[] = {
        lua_setmetatable(state, -2);
        return 1;
      }},
+    {"sprite_handle",
+     "Resolves a sprite by name into a handle that G.graphics.draw_sprite "
+     "draws without looking anything up. Handles go stale when sprite sheets "
+     "are reloaded. Returns nil if the sprite does not exist.",
+     {{"name", "name of the sprite", "string"}},
+     {{"result", "A handle to the sprite", "sprite_handle"}},
+     [](lua_State* state) {
+       std::string_view name = GetLuaString(state, 1);
+       auto* renderer = Registry<Renderer>::Retrieve(state);
+       auto handle = renderer->ResolveSprite(name);
+       if (handle.is_error()) {
+         lua_pushnil(state);
+         return 1;
+       }
+       NewUserdata<SpriteHandle>(state, handle.value());
+       return 1;
+     }},
+    {"sprite_id",
+     "Resolves a sprite by name into the integer that identifies it in the "
+     "records of G.graphics.draw_batch. Returns nil if the sprite does not "
+     "exist.",
+     {{"name", "name of the sprite", "string"}},
+     {{"result", "The id of the sprite", "integer"}},
+     [](lua_State* state) {
+       std::string_view name = GetLuaString(state, 1);
+       auto id = Registry<Renderer>::Retrieve(state)->SpriteId(name);
+       if (id.is_error()) {
+         lua_pushnil(state);
+         return 1;
+       }
+       lua_pushinteger(state, id.value());
+       return 1;
+     }},
     {"sprite_info",
      "Returns a table with width and height in pixels of a sprite.",
      {{"name", "sprite object ptr or sprite name as string", "string"}},
@@ -98,7 +131,11 @@ const struct LuaApiFunction kAssetsLib[] = {
 
 }  // namespace
 
-void AddAssetsLibrary(Lua* lua) { lua->AddLibrary("assets", kAssetsLib); }
+void AddAssetsLibrary(Lua* lua) {
+  lua->LoadMetatable("sprite_handle", /*registers=*/nullptr,
+                     /*register_count=*/0);
+  lua->AddLibrary("assets", kAssetsLib);
+}
 
 LuaLibraryDef GetAssetsLibraryDef() {
   static const LuaLibraryDef::Library kLibs[] = {
@@ -106,6 +143,8 @@ LuaLibraryDef GetAssetsLibraryDef() {
   };
   static const LuaUserdataType kTypes[] = {
       {"asset_sprite_ptr", "sprite_asset", "A reference to a sprite asset"},
+      {"sprite_handle", "sprite_handle",
+       "A sprite resolved by G.assets.sprite_handle"},
   };
   return {kLibs, std::size(kLibs), kTypes, std::size(kTypes)};
 }
@@ -1,5 +1,7 @@
 #include "lua_bytebuffer.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iterator>
 
 #include "libraries/rapidhash.h"
@@ -50,7 +52,84 @@ constexpr luaL_Reg kByteBufferMethods[] = {
        return 1;
      }}};
 
+// Bytes per field of a G.data.pack format character, 0 if invalid.
+size_t PackFieldSize(char c) {
+  switch (c) {
+    case 'f':
+    case 'I':
+      return 4;
+    case 'B':
+      return 1;
+    default:
+      return 0;
+  }
+}
+
 const struct LuaApiFunction kDataLib[] = {
+    {"pack",
+     "Packs a flat list of numbers into a byte buffer of fixed size "
+     "records, for APIs such as G.graphics.draw_batch. Each character of "
+     "the format is one field of a record: 'f' a 32-bit float, 'I' a 32-bit "
+     "unsigned integer (an error outside 0-4294967295), 'B' a byte (clamped "
+     "to 0-255). Spaces are ignored. "
+     "The format repeats for as many records as the list holds.",
+     {{"format", "the fields of one record, e.g. 'IfffBBBB'", "string"},
+      {"values", "the fields of every record, one after another", "table"}},
+     {{"buffer", "the packed records", "byte_buffer"}},
+     [](lua_State* state) {
+       std::string_view format = GetLuaString(state, 1);
+       luaL_checktype(state, 2, LUA_TTABLE);
+       size_t fields = 0, record_size = 0;
+       for (char c : format) {
+         if (c == ' ') continue;
+         const size_t size = PackFieldSize(c);
+         if (size == 0) LUA_ERROR(state, "Invalid pack format '", c, "'");
+         fields++;
+         record_size += size;
+       }
+       if (fields == 0) LUA_ERROR(state, "Empty pack format");
+       const size_t values = lua_objlen(state, 2);
+       if (values % fields != 0) {
+         LUA_ERROR(state, "Got ", values, " values for records of ", fields,
+                   " fields");
+       }
+       uint8_t* out = PushBufferIntoLua(state, values / fields * record_size);
+       size_t index = 1;
+       for (size_t record = 0; record < values / fields; ++record) {
+         for (char c : format) {
+           if (c == ' ') continue;
+           lua_rawgeti(state, 2, index);
+           if (lua_type(state, -1) != LUA_TNUMBER) {
+             luaL_argerror(
+                 state, 2,
+                 lua_pushfstring(state, "value %d is a %s, not a number",
+                                 static_cast<int>(index),
+                                 luaL_typename(state, -1)));
+           }
+           const lua_Number n = lua_tonumber(state, -1);
+           lua_pop(state, 1);
+           if (c == 'I' && !(n >= 0 && n <= UINT32_MAX)) {
+             luaL_argerror(
+                 state, 2,
+                 lua_pushfstring(state, "value %d (%f) is out of range for 'I'",
+                                 static_cast<int>(index), n));
+           }
+           index++;
+           if (c == 'f') {
+             const float f = n;
+             std::memcpy(out, &f, sizeof(f));
+             out += sizeof(f);
+           } else if (c == 'I') {
+             const auto u = static_cast<uint32_t>(n);
+             std::memcpy(out, &u, sizeof(u));
+             out += sizeof(u);
+           } else {
+             *out++ = static_cast<uint8_t>(std::clamp(n, 0.0, 255.0));
+           }
+         }
+       }
+       return 1;
+     }},
     {"hash",
      "Computes a hash of a string or byte buffer",
      {{"data", "a string or byte_buffer to hash", "string"}},
@@ -70,11 +70,17 @@ int CollisionTest(lua_State* state) {
 
 int PushCollisionWorld(lua_State* state) {
   float cell_size = luaL_optnumber(state, 1, 64.0);
+  const lua_Integer capacity =
+      luaL_optinteger(state, 2, CollisionWorld::kDefaultCapacity);
+  if (capacity < 1 || capacity > UINT32_MAX / 4) {
+    LUA_ERROR(state, "Invalid collider capacity ", capacity);
+  }
   auto* allocator = Registry<Lua>::Retrieve(state)->allocator();
 
   auto* world = static_cast<CollisionWorld*>(
       lua_newuserdata(state, sizeof(CollisionWorld)));
-  new (world) CollisionWorld(cell_size, allocator);
+  new (world) CollisionWorld(cell_size, allocator,
+                             static_cast<uint32_t>(capacity));
 
   luaL_getmetatable(state, "collision_world");
   lua_setmetatable(state, -2);
@@ -315,6 +321,81 @@ int CollisionWorldMoveAndSlide(lua_State* state) {
   return 3;
 }
 
+int CollisionWorldMoveAndSlideBatch(lua_State* state) {
+  auto* world = CheckWorld(state, 1);
+  luaL_checktype(state, 2, LUA_TTABLE);
+  luaL_checktype(state, 3, LUA_TTABLE);
+  const bool parallel = lua_toboolean(state, 4);
+  const size_t n = lua_objlen(state, 2);
+  if (lua_objlen(state, 3) != 2 * n) {
+    LUA_ERROR(state, "Expected ", 2 * n, " velocity components, got ",
+              lua_objlen(state, 3));
+  }
+
+  // Checked first: a Lua error would skip the destructors below. `seen`
+  // maps collider indices to their position in `handles`.
+  lua_createtable(state, 0, n);
+  const int seen = lua_gettop(state);
+  for (size_t i = 1; i <= n; ++i) {
+    lua_rawgeti(state, 2, i);
+    const ColliderHandle handle = CheckHandle(state, -1);
+    if (!world->IsValid(handle)) {
+      LUA_ERROR(state, "Invalid collision handle at index ", i);
+    }
+    lua_rawgeti(state, seen, handle.index);
+    if (!lua_isnil(state, -1)) {
+      LUA_ERROR(state, "Collision handle at index ", i,
+                " is already at index ", lua_tointeger(state, -1));
+    }
+    lua_pop(state, 2);
+    lua_pushinteger(state, i);
+    lua_rawseti(state, seen, handle.index);
+  }
+  lua_pop(state, 1);
+  for (size_t i = 1; i <= 2 * n; ++i) {
+    lua_rawgeti(state, 3, i);
+    luaL_checknumber(state, -1);
+    lua_pop(state, 1);
+  }
+
+  auto* lua = Registry<Lua>::Retrieve(state);
+  FixedArray<ColliderHandle> handles(n, lua->allocator());
+  FixedArray<FVec2> velocities(n, lua->allocator());
+  FixedArray<CollisionWorld::MoveResult> results(n, lua->allocator());
+  for (size_t i = 0; i < n; ++i) {
+    lua_rawgeti(state, 2, i + 1);
+    handles.Push(*static_cast<ColliderHandle*>(lua_touserdata(state, -1)));
+    lua_rawgeti(state, 3, 2 * i + 1);
+    lua_rawgeti(state, 3, 2 * i + 2);
+    velocities.Push(FVec(lua_tonumber(state, -2), lua_tonumber(state, -1)));
+    lua_pop(state, 3);
+    results.Push({});
+  }
+
+  world->MoveAndSlideBatch(handles.data(), velocities.data(), results.data(),
+                           n, parallel ? lua->executor() : nullptr);
+
+  lua_createtable(state, 2 * n, 0);
+  for (size_t i = 0; i < n; ++i) {
+    lua_pushnumber(state, results[i].position.x);
+    lua_rawseti(state, -2, 2 * i + 1);
+    lua_pushnumber(state, results[i].position.y);
+    lua_rawseti(state, -2, 2 * i + 2);
+  }
+  // Contact tables are not pooled here: every mover needs its own.
+  lua_createtable(state, 0, 0);
+  for (size_t i = 0; i < n; ++i) {
+    if (results[i].contact_count == 0) continue;
+    lua_createtable(state, results[i].contact_count, 0);
+    for (uint32_t k = 0; k < results[i].contact_count; ++k) {
+      PushContact(state, results[i].contacts[k]);
+      lua_rawseti(state, -2, k + 1);
+    }
+    lua_rawseti(state, -2, i + 1);
+  }
+  return 2;
+}
+
 int CollisionWorldMoveAndCollide(lua_State* state) {
   auto* world = CheckWorld(state, 1);
   ColliderHandle handle = CheckHandle(state, 2);
@@ -623,6 +704,7 @@ constexpr luaL_Reg kCollisionWorldMethods[] = {
     {"set_filter", CollisionWorldSetFilter},
     {"get_userdata", CollisionWorldGetUserdata},
     {"move_and_slide", CollisionWorldMoveAndSlide},
+    {"move_and_slide_batch", CollisionWorldMoveAndSlideBatch},
     {"move_and_collide", CollisionWorldMoveAndCollide},
     {"move_toward", CollisionWorldMoveToward},
     {"get_overlaps", CollisionWorldGetOverlaps},
@@ -651,7 +733,11 @@ const struct LuaApiFunction kCollisionLib[] = {
     {"new_world",
      "Creates a new collision world",
      {{"cell_size", "Spatial hash cell size in pixels (default 64)",
-       "number?"}},
+       "number?"},
+      {"capacity",
+       "Colliders to make room for up front; the world grows past it as "
+       "needed (default 256)",
+       "integer?"}},
      {{"world", "The collision world", "collision_world"}},
      PushCollisionWorld},
     {"circle",
@@ -725,6 +811,19 @@ const LuaUserdataMethod kWorldMethods[] = {
      {{"x", "Final x position", "number"},
       {"y", "Final y position", "number"},
       {"contacts", "Array of contact info", "table"}}},
+    {"move_and_slide_batch",
+     "Moves many colliders with sliding collision resolution in one call",
+     {{"handles", "Array of collider handles, each listed once", "table"},
+      {"velocities", "Flat array of velocities: vx1, vy1, vx2, vy2, ...",
+       "table"},
+      {"parallel",
+       "Resolves all moves against the world as it was at the call, on the "
+       "thread pool (default false)",
+       "boolean?"}},
+     {{"positions", "Flat array of final positions: x1, y1, x2, y2, ...",
+       "table"},
+      {"contacts", "Arrays of contact info by handle index, for the "
+                   "colliders that hit something", "table"}}},
     {"move_and_collide",
      "Moves a collider until first collision",
      {{"handle", "Collider handle", "collision_handle"},
@@ -795,7 +894,7 @@ const LuaUserdataMethod kWorldMethods[] = {
      {{"fn", "Callback function(handle_a, handle_b)", "function"}},
      {}},
     {"update",
-     "Updates the collision world (rebuilds broad phase, fires triggers)",
+     "Detects trigger overlaps and fires the enter and exit callbacks",
      {},
      {}},
 };
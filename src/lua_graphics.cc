@@ -99,7 +99,10 @@ static const LuaApiFunction kGraphicsLib[] = {
      }},
     {"draw_sprite",
      "Draws a sprite by name to the screen",
-     {{"sprite", "the name of the sprite in any sprite sheet", "string"},
+     {{"sprite",
+       "the name of the sprite in any sprite sheet, or a handle from "
+       "G.assets.sprite_handle",
+       "string|sprite_handle"},
       {"x",
        "the x position (left-right) in screen coordinates where to draw the "
        "sprite",
@@ -112,11 +115,15 @@ static const LuaApiFunction kGraphicsLib[] = {
      {},
      [](lua_State* state) {
        const int parameters = lua_gettop(state);
-       std::string_view sprite_name = GetLuaString(state, 1);
        const FVec2 pos = CheckVec2(state, 2);
        float angle = 0;
        if (parameters == 4) angle = luaL_checknumber(state, 4);
        auto* renderer = Registry<Renderer>::Retrieve(state);
+       if (lua_type(state, 1) == LUA_TUSERDATA) {
+         renderer->DrawSprite(*AsUserdata<SpriteHandle>(state, 1), pos, angle);
+         return 0;
+       }
+       std::string_view sprite_name = GetLuaString(state, 1);
        auto result = renderer->DrawSprite(sprite_name, pos, angle);
        if (result.is_error()) {
          LUA_ERROR(state, result.error().message());
@@ -149,6 +156,85 @@ static const LuaApiFunction kGraphicsLib[] = {
        }
        return 0;
      }},
+    {"draw_sprite_instances",
+     "Draws many sprites of one texture in a single draw call, with the "
+     "current color, transform and blend mode. Each sprite is 40 bytes: "
+     "nine floats (center x and y, width, height, texture coordinates u0, "
+     "v0 of the top-left and u1, v1 of the bottom-right corner, angle in "
+     "radians) and four color bytes (r, g, b, a), as packed by "
+     "G.data.pack('fffffffffBBBB', values).",
+     {{"texture", "the name of an image or sprite sheet", "string"},
+      {"sprites", "a string or byte buffer with the packed sprites",
+       "string"}},
+     {},
+     [](lua_State* state) {
+       std::string_view texture = GetLuaString(state, 1);
+       std::string_view data;
+       if (lua_type(state, 2) == LUA_TUSERDATA) {
+         auto* buf = AsUserdata<ByteBuffer>(state, 2);
+         data = std::string_view(reinterpret_cast<const char*>(buf->contents),
+                                 buf->size);
+       } else {
+         data = GetLuaString(state, 2);
+       }
+       if (data.size() % sizeof(SpriteInstanceData) != 0) {
+         LUA_ERROR(state, "Sprite data must be a multiple of ",
+                   sizeof(SpriteInstanceData), " bytes, got ", data.size());
+       }
+       auto* renderer = Registry<Renderer>::Retrieve(state);
+       if (!renderer->SetImageTexture(texture)) {
+         LUA_ERROR(state, "Unknown texture ", texture);
+       }
+       // The bytes are copied into the frame, so alignment does not matter.
+       Registry<BatchRenderer>::Retrieve(state)->DrawSpriteInstances(
+           reinterpret_cast<const SpriteInstanceData*>(data.data()),
+           data.size() / sizeof(SpriteInstanceData));
+       return 0;
+     }},
+    {"draw_batch",
+     "Draws many sprites or rectangles from packed records in one call. "
+     "Format 'sprite' records are 20 bytes: sprite id (from "
+     "G.assets.sprite_id), center x, y and angle, then r, g, b, a bytes, "
+     "as packed by G.data.pack('IfffBBBB', values). Format 'rect' records "
+     "are 24 bytes: x1, y1, x2, y2 and angle, then r, g, b, a bytes "
+     "('fffffBBBB'). Each record uses its own color; the current color is "
+     "kept.",
+     {{"buffer", "a byte buffer or string with the records", "byte_buffer"},
+      {"count", "how many records to draw", "integer"},
+      {"format", "'sprite' or 'rect'", "string"}},
+     {},
+     [](lua_State* state) {
+       std::string_view data;
+       if (lua_type(state, 1) == LUA_TSTRING) {
+         data = GetLuaString(state, 1);
+       } else {
+         auto* buf = AsUserdata<ByteBuffer>(state, 1);
+         data = std::string_view(reinterpret_cast<const char*>(buf->contents),
+                                 buf->size);
+       }
+       const lua_Integer count = luaL_checkinteger(state, 2);
+       std::string_view format_name = GetLuaString(state, 3);
+       DrawRecordFormat format = kSpriteRecords;
+       size_t record_size = sizeof(SpriteDrawRecord);
+       if (format_name == "rect") {
+         format = kRectRecords;
+         record_size = sizeof(RectDrawRecord);
+       } else if (format_name != "sprite") {
+         LUA_ERROR(state, "Unknown draw_batch format ", format_name);
+       }
+       const size_t capacity = data.size() / record_size;
+       if (count < 0 || static_cast<size_t>(count) > capacity) {
+         LUA_ERROR(state, "Buffer of ", data.size(), " bytes does not hold ",
+                   count, " ", format_name, " records");
+       }
+       auto* renderer = Registry<Renderer>::Retrieve(state);
+       auto result = renderer->DrawBatch(
+           format, reinterpret_cast<const uint8_t*>(data.data()), count);
+       if (result.is_error()) {
+         LUA_ERROR(state, result.error().message());
+       }
+       return 0;
+     }},
     {"draw_rect",
      "Draws a solid rectangle to the screen, with the color provided by the "
      "global context",
@@ -801,9 +887,20 @@ static const LuaApiFunction kGraphicsLib[] = {
        shaders->UseProgram(program_name);
        return 0;
      }},
+    {"uniform",
+     "Returns a handle for a uniform name. Pass it instead of the name to "
+     "send_uniform, has_uniform and send_as_uniform to skip hashing the "
+     "name on every call.",
+     {{"name", "Name of the uniform", "string"}},
+     {{"handle", "Handle of the name", "integer"}},
+     [](lua_State* state) {
+       lua_pushinteger(state, StringIntern(GetLuaString(state, 1)));
+       return 1;
+     }},
     {"send_uniform",
      "Sends a uniform with the given name to the current shader",
-     {{"name", "Name of the uniform to send", "string"},
+     {{"name", "Name of the uniform to send, or its handle from uniform",
+       "string|integer"},
       {"value",
        "Value to send. Supported values are G.math.v2,v3,v4, G.math.m2x2, "
        "G.math.m3x3, G.math.m4x4, and floats",
@@ -811,13 +908,13 @@ static const LuaApiFunction kGraphicsLib[] = {
      {},
      [](lua_State* state) {
        auto* shaders = Registry<Shaders>::Retrieve(state);
-       const char* name = luaL_checkstring(state, 1);
+       const uint32_t name = CheckStringHandle(state, 1);
        if (lua_isnumber(state, 2)) {
          auto uniform_result =
              shaders->SetUniformF(name, luaL_checknumber(state, 2));
          if (uniform_result.is_error()) {
-           LUA_ERROR(state, "Could not set uniform ", name, ": ",
-                     uniform_result.error().message());
+           LUA_ERROR(state, "Could not set uniform ", StringByHandle(name),
+                     ": ", uniform_result.error().message());
          }
        } else {
          if (!lua_getmetatable(state, 2)) {
@@ -835,12 +932,12 @@ static const LuaApiFunction kGraphicsLib[] = {
      }},
     {"has_uniform",
      "Returns true if the current shader has a uniform with the given name",
-     {{"name", "Name of the uniform to check", "string"}},
+     {{"name", "Name of the uniform to check, or its handle from uniform",
+       "string|integer"}},
      {{"exists", "Whether the uniform exists", "boolean"}},
      [](lua_State* state) {
        auto* shaders = Registry<Shaders>::Retrieve(state);
-       const char* name = luaL_checkstring(state, 1);
-       lua_pushboolean(state, shaders->HasUniform(name));
+       lua_pushboolean(state, shaders->HasUniform(CheckStringHandle(state, 1)));
        return 1;
      }},
     {"set_scissor",
@@ -987,6 +1084,36 @@ static const LuaApiFunction kGraphicsLib[] = {
        }
        return 0;
      }},
+    {"set_layer",
+     "Set the layer for subsequent drawing operations. Only used when draw "
+     "sorting is enabled: lower layers are drawn first.",
+     {{"layer", "Layer between -32768 and 32767 (default 0)", "integer"}},
+     {},
+     [](lua_State* state) {
+       auto* batch = Registry<BatchRenderer>::Retrieve(state);
+       const lua_Integer layer = luaL_checkinteger(state, 1);
+       if (layer < BatchRenderer::kMinLayer ||
+           layer > BatchRenderer::kMaxLayer) {
+         LUA_ERROR(state, "Layer ", layer, " is out of range [",
+                   BatchRenderer::kMinLayer, ", ", BatchRenderer::kMaxLayer,
+                   "]");
+       }
+       batch->SetLayer(static_cast<int>(layer));
+       return 0;
+     }},
+    {"set_draw_sorting",
+     "Enable or disable draw sorting. When enabled, sprites and shapes are "
+     "drawn by layer and, within a layer, grouped by shader, blend mode and "
+     "texture to reduce draw calls, so overlapping draws on the same layer "
+     "may change order. Canvas, scissor, stencil, clear, line and particle "
+     "calls keep their position.",
+     {{"enabled", "Whether to sort draws", "boolean"}},
+     {},
+     [](lua_State* state) {
+       auto* batch = Registry<BatchRenderer>::Retrieve(state);
+       batch->SetDrawSorting(lua_toboolean(state, 1));
+       return 0;
+     }},
     {"set_default_filter",
      "Sets the texture filter mode for newly loaded textures. Use 'nearest' "
      "for pixel art (crisp pixels) or 'linear' for smooth graphics.",
@@ -1198,6 +1325,7 @@ constexpr luaL_Reg kCanvasMethods[] = {
      }},
     {"__gc",
      [](lua_State* state) {
+       Registry<BatchRenderer>::Retrieve(state)->ClaimGlContext();
        AsUserdata<Canvas>(state, 1)->Destroy();
        return 0;
      }},
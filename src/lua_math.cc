@@ -47,6 +47,60 @@ T FromLuaMatrix(lua_State* state, int index) {
   return result;
 }
 
+// In-place vector methods. They overwrite the receiver and return it, so
+// update loops can chain them without allocating a userdata per result.
+template <typename V>
+int SetInPlace(lua_State* state) {
+  auto* v = AsUserdata<V>(state, 1);
+  for (size_t i = 0; i < V::kCardinality; ++i) {
+    v->v[i] = luaL_checknumber(state, i + 2);
+  }
+  lua_settop(state, 1);
+  return 1;
+}
+
+template <typename V>
+int AddInPlace(lua_State* state) {
+  auto* v = AsUserdata<V>(state, 1);
+  *v = *v + *AsUserdata<V>(state, 2);
+  lua_settop(state, 1);
+  return 1;
+}
+
+template <typename V>
+int SubInPlace(lua_State* state) {
+  auto* v = AsUserdata<V>(state, 1);
+  *v = *v - *AsUserdata<V>(state, 2);
+  lua_settop(state, 1);
+  return 1;
+}
+
+template <typename V>
+int ScaleInPlace(lua_State* state) {
+  auto* v = AsUserdata<V>(state, 1);
+  *v = *v * static_cast<float>(luaL_checknumber(state, 2));
+  lua_settop(state, 1);
+  return 1;
+}
+
+template <typename V>
+int NormalizeInPlace(lua_State* state) {
+  auto* v = AsUserdata<V>(state, 1);
+  *v = v->Normalized();
+  lua_settop(state, 1);
+  return 1;
+}
+
+template <typename V>
+int LerpInPlace(lua_State* state) {
+  auto* v = AsUserdata<V>(state, 1);
+  auto* w = AsUserdata<V>(state, 2);
+  const float t = luaL_checknumber(state, 3);
+  *v = *v + (*w - *v) * t;
+  lua_settop(state, 1);
+  return 1;
+}
+
 const struct LuaApiFunction kMathLib[] = {
     {"clamp",
      "Clamps a value between a minimum and maximum",
@@ -173,6 +227,43 @@ const struct LuaApiFunction kMathLib[] = {
        lua_pushnumber(state, std::sin(angle) * mag);
        return 2;
      }},
+    {"length",
+     "Length of the 2D vector (x, y), without creating a vec2",
+     {{"x", "x component", "number"}, {"y", "y component", "number"}},
+     {{"length", "length", "number"}},
+     [](lua_State* state) {
+       const float x = luaL_checknumber(state, 1);
+       const float y = luaL_checknumber(state, 2);
+       lua_pushnumber(state, std::sqrt(x * x + y * y));
+       return 1;
+     }},
+    {"normalize",
+     "Normalizes the 2D vector (x, y), without creating a vec2",
+     {{"x", "x component", "number"}, {"y", "y component", "number"}},
+     {{"x", "normalized x", "number"}, {"y", "normalized y", "number"}},
+     [](lua_State* state) {
+       const FVec2 v =
+           FVec(luaL_checknumber(state, 1), luaL_checknumber(state, 2))
+               .Normalized();
+       lua_pushnumber(state, v.x);
+       lua_pushnumber(state, v.y);
+       return 2;
+     }},
+    {"rotate",
+     "Rotates the 2D vector (x, y) by an angle, without creating a vec2",
+     {{"x", "x component", "number"},
+      {"y", "y component", "number"},
+      {"angle", "rotation in radians", "number"}},
+     {{"x", "rotated x", "number"}, {"y", "rotated y", "number"}},
+     [](lua_State* state) {
+       const float x = luaL_checknumber(state, 1);
+       const float y = luaL_checknumber(state, 2);
+       const float angle = luaL_checknumber(state, 3);
+       const float c = std::cos(angle), s = std::sin(angle);
+       lua_pushnumber(state, x * c - y * s);
+       lua_pushnumber(state, x * s + y * c);
+       return 2;
+     }},
     {"smoothstep",
      "Hermite smoothstep interpolation between edge0 and edge1",
      {{"edge0", "lower edge", "number"},
@@ -305,6 +396,28 @@ const struct LuaApiFunction kMathLib[] = {
      }}};
 
 constexpr luaL_Reg kV2Methods[] = {
+    {"set", SetInPlace<FVec2>},
+    {"add_", AddInPlace<FVec2>},
+    {"sub_", SubInPlace<FVec2>},
+    {"scale_", ScaleInPlace<FVec2>},
+    {"normalize_", NormalizeInPlace<FVec2>},
+    {"lerp_", LerpInPlace<FVec2>},
+    {"rotate_",
+     [](lua_State* state) {
+       auto* v = AsUserdata<FVec2>(state, 1);
+       const float angle = luaL_checknumber(state, 2);
+       const float c = std::cos(angle), s = std::sin(angle);
+       *v = FVec(v->x * c - v->y * s, v->x * s + v->y * c);
+       lua_settop(state, 1);
+       return 1;
+     }},
+    {"perpendicular_",
+     [](lua_State* state) {
+       auto* v = AsUserdata<FVec2>(state, 1);
+       *v = FVec(-v->y, v->x);
+       lua_settop(state, 1);
+       return 1;
+     }},
     {"dot",
      [](lua_State* state) {
        auto* a = AsUserdata<FVec2>(state, 1);
@@ -449,17 +562,23 @@ constexpr luaL_Reg kV2Methods[] = {
      }},
     {"send_as_uniform", [](lua_State* state) {
        auto* v = AsUserdata<FVec2>(state, 1);
-       const char* name = luaL_checkstring(state, 2);
+       const uint32_t name = CheckStringHandle(state, 2);
        auto* shaders = Registry<Shaders>::Retrieve(state);
        auto result = shaders->SetUniform(name, *v);
        if (result.is_error()) {
-         LUA_ERROR(state, "Could not set uniform '", name,
+         LUA_ERROR(state, "Could not set uniform '", StringByHandle(name),
                    "': ", result.error().message());
        }
        return 0;
      }}};
 
 constexpr luaL_Reg kV3Methods[] = {
+    {"set", SetInPlace<FVec3>},
+    {"add_", AddInPlace<FVec3>},
+    {"sub_", SubInPlace<FVec3>},
+    {"scale_", ScaleInPlace<FVec3>},
+    {"normalize_", NormalizeInPlace<FVec3>},
+    {"lerp_", LerpInPlace<FVec3>},
     {"dot",
      [](lua_State* state) {
        auto* a = AsUserdata<FVec3>(state, 1);
@@ -545,17 +664,23 @@ constexpr luaL_Reg kV3Methods[] = {
      }},
     {"send_as_uniform", [](lua_State* state) {
        auto* v = AsUserdata<FVec3>(state, 1);
-       const char* name = luaL_checkstring(state, 2);
+       const uint32_t name = CheckStringHandle(state, 2);
        auto* shaders = Registry<Shaders>::Retrieve(state);
        auto result = shaders->SetUniform(name, *v);
        if (result.is_error()) {
-         LUA_ERROR(state, "Could not set uniform '", name,
+         LUA_ERROR(state, "Could not set uniform '", StringByHandle(name),
                    "': ", result.error().message());
        }
        return 0;
      }}};
 
 constexpr luaL_Reg kV4Methods[] = {
+    {"set", SetInPlace<FVec4>},
+    {"add_", AddInPlace<FVec4>},
+    {"sub_", SubInPlace<FVec4>},
+    {"scale_", ScaleInPlace<FVec4>},
+    {"normalize_", NormalizeInPlace<FVec4>},
+    {"lerp_", LerpInPlace<FVec4>},
     {"dot",
      [](lua_State* state) {
        auto* a = AsUserdata<FVec4>(state, 1);
@@ -643,11 +768,11 @@ constexpr luaL_Reg kV4Methods[] = {
      }},
     {"send_as_uniform", [](lua_State* state) {
        auto* v = AsUserdata<FVec4>(state, 1);
-       const char* name = luaL_checkstring(state, 2);
+       const uint32_t name = CheckStringHandle(state, 2);
        auto* shaders = Registry<Shaders>::Retrieve(state);
        auto result = shaders->SetUniform(name, *v);
        if (result.is_error()) {
-         LUA_ERROR(state, "Could not set uniform '", name,
+         LUA_ERROR(state, "Could not set uniform '", StringByHandle(name),
                    "': ", result.error().message());
        }
        return 0;
@@ -656,11 +781,11 @@ constexpr luaL_Reg kV4Methods[] = {
 constexpr luaL_Reg kM2x2Methods[] = {
     {"send_as_uniform", [](lua_State* state) {
        auto* v = AsUserdata<FMat2x2>(state, 1);
-       const char* name = luaL_checkstring(state, 2);
+       const uint32_t name = CheckStringHandle(state, 2);
        auto* shaders = Registry<Shaders>::Retrieve(state);
        auto result = shaders->SetUniform(name, *v);
        if (result.is_error()) {
-         LUA_ERROR(state, "Could not set uniform '", name,
+         LUA_ERROR(state, "Could not set uniform '", StringByHandle(name),
                    "': ", result.error().message());
        }
        return 0;
@@ -669,11 +794,11 @@ constexpr luaL_Reg kM2x2Methods[] = {
 constexpr luaL_Reg kM3x3Methods[] = {
     {"send_as_uniform", [](lua_State* state) {
        auto* v = AsUserdata<FMat3x3>(state, 1);
-       const char* name = luaL_checkstring(state, 2);
+       const uint32_t name = CheckStringHandle(state, 2);
        auto* shaders = Registry<Shaders>::Retrieve(state);
        auto result = shaders->SetUniform(name, *v);
        if (result.is_error()) {
-         LUA_ERROR(state, "Could not set uniform '", name,
+         LUA_ERROR(state, "Could not set uniform '", StringByHandle(name),
                    "': ", result.error().message());
        }
        return 0;
@@ -682,11 +807,11 @@ constexpr luaL_Reg kM3x3Methods[] = {
 constexpr luaL_Reg kM4x4Methods[] = {
     {"send_as_uniform", [](lua_State* state) {
        auto* v = AsUserdata<FMat4x4>(state, 1);
-       const char* name = luaL_checkstring(state, 2);
+       const uint32_t name = CheckStringHandle(state, 2);
        auto* shaders = Registry<Shaders>::Retrieve(state);
        auto result = shaders->SetUniform(name, *v);
        if (result.is_error()) {
-         LUA_ERROR(state, "Could not set uniform '", name,
+         LUA_ERROR(state, "Could not set uniform '", StringByHandle(name),
                    "': ", result.error().message());
        }
        return 0;
@@ -721,8 +846,37 @@ const LuaUserdataMethod kVecMethods[] = {
      {{"x", "x component", "number"}, {"y", "y component", "number"}}},
     {"send_as_uniform",
      "Sends this value as a shader uniform. Errors if uniform not found.",
-     {{"name", "uniform name", "string"}},
+     {{"name", "uniform name, or its handle from G.graphics.uniform",
+       "string|integer"}},
      {}},
+    {"set",
+     "Overwrites the components in place and returns self",
+     {{"x", "x component", "number"},
+      {"y", "y component", "number"},
+      {"z", "z component", "number"},
+      {"w?", "w component, vec4 only", "number"}},
+     {{"self", "this vector", "self"}}},
+    {"add_",
+     "Adds another vector in place and returns self",
+     {{"other", "the other vector", "self"}},
+     {{"self", "this vector", "self"}}},
+    {"sub_",
+     "Subtracts another vector in place and returns self",
+     {{"other", "the other vector", "self"}},
+     {{"self", "this vector", "self"}}},
+    {"scale_",
+     "Multiplies by a number in place and returns self",
+     {{"factor", "the scale factor", "number"}},
+     {{"self", "this vector", "self"}}},
+    {"normalize_",
+     "Normalizes in place and returns self",
+     {},
+     {{"self", "this vector", "self"}}},
+    {"lerp_",
+     "Moves towards another vector in place and returns self",
+     {{"other", "target vector", "self"},
+      {"t", "interpolation factor (0-1)", "number"}},
+     {{"self", "this vector", "self"}}},
 };
 
 // Vec2-specific methods (not on vec3/vec4).
@@ -759,6 +913,39 @@ const LuaUserdataMethod kVec2ExtraMethods[] = {
      "Projects this vector onto another",
      {{"onto", "vector to project onto", "vec2"}},
      {{"result", "projected vector", "vec2"}}},
+    {"set",
+     "Overwrites x and y in place and returns self",
+     {{"x", "x component", "number"}, {"y", "y component", "number"}},
+     {{"self", "this vector", "vec2"}}},
+    {"add_",
+     "Adds another vector in place and returns self",
+     {{"other", "the other vector", "vec2"}},
+     {{"self", "this vector", "vec2"}}},
+    {"sub_",
+     "Subtracts another vector in place and returns self",
+     {{"other", "the other vector", "vec2"}},
+     {{"self", "this vector", "vec2"}}},
+    {"scale_",
+     "Multiplies by a number in place and returns self",
+     {{"factor", "the scale factor", "number"}},
+     {{"self", "this vector", "vec2"}}},
+    {"normalize_",
+     "Normalizes in place and returns self",
+     {},
+     {{"self", "this vector", "vec2"}}},
+    {"lerp_",
+     "Moves towards another vector in place and returns self",
+     {{"other", "target vector", "vec2"},
+      {"t", "interpolation factor (0-1)", "number"}},
+     {{"self", "this vector", "vec2"}}},
+    {"rotate_",
+     "Rotates in place and returns self",
+     {{"angle", "rotation in radians", "number"}},
+     {{"self", "this vector", "vec2"}}},
+    {"perpendicular_",
+     "Replaces the vector with (-y, x) and returns self",
+     {},
+     {{"self", "this vector", "vec2"}}},
 };
 
 const LuaUserdataOperator kVecOperators[] = {
@@ -771,7 +958,8 @@ const LuaUserdataOperator kVecOperators[] = {
 const LuaUserdataMethod kMatMethods[] = {
     {"send_as_uniform",
      "Sends this matrix as a shader uniform. Errors if uniform not found.",
-     {{"name", "uniform name", "string"}},
+     {{"name", "uniform name, or its handle from G.graphics.uniform",
+       "string|integer"}},
      {}},
 };
 
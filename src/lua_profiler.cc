@@ -0,0 +1,201 @@
+#include "lua_profiler.h"
+
+#include <physfs.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "array.h"
+#include "clock.h"
+#include "constants.h"
+#include "defer.h"
+#include "logging.h"
+#include "string_table.h"
+#include "stringlib.h"
+
+namespace G {
+namespace {
+
+uint32_t InternFrame(const lua_Debug& ar) {
+  FixedStringBuffer<kMaxLogLineLength> label(kTruncating);
+  if (ar.name != nullptr) {
+    label.Append(ar.name);
+  } else if (std::strcmp(ar.what, "main") == 0) {
+    label.Append("(main chunk)");
+  } else {
+    label.Append("?");
+  }
+  if (ar.linedefined > 0) {
+    label.Append(" ", ar.short_src, ":", ar.linedefined);
+  } else {
+    label.Append(" ", ar.short_src);
+  }
+  return StringIntern(label.str());
+}
+
+}  // namespace
+
+LuaProfiler::~LuaProfiler() {
+  if (running()) Stop();
+  if (samples_ != nullptr) allocator_->DeallocArray(samples_, kMaxSamples);
+}
+
+void LuaProfiler::Start(lua_State* state, double interval_ms) {
+  CHECK(!running(), "Lua profiler already started");
+  if (samples_ == nullptr) {
+    samples_ = allocator_->NewArray<Sample>(kMaxSamples);
+  }
+  write_pos_ = 0;
+  count_ = 0;
+  interval_ = interval_ms / 1000.0;
+  next_sample_ = 0;
+  state_ = state;
+  Registry<LuaProfiler>::Register(state, this);
+  lua_sethook(state, &LuaProfiler::Hook, LUA_MASKCOUNT, kHookInstructions);
+}
+
+void LuaProfiler::Stop() {
+  if (!running()) return;
+  lua_sethook(state_, nullptr, 0, 0);
+  state_ = nullptr;
+}
+
+void LuaProfiler::StartSession(lua_State* state) {
+  Start(state);
+  Profiler* profiler = GetProfiler();
+  owns_trace_ = !profiler->recording();
+  if (owns_trace_) profiler->ToggleRecording();
+  LOG("Lua profiler: started");
+}
+
+void LuaProfiler::StopSession() {
+  Stop();
+  LOG("Lua profiler: stopped with ", count_, " samples");
+  // Recording is restarted if it was stopped (F11) during the session.
+  Profiler* profiler = GetProfiler();
+  const bool flush_trace = owns_trace_ || !profiler->recording();
+  if (!profiler->recording()) profiler->ToggleRecording();
+  AddTraceEvents(profiler);
+  if (flush_trace) profiler->ToggleRecording();
+  owns_trace_ = false;
+
+  const char* write_dir = PHYSFS_getWriteDir();
+  if (write_dir == nullptr) {
+    LOG("Lua profiler: no PhysFS write directory set");
+    return;
+  }
+  FixedStringBuffer<kMaxPathLength> path(write_dir, "lua.folded");
+  FILE* f = fopen(path.str(), "w");
+  if (f == nullptr) {
+    LOG("Lua profiler: failed to open ", path.str(), " for writing");
+    return;
+  }
+  DEFER([f] { fclose(f); });
+  WriteFolded(f);
+  LOG("Lua profiler: wrote ", path.str());
+}
+
+void LuaProfiler::Toggle(lua_State* state) {
+  if (running()) {
+    StopSession();
+  } else {
+    StartSession(state);
+  }
+}
+
+void LuaProfiler::Hook(lua_State* state, lua_Debug*) {
+  auto* profiler = Registry<LuaProfiler>::Retrieve(state);
+  const double now = NowInSeconds();
+  if (now < profiler->next_sample_) return;
+  profiler->next_sample_ = now + profiler->interval_;
+  profiler->TakeSample(state);
+}
+
+void LuaProfiler::TakeSample(lua_State* state) {
+  // lua_getstack numbers the frames from the innermost one.
+  uint32_t frames[kMaxDepth];
+  uint32_t depth = 0;
+  lua_Debug ar;
+  for (int level = 0; depth < kMaxDepth && lua_getstack(state, level, &ar);
+       ++level) {
+    lua_getinfo(state, "Sn", &ar);
+    frames[depth++] = InternFrame(ar);
+  }
+  if (depth == 0) return;
+  Sample& sample = samples_[write_pos_];
+  write_pos_ = (write_pos_ + 1) % kMaxSamples;
+  if (count_ < kMaxSamples) count_++;
+  sample.time = NowInSeconds();
+  sample.depth = depth;
+  for (uint32_t i = 0; i < depth; ++i) {
+    sample.frames[i] = frames[depth - 1 - i];
+  }
+}
+
+void LuaProfiler::WriteFolded(FILE* f) {
+  if (count_ == 0) return;
+  auto same_stack = [](const Sample& a, const Sample& b) {
+    return a.depth == b.depth &&
+           std::memcmp(a.frames, b.frames, a.depth * sizeof(uint32_t)) == 0;
+  };
+  // Sorted so that equal stacks are adjacent and can be counted in a pass.
+  FixedArray<uint32_t> order(count_, allocator_);
+  for (size_t i = 0; i < count_; ++i) order.Push(i);
+  std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    const Sample& x = SampleAt(a);
+    const Sample& y = SampleAt(b);
+    return std::lexicographical_compare(x.frames, x.frames + x.depth,
+                                        y.frames, y.frames + y.depth);
+  });
+  for (size_t i = 0; i < count_;) {
+    const Sample& sample = SampleAt(order[i]);
+    size_t run = 1;
+    while (i + run < count_ && same_stack(sample, SampleAt(order[i + run]))) {
+      run++;
+    }
+    for (uint32_t d = 0; d < sample.depth; ++d) {
+      const std::string_view label = StringByHandle(sample.frames[d]);
+      fprintf(f, "%s%.*s", d == 0 ? "" : ";", static_cast<int>(label.size()),
+              label.data());
+    }
+    fprintf(f, " %zu\n", run);
+    i += run;
+  }
+}
+
+void LuaProfiler::AddTraceEvents(Profiler* profiler) {
+  uint32_t open[kMaxDepth];
+  double start[kMaxDepth];
+  uint32_t open_depth = 0;
+  auto close_to = [&](uint32_t depth, double end) {
+    while (open_depth > depth) {
+      --open_depth;
+      profiler->AddEvent(StringByHandle(open[open_depth]), "lua",
+                         start[open_depth], end - start[open_depth],
+                         kTraceTid);
+    }
+  };
+  double last = 0;
+  for (size_t i = 0; i < count_; ++i) {
+    const Sample& sample = SampleAt(i);
+    // Lua was not running in between (the engine's own work, or the end of
+    // the frame): close everything one interval after the previous sample.
+    if (open_depth > 0 && sample.time - last > 2 * interval_) {
+      close_to(0, last + interval_);
+    }
+    uint32_t common = 0;
+    while (common < open_depth && common < sample.depth &&
+           open[common] == sample.frames[common]) {
+      common++;
+    }
+    close_to(common, sample.time);
+    for (; open_depth < sample.depth; ++open_depth) {
+      open[open_depth] = sample.frames[open_depth];
+      start[open_depth] = sample.time;
+    }
+    last = sample.time;
+  }
+  close_to(0, last + interval_);
+}
+
+}  // namespace G
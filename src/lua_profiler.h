@@ -0,0 +1,101 @@
+#pragma once
+#ifndef _GAME_LUA_PROFILER_H
+#define _GAME_LUA_PROFILER_H
+
+#include <cstdint>
+#include <cstdio>
+
+#include "allocators.h"
+#include "lua.h"  // For lua_State and lua_Debug.
+#include "profiler.h"
+
+namespace G {
+
+// Sampling profiler for Lua code. Installs a count hook that, at most once
+// per sampling interval, records the Lua call stack into a ring buffer.
+// Each frame is interned as "name chunk:line", with the line the function
+// was defined on, so all samples of a function share one entry.
+//
+// Only code running on the main state, or on coroutines created after
+// Start, is sampled: Lua 5.1 hooks are per thread and copied on creation.
+class LuaProfiler {
+ public:
+  // Holds ~16 seconds of Lua execution at the default interval.
+  static constexpr size_t kMaxSamples = 1 << 14;
+  // Frames past this depth, counting from the innermost, are dropped.
+  static constexpr uint32_t kMaxDepth = 32;
+  // VM instructions between two checks of the clock.
+  static constexpr int kHookInstructions = 1000;
+  // Thread id of the sampled stacks in the Chrome trace.
+  static constexpr uint32_t kTraceTid = 1;
+
+  explicit LuaProfiler(Allocator* allocator) : allocator_(allocator) {}
+  ~LuaProfiler();
+
+  LuaProfiler(const LuaProfiler&) = delete;
+  LuaProfiler& operator=(const LuaProfiler&) = delete;
+
+  // Clears the samples and starts sampling `state` every `interval_ms`.
+  void Start(lua_State* state, double interval_ms = 1.0);
+
+  // Removes the hook. The samples are kept until the next Start.
+  void Stop();
+
+  // Start, also starting the global Profiler if it is not recording so
+  // that StopSession can write a trace.
+  void StartSession(lua_State* state);
+
+  // Stop, then writes lua.folded to the write directory and adds the
+  // samples to the global Profiler. Flushes its trace.json unless someone
+  // else started the recording.
+  void StopSession();
+
+  // Starts or stops a session on `state`.
+  void Toggle(lua_State* state);
+
+  bool running() const { return state_ != nullptr; }
+
+  // Samples in the buffer, at most kMaxSamples.
+  size_t sample_count() const { return count_; }
+
+  // Writes one "outer;...;inner count" line per distinct stack, the input
+  // format of flamegraph.pl, inferno and speedscope.
+  void WriteFolded(FILE* f);
+
+  // Adds the samples to `profiler` as nested duration events. A frame spans
+  // the consecutive samples it appears in, so short calls between two
+  // samples are not visible.
+  void AddTraceEvents(Profiler* profiler);
+
+ private:
+  struct Sample {
+    double time;
+    uint32_t depth;
+    // Interned frame labels, outermost first.
+    uint32_t frames[kMaxDepth];
+  };
+
+  static void Hook(lua_State* state, lua_Debug* ar);
+
+  // Records the current stack of `state`.
+  void TakeSample(lua_State* state);
+
+  // Returns the i-th sample, oldest first.
+  const Sample& SampleAt(size_t i) const {
+    const size_t start = count_ == kMaxSamples ? write_pos_ : 0;
+    return samples_[(start + i) % kMaxSamples];
+  }
+
+  Allocator* allocator_;
+  Sample* samples_ = nullptr;
+  size_t write_pos_ = 0;
+  size_t count_ = 0;
+  lua_State* state_ = nullptr;
+  double interval_ = 0;
+  double next_sample_ = 0;
+  bool owns_trace_ = false;
+};
+
+}  // namespace G
+
+#endif  // _GAME_LUA_PROFILER_H
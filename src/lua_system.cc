@@ -125,6 +125,17 @@ const struct LuaApiFunction kSystemLib[] = {
        auto* lua = Registry<Lua>::Retrieve(state);
        lua_pushnumber(state, lua->RealTime());
        return 1;
+     }},
+    {"dump_bindings",
+     "Writes the call count and time of every G.* function called so far "
+     "to bindings.tsv in the write directory. Needs a build with "
+     "-DENABLE_BINDING_PROFILER=ON",
+     {},
+     {{"ok", "true if the file was written", "boolean"}},
+     [](lua_State* state) {
+       auto* lua = Registry<Lua>::Retrieve(state);
+       lua_pushboolean(state, lua->DumpBindingProfiles());
+       return 1;
      }}};
 
 const struct LuaApiFunction kClockLib[] = {
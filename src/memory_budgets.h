@@ -21,7 +21,6 @@ inline constexpr size_t kEngineArenaSize = Megabytes(256);
 inline constexpr size_t kLuaArenaSize = Megabytes(96);
 inline constexpr size_t kFrameArenaSize = Megabytes(64);
 inline constexpr size_t kRenderCommandMemory = Megabytes(24);
-inline constexpr size_t kRenderScratchSize = Megabytes(24);
 inline constexpr size_t kThirdPartyHeapSize = Megabytes(32);
 inline constexpr size_t kCliArenaSize = Megabytes(32);
 inline constexpr size_t kSqliteHeapSize = Megabytes(16);
@@ -30,7 +29,6 @@ inline constexpr size_t kEngineArenaSize = Gigabytes(4);
 inline constexpr size_t kLuaArenaSize = Megabytes(256);
 inline constexpr size_t kFrameArenaSize = Megabytes(128);
 inline constexpr size_t kRenderCommandMemory = Megabytes(64);
-inline constexpr size_t kRenderScratchSize = Megabytes(64);
 inline constexpr size_t kThirdPartyHeapSize = Megabytes(64);
 inline constexpr size_t kCliArenaSize = Gigabytes(1);
 inline constexpr size_t kSqliteHeapSize = Megabytes(32);
@@ -9,6 +9,10 @@ extern "C" {
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
+// lua_dump cannot drop debug info in Lua 5.1; luaU_dump (as used by luac)
+// takes a strip flag.
+#include <lobject.h>
+#include <lundump.h>
 }
 
 #include "clock.h"
@@ -24,6 +28,7 @@ extern "C" {
 #include "libraries/stb_vorbis.h"
 #include "libraries/yyjson.h"
 #include "physfs.h"
+#include "platform.h"
 #include "qoa.h"
 #include "schema.sql.h"
 #include "sqlite_helpers.h"
@@ -949,6 +954,69 @@ ErrorOr<AssetWriteResult> WriteAssetsToDb(const char* source_directory,
   return result;
 }
 
+ErrorOr<size_t> WriteScriptBytecode(sqlite3* db, BlobStore* blobs,
+                                    ScriptBytecode mode,
+                                    Allocator* allocator) {
+  SqlTransaction txn(db);
+  TRY(SqlExec(db, "DELETE FROM script_bytecode"));
+  if (mode == ScriptBytecode::kNone) return size_t{0};
+  // Everything is recompiled: it is cheap next to packing the other assets,
+  // and blobs that already exist are not rewritten.
+  SqlStmt scripts(db,
+                  "SELECT name, hash, size, blob_hash FROM asset_metadata "
+                  "WHERE type = 'script' AND name LIKE '%.lua'");
+  if (!scripts.ok()) return Error::Message("failed to query scripts");
+  SqlStmt insert(db,
+                 "INSERT INTO script_bytecode (name, source_hash, stripped, "
+                 "size, blob_hash) VALUES (?, ?, ?, ?, ?)");
+  if (!insert.ok()) return Error::Message("failed to prepare bytecode insert");
+  lua_State* state = luaL_newstate();
+  DEFER([state] { lua_close(state); });
+  ArenaAllocator scratch(allocator, Megabytes(16));
+  size_t compiled = 0;
+  while (TRY(scripts.Step())) {
+    const std::string_view name = scripts.ColumnText(0);
+    char blob_name[17];
+    FormatBlobName(static_cast<uint64_t>(scripts.ColumnInt64(3)), blob_name);
+    PathBuffer blob_path(blobs->directory(), "/", blob_name);
+    scratch.Reset();
+    uint8_t* source = nullptr;
+    const size_t size = TRY(ReadEntireFile(blob_path.str(), &source, &scratch));
+    if (size != static_cast<size_t>(scripts.ColumnInt64(2))) {
+      return Error::Message("script blob has the wrong size");
+    }
+    // Same chunk name as Lua::LoadLuaAsset, so errors point at the file.
+    FixedStringBuffer<kMaxPathLength + 1> chunk_name("@", name);
+    if (luaL_loadbuffer(state, reinterpret_cast<const char*>(source), size,
+                        chunk_name.str()) != 0) {
+      LOG("Failed to compile ", name, ": ", lua_tostring(state, -1));
+      return Error::Message("script does not compile");
+    }
+    DynArray<uint8_t> bytecode(&scratch);
+    auto* closure = static_cast<const Closure*>(lua_topointer(state, -1));
+    luaU_dump(
+        state, closure->l.p,
+        [](lua_State*, const void* p, size_t sz, void* ud) {
+          static_cast<DynArray<uint8_t>*>(ud)->Insert(
+              static_cast<const uint8_t*>(p), sz);
+          return 0;
+        },
+        &bytecode, /*strip=*/mode == ScriptBytecode::kStripped);
+    lua_pop(state, 1);
+    const uint64_t blob_hash =
+        TRY(blobs->Put(ByteSlice(bytecode.data(), bytecode.size())));
+    insert.BindText(1, name);
+    insert.BindInt64(2, scripts.ColumnInt64(1));
+    insert.BindInt(3, mode == ScriptBytecode::kStripped);
+    insert.BindInt64(4, bytecode.size());
+    insert.BindInt64(5, blob_hash);
+    TRY(insert.Step());
+    insert.Reset();
+    compiled++;
+  }
+  return compiled;
+}
+
 void InitializeAssetDb(sqlite3* db) {
   int version = 0;
   {
@@ -966,7 +1034,8 @@ void InitializeAssetDb(sqlite3* db) {
         "images",         "spritesheets",      "sprites",
         "audios",         "scripts",           "shaders",
         "fonts",          "text_files",        "proto_descriptors",
-        "asset_metadata", "compilation_cache", "sdf_cache"};
+        "asset_metadata", "compilation_cache", "sdf_cache",
+        "script_bytecode"};
     for (const char* table : kAssetTables) {
       SqlBuffer sql("DROP TABLE IF EXISTS ", table, ";");
       MUST(SqlExec(db, sql.str()));
@@ -16,7 +16,7 @@ namespace G {
 // Version of the asset database schema. Bump when the schema changes
 // incompatibly; dev caches are wiped and rebuilt, packaged games refuse to
 // start until re-packaged.
-inline constexpr int kAssetDbSchemaVersion = 2;
+inline constexpr int kAssetDbSchemaVersion = 3;
 
 struct AssetWriteResult {
   size_t written_files = 0;
@@ -29,6 +29,21 @@ ErrorOr<AssetWriteResult> WriteAssetsToDb(const char* source_directory,
                                           Allocator* allocator,
                                           Executor* executor);
 
+// How packaged builds ship .lua scripts.
+enum class ScriptBytecode {
+  kNone,       // Source only, compiled when the game starts.
+  kDebugInfo,  // Precompiled, keeping line info for error messages.
+  kStripped,   // Precompiled without debug info: smaller, no line numbers.
+};
+
+// Compiles every .lua script in asset_metadata to Lua bytecode, puts it in
+// the blob store and records it in script_bytecode, replacing any previous
+// rows. kNone only clears the table. Bytecode is tied to the word size of
+// the machine that compiles it, so it must only ship to matching targets.
+// Returns the number of scripts compiled.
+ErrorOr<size_t> WriteScriptBytecode(sqlite3* db, BlobStore* blobs,
+                                    ScriptBytecode mode, Allocator* allocator);
+
 // Creates the asset database schema. If the database was created by a
 // different schema version, drops all asset tables and rebuilds them.
 void InitializeAssetDb(sqlite3* db);
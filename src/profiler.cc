@@ -8,6 +8,7 @@
 #include "defer.h"
 #include "logging.h"
 #include "stringlib.h"
+#include "thread.h"
 
 namespace G {
 
@@ -18,55 +19,67 @@ Profiler* GetProfiler() {
 
 void Profiler::AddEvent(std::string_view name, std::string_view category,
                         double start, double duration, uint32_t tid) {
-  TraceEvent& e = events_[write_pos_ % kMaxEvents];
-  e.name = name;
-  e.category = category;
-  e.timestamp = start;
-  e.duration = duration;
-  e.thread_id = tid;
-  e.phase = kComplete;
-  e.counter_value = 0;
-  write_pos_++;
-  if (count_ < kMaxEvents) count_++;
+  Push(TraceEvent{.name = name,
+                  .category = category,
+                  .timestamp = start,
+                  .duration = duration,
+                  .thread_id = tid,
+                  .phase = kComplete,
+                  .counter_value = 0});
 }
 
 void Profiler::AddInstant(std::string_view name, std::string_view category,
                           uint32_t tid) {
-  TraceEvent& e = events_[write_pos_ % kMaxEvents];
-  e.name = name;
-  e.category = category;
-  e.timestamp = NowInSeconds();
-  e.duration = 0;
-  e.thread_id = tid;
-  e.phase = kInstant;
-  e.counter_value = 0;
-  write_pos_++;
-  if (count_ < kMaxEvents) count_++;
+  Push(TraceEvent{.name = name,
+                  .category = category,
+                  .timestamp = NowInSeconds(),
+                  .duration = 0,
+                  .thread_id = tid,
+                  .phase = kInstant,
+                  .counter_value = 0});
 }
 
 void Profiler::AddCounter(std::string_view name, double value, uint32_t tid) {
-  TraceEvent& e = events_[write_pos_ % kMaxEvents];
-  e.name = name;
-  e.category = "counters";
-  e.timestamp = NowInSeconds();
-  e.duration = 0;
-  e.thread_id = tid;
-  e.phase = kCounter;
-  e.counter_value = value;
+  Push(TraceEvent{.name = name,
+                  .category = "counters",
+                  .timestamp = NowInSeconds(),
+                  .duration = 0,
+                  .thread_id = tid,
+                  .phase = kCounter,
+                  .counter_value = value});
+}
+
+void Profiler::Push(const TraceEvent& event) {
+  LockMutex l(mu_);
+  // Dropped once recording stops, while the buffer is being written out.
+  if (!recording_) return;
+  events_[write_pos_ % kMaxEvents] = event;
   write_pos_++;
   if (count_ < kMaxEvents) count_++;
 }
 
 void Profiler::ToggleRecording() {
+  // Held across the flush so that recording cannot restart into the buffer
+  // while it is being written.
+  LockMutex toggle(toggle_mu_);
   if (recording_) {
-    recording_ = false;
-    Flush();
+    size_t write_pos, count;
+    {
+      LockMutex l(mu_);
+      recording_ = false;
+      write_pos = write_pos_;
+      count = count_;
+      write_pos_ = 0;
+      count_ = 0;
+    }
+    // Push no longer touches the buffer, so threads recording zones are
+    // not blocked on the file I/O.
+    Flush(write_pos, count);
     const char* write_dir = PHYSFS_getWriteDir();
-    LOG("Profiler: stopped recording, wrote ", count_, " events to ",
+    LOG("Profiler: stopped recording, wrote ", count, " events to ",
         write_dir ? write_dir : "", "trace.json");
-    write_pos_ = 0;
-    count_ = 0;
   } else {
+    LockMutex l(mu_);
     write_pos_ = 0;
     count_ = 0;
     recording_ = true;
@@ -74,8 +87,8 @@ void Profiler::ToggleRecording() {
   }
 }
 
-void Profiler::Flush() {
-  if (count_ == 0) return;
+void Profiler::Flush(size_t write_pos, size_t count) {
+  if (count == 0) return;
 
   const char* write_dir = PHYSFS_getWriteDir();
   if (write_dir == nullptr) {
@@ -93,8 +106,8 @@ void Profiler::Flush() {
   fputs("[\n", f);
 
   // Walk the ring buffer from oldest to newest.
-  size_t start = (count_ == kMaxEvents) ? write_pos_ : 0;
-  for (size_t i = 0; i < count_; ++i) {
+  size_t start = (count == kMaxEvents) ? write_pos : 0;
+  for (size_t i = 0; i < count; ++i) {
     const TraceEvent& e = events_[(start + i) % kMaxEvents];
     // Chrome Tracing uses microseconds.
     double ts_us = e.timestamp * 1000000.0;
@@ -128,7 +141,7 @@ void Profiler::Flush() {
   }
 
   fputs("\n]\n", f);
-  LOG("Profiler: wrote ", count_, " events to ", path.str());
+  LOG("Profiler: wrote ", count, " events to ", path.str());
 }
 
 }  // namespace G
@@ -2,8 +2,10 @@
 #ifndef _GAME_PROFILER_H
 #define _GAME_PROFILER_H
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <mutex>
 #include <string_view>
 
 #include "clock.h"
@@ -30,7 +32,8 @@ struct TraceEvent {
 
 // Fixed-capacity ring buffer profiler. When full, oldest events are
 // overwritten. Call ToggleRecording() to start/stop; on stop the buffer
-// is flushed to a Chrome Tracing JSON file.
+// is flushed to a Chrome Tracing JSON file. Events may be added from any
+// thread (the render thread records its frames too).
 class Profiler {
  public:
   // Holds ~16 seconds at 60 FPS with ~1000 events/frame.
@@ -55,13 +58,19 @@ class Profiler {
   bool recording() const { return recording_; }
 
  private:
-  // Writes all buffered events to a Chrome Tracing JSON file.
-  void Flush();
+  // Writes the `count` buffered events, the newest just before `write_pos`,
+  // to a Chrome Tracing JSON file.
+  void Flush(size_t write_pos, size_t count);
 
+  // Appends an event to the ring buffer.
+  void Push(const TraceEvent& event);
+
+  std::mutex mu_;
+  std::mutex toggle_mu_;
   TraceEvent events_[kMaxEvents];
   size_t write_pos_ = 0;
   size_t count_ = 0;
-  bool recording_ = false;
+  std::atomic<bool> recording_ = false;
 };
 
 // Returns the global profiler instance.
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef _GAME_RADIX_SORT_H
+#define _GAME_RADIX_SORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace G {
+
+// Stable least-significant-digit radix sort of `n` items by the 64-bit key
+// returned by `key(item)`, one byte per pass. Passes where every item has
+// the same digit are skipped, so keys that only vary in a few bytes cost a
+// few passes. `scratch` must have room for `n` items; the result ends up in
+// `items`.
+template <typename T, typename KeyFn>
+void RadixSort(T* items, T* scratch, size_t n, KeyFn key) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (n < 2) return;
+  constexpr int kDigits = sizeof(uint64_t);
+  size_t counts[kDigits][256] = {};
+  for (size_t i = 0; i < n; ++i) {
+    const uint64_t k = key(items[i]);
+    for (int d = 0; d < kDigits; ++d) counts[d][(k >> (8 * d)) & 0xFF]++;
+  }
+  T* src = items;
+  T* dst = scratch;
+  for (int d = 0; d < kDigits; ++d) {
+    size_t* count = counts[d];
+    const int shift = 8 * d;
+    if (count[(key(src[0]) >> shift) & 0xFF] == n) continue;
+    size_t offset = 0;
+    for (size_t& c : counts[d]) {
+      const size_t bucket = c;
+      c = offset;
+      offset += bucket;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      dst[count[(key(src[i]) >> shift) & 0xFF]++] = src[i];
+    }
+    T* t = src;
+    src = dst;
+    dst = t;
+  }
+  if (src != items) std::memcpy(items, src, n * sizeof(T));
+}
+
+}  // namespace G
+
+#endif  // _GAME_RADIX_SORT_H
@@ -0,0 +1,97 @@
+#include "render_thread.h"
+
+#include "clock.h"
+#include "logging.h"
+#include "thread.h"
+
+namespace G {
+
+namespace {
+
+thread_local bool on_render_thread = false;
+
+}  // namespace
+
+void RenderThread::Start(SDL_GLContext context) {
+  CHECK(!running_, "Render thread already started");
+  context_ = context;
+  exit_ = false;
+  running_ = true;
+  main_owns_context_ = true;
+  thread_ = std::thread(&RenderThread::Loop, this);
+}
+
+void RenderThread::Stop() {
+  if (!running_) return;
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    done_cv_.wait(lock, [this] { return !in_flight_; });
+    exit_ = true;
+  }
+  work_cv_.notify_one();
+  thread_.join();
+  running_ = false;
+  Claim();
+}
+
+void RenderThread::Submit(void (*fn)(void* userdata), void* userdata) {
+  DCHECK(running_ && !on_render_thread);
+  Wait();
+  if (main_owns_context_) {
+    CHECK(SDL_GL_MakeCurrent(window_, nullptr),
+          "Could not release the GL context: ", SDL_GetError());
+    main_owns_context_ = false;
+  }
+  {
+    LockMutex l(mu_);
+    fn_ = fn;
+    userdata_ = userdata;
+    in_flight_ = true;
+  }
+  work_cv_.notify_one();
+}
+
+void RenderThread::Wait() {
+  if (!running_) return;
+  std::unique_lock<std::mutex> lock(mu_);
+  done_cv_.wait(lock, [this] { return !in_flight_; });
+}
+
+void RenderThread::Claim() {
+  if (on_render_thread || main_owns_context_) return;
+  Wait();
+  CHECK(SDL_GL_MakeCurrent(window_, context_),
+        "Could not make the GL context current: ", SDL_GetError());
+  main_owns_context_ = true;
+}
+
+float RenderThread::last_frame_ms() {
+  LockMutex l(mu_);
+  return last_frame_ms_;
+}
+
+void RenderThread::Loop() {
+  SetCurrentThreadName("render");
+  on_render_thread = true;
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    work_cv_.wait(lock, [this] { return exit_ || in_flight_; });
+    if (!in_flight_) break;
+    lock.unlock();
+    const Time start = Now();
+    CHECK(SDL_GL_MakeCurrent(window_, context_),
+          "Could not make the GL context current on the render thread: ",
+          SDL_GetError());
+    fn_(userdata_);
+    // Released after every frame so the main thread can claim the context
+    // without a round trip through this thread.
+    SDL_GL_MakeCurrent(window_, nullptr);
+    const float ms = ElapsedMs(start);
+    lock.lock();
+    last_frame_ms_ = ms;
+    in_flight_ = false;
+    done_cv_.notify_all();
+  }
+}
+
+}  // namespace G
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef _GAME_RENDER_THREAD_H
+#define _GAME_RENDER_THREAD_H
+
+#include <SDL3/SDL.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace G {
+
+// Runs the GL submission of one frame at a time on a dedicated thread, so
+// the main thread can update and record the next frame meanwhile.
+//
+// The GL context is current on one thread at a time: the render thread
+// while a frame is in flight, the main thread otherwise. Code outside the
+// render thread calls Claim() before touching GL; it waits for the frame in
+// flight and takes the context back. Claim() is free when the main thread
+// already holds the context or on the render thread itself, so subsystems
+// can call it from every GL entry point.
+class RenderThread {
+ public:
+  explicit RenderThread(SDL_Window* window) : window_(window) {}
+  ~RenderThread() { Stop(); }
+
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+
+  // Starts the thread. `context` must be current on the calling thread,
+  // which becomes the main thread.
+  void Start(SDL_GLContext context);
+
+  // Finishes the frame in flight, joins the thread and makes the context
+  // current on the main thread again.
+  void Stop();
+
+  bool running() const { return running_; }
+
+  // Waits for the previous frame, hands the GL context over and runs
+  // `fn(userdata)` on the render thread.
+  void Submit(void (*fn)(void* userdata), void* userdata);
+
+  // Blocks until the frame in flight, if any, is done. Leaves the context
+  // unbound on the main thread.
+  void Wait();
+
+  // Waits for the frame in flight and makes the GL context current on the
+  // calling thread. No-op on the render thread or if the caller already
+  // holds the context.
+  void Claim();
+
+  // Milliseconds the render thread spent on the last finished frame.
+  float last_frame_ms();
+
+ private:
+  void Loop();
+
+  SDL_Window* window_;
+  SDL_GLContext context_ = nullptr;
+  std::thread thread_;
+  bool running_ = false;
+  // Only touched by the main thread.
+  bool main_owns_context_ = true;
+
+  std::mutex mu_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  void (*fn_)(void*) = nullptr;
+  void* userdata_ = nullptr;
+  bool in_flight_ = false;
+  bool exit_ = false;
+  float last_frame_ms_ = 0;
+};
+
+}  // namespace G
+
+#endif  // _GAME_RENDER_THREAD_H
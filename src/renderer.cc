@@ -3,6 +3,12 @@
 #include <cmath>
 #include <cstring>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "bits.h"
 #include "clock.h"
 #include "defer.h"
@@ -13,6 +19,7 @@
 #include "libraries/stb_rect_pack.h"
 #include "memory_budgets.h"
 #include "profiler.h"
+#include "radix_sort.h"
 #include "sqlite_helpers.h"
 #include "transformations.h"
 #include "units.h"
@@ -53,6 +60,148 @@ constexpr int kNumChars = kLastChar - kFirstChar + 1;
 constexpr int kAtlasGutter = 2;
 // Bump this when SDF generation parameters change to invalidate cached atlases.
 constexpr uint64_t kSDFCacheVersion = 1;
+// Initial size of one StreamBuffer segment for batch geometry. Segments grow
+// on demand when a single batch does not fit.
+constexpr size_t kVertexStreamSegment = Megabytes(4);
+constexpr size_t kIndexStreamSegment = Megabytes(1);
+// Texture unit used by the particle shader, past the batch texture slots.
+constexpr int kParticleTextureUnit = BatchRenderer::kTextureSlots;
+static_assert(BatchRenderer::kTextureSlots == 8,
+              "texture_slots.frag declares sampler2D tex_slots[8]");
+
+// Assigns the textures of a batch to texture units. RenderBatch runs the
+// same sequence of lookups twice, once while planning the vertex fill and
+// once while issuing draw calls, so both passes agree on the unit each
+// vertex samples from and on where a full table forces a flush. Fill chunks
+// resume from a copy taken while planning.
+class TextureSlots {
+ public:
+  explicit TextureSlots(int capacity) : capacity_(capacity) {
+    DCHECK(capacity_ >= 1 && capacity_ <= BatchRenderer::kTextureSlots);
+  }
+
+  // Returns the slot holding `texture`, or -1.
+  int Find(size_t texture) const {
+    for (int i = 0; i < size_; ++i) {
+      if (textures_[i] == texture) return i;
+    }
+    return -1;
+  }
+
+  int Add(size_t texture) {
+    DCHECK(!full());
+    textures_[size_] = texture;
+    return size_++;
+  }
+
+  bool full() const { return size_ == capacity_; }
+  int size() const { return size_; }
+  size_t texture(int slot) const { return textures_[slot]; }
+  void Reset() { size_ = 0; }
+
+ private:
+  int capacity_;
+  int size_ = 0;
+  size_t textures_[BatchRenderer::kTextureSlots];
+};
+
+// The 2D affine part of a transform: x' = a x + b y + tx, y' = c x + d y + ty.
+// Transforms built from the Renderer stack (translate, rotate, scale) have
+// no projective part, so this is all pre_pass.vert uses of them.
+struct Affine2D {
+  float a, b, tx;
+  float c, d, ty;
+};
+
+Affine2D AffineFromMat(const FMat4x4& m) {
+  // FMat4x4 is row-major (it is uploaded with transpose = GL_TRUE).
+  return {m.v[0], m.v[1], m.v[3], m.v[4], m.v[5], m.v[7]};
+}
+
+// Returns m * Translate(origin) * RotateZ(angle) * Translate(-origin), the
+// per-vertex rotation pre_pass.vert applies before the transform.
+Affine2D RotateAbout(const Affine2D& m, FVec2 origin, float angle) {
+  const float cs = std::cos(angle), sn = std::sin(angle);
+  const float rtx = origin.x - cs * origin.x + sn * origin.y;
+  const float rty = origin.y - sn * origin.x - cs * origin.y;
+  return {.a = m.a * cs + m.b * sn,
+          .b = m.b * cs - m.a * sn,
+          .tx = m.a * rtx + m.b * rty + m.tx,
+          .c = m.c * cs + m.d * sn,
+          .d = m.d * cs - m.c * sn,
+          .ty = m.c * rtx + m.d * rty + m.ty};
+}
+
+// Transforms four points in place, one per SIMD lane.
+void TransformPoints4(const Affine2D& m, float* xs, float* ys) {
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128 x = _mm_loadu_ps(xs);
+  const __m128 y = _mm_loadu_ps(ys);
+  const __m128 rx =
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.a), x),
+                            _mm_mul_ps(_mm_set1_ps(m.b), y)),
+                 _mm_set1_ps(m.tx));
+  const __m128 ry =
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.c), x),
+                            _mm_mul_ps(_mm_set1_ps(m.d), y)),
+                 _mm_set1_ps(m.ty));
+  _mm_storeu_ps(xs, rx);
+  _mm_storeu_ps(ys, ry);
+#elif defined(__ARM_NEON)
+  const float32x4_t x = vld1q_f32(xs);
+  const float32x4_t y = vld1q_f32(ys);
+  const float32x4_t rx = vaddq_f32(
+      vaddq_f32(vmulq_n_f32(x, m.a), vmulq_n_f32(y, m.b)), vdupq_n_f32(m.tx));
+  const float32x4_t ry = vaddq_f32(
+      vaddq_f32(vmulq_n_f32(x, m.c), vmulq_n_f32(y, m.d)), vdupq_n_f32(m.ty));
+  vst1q_f32(xs, rx);
+  vst1q_f32(ys, ry);
+#else
+  for (int i = 0; i < 4; ++i) {
+    const float x = xs[i], y = ys[i];
+    xs[i] = m.a * x + m.b * y + m.tx;
+    ys[i] = m.c * x + m.d * y + m.ty;
+  }
+#endif
+}
+
+bool InUnitSquare(FVec2 q) {
+  return q.x >= 0 && q.x <= 1 && q.y >= 0 && q.y <= 1;
+}
+
+// Texture coordinate in [0, 1] as a normalized 16-bit integer. A texel of
+// an 8192 pixel texture still spans 8 steps.
+uint16_t QuantizeTexCoord(float t) {
+  return static_cast<uint16_t>(std::clamp(t, 0.f, 1.f) * 65535.f + 0.5f);
+}
+
+// Uniforms and attributes the batch renderer sets on every flush or program
+// switch, interned once so lookups skip hashing the names. First built by
+// the BatchRenderer constructor: the string table is not thread safe, so
+// the render thread must only ever read these.
+struct ShaderNames {
+  uint32_t tex = StringIntern("tex");
+  uint32_t tex_slots = StringIntern("tex_slots");
+  uint32_t projection = StringIntern("projection");
+  uint32_t transform = StringIntern("transform");
+  uint32_t global_color = StringIntern("global_color");
+  uint32_t screen_size = StringIntern("g_ScreenSize");
+  uint32_t time = StringIntern("g_Time");
+  uint32_t position = StringIntern("input_position");
+  uint32_t tex_coord = StringIntern("input_tex_coord");
+  uint32_t origin = StringIntern("origin");
+  uint32_t angle = StringIntern("angle");
+  uint32_t color = StringIntern("color");
+  uint32_t slot = StringIntern("tex_slot");
+  uint32_t outline_thickness = StringIntern("u_outline_thickness");
+  uint32_t outline_color = StringIntern("u_outline_color");
+  uint32_t screen_texture = StringIntern("screen_texture");
+};
+
+const ShaderNames& Names() {
+  static const ShaderNames names;
+  return names;
+}
 
 }  // namespace
 
@@ -92,6 +241,9 @@ constexpr size_t BatchRenderer::SizeOfCommand(CommandType t) {
       Align(sizeof(SetStencilTestCmd), kAlign),
       Align(sizeof(ClearStencilTestCmd), kAlign),
       Align(sizeof(RenderParticlesCmd), kAlign),
+      Align(sizeof(SetLayerCmd), kAlign),
+      Align(sizeof(DrawStaticMeshCmd), kAlign),
+      Align(sizeof(RenderSpriteInstancesCmd), kAlign),
       0,  // kDone
   };
   return kSizes[t];
@@ -141,6 +293,12 @@ constexpr std::string_view BatchRenderer::CommandName(CommandType t) {
       return "CLEAR_STENCIL_TEST";
     case kRenderParticles:
       return "RENDER_PARTICLES";
+    case kSetLayer:
+      return "SET_LAYER";
+    case kDrawStaticMesh:
+      return "DRAW_STATIC_MESH";
+    case kRenderSpriteInstances:
+      return "RENDER_SPRITE_INSTANCES";
     case kDone:
       return "DONE";
   }
@@ -182,56 +340,487 @@ class BatchRenderer::CommandIterator {
   size_t pos_ = 0, remaining_ = 0, i_ = 0;
 };
 
+// Appends commands to a buffer laid out like command_buffer_, merging
+// queue entries the same way AddCommand does. Instead of flushing when full
+// it records the overflow in ok().
+class BatchRenderer::CommandWriter {
+ public:
+  CommandWriter(uint8_t* buffer, size_t capacity,
+                FixedArray<QueueEntry>* commands)
+      : commands_(commands), buffer_(buffer), capacity_(capacity) {}
+
+  template <typename T>
+  void Write(CommandType type, const T& data) {
+    Write(type, &data, sizeof(data));
+  }
+
+  void Write(CommandType type, const void* data, size_t size) {
+    if (!ok_) return;
+    const size_t aligned = Align(size, alignof(Command));
+    if (pos_ + aligned > capacity_) {
+      ok_ = false;
+      return;
+    }
+    if (size > 0) std::memcpy(&buffer_[pos_], data, size);
+    pos_ += aligned;
+    if (!commands_->empty() && commands_->back().type == type &&
+        commands_->back().count < kMaxCount) {
+      commands_->back().count++;
+      return;
+    }
+    if (commands_->size() == commands_->capacity()) {
+      ok_ = false;
+      return;
+    }
+    commands_->Push(QueueEntry{.type = type, .count = 1});
+  }
+
+  bool ok() const { return ok_; }
+
+ private:
+  FixedArray<QueueEntry>* commands_;
+  uint8_t* buffer_;
+  size_t capacity_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+// State the vertex fill carries from one command to the next.
+struct BatchRenderer::FillState {
+  Color color = Color::White();
+  // Last transform set, null while it is the identity.
+  const FMat4x4* transform = nullptr;
+  TextureSlots slots;
+  size_t texture = 0;
+  int32_t slot = 0;
+  // Whether the bound program takes the transform as a uniform.
+  bool custom_shader = false;
+};
+
+// A run of commands filled by one task, with the state in effect where it
+// starts and the output ranges it writes.
+struct BatchRenderer::FillChunk {
+  CommandIterator it;
+  size_t commands;
+  size_t first_vertex, last_vertex;
+  size_t first_index, last_index;
+  FillState state;
+};
+
+void BatchRenderer::ApplyFillState(CommandType type, const Command& c,
+                                 FillState* state) {
+  switch (type) {
+    case kSetColor:
+      state->color = c.set_color.color;
+      break;
+    case kSetTransform:
+      state->transform = c.set_transform.transform == FMat4x4::Identity()
+                            ? nullptr
+                            : &c.set_transform.transform;
+      break;
+    case kSetTexture:
+      state->texture = c.set_texture.texture_unit;
+      state->slot = state->slots.Find(state->texture);
+      if (state->slot == -1) {
+        if (state->slots.full()) state->slots.Reset();
+        state->slot = state->slots.Add(state->texture);
+      }
+      break;
+    case kSetShader:
+      state->custom_shader = c.set_shader.custom;
+      break;
+    case kSetCanvas:
+      // Never keep a canvas texture bound while rendering into it.
+      state->slots.Reset();
+      state->slot = state->slots.Add(state->texture);
+      break;
+    default:
+      // Other commands do not change what the fill writes.
+      break;
+  }
+}
+
+BatchRenderer::FillPlan::FillPlan(Allocator* parent)
+    : allocator(parent), chunks(parent->NewArray<FillChunk>(kMaxFillChunks)) {
+  CHECK(chunks != nullptr, "BatchRenderer: failed to allocate fill plan");
+}
+
+BatchRenderer::FillPlan::~FillPlan() {
+  allocator->DeallocArray(chunks, kMaxFillChunks);
+}
+
+void BatchRenderer::PlanFill(uint8_t* buffer, FixedArray<QueueEntry>* commands,
+                             int texture_slots, size_t chunk_commands,
+                             FillPlan* plan) {
+  size_t total = 0;
+  for (const QueueEntry& e : *commands) total += e.count;
+  chunk_commands = std::max<size_t>(
+      {chunk_commands, (total + kMaxFillChunks - 1) / kMaxFillChunks, 1});
+  FillState state = {.slots = TextureSlots(texture_slots)};
+  state.slot = state.slots.Add(state.texture);
+  size_t vertices = 0, indices = 0, index = 0;
+  FillChunk* chunk = nullptr;
+  bool packable = true;
+  plan->count = 0;
+  for (CommandIterator it(buffer, commands); !it.Done(); ++index) {
+    const CommandIterator start = it;
+    const Command* c;
+    const CommandType type = it.Read(&c);
+    // The stream ends here; kDone itself writes nothing.
+    if (type == kDone) break;
+    if (index % chunk_commands == 0) {
+      DCHECK(plan->count < kMaxFillChunks);
+      if (chunk != nullptr) {
+        chunk->last_vertex = vertices;
+        chunk->last_index = indices;
+      }
+      chunk = &plan->chunks[plan->count++];
+      *chunk = {.it = start,
+                .commands = 0,
+                .first_vertex = vertices,
+                .last_vertex = vertices,
+                .first_index = indices,
+                .last_index = indices,
+                .state = state};
+    }
+    chunk->commands++;
+    switch (type) {
+      case kRenderQuad:
+        vertices += 4;
+        indices += 6;
+        packable = packable && InUnitSquare(c->quad.q0) &&
+                   InUnitSquare(c->quad.q1);
+        break;
+      case kRenderTrig:
+        vertices += 3;
+        indices += 3;
+        packable = packable && InUnitSquare(c->triangle.q0) &&
+                   InUnitSquare(c->triangle.q1) &&
+                   InUnitSquare(c->triangle.q2);
+        break;
+      case kAddLinePoint:
+        vertices += 1;
+        indices += 1;
+        break;
+      default:
+        ApplyFillState(type, *c, &state);
+        break;
+    }
+  }
+  if (chunk != nullptr) {
+    chunk->last_vertex = vertices;
+    chunk->last_index = indices;
+  }
+  plan->vertices = vertices;
+  plan->indices = indices;
+  plan->last_color = state.color;
+  plan->packable = packable;
+}
+
+template <typename Vertex>
+void BatchRenderer::FillChunkGeometry(const FillChunk& chunk,
+                                      bool cpu_transforms, size_t base_vertex,
+                                      Vertex* vertices, GLuint* indices) {
+  // Packed vertices have no origin and angle, so rotations are always
+  // applied here.
+  constexpr bool kPacked = std::is_same_v<Vertex, PackedVertexData>;
+  size_t vertices_written = chunk.first_vertex;
+  size_t indices_written = chunk.first_index;
+  auto push_vertex = [&](const VertexData& v) {
+    DCHECK(vertices_written < chunk.last_vertex);
+    if constexpr (kPacked) {
+      vertices[vertices_written++] = {
+          .position = v.position,
+          .tex_coords = {QuantizeTexCoord(v.tex_coords.x),
+                         QuantizeTexCoord(v.tex_coords.y)},
+          .color = v.color,
+          .tex_slot = v.tex_slot};
+    } else {
+      vertices[vertices_written++] = v;
+    }
+  };
+  auto push_index = [&](size_t i) {
+    DCHECK(indices_written < chunk.last_index);
+    indices[indices_written++] = static_cast<GLuint>(base_vertex + i);
+  };
+  FillState state = chunk.state;
+  // With CPU transforms, positions are written in screen space and the
+  // transform uniform stays at identity. Geometry under an identity
+  // transform is written as is.
+  auto affine_of = [](const FMat4x4* transform) {
+    return AffineFromMat(transform ? *transform : FMat4x4::Identity());
+  };
+  Affine2D affine = affine_of(state.transform);
+  const Affine2D identity = affine_of(nullptr);
+  CommandIterator it = chunk.it;
+  for (size_t n = 0; n < chunk.commands; ++n) {
+    const bool transformed =
+        cpu_transforms && !state.custom_shader && state.transform != nullptr;
+    const Color color = state.color;
+    const int32_t slot = state.slot;
+    const size_t current = vertices_written;
+    const Command* c;
+    const CommandType type = it.Read(&c);
+    switch (type) {
+      case kRenderQuad: {
+        const RenderQuad& q = c->quad;
+        float xs[4] = {q.p0.x, q.p1.x, q.p1.x, q.p0.x};
+        float ys[4] = {q.p1.y, q.p1.y, q.p0.y, q.p0.y};
+        FVec2 origin = q.origin;
+        float angle = q.angle;
+        if (transformed || (kPacked && angle != 0)) {
+          // Without a CPU transform the GPU applies it after the rotation.
+          const Affine2D& base = transformed ? affine : identity;
+          TransformPoints4(
+              angle == 0 ? base : RotateAbout(base, origin, angle), xs, ys);
+          origin = FVec(0, 0);
+          angle = 0;
+        }
+        push_vertex({.position = FVec(xs[0], ys[0]),
+                     .tex_coords = FVec(q.q0.x, q.q1.y),
+                     .origin = origin,
+                     .angle = angle,
+                     .color = color,
+                     .tex_slot = slot});
+        push_vertex({.position = FVec(xs[1], ys[1]),
+                     .tex_coords = q.q1,
+                     .origin = origin,
+                     .angle = angle,
+                     .color = color,
+                     .tex_slot = slot});
+        push_vertex({.position = FVec(xs[2], ys[2]),
+                     .tex_coords = FVec(q.q1.x, q.q0.y),
+                     .origin = origin,
+                     .angle = angle,
+                     .color = color,
+                     .tex_slot = slot});
+        push_vertex({.position = FVec(xs[3], ys[3]),
+                     .tex_coords = q.q0,
+                     .origin = origin,
+                     .angle = angle,
+                     .color = color,
+                     .tex_slot = slot});
+        for (int i : {0, 1, 3, 1, 2, 3}) {
+          push_index(current + i);
+        }
+      }; break;
+      case kRenderTrig: {
+        const RenderTriangle& t = c->triangle;
+        float xs[4] = {t.p0.x, t.p1.x, t.p2.x, 0};
+        float ys[4] = {t.p0.y, t.p1.y, t.p2.y, 0};
+        if (transformed) {
+          TransformPoints4(affine, xs, ys);
+        }
+        push_vertex({.position = FVec(xs[0], ys[0]),
+                     .tex_coords = t.q0,
+                     .origin = FVec(0, 0),
+                     .angle = 0,
+                     .color = color,
+                     .tex_slot = slot});
+        push_vertex({.position = FVec(xs[1], ys[1]),
+                     .tex_coords = t.q1,
+                     .origin = FVec(0, 0),
+                     .angle = 0,
+                     .color = color,
+                     .tex_slot = slot});
+        push_vertex({.position = FVec(xs[2], ys[2]),
+                     .tex_coords = t.q2,
+                     .origin = FVec(0, 0),
+                     .angle = 0,
+                     .color = color,
+                     .tex_slot = slot});
+        for (int i : {0, 1, 2}) {
+          push_index(current + i);
+        }
+      }; break;
+      case kAddLinePoint: {
+        const AddLinePoint& l = c->add_line_point;
+        FVec2 p = l.p0;
+        if (transformed) {
+          p = FVec(affine.a * p.x + affine.b * p.y + affine.tx,
+                   affine.c * p.x + affine.d * p.y + affine.ty);
+        }
+        push_vertex({.position = p,
+                     .tex_coords = FVec(0, 0),
+                     .origin = FVec(0, 0),
+                     .angle = 0,
+                     .color = color,
+                     .tex_slot = slot});
+        push_index(current);
+      }; break;
+      case kSetTransform:
+        ApplyFillState(type, *c, &state);
+        affine = affine_of(state.transform);
+        break;
+      default:
+        ApplyFillState(type, *c, &state);
+        break;
+    }
+  }
+  DCHECK(vertices_written == chunk.last_vertex);
+  DCHECK(indices_written == chunk.last_index);
+}
+
+void BatchRenderer::FillGeometry(const FillPlan& plan, bool cpu_transforms,
+                                 VertexFormat format, size_t base_vertex,
+                                 void* vertices, GLuint* indices,
+                                 Executor* executor) {
+  struct Context {
+    const FillPlan* plan;
+    bool cpu_transforms;
+    VertexFormat format;
+    size_t base_vertex;
+    void* vertices;
+    GLuint* indices;
+  };
+  Context context = {.plan = &plan,
+                     .cpu_transforms = cpu_transforms,
+                     .format = format,
+                     .base_vertex = base_vertex,
+                     .vertices = vertices,
+                     .indices = indices};
+  auto fill = [](int start, int end, void* userdata) {
+    const auto* ctx = static_cast<const Context*>(userdata);
+    for (int i = start; i < end; ++i) {
+      if (ctx->format == kVertexPacked) {
+        FillChunkGeometry(ctx->plan->chunks[i], ctx->cpu_transforms,
+                          ctx->base_vertex,
+                          static_cast<PackedVertexData*>(ctx->vertices),
+                          ctx->indices);
+      } else {
+        FillChunkGeometry(ctx->plan->chunks[i], ctx->cpu_transforms,
+                          ctx->base_vertex,
+                          static_cast<VertexData*>(ctx->vertices),
+                          ctx->indices);
+      }
+    }
+  };
+  if (executor == nullptr || plan.count == 1) {
+    fill(0, plan.count, &context);
+  } else {
+    executor->ParallelFor(plan.count, /*min_batch=*/1, fill, &context);
+  }
+}
+
+BatchRenderer::RecordedFrame::RecordedFrame(Allocator* parent)
+    : allocator(parent),
+      buffer(static_cast<uint8_t*>(
+          parent->Alloc(kCommandMemory, alignof(Command)))),
+      commands(1 << 20, parent) {
+  CHECK(buffer != nullptr, "BatchRenderer: failed to allocate ",
+        kCommandMemory, " byte command buffer");
+}
+
+BatchRenderer::RecordedFrame::~RecordedFrame() {
+  allocator->Dealloc(buffer, kCommandMemory);
+  if (particles != nullptr) {
+    allocator->DeallocArray(particles, particle_capacity);
+  }
+  if (sprites != nullptr) allocator->DeallocArray(sprites, sprite_capacity);
+}
+
+void BatchRenderer::RetainParticleData(RecordedFrame* frame) {
+  // Queue entries carry the command counts, so the particle commands are
+  // found without walking every command.
+  auto for_each_particles = [frame](auto fn) {
+    size_t pos = 0;
+    for (const QueueEntry& e : frame->commands) {
+      const auto type = static_cast<CommandType>(e.type);
+      if (type != kRenderParticles) {
+        pos += e.count * SizeOfCommand(type);
+        continue;
+      }
+      for (uint32_t i = 0; i < e.count; ++i) {
+        fn(&reinterpret_cast<Command*>(&frame->buffer[pos])->render_particles);
+        pos += SizeOfCommand(type);
+      }
+    }
+  };
+  size_t total = 0;
+  for_each_particles([&](RenderParticlesCmd* cmd) { total += cmd->count; });
+  if (total == 0) return;
+  if (total > frame->particle_capacity) {
+    if (frame->particles != nullptr) {
+      frame->allocator->DeallocArray(frame->particles,
+                                     frame->particle_capacity);
+    }
+    frame->particle_capacity = NextPow2(total);
+    frame->particles = frame->allocator->NewArray<ParticleInstanceData>(
+        frame->particle_capacity);
+    CHECK(frame->particles != nullptr, "BatchRenderer: failed to allocate ",
+          frame->particle_capacity, " particle instances");
+  }
+  size_t used = 0;
+  for_each_particles([&](RenderParticlesCmd* cmd) {
+    ParticleInstanceData* copy = &frame->particles[used];
+    std::memcpy(copy, cmd->data, cmd->count * sizeof(ParticleInstanceData));
+    cmd->data = copy;
+    used += cmd->count;
+  });
+}
+
 void BatchRenderer::AddCommand(CommandType command, uint32_t count,
                                const void* data, size_t size) {
+  RecordedFrame& frame = *recording_;
   if (command != kDone) {
     const size_t aligned = Align(size, alignof(Command));
-    if (pos_ + aligned > kCommandMemory) {
+    if (frame.pos + aligned > kCommandMemory) {
       FlushAndContinue();
     }
-    std::memcpy(&command_buffer_[pos_], data, size);
+    std::memcpy(&frame.buffer[frame.pos], data, size);
     // Advance by the actual byte count written, rounded up to
     // alignof(Command), so the next command starts on a Command-aligned
     // offset (CommandIterator::Read returns pointers directly into this
     // buffer and assumes alignment). `size` is per-call total bytes:
     // `count * sizeof(T)` for batched multi-element commands like
     // PushLinePoints, so we can't use SizeOfCommand here.
-    pos_ += aligned;
+    frame.pos += aligned;
   }
   // Check if we need a new queue entry or can merge with the previous one.
-  bool needs_new_entry = commands_.empty() ||
-                         commands_.back().type != command ||
-                         commands_.back().count == kMaxCount;
+  FixedArray<QueueEntry>& commands = frame.commands;
+  bool needs_new_entry = commands.empty() ||
+                         commands.back().type != command ||
+                         commands.back().count == kMaxCount;
   if (needs_new_entry) {
-    if (commands_.size() == commands_.capacity()) {
+    if (commands.size() == commands.capacity()) {
       FlushAndContinue();
     }
-    commands_.Push(QueueEntry{.type = command, .count = count});
+    commands.Push(QueueEntry{.type = command, .count = count});
   } else {
-    commands_.back().count += count;
+    commands.back().count += count;
   }
 }
 
 BatchRenderer::BatchRenderer(IVec2 viewport, Shaders* shaders,
                              Allocator* allocator)
     : allocator_(allocator),
-      command_buffer_(static_cast<uint8_t*>(
-          allocator->Alloc(kCommandMemory, alignof(Command)))),
-      commands_(1 << 20, allocator),
+      recording_(allocator->New<RecordedFrame>(allocator)),
+      submitted_(recording_),
       tex_(256, allocator),
       shaders_(shaders),
+      vertex_stream_(GL_ARRAY_BUFFER, allocator),
+      index_stream_(GL_ELEMENT_ARRAY_BUFFER, allocator),
+      static_meshes_(kMaxStaticMeshes, allocator),
       viewport_(viewport),
-      window_size_(viewport),
-      render_scratch_(allocator, kRenderScratchSize) {
-  CHECK(command_buffer_ != nullptr, "BatchRenderer: failed to allocate ",
-        kCommandMemory, " byte command buffer");
+      fill_plan_(allocator) {
+  recording_->window_size = viewport;
   TIMER();
+  // Intern everything the render thread uses while still on the main thread.
+  Names();
+  pre_pass_program_ = ResolveProgram(StringIntern("pre_pass"));
+  sdf_program_ = ResolveProgram(StringIntern("sdf"));
+  post_pass_program_ = ResolveProgram(StringIntern("post_pass"));
+  particle_program_ = ResolveProgram(StringIntern("particle"));
+  sprite_instances_program_ = ResolveProgram(StringIntern("sprite_instances"));
   glGetIntegerv(GL_MAX_SAMPLES, &antialiasing_samples_);
   LOG("Using ", antialiasing_samples_, " MSAA samples");
   LOG("Using viewport = ", viewport.x, " ", viewport.y);
   OPENGL_CALL(glGenVertexArrays(1, &vao_));
-  OPENGL_CALL(glGenBuffers(1, &vbo_));
-  OPENGL_CALL(glGenBuffers(1, &ebo_));
+  {
+    GL::VertexArrayScope vao(vao_);
+    vertex_stream_.Init(kVertexStreamSegment);
+    index_stream_.Init(kIndexStreamSegment);
+  }
   // Generate the quad for the post pass step.
   OPENGL_CALL(glGenVertexArrays(1, &screen_quad_vao_));
   OPENGL_CALL(glGenBuffers(1, &screen_quad_vbo_));
@@ -246,18 +835,21 @@ BatchRenderer::BatchRenderer(IVec2 viewport, Shaders* shaders,
     OPENGL_CALL(glBufferData(GL_ARRAY_BUFFER,
                              screen_quad_vertices.size() * sizeof(float),
                              screen_quad_vertices.data(), GL_STATIC_DRAW));
-    shaders_->UseProgram("post_pass");
-    const GLint pos_attribute = shaders_->AttributeLocation("input_position");
+    shaders_->UseProgram(post_pass_program_);
+    const GLint pos_attribute = shaders_->AttributeLocation(Names().position);
     OPENGL_CALL(glEnableVertexAttribArray(pos_attribute));
     OPENGL_CALL(glVertexAttribPointer(pos_attribute, 2, GL_FLOAT, GL_FALSE,
                                       4 * sizeof(float), (void*)0));
-    const GLint tex_attribute = shaders_->AttributeLocation("input_tex_coord");
+    const GLint tex_attribute = shaders_->AttributeLocation(Names().tex_coord);
     OPENGL_CALL(glEnableVertexAttribArray(tex_attribute));
     OPENGL_CALL(glVertexAttribPointer(tex_attribute, 2, GL_FLOAT, GL_FALSE,
                                       4 * sizeof(float),
                                       (void*)(2 * sizeof(float))));
   }
   InitializeParticleResources();
+  InitializeSpriteInstanceResources();
+  OPENGL_CALL(glGenVertexArrays(1, &static_mesh_vao_));
+  OPENGL_CALL(glGenBuffers(1, &static_mesh_ebo_));
 
   InitializeFramebuffers();
   rec_canvas_ = {render_target_, viewport_.x, viewport_.y};
@@ -337,6 +929,7 @@ void BatchRenderer::InitializeFramebuffers() {
 
 void BatchRenderer::SetViewport(IVec2 viewport) {
   if (viewport_ == viewport) return;
+  ClaimGlContext();
   LOG("Resizing viewport from ", viewport_, " to ", viewport);
   viewport_ = viewport;
   // Delete the framebuffers, renderbuffer, and textures, then recreate them.
@@ -366,31 +959,35 @@ size_t BatchRenderer::LoadTexture(const DbAssets::Image& image) {
 }
 
 BatchRenderer::~BatchRenderer() {
-  std::array<GLuint, 6> object_buffers = {vbo_,
-                                          ebo_,
-                                          screen_quad_vbo_,
-                                          particle_quad_vbo_,
-                                          particle_quad_ebo_,
-                                          particle_instance_vbo_};
+  std::array<GLuint, 6> object_buffers = {
+      screen_quad_vbo_,       particle_quad_vbo_, particle_quad_ebo_,
+      particle_instance_vbo_, static_mesh_ebo_,   sprite_instance_vbo_};
   OPENGL_CALL(glDeleteBuffers(object_buffers.size(), object_buffers.data()));
+  for (const StaticMesh& mesh : static_meshes_) {
+    if (mesh.vbo != 0) OPENGL_CALL(glDeleteBuffers(1, &mesh.vbo));
+  }
   std::array<GLuint, 2> frame_buffers = {render_target_, downsampled_target_};
   OPENGL_CALL(glDeleteFramebuffers(frame_buffers.size(), frame_buffers.data()));
   OPENGL_CALL(glDeleteRenderbuffers(1, &depth_buffer_));
   if (render_color_rb_ != 0) {
     OPENGL_CALL(glDeleteRenderbuffers(1, &render_color_rb_));
   }
-  std::array<GLuint, 3> vaos = {vao_, screen_quad_vao_, particle_vao_};
+  std::array<GLuint, 5> vaos = {vao_, screen_quad_vao_, particle_vao_,
+                                static_mesh_vao_, sprite_vao_};
   OPENGL_CALL(glDeleteVertexArrays(vaos.size(), vaos.data()));
   std::array<GLuint, 2> render_target_textures = {render_texture_,
                                                   downsampled_texture_};
   OPENGL_CALL(glDeleteTextures(render_target_textures.size(),
                                render_target_textures.data()));
   OPENGL_CALL(glDeleteTextures(tex_.size(), tex_.data()));
-  allocator_->Dealloc(command_buffer_, kCommandMemory);
+  if (submitted_ != recording_) allocator_->Destroy(submitted_);
+  allocator_->Destroy(recording_);
+  if (sort_ != nullptr) allocator_->Destroy(sort_);
 }
 
 size_t BatchRenderer::LoadTexture(const void* data, size_t width,
                                   size_t height) {
+  ClaimGlContext();
   GLuint tex;
   const size_t index = tex_.size();
   // Check against the hardware texture unit limit.
@@ -422,6 +1019,7 @@ size_t BatchRenderer::LoadTexture(const void* data, size_t width,
 
 size_t BatchRenderer::LoadFontTexture(const void* data, size_t width,
                                       size_t height) {
+  ClaimGlContext();
   GLuint tex;
   const size_t index = tex_.size();
   OPENGL_CALL(glGenTextures(1, &tex));
@@ -448,6 +1046,7 @@ size_t BatchRenderer::LoadFontTexture(const void* data, size_t width,
 }
 
 size_t BatchRenderer::RegisterTexture(GLuint tex) {
+  ClaimGlContext();
   const size_t index = tex_.size();
   OPENGL_CALL(glActiveTexture(GL_TEXTURE0 + index));
   OPENGL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
@@ -456,6 +1055,7 @@ size_t BatchRenderer::RegisterTexture(GLuint tex) {
 }
 
 Canvas BatchRenderer::CreateCanvas(int width, int height, bool nearest_filter) {
+  ClaimGlContext();
   Canvas c;
   c.width = width;
   c.height = height;
@@ -501,7 +1101,7 @@ void Canvas::Destroy() {
   glDeleteTextures(1, &texture);
 }
 
-void BatchRenderer::SetupGLState() {
+void BatchRenderer::SetupGLState(RecordedFrame* frame) {
 #ifndef GAME_WEB
   // Nonexistent in GLES3: multisampling is implied by the multisampled
   // renderbuffer, and line smoothing is unsupported.
@@ -516,12 +1116,12 @@ void BatchRenderer::SetupGLState() {
   OPENGL_CALL(glDisable(GL_DEPTH_TEST));
   OPENGL_CALL(glDisable(GL_STENCIL_TEST));
   OPENGL_CALL(glStencilMask(0x00));
-  if (needs_clear_) {
+  if (frame->needs_clear) {
     OPENGL_CALL(glClearColor(0.f, 0.f, 0.f, 0.f));
     OPENGL_CALL(glStencilMask(0xFF));
     OPENGL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT));
     OPENGL_CALL(glStencilMask(0x00));
-    needs_clear_ = false;
+    frame->needs_clear = false;
   }
 }
 
@@ -581,6 +1181,80 @@ void BatchRenderer::InitializeParticleResources() {
   OPENGL_CALL(glVertexAttribDivisor(5, 1));
 }
 
+void BatchRenderer::InitializeSpriteInstanceResources() {
+  OPENGL_CALL(glGenVertexArrays(1, &sprite_vao_));
+  OPENGL_CALL(glGenBuffers(1, &sprite_instance_vbo_));
+  GL::VertexArrayScope vao(sprite_vao_);
+  // Same unit quad as the particles.
+  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, particle_quad_vbo_));
+  OPENGL_CALL(glEnableVertexAttribArray(0));
+  OPENGL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                                    (void*)0));
+  OPENGL_CALL(glEnableVertexAttribArray(1));
+  OPENGL_CALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                                    (void*)(2 * sizeof(float))));
+  OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, particle_quad_ebo_));
+  // Per-instance attributes, see SpriteInstanceData.
+  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, sprite_instance_vbo_));
+  struct Attribute {
+    GLint components;
+    GLenum type;
+    size_t offset;
+  };
+  const Attribute attributes[] = {
+      {2, GL_FLOAT, offsetof(SpriteInstanceData, x)},              // center
+      {2, GL_FLOAT, offsetof(SpriteInstanceData, width)},          // size
+      {4, GL_FLOAT, offsetof(SpriteInstanceData, u0)},             // uv
+      {1, GL_FLOAT, offsetof(SpriteInstanceData, angle)},          // angle
+      {4, GL_UNSIGNED_BYTE, offsetof(SpriteInstanceData, color)},  // color
+  };
+  GLuint location = 2;
+  for (const Attribute& a : attributes) {
+    OPENGL_CALL(glEnableVertexAttribArray(location));
+    OPENGL_CALL(glVertexAttribPointer(
+        location, a.components, a.type,
+        /*normalized=*/a.type == GL_UNSIGNED_BYTE ? GL_TRUE : GL_FALSE,
+        sizeof(SpriteInstanceData), (void*)a.offset));
+    OPENGL_CALL(glVertexAttribDivisor(location, 1));
+    location++;
+  }
+}
+
+void BatchRenderer::RenderSpriteInstances(const RenderSpriteInstancesCmd& cmd,
+                                          const RecordedFrame& frame,
+                                          int viewport_w, int viewport_h,
+                                          const FMat4x4& transform,
+                                          FVec4 color, FrameStats& stats) {
+  if (cmd.count == 0) return;
+  // Sampled from the particle unit so the batch texture slots stay bound.
+  OPENGL_CALL(glActiveTexture(GL_TEXTURE0 + kParticleTextureUnit));
+  OPENGL_CALL(glBindTexture(GL_TEXTURE_2D, tex_[cmd.texture_unit]));
+  const FVec4 tint = cmd.color.ToFloat();
+  const ShaderNames& names = Names();
+  shaders_->UseProgram(sprite_instances_program_);
+  shaders_->SetUniformSilent(names.tex, kParticleTextureUnit);
+  shaders_->SetUniformSilent(names.projection,
+                             Ortho(0, viewport_w, 0, viewport_h));
+  shaders_->SetUniformSilent(names.transform, transform);
+  shaders_->SetUniformSilent(names.global_color,
+                             FVec(color.x * tint.x, color.y * tint.y,
+                                  color.z * tint.z, color.w * tint.w));
+  {
+    GL::VertexArrayScope vao(sprite_vao_);
+    OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, sprite_instance_vbo_));
+    OPENGL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                             cmd.count * sizeof(SpriteInstanceData),
+                             &frame.sprites[cmd.first], GL_STREAM_DRAW));
+    OPENGL_CALL(glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT,
+                                        nullptr, cmd.count));
+    stats.draw_calls++;
+    stats.sprite_instances += cmd.count;
+  }
+  OPENGL_CALL(glBindVertexArray(vao_));
+  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vertex_stream_.id()));
+  OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_stream_.id()));
+}
+
 void BatchRenderer::RenderParticlesBatch(const RenderParticlesCmd& rp,
                                          int viewport_w, int viewport_h,
                                          const FMat4x4& transform,
@@ -605,14 +1279,16 @@ void BatchRenderer::RenderParticlesBatch(const RenderParticlesCmd& rp,
       break;
   }
   // Bind particle texture.
-  OPENGL_CALL(glActiveTexture(GL_TEXTURE0 + rp.texture_unit));
+  OPENGL_CALL(glActiveTexture(GL_TEXTURE0 + kParticleTextureUnit));
   OPENGL_CALL(glBindTexture(GL_TEXTURE_2D, tex_[rp.texture_unit]));
   // Switch to particle shader.
-  shaders_->UseProgram("particle");
-  shaders_->SetUniformSilent("tex", static_cast<int>(rp.texture_unit));
-  shaders_->SetUniformSilent("projection", Ortho(0, viewport_w, 0, viewport_h));
-  shaders_->SetUniformSilent("transform", transform);
-  shaders_->SetUniformSilent("global_color", Color::White().ToFloat());
+  const ShaderNames& names = Names();
+  shaders_->UseProgram(particle_program_);
+  shaders_->SetUniformSilent(names.tex, kParticleTextureUnit);
+  shaders_->SetUniformSilent(names.projection,
+                             Ortho(0, viewport_w, 0, viewport_h));
+  shaders_->SetUniformSilent(names.transform, transform);
+  shaders_->SetUniformSilent(names.global_color, Color::White().ToFloat());
   // Bind particle VAO, draw, and restore normal rendering state.
   {
     GL::VertexArrayScope vao(particle_vao_);
@@ -627,18 +1303,20 @@ void BatchRenderer::RenderParticlesBatch(const RenderParticlesCmd& rp,
   }
   // Rebind the main VAO and buffers after the particle scope.
   OPENGL_CALL(glBindVertexArray(vao_));
-  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
-  OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_));
+  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vertex_stream_.id()));
+  OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_stream_.id()));
 }
 
 void BatchRenderer::FlushAndContinue() {
   Finish();
-  SetupGLState();
-  RenderBatch();
-  commands_.Clear();
-  pos_ = 0;
+  // The batch is drawn right away, so the context has to be ours.
+  ClaimGlContext();
+  SetupGLState(recording_);
+  RenderBatch(recording_);
+  recording_->commands.Clear();
+  recording_->pos = 0;
   ReEmitState();
-  flush_overflow_++;
+  recording_->flush_overflow++;
 }
 
 void BatchRenderer::DrawParticles(const ParticleInstanceData* instance_data,
@@ -648,12 +1326,147 @@ void BatchRenderer::DrawParticles(const ParticleInstanceData* instance_data,
              RenderParticlesCmd{instance_data, count, texture_unit, blend});
 }
 
+void BatchRenderer::DrawSpriteInstances(const SpriteInstanceData* instances,
+                                        uint32_t count) {
+  if (count == 0) return;
+  const uint32_t first = AppendSpriteInstances(recording_, instances, count);
+  AddCommand(kRenderSpriteInstances,
+             RenderSpriteInstancesCmd{first, count, rec_texture_, rec_color_});
+}
+
+uint32_t BatchRenderer::AppendSpriteInstances(
+    RecordedFrame* frame, const SpriteInstanceData* instances,
+    uint32_t count) {
+  const size_t needed = frame->sprite_count + count;
+  if (needed > frame->sprite_capacity) {
+    const size_t capacity = NextPow2(needed);
+    auto* sprites = frame->allocator->NewArray<SpriteInstanceData>(capacity);
+    CHECK(sprites != nullptr, "BatchRenderer: failed to allocate ", capacity,
+          " sprite instances");
+    if (frame->sprites != nullptr) {
+      std::memcpy(sprites, frame->sprites,
+                  frame->sprite_count * sizeof(SpriteInstanceData));
+      frame->allocator->DeallocArray(frame->sprites, frame->sprite_capacity);
+    }
+    frame->sprites = sprites;
+    frame->sprite_capacity = capacity;
+  }
+  std::memcpy(&frame->sprites[frame->sprite_count], instances,
+              count * sizeof(SpriteInstanceData));
+  const auto first = static_cast<uint32_t>(frame->sprite_count);
+  frame->sprite_count = needed;
+  return first;
+}
+
+uint32_t BatchRenderer::CreateStaticMesh(Slice<StaticQuad> quads) {
+  ClaimGlContext();
+  size_t slot = 0;
+  while (slot < static_meshes_.size() && static_meshes_[slot].vbo != 0) {
+    ++slot;
+  }
+  if (slot == static_meshes_.size()) static_meshes_.Push(StaticMesh{});
+  StaticMesh* mesh = &static_meshes_[slot];
+  OPENGL_CALL(glGenBuffers(1, &mesh->vbo));
+  UploadStaticMesh(mesh, quads);
+  return (uint32_t{mesh->generation} << 16) | (slot + 1);
+}
+
+void BatchRenderer::UpdateStaticMesh(uint32_t mesh, Slice<StaticQuad> quads) {
+  ClaimGlContext();
+  const StaticMesh* found = FindStaticMesh(mesh);
+  CHECK(found != nullptr, "Invalid static mesh ", mesh);
+  UploadStaticMesh(&static_meshes_[(mesh & 0xFFFF) - 1], quads);
+}
+
+void BatchRenderer::DestroyStaticMesh(uint32_t mesh) {
+  ClaimGlContext();
+  if (FindStaticMesh(mesh) == nullptr) return;
+  StaticMesh& m = static_meshes_[(mesh & 0xFFFF) - 1];
+  OPENGL_CALL(glDeleteBuffers(1, &m.vbo));
+  m = StaticMesh{.generation = static_cast<uint16_t>(m.generation + 1)};
+}
+
+const BatchRenderer::StaticMesh* BatchRenderer::FindStaticMesh(
+    uint32_t mesh) const {
+  const uint32_t slot = mesh & 0xFFFF;
+  if (slot == 0 || slot > static_meshes_.size()) return nullptr;
+  const StaticMesh& m = static_meshes_[slot - 1];
+  return m.vbo != 0 && m.generation == mesh >> 16 ? &m : nullptr;
+}
+
+void BatchRenderer::UploadStaticMesh(StaticMesh* mesh,
+                                     Slice<StaticQuad> quads) {
+  mesh->quads = quads.size();
+  if (quads.empty()) return;
+  // Same corner order and indices as the quads of a batch.
+  auto* vertices = allocator_->NewArray<VertexData>(4 * quads.size());
+  for (size_t i = 0; i < quads.size(); ++i) {
+    const StaticQuad& q = quads[i];
+    const FVec2 corners[4][2] = {{FVec(q.p0.x, q.p1.y), FVec(q.q0.x, q.q1.y)},
+                                 {q.p1, q.q1},
+                                 {FVec(q.p1.x, q.p0.y), FVec(q.q1.x, q.q0.y)},
+                                 {q.p0, q.q0}};
+    for (int j = 0; j < 4; ++j) {
+      vertices[4 * i + j] = {.position = corners[j][0],
+                             .tex_coords = corners[j][1],
+                             .origin = FVec(0, 0),
+                             .angle = 0,
+                             .color = Color::White(),
+                             .tex_slot = 0};
+    }
+  }
+  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo));
+  OPENGL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                           4 * quads.size() * sizeof(VertexData), vertices,
+                           GL_STATIC_DRAW));
+  allocator_->DeallocArray(vertices, 4 * quads.size());
+  if (quads.size() <= static_mesh_indexed_quads_) return;
+  static_mesh_indexed_quads_ = NextPow2(quads.size());
+  const size_t index_count = 6 * static_mesh_indexed_quads_;
+  auto* indices = allocator_->NewArray<GLuint>(index_count);
+  for (size_t i = 0; i < static_mesh_indexed_quads_; ++i) {
+    for (int j = 0; j < 6; ++j) {
+      constexpr GLuint kQuadIndices[6] = {0, 1, 3, 1, 2, 3};
+      indices[6 * i + j] = 4 * i + kQuadIndices[j];
+    }
+  }
+  // The element buffer binding is vertex array state.
+  GL::VertexArrayScope vao(static_mesh_vao_);
+  OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, static_mesh_ebo_));
+  OPENGL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                           index_count * sizeof(GLuint), indices,
+                           GL_STATIC_DRAW));
+  allocator_->DeallocArray(indices, index_count);
+}
+
+Shaders::ProgramInfo* BatchRenderer::ResolveProgram(uint32_t handle) const {
+  if (handle == 0) return pre_pass_program_;
+  Shaders::ProgramInfo* program =
+      shaders_->FindProgram(StringByHandle(handle));
+  CHECK(program != nullptr, "No program ", StringByHandle(handle));
+  return program;
+}
+
+BatchRenderer::SetShader BatchRenderer::ShaderCommand(
+    uint32_t handle, Shaders::ProgramInfo* program) const {
+  return SetShader{
+      .shader_handle = handle,
+      .program = program,
+      .custom = program != pre_pass_program_ && program != sdf_program_};
+}
+
+void BatchRenderer::SetShaderByHandle(uint32_t handle) {
+  current_shader_ = handle;
+  current_program_ = ResolveProgram(handle);
+  AddCommand(kSetShader, ShaderCommand(handle, current_program_));
+}
+
 void BatchRenderer::ReEmitState() {
   AddCommand(kSetColor, SetColor{rec_color_});
   AddCommand(kSetTexture, SetTexture{rec_texture_});
   AddCommand(kSetTransform, SetTransform{rec_transform_});
   if (current_shader_ != 0) {
-    AddCommand(kSetShader, SetShader{current_shader_});
+    AddCommand(kSetShader, ShaderCommand(current_shader_, current_program_));
   }
   AddCommand(kSetBlendMode, SetBlendMode{rec_blend_});
   AddCommand(kSetLineWidth, SetLineWidth{rec_line_width_});
@@ -672,164 +1485,407 @@ void BatchRenderer::ReEmitState() {
   if (rec_stencil_test_active_) {
     AddCommand(kSetStencilTest, rec_stencil_test_);
   }
+  if (rec_layer_ != 0) {
+    AddCommand(kSetLayer, SetLayerCmd{rec_layer_});
+  }
+}
+
+namespace {
+
+// Draws collected into one sort region before it is closed early.
+constexpr size_t kSortRegionDraws = 1 << 16;
+// Distinct shaders per sort region; the key stores them in 8 bits.
+constexpr int kSortRegionShaders = 256;
+// The sort key is layer:16 | shader:8 | blend:8 | texture:16 | transform:16.
+// Everything below the layer is render state.
+constexpr uint64_t kSortStateMask = (uint64_t{1} << 48) - 1;
+
+}  // namespace
+
+struct BatchRenderer::SortScratch {
+  // Render state a draw was recorded with.
+  struct State {
+    const SetTransform* transform;
+    Color color;
+    uint32_t shader;
+    Shaders::ProgramInfo* program;
+    bool custom_shader;
+    size_t texture;
+    BlendMode blend;
+  };
+
+  struct Draw {
+    uint64_t key;
+    const Command* command;
+    uint32_t state;
+    CommandType type;
+  };
+
+  explicit SortScratch(Allocator* parent)
+      : allocator(parent),
+        buffer(static_cast<uint8_t*>(
+            parent->Alloc(kCommandMemory, alignof(Command)))),
+        commands(1 << 20, parent),
+        draws(kSortRegionDraws, parent),
+        draws_scratch(kSortRegionDraws, parent),
+        states(kSortRegionDraws, parent) {
+    CHECK(buffer != nullptr, "BatchRenderer: failed to allocate ",
+          kCommandMemory, " byte sort buffer");
+  }
+
+  ~SortScratch() { allocator->Dealloc(buffer, kCommandMemory); }
+
+  Allocator* allocator;
+  uint8_t* buffer;
+  FixedArray<QueueEntry> commands;
+  FixedArray<Draw> draws;
+  FixedArray<Draw> draws_scratch;
+  FixedArray<State> states;
+};
+
+void BatchRenderer::SetRenderThread(RenderThread* render_thread) {
+  render_thread_ = render_thread;
+  if (render_thread != nullptr && submitted_ == recording_) {
+    submitted_ = allocator_->New<RecordedFrame>(allocator_);
+    submitted_->window_size = recording_->window_size;
+  }
+}
+
+void BatchRenderer::SwapFrames() {
+  if (submitted_ == recording_) return;
+  RecordedFrame* frame = recording_;
+  recording_ = submitted_;
+  submitted_ = frame;
+  RetainParticleData(submitted_);
+  recording_->window_size = submitted_->window_size;
+}
+
+void BatchRenderer::SetDrawSorting(bool enabled) {
+  // The render thread reads the sorting state while it draws.
+  ClaimGlContext();
+  if (enabled && sort_ == nullptr) {
+    sort_ = allocator_->New<SortScratch>(allocator_);
+  }
+  sort_draws_ = enabled;
 }
 
-void BatchRenderer::RenderBatch() {
-  render_scratch_.Reset();
-  Allocator* scratch = &render_scratch_;
-  // Compute size of data.
-  size_t vertices_count = 0, indices_count = 0;
-  for (CommandIterator it(command_buffer_, &commands_); !it.Done();) {
+bool BatchRenderer::SortCommands(RecordedFrame* frame, FrameStats* stats) {
+  PROFILE_SCOPE;
+  SortScratch& sort = *sort_;
+  using State = SortScratch::State;
+  using Draw = SortScratch::Draw;
+  static const SetTransform kIdentity = {FMat4x4::Identity()};
+  sort.commands.Clear();
+  CommandWriter out(sort.buffer, kCommandMemory, &sort.commands);
+  // Render state in submission order, and as last written to `out`. Both
+  // start out as the defaults RenderBatch assumes.
+  State current = {.transform = &kIdentity,
+                   .color = Color::White(),
+                   .shader = 0,
+                   .program = pre_pass_program_,
+                   .custom_shader = false,
+                   .texture = 0,
+                   .blend = BLEND_ALPHA};
+  State emitted = current;
+  int16_t layer = 0;
+  bool new_state = true;
+  uint64_t state_key = 0;
+  // Region-local ids for shaders and transforms, in order of appearance.
+  uint32_t shaders[kSortRegionShaders];
+  int shader_count = 0;
+  uint32_t transform_id = 0;
+  int draws_before = 0, draws_after = 0;
+
+  auto emit_state = [&](const State& to) {
+    if (to.shader != emitted.shader) {
+      out.Write(kSetShader,
+                SetShader{to.shader, to.program, to.custom_shader});
+    }
+    if (to.blend != emitted.blend) {
+      out.Write(kSetBlendMode, SetBlendMode{to.blend});
+    }
+    if (to.texture != emitted.texture) {
+      out.Write(kSetTexture, SetTexture{to.texture});
+    }
+    if (!(to.transform->transform == emitted.transform->transform)) {
+      out.Write(kSetTransform, *to.transform);
+    }
+    if (std::memcmp(&to.color, &emitted.color, sizeof(Color)) != 0) {
+      out.Write(kSetColor, SetColor{to.color});
+    }
+    emitted = to;
+  };
+  auto count_runs = [&] {
+    int runs = 0;
+    uint64_t last = ~uint64_t{0};
+    for (const Draw& d : sort.draws) {
+      if ((d.key & kSortStateMask) != last) runs++;
+      last = d.key & kSortStateMask;
+    }
+    return runs;
+  };
+  // Sorts and writes out the draws collected since the last barrier, then
+  // restores the state later commands were recorded with.
+  auto close_region = [&] {
+    if (!sort.draws.empty()) {
+      draws_before += count_runs();
+      RadixSort(sort.draws.data(), sort.draws_scratch.data(),
+                sort.draws.size(), [](const Draw& d) { return d.key; });
+      draws_after += count_runs();
+      for (const Draw& d : sort.draws) {
+        emit_state(sort.states[d.state]);
+        out.Write(d.type, d.command, SizeOfCommand(d.type));
+      }
+    }
+    emit_state(current);
+    sort.draws.Clear();
+    sort.states.Clear();
+    shader_count = 0;
+    transform_id = 0;
+    new_state = true;
+  };
+  auto shader_id = [&](uint32_t handle) {
+    for (int i = 0; i < shader_count; ++i) {
+      if (shaders[i] == handle) return i;
+    }
+    if (shader_count == kSortRegionShaders) return -1;
+    shaders[shader_count] = handle;
+    return shader_count++;
+  };
+  auto add_draw = [&](CommandType type, const Command* c) {
+    if (sort.draws.size() == sort.draws.capacity()) close_region();
+    if (new_state) {
+      int shader = shader_id(current.shader);
+      if (shader == -1) {
+        close_region();
+        shader = shader_id(current.shader);
+      }
+      state_key = (uint64_t{static_cast<uint8_t>(shader)} << 40) |
+                  (uint64_t{current.blend} << 32) |
+                  (uint64_t{current.texture & 0xFFFF} << 16) |
+                  (cpu_transforms_ && !current.custom_shader
+                       ? 0
+                       : transform_id & 0xFFFF);
+      sort.states.Push(current);
+      new_state = false;
+    }
+    const uint64_t layer_key = static_cast<uint16_t>(layer - INT16_MIN);
+    sort.draws.Push(Draw{.key = (layer_key << 48) | state_key,
+                         .command = c,
+                         .state = static_cast<uint32_t>(sort.states.size() - 1),
+                         .type = type});
+  };
+
+  for (CommandIterator it(frame->buffer, &frame->commands); !it.Done();) {
     const Command* c;
-    switch (it.Read(&c)) {
+    const CommandType type = it.Read(&c);
+    switch (type) {
       case kRenderQuad:
-        vertices_count += 4;
-        indices_count += 6;
-        break;
       case kRenderTrig:
-        vertices_count += 3;
-        indices_count += 3;
-        break;
-      case kAddLinePoint:
-        vertices_count += 1;
-        indices_count += 1;
+        add_draw(type, c);
         break;
-      default:
-        // Other commands do not add vertices.
+      case kSetTexture:
+        current.texture = c->set_texture.texture_unit;
+        new_state = true;
         break;
-    }
-  }
-  FixedArray<VertexData> vertices(vertices_count, scratch);
-  FixedArray<GLuint> indices(indices_count, scratch);
-  // Add data.
-  Color color = Color::White();
-  for (CommandIterator it(command_buffer_, &commands_); !it.Done();) {
-    size_t current = vertices.size();
-    const Command* c;
-    switch (it.Read(&c)) {
-      case kRenderQuad: {
-        const RenderQuad& q = c->quad;
-        vertices.Push({.position = FVec(q.p0.x, q.p1.y),
-                       .tex_coords = FVec(q.q0.x, q.q1.y),
-                       .origin = q.origin,
-                       .angle = q.angle,
-                       .color = color});
-        vertices.Push({.position = FVec(q.p1.x, q.p1.y),
-                       .tex_coords = q.q1,
-                       .origin = q.origin,
-                       .angle = q.angle,
-                       .color = color});
-        vertices.Push({.position = FVec(q.p1.x, q.p0.y),
-                       .tex_coords = FVec(q.q1.x, q.q0.y),
-                       .origin = q.origin,
-                       .angle = q.angle,
-                       .color = color});
-        vertices.Push({.position = FVec(q.p0.x, q.p0.y),
-                       .tex_coords = q.q0,
-                       .origin = q.origin,
-                       .angle = q.angle,
-                       .color = color});
-        for (int i : {0, 1, 3, 1, 2, 3}) {
-          indices.Push(current + i);
-        }
-      }; break;
-      case kRenderTrig: {
-        const RenderTriangle& t = c->triangle;
-        vertices.Push({.position = FVec(t.p0.x, t.p0.y),
-                       .tex_coords = t.q0,
-                       .origin = FVec(0, 0),
-                       .angle = 0,
-                       .color = color});
-        vertices.Push({.position = FVec(t.p1.x, t.p1.y),
-                       .tex_coords = t.q1,
-                       .origin = FVec(0, 0),
-                       .angle = 0,
-                       .color = color});
-        vertices.Push({.position = FVec(t.p2.x, t.p2.y),
-                       .tex_coords = t.q2,
-                       .origin = FVec(0, 0),
-                       .angle = 0,
-                       .color = color});
-        for (int i : {0, 1, 2}) {
-          indices.Push(current + i);
-        }
-      }; break;
-      case kAddLinePoint: {
-        const AddLinePoint& l = c->add_line_point;
-        vertices.Push({.position = l.p0,
-                       .tex_coords = FVec(0, 0),
-                       .origin = FVec(0, 0),
-                       .angle = 0,
-                       .color = color});
-        indices.Push(current);
-      }; break;
       case kSetColor:
-        color = c->set_color.color;
+        current.color = c->set_color.color;
+        new_state = true;
+        break;
+      case kSetTransform:
+        if (c->set_transform.transform == current.transform->transform) break;
+        if (transform_id == 0xFFFF) close_region();
+        current.transform = &c->set_transform;
+        transform_id++;
+        new_state = true;
+        break;
+      case kSetShader:
+        current.shader = c->set_shader.shader_handle;
+        current.program = c->set_shader.program;
+        current.custom_shader = c->set_shader.custom;
+        new_state = true;
+        break;
+      case kSetBlendMode:
+        current.blend = c->set_blend_mode.mode;
+        new_state = true;
+        break;
+      case kSetLayer:
+        layer = c->set_layer.layer;
         break;
       default:
-        // Other commands do not add vertices.
+        // Everything else is a barrier that keeps its position.
+        close_region();
+        out.Write(type, c, SizeOfCommand(type));
         break;
     }
   }
-  // Setup OpenGL context.
-  OPENGL_CALL(glBindVertexArray(vao_));
-  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
-  OPENGL_CALL(glBufferData(GL_ARRAY_BUFFER, vertices.bytes(), vertices.data(),
-                           GL_STATIC_DRAW));
-  OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_));
-  OPENGL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.bytes(),
-                           indices.data(), GL_STATIC_DRAW));
-  auto set_program_state = [&](std::string_view program_name) {
-    shaders_->UseProgram(program_name);
-    const GLint pos_attribute = shaders_->AttributeLocation("input_position");
-    if (pos_attribute != -1) {
+  close_region();
+  if (!out.ok()) return false;
+  stats->draws_before_sort += draws_before;
+  stats->draws_after_sort += draws_after;
+  return true;
+}
+
+void BatchRenderer::SetVertexAttributes(VertexFormat format) {
+  const ShaderNames& names = Names();
+  const bool packed = format == kVertexPacked;
+  const GLsizei stride =
+      packed ? sizeof(PackedVertexData) : sizeof(VertexData);
+  auto offset = [&](size_t full, size_t compact) {
+    return reinterpret_cast<void*>(packed ? compact : full);
+  };
+  const GLint pos_attribute = shaders_->AttributeLocation(names.position);
+  if (pos_attribute != -1) {
+    OPENGL_CALL(glVertexAttribPointer(
+        pos_attribute, FVec2::kCardinality, GL_FLOAT, GL_FALSE, stride,
+        offset(offsetof(VertexData, position),
+               offsetof(PackedVertexData, position))));
+    OPENGL_CALL(glEnableVertexAttribArray(pos_attribute));
+  }
+  const GLint tex_coord_attribute =
+      shaders_->AttributeLocation(names.tex_coord);
+  if (tex_coord_attribute != -1) {
+    if (packed) {
       OPENGL_CALL(glVertexAttribPointer(
-          pos_attribute, FVec2::kCardinality, GL_FLOAT, GL_FALSE,
-          sizeof(VertexData),
-          reinterpret_cast<void*>(offsetof(VertexData, position))));
-      OPENGL_CALL(glEnableVertexAttribArray(pos_attribute));
-    }
-    const GLint tex_coord_attribute =
-        shaders_->AttributeLocation("input_tex_coord");
-    if (tex_coord_attribute != -1) {
+          tex_coord_attribute, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+          offset(0, offsetof(PackedVertexData, tex_coords))));
+    } else {
       OPENGL_CALL(glVertexAttribPointer(
           tex_coord_attribute, FVec2::kCardinality, GL_FLOAT, GL_FALSE,
-          sizeof(VertexData),
-          reinterpret_cast<void*>(offsetof(VertexData, tex_coords))));
-      OPENGL_CALL(glEnableVertexAttribArray(tex_coord_attribute));
+          stride, offset(offsetof(VertexData, tex_coords), 0)));
     }
-    const GLint origin_attribute = shaders_->AttributeLocation("origin");
-    if (origin_attribute != -1) {
+    OPENGL_CALL(glEnableVertexAttribArray(tex_coord_attribute));
+  }
+  // Packed vertices are already rotated. With the arrays disabled the
+  // shader reads the constant attribute values instead: no rotation.
+  const GLint origin_attribute = shaders_->AttributeLocation(names.origin);
+  if (origin_attribute != -1) {
+    if (packed) {
+      OPENGL_CALL(glDisableVertexAttribArray(origin_attribute));
+      OPENGL_CALL(glVertexAttrib2f(origin_attribute, 0, 0));
+    } else {
       OPENGL_CALL(glVertexAttribPointer(
-          origin_attribute, FVec2::kCardinality, GL_FLOAT, GL_FALSE,
-          sizeof(VertexData),
-          reinterpret_cast<void*>(offsetof(VertexData, origin))));
+          origin_attribute, FVec2::kCardinality, GL_FLOAT, GL_FALSE, stride,
+          offset(offsetof(VertexData, origin), 0)));
       OPENGL_CALL(glEnableVertexAttribArray(origin_attribute));
     }
-    const GLint angle_attribute = shaders_->AttributeLocation("angle");
-    if (angle_attribute != -1) {
+  }
+  const GLint angle_attribute = shaders_->AttributeLocation(names.angle);
+  if (angle_attribute != -1) {
+    if (packed) {
+      OPENGL_CALL(glDisableVertexAttribArray(angle_attribute));
+      OPENGL_CALL(glVertexAttrib1f(angle_attribute, 0));
+    } else {
       OPENGL_CALL(glVertexAttribPointer(
-          angle_attribute, 1, GL_FLOAT, GL_FALSE, sizeof(VertexData),
-          reinterpret_cast<void*>(offsetof(VertexData, angle))));
+          angle_attribute, 1, GL_FLOAT, GL_FALSE, stride,
+          offset(offsetof(VertexData, angle), 0)));
       OPENGL_CALL(glEnableVertexAttribArray(angle_attribute));
     }
-    const GLint color_attribute = shaders_->AttributeLocation("color");
-    if (color_attribute != -1) {
-      OPENGL_CALL(glVertexAttribPointer(
-          color_attribute, sizeof(Color), GL_UNSIGNED_BYTE, GL_FALSE,
-          sizeof(VertexData),
-          reinterpret_cast<void*>(offsetof(VertexData, color))));
-      OPENGL_CALL(glEnableVertexAttribArray(color_attribute));
+  }
+  const GLint color_attribute = shaders_->AttributeLocation(names.color);
+  if (color_attribute != -1) {
+    OPENGL_CALL(glVertexAttribPointer(
+        color_attribute, sizeof(Color), GL_UNSIGNED_BYTE, GL_FALSE, stride,
+        offset(offsetof(VertexData, color),
+               offsetof(PackedVertexData, color))));
+    OPENGL_CALL(glEnableVertexAttribArray(color_attribute));
+  }
+  const GLint slot_attribute = shaders_->AttributeLocation(names.slot);
+  if (slot_attribute != -1) {
+    OPENGL_CALL(glVertexAttribIPointer(
+        slot_attribute, 1, GL_INT, stride,
+        offset(offsetof(VertexData, tex_slot),
+               offsetof(PackedVertexData, tex_slot))));
+    OPENGL_CALL(glEnableVertexAttribArray(slot_attribute));
+  }
+}
+
+void BatchRenderer::RenderBatch(RecordedFrame* frame) {
+  // Batch statistics, accumulated into frame_stats_ at the end.
+  FrameStats stats = {};
+  uint8_t* command_buffer = frame->buffer;
+  FixedArray<QueueEntry>* commands = &frame->commands;
+  if (sort_draws_) {
+    if (SortCommands(frame, &stats)) {
+      command_buffer = sort_->buffer;
+      commands = &sort_->commands;
+    } else {
+      LOG("Sorted commands do not fit the sort buffer, drawing unsorted");
     }
-    shaders_->SetUniformSilent("global_color", color.ToFloat());
+  }
+  // Size the geometry and split it into chunks that can be filled in
+  // parallel.
+  PlanFill(command_buffer, commands, texture_slots_, kFillChunkCommands,
+           &fill_plan_);
+  const size_t vertices_count = fill_plan_.vertices;
+  const size_t indices_count = fill_plan_.indices;
+  stats.fill_chunks = fill_plan_.count;
+  const VertexFormat format = packed_vertices_ && fill_plan_.packable
+                                  ? kVertexPacked
+                                  : kVertexFull;
+  const size_t stride =
+      format == kVertexPacked ? sizeof(PackedVertexData) : sizeof(VertexData);
+  if (format == kVertexPacked && vertices_count > 0) stats.packed_batches++;
+  // Write the geometry straight into the stream buffers. Indices are
+  // absolute, so the vertex offset of this batch inside the stream is folded
+  // into them instead of re-pointing the vertex attributes every batch.
+  OPENGL_CALL(glBindVertexArray(vao_));
+  OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vertex_stream_.id()));
+  OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_stream_.id()));
+  size_t vertex_offset = 0, index_offset = 0;
+  void* vertices = vertex_stream_.Map(vertices_count * stride,
+                                     /*align=*/stride, &vertex_offset);
+  auto* indices = static_cast<GLuint*>(index_stream_.Map(
+      indices_count * sizeof(GLuint), /*align=*/sizeof(GLuint), &index_offset));
+  FillGeometry(fill_plan_, cpu_transforms_, format,
+               /*base_vertex=*/vertex_offset / stride, vertices, indices,
+               executor_);
+  const bool cpu_transforms = cpu_transforms_;
+  Color color = fill_plan_.last_color;
+  TextureSlots slots(texture_slots_);
+  vertex_stream_.Unmap();
+  index_stream_.Unmap();
+  bool multi_texture_program = false;
+  // Value of global_color set with the current program.
+  Color program_color = color;
+  const ShaderNames& names = Names();
+  auto set_program_state = [&](Shaders::ProgramInfo* program) {
+    shaders_->UseProgram(program);
+    SetVertexAttributes(format);
+    // Programs without the sampler array only see `tex`, so a texture change
+    // still has to flush while they are active.
+    multi_texture_program = shaders_->HasUniform(names.tex_slots);
+    if (multi_texture_program) {
+      static constexpr int kUnits[kTextureSlots] = {0, 1, 2, 3, 4, 5, 6, 7};
+      shaders_->SetUniformSilent(names.tex_slots, kUnits, kTextureSlots);
+    }
+    program_color = color;
+    shaders_->SetUniformSilent(names.global_color, color.ToFloat());
   };
-  uint32_t current_shader_handle = current_shader_;
-  set_program_state("pre_pass");
+  // Handle 0 is the default program, which every batch starts with.
+  uint32_t current_shader_handle = 0;
+  Shaders::ProgramInfo* current_program = pre_pass_program_;
+  // Custom programs get the transform as a uniform, see SetShader::custom.
+  bool custom_program = false;
+  set_program_state(current_program);
   // Render batches by finding changes to the OpenGL context.
-  FrameStats stats = {};
   size_t indices_start = 0;
   size_t indices_end = 0;
   GLuint texture_unit = 0;
+  slots.Reset();
+  int texture_slot = slots.Add(texture_unit);
+  // Textures bound to each slot's unit, 0 if unknown.
+  GLuint bound_textures[kTextureSlots] = {};
+  auto unbind_slots = [&] {
+    const GLuint noop = tex_[noop_texture_];
+    for (int i = 0; i < kTextureSlots; ++i) {
+      if (bound_textures[i] == noop) continue;
+      OPENGL_CALL(glActiveTexture(GL_TEXTURE0 + i));
+      OPENGL_CALL(glBindTexture(GL_TEXTURE_2D, noop));
+      bound_textures[i] = noop;
+    }
+  };
+  unbind_slots();
   FMat4x4 transform = FMat4x4::Identity();
   GLint primitives = GL_TRIANGLES;
   float line_width = 2.5;
@@ -840,23 +1896,30 @@ void BatchRenderer::RenderBatch() {
   int current_viewport_w = viewport_.x;
   int current_viewport_h = viewport_.y;
   const Command* c;
-  for (CommandIterator it(command_buffer_, &commands_); !it.Done();) {
+  for (CommandIterator it(command_buffer, commands); !it.Done();) {
     auto flush = [&] {
       if (indices_start == indices_end) return;
       glLineWidth(line_width);
-      glActiveTexture(GL_TEXTURE0 + texture_unit);
-      shaders_->SetUniformSilent("tex", texture_unit);
+      for (int i = 0; i < slots.size(); ++i) {
+        const GLuint id = tex_[slots.texture(i)];
+        if (bound_textures[i] == id) continue;
+        OPENGL_CALL(glActiveTexture(GL_TEXTURE0 + i));
+        OPENGL_CALL(glBindTexture(GL_TEXTURE_2D, id));
+        bound_textures[i] = id;
+      }
+      shaders_->SetUniformSilent(names.tex, texture_slot);
       shaders_->SetUniformSilent(
-          "projection", Ortho(0, current_viewport_w, 0, current_viewport_h));
-      shaders_->SetUniformSilent("transform", transform);
-      shaders_->SetUniformSilent("g_ScreenSize",
+          names.projection,
+          Ortho(0, current_viewport_w, 0, current_viewport_h));
+      shaders_->SetUniformSilent(
+          names.transform,
+          cpu_transforms && !custom_program ? FMat4x4::Identity() : transform);
+      shaders_->SetUniformSilent(names.screen_size,
                                  FVec(current_viewport_w, current_viewport_h));
-      shaders_->SetUniformSilentF("g_Time", frame_time_);
-      OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_));
-      OPENGL_CALL(glBindTexture(GL_TEXTURE_2D, tex_[texture_unit]));
-      const auto indices_start_ptr =
-          reinterpret_cast<uintptr_t>(&indices[indices_start]) -
-          reinterpret_cast<uintptr_t>(&indices[0]);
+      shaders_->SetUniformSilentF(names.time, frame->frame_time);
+      OPENGL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_stream_.id()));
+      const uintptr_t indices_start_ptr =
+          index_offset + indices_start * sizeof(GLuint);
       OPENGL_CALL(glDrawElementsInstanced(
           primitives, indices_end - indices_start, GL_UNSIGNED_INT,
           reinterpret_cast<void*>(indices_start_ptr), 1));
@@ -891,19 +1954,35 @@ void BatchRenderer::RenderBatch() {
           stats.redundant_transform++;
           break;
         }
-        flush();
-        stats.flush_transform++;
+        // Particles still take the transform as a uniform, so keep
+        // tracking it even when the vertices already have it applied.
+        if (cpu_transforms && !custom_program) {
+          stats.cpu_transforms++;
+        } else {
+          flush();
+          stats.flush_transform++;
+        }
         transform = c->set_transform.transform;
         break;
-      case kSetTexture:
+      case kSetTexture: {
         if (c->set_texture.texture_unit == texture_unit) {
           stats.redundant_texture++;
           break;
         }
-        flush();
-        stats.flush_texture++;
         texture_unit = c->set_texture.texture_unit;
-        break;
+        const int found = slots.Find(texture_unit);
+        if (found == -1 && slots.full()) {
+          flush();
+          stats.flush_texture++;
+          slots.Reset();
+        } else if (!multi_texture_program) {
+          flush();
+          stats.flush_texture++;
+        } else {
+          stats.texture_slot_hits++;
+        }
+        texture_slot = found != -1 ? found : slots.Add(texture_unit);
+      } break;
       case kSetShader:
         if (c->set_shader.shader_handle == current_shader_handle) {
           stats.redundant_shader++;
@@ -912,7 +1991,9 @@ void BatchRenderer::RenderBatch() {
         flush();
         stats.flush_shader++;
         current_shader_handle = c->set_shader.shader_handle;
-        set_program_state(StringByHandle(c->set_shader.shader_handle));
+        current_program = c->set_shader.program;
+        custom_program = c->set_shader.custom;
+        set_program_state(current_program);
         break;
       case kSetLineWidth:
         if (c->set_line_width.width == line_width) {
@@ -932,6 +2013,9 @@ void BatchRenderer::RenderBatch() {
         current_fbo = c->set_canvas.fbo;
         current_viewport_w = c->set_canvas.width;
         current_viewport_h = c->set_canvas.height;
+        slots.Reset();
+        texture_slot = slots.Add(texture_unit);
+        unbind_slots();
         break;
       case kSetBlendMode:
         if (c->set_blend_mode.mode == blend_mode) {
@@ -986,9 +2070,9 @@ void BatchRenderer::RenderBatch() {
         sdf_g = c->sdf_outline.g;
         sdf_b = c->sdf_outline.b;
         sdf_a = c->sdf_outline.a;
-        shaders_->SetUniformSilentF("u_outline_thickness",
+        shaders_->SetUniformSilentF(names.outline_thickness,
                                     c->sdf_outline.thickness);
-        shaders_->SetUniformSilent("u_outline_color",
+        shaders_->SetUniformSilent(names.outline_color,
                                    FVec(c->sdf_outline.r, c->sdf_outline.g,
                                         c->sdf_outline.b, c->sdf_outline.a));
         break;
@@ -1045,9 +2129,7 @@ void BatchRenderer::RenderBatch() {
         RenderParticlesBatch(c->render_particles, current_viewport_w,
                              current_viewport_h, transform, stats);
         // Restore shader and blend mode after the particle draw.
-        set_program_state(current_shader_handle
-                              ? StringByHandle(current_shader_handle)
-                              : std::string_view("pre_pass"));
+        set_program_state(current_program);
         switch (blend_mode) {
           case BLEND_ALPHA:
             OPENGL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
@@ -1067,6 +2149,55 @@ void BatchRenderer::RenderBatch() {
         }
         break;
       }
+      case kDrawStaticMesh: {
+        flush();
+        stats.static_meshes++;
+        const DrawStaticMeshCmd& d = c->draw_static_mesh;
+        const StaticMesh* mesh = FindStaticMesh(d.mesh);
+        if (mesh == nullptr || mesh->quads == 0) break;
+        // The mesh samples from unit 0. The next flush rebinds the batch
+        // texture there if it differs.
+        const GLuint id = tex_[d.texture_unit];
+        if (bound_textures[0] != id) {
+          OPENGL_CALL(glActiveTexture(GL_TEXTURE0));
+          OPENGL_CALL(glBindTexture(GL_TEXTURE_2D, id));
+          bound_textures[0] = id;
+        }
+        // Tint like a batched quad: vertex color times global_color.
+        const FVec4 tint = program_color.ToFloat();
+        const FVec4 mesh_color = d.color.ToFloat();
+        shaders_->SetUniformSilent(names.tex, 0);
+        shaders_->SetUniformSilent(
+            names.projection,
+            Ortho(0, current_viewport_w, 0, current_viewport_h));
+        shaders_->SetUniformSilent(
+            names.transform, transform * TranslationXY(d.offset.x, d.offset.y));
+        shaders_->SetUniformSilent(
+            names.screen_size, FVec(current_viewport_w, current_viewport_h));
+        shaders_->SetUniformSilentF(names.time, frame->frame_time);
+        shaders_->SetUniformSilent(
+            names.global_color,
+            FVec(tint.x * mesh_color.x, tint.y * mesh_color.y,
+                 tint.z * mesh_color.z, tint.w * mesh_color.w));
+        OPENGL_CALL(glBindVertexArray(static_mesh_vao_));
+        OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo));
+        SetVertexAttributes(kVertexFull);
+        OPENGL_CALL(glDrawElements(GL_TRIANGLES, 6 * mesh->quads,
+                                   GL_UNSIGNED_INT, nullptr));
+        stats.draw_calls++;
+        OPENGL_CALL(glBindVertexArray(vao_));
+        OPENGL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vertex_stream_.id()));
+        shaders_->SetUniformSilent(names.global_color, tint);
+      } break;
+      case kRenderSpriteInstances:
+        flush();
+        RenderSpriteInstances(c->render_sprite_instances, *frame,
+                              current_viewport_w, current_viewport_h,
+                              transform, program_color.ToFloat(), stats);
+        set_program_state(current_program);
+        break;
+      case kSetLayer:
+        break;
       case kDone:
         color = Color::White();
         flush();
@@ -1099,15 +2230,33 @@ void BatchRenderer::AccumulateStats(const FrameStats& stats,
   frame_stats_.redundant_blend += stats.redundant_blend;
   frame_stats_.redundant_line_width += stats.redundant_line_width;
   frame_stats_.redundant_sdf_outline += stats.redundant_sdf_outline;
+  frame_stats_.texture_slot_hits += stats.texture_slot_hits;
+  frame_stats_.cpu_transforms += stats.cpu_transforms;
+  frame_stats_.draws_before_sort += stats.draws_before_sort;
+  frame_stats_.draws_after_sort += stats.draws_after_sort;
   frame_stats_.flush_particles += stats.flush_particles;
+  frame_stats_.static_meshes += stats.static_meshes;
+  frame_stats_.sprite_instances += stats.sprite_instances;
+  frame_stats_.fill_chunks += stats.fill_chunks;
+  frame_stats_.packed_batches += stats.packed_batches;
 }
 
 void BatchRenderer::Render() {
   PROFILE_SCOPE;
   frame_stats_ = {};
-  SetupGLState();
-  RenderBatch();
-  frame_stats_.flush_overflow = flush_overflow_;
+  RecordedFrame* frame = submitted_;
+  SetupGLState(frame);
+  RenderBatch(frame);
+  frame_stats_.flush_overflow = frame->flush_overflow;
+  // Stream stats also cover overflow flushes issued earlier in the frame.
+  for (StreamBuffer* stream : {&vertex_stream_, &index_stream_}) {
+    frame_stats_.bytes_uploaded += stream->stats().bytes_uploaded;
+    frame_stats_.upload_stalls += stream->stats().stalls;
+    frame_stats_.upload_orphans += stream->stats().orphans;
+    stream->ResetStats();
+  }
+  frame_stats_.redundant_uniform = shaders_->skipped_uploads();
+  shaders_->ResetStats();
   // MSAA resolve: downsample from multisampled to regular framebuffer.
   OPENGL_CALL(glActiveTexture(GL_TEXTURE0));
   OPENGL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, render_target_));
@@ -1119,15 +2268,15 @@ void BatchRenderer::Render() {
   OPENGL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
   OPENGL_CALL(glClearColor(0.f, 0.f, 0.f, 0.f));
   OPENGL_CALL(glClear(GL_COLOR_BUFFER_BIT));
-  shaders_->UseProgram("post_pass");
+  shaders_->UseProgram(post_pass_program_);
   glActiveTexture(GL_TEXTURE1);
-  shaders_->SetUniformSilent("screen_texture", 1);
+  shaders_->SetUniformSilent(Names().screen_texture, 1);
   {
     GL::VertexArrayScope vao(screen_quad_vao_);
     GL::TextureScope tex(GL_TEXTURE_2D, downsampled_texture_);
     // Fit viewport into window preserving aspect ratio (letterbox).
     FVec2 vp(viewport_.x, viewport_.y);
-    FVec2 win(window_size_.x, window_size_.y);
+    FVec2 win(frame->window_size.x, frame->window_size.y);
     float scale_x = win.x / vp.x;
     float scale_y = win.y / vp.y;
     float scale = scale_x < scale_y ? scale_x : scale_y;
@@ -1152,10 +2301,14 @@ void BatchRenderer::Render() {
   PROFILE_COUNTER("Redundant: Texture", frame_stats_.redundant_texture);
   PROFILE_COUNTER("Redundant: Transform", frame_stats_.redundant_transform);
   PROFILE_COUNTER("Redundant: Shader", frame_stats_.redundant_shader);
+  PROFILE_COUNTER("Bytes Uploaded",
+                  static_cast<double>(frame_stats_.bytes_uploaded));
+  PROFILE_COUNTER("Upload Stalls", frame_stats_.upload_stalls);
 }
 
 BatchRenderer::Screenshot BatchRenderer::TakeScreenshot(
     Allocator* allocator) const {
+  ClaimGlContext();
   Screenshot result;
   const IVec2 viewport = GetViewport();
   size_t bytes = viewport.x;
@@ -1197,6 +2350,8 @@ Renderer::Renderer(const DbAssets& /*assets*/, BatchRenderer* renderer,
       loaded_spritesheets_(allocator),
       loaded_sprites_table_(allocator),
       loaded_sprites_(allocator),
+      sprite_ids_(allocator),
+      sprites_by_id_(kMaxSpriteIds, allocator),
       loaded_images_table_(allocator),
       loaded_images_(1 << 10, allocator),
       font_table_(allocator),
@@ -1281,6 +2436,19 @@ ErrorOr<void> Renderer::DrawSprite(std::string_view sprite_name, FVec2 position,
 
 ErrorOr<void> Renderer::DrawSprite(const DbAssets::Sprite& sprite,
                                    FVec2 position, float angle) {
+  DrawSprite(TRY(ResolveSprite(sprite)), position, angle);
+  return {};
+}
+
+ErrorOr<SpriteHandle> Renderer::ResolveSprite(std::string_view sprite_name) {
+  DbAssets::Sprite* sprite = nullptr;
+  if (!loaded_sprites_table_.Lookup(sprite_name, &sprite)) {
+    return Error::Message("sprite not found");
+  }
+  return ResolveSprite(*sprite);
+}
+
+ErrorOr<SpriteHandle> Renderer::ResolveSprite(const DbAssets::Sprite& sprite) {
   DbAssets::Spritesheet* spritesheet;
   if (!loaded_spritesheets_table_.Lookup(sprite.spritesheet, &spritesheet)) {
     return Error::Message("spritesheet not found");
@@ -1289,15 +2457,60 @@ ErrorOr<void> Renderer::DrawSprite(const DbAssets::Sprite& sprite,
   CHECK(textures_table_.Lookup(spritesheet->name, &texture_index),
         "No spritesheet texture for ", sprite.name, "(spritesheet ",
         spritesheet->name, ")");
-  SetTextureDedup(textures_[texture_index]);
   const float x = sprite.x, y = sprite.y, w = sprite.width, h = sprite.height;
-  const FVec2 p0(position - FVec(w / 2.0, h / 2.0));
-  const FVec2 p1(position + FVec(w / 2.0, h / 2.0));
-  const FVec2 q0(
-      FVec(1.0 * x / spritesheet->width, 1.0 * y / spritesheet->height));
-  const FVec2 q1(1.0f * (x + w) / spritesheet->width,
-                 1.0f * (y + h) / spritesheet->height);
-  renderer_->PushQuad(p0, p1, q0, q1, position, angle);
+  return SpriteHandle{
+      .texture = textures_[texture_index],
+      .size = FVec(w, h),
+      .q0 = FVec(1.0 * x / spritesheet->width, 1.0 * y / spritesheet->height),
+      .q1 = FVec(1.0f * (x + w) / spritesheet->width,
+                 1.0f * (y + h) / spritesheet->height)};
+}
+
+ErrorOr<uint32_t> Renderer::SpriteId(std::string_view sprite_name) {
+  uint32_t id;
+  if (sprite_ids_.Lookup(sprite_name, &id)) return id;
+  if (sprites_by_id_.size() == sprites_by_id_.capacity()) {
+    return Error::Message("too many sprite ids");
+  }
+  const SpriteHandle handle = TRY(ResolveSprite(sprite_name));
+  id = sprites_by_id_.size();
+  sprites_by_id_.Push(handle);
+  sprite_ids_.Insert(sprite_name, id);
+  return id;
+}
+
+ErrorOr<void> Renderer::DrawBatch(DrawRecordFormat format,
+                                  const uint8_t* records, size_t count) {
+  // Records are copied out since buffers carry no alignment guarantees.
+  Color color = color_;
+  auto set_color = [&](Color c) {
+    if (std::memcmp(&c, &color, sizeof(Color)) == 0) return;
+    color = c;
+    renderer_->SetActiveColor(c);
+  };
+  switch (format) {
+    case kSpriteRecords:
+      for (size_t i = 0; i < count; ++i) {
+        SpriteDrawRecord r;
+        std::memcpy(&r, records + i * sizeof(r), sizeof(r));
+        if (r.sprite >= sprites_by_id_.size()) {
+          set_color(color_);
+          return Error::Message("unknown sprite id");
+        }
+        set_color(r.color);
+        DrawSprite(sprites_by_id_[r.sprite], FVec(r.x, r.y), r.angle);
+      }
+      break;
+    case kRectRecords:
+      for (size_t i = 0; i < count; ++i) {
+        RectDrawRecord r;
+        std::memcpy(&r, records + i * sizeof(r), sizeof(r));
+        set_color(r.color);
+        DrawRect(FVec(r.x1, r.y1), FVec(r.x2, r.y2), r.angle);
+      }
+      break;
+  }
+  set_color(color_);
   return {};
 }
 
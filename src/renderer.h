@@ -2,18 +2,24 @@
 #ifndef _GAME_RENDERER_H
 #define _GAME_RENDERER_H
 
+#include <algorithm>
+#include <cstdint>
+
 #include "allocators.h"
 #include "array.h"
 #include "assets.h"
 #include "color.h"
 #include "dictionary.h"
+#include "executor.h"
 #include "libraries/sqlite3.h"
 #include "libraries/stb_rect_pack.h"
 #include "libraries/stb_truetype.h"
 #include "mat.h"
 #include "particles.h"
+#include "render_thread.h"
 #include "segmented_list.h"
 #include "shaders.h"
+#include "stream_buffer.h"
 #include "transformations.h"
 #include "vec.h"
 
@@ -60,11 +66,87 @@ struct FrameStats {
   int redundant_blend = 0;
   int redundant_line_width = 0;
   int redundant_sdf_outline = 0;
+  // Uniform uploads skipped because the program already had the value.
+  int redundant_uniform = 0;
+  // Texture changes absorbed by the texture slots instead of flushing.
+  int texture_slot_hits = 0;
+  // Transform changes applied to vertices on the CPU instead of flushing.
+  int cpu_transforms = 0;
+  // Runs of identical render state (shader, blend, texture, transform)
+  // among sortable draws, in submission order and after sorting. Only
+  // populated with draw sorting enabled.
+  int draws_before_sort = 0;
+  int draws_after_sort = 0;
   int flush_particles = 0;
+  // Draws of resident geometry (see BatchRenderer::DrawStaticMesh).
+  int static_meshes = 0;
+  // Sprites drawn by BatchRenderer::DrawSpriteInstances.
+  int sprite_instances = 0;
+  // Tasks the vertex fill was split into (see BatchRenderer::SetExecutor).
+  int fill_chunks = 0;
+  // Batches uploaded in the packed vertex format (see
+  // BatchRenderer::SetPackedVertices).
+  int packed_batches = 0;
+  // Streaming uploads of vertex/index data (see StreamBuffer).
+  size_t bytes_uploaded = 0;
+  int upload_stalls = 0;   // Waits on a GPU fence before reusing a segment.
+  int upload_orphans = 0;  // Buffer reallocations (growth, web laps).
+};
+
+// A textured axis-aligned quad of a static mesh, see
+// BatchRenderer::CreateStaticMesh.
+struct StaticQuad {
+  FVec2 p0, p1;  // Opposite corners.
+  FVec2 q0, q1;  // Texture coordinates at p0 and p1.
+};
+
+// One sprite of BatchRenderer::DrawSpriteInstances. Lua builds arrays of
+// these with G.data.pack (see G.graphics.draw_sprite_instances), so the
+// layout must stay packed.
+struct SpriteInstanceData {
+  float x, y;            // Center.
+  float width, height;   // Full size.
+  float u0, v0, u1, v1;  // Texture coordinates at the top-left and
+                         // bottom-right corners.
+  float angle;           // Rotation around the center, in radians.
+  Color color;           // Multiplied with the current color.
+};
+
+static_assert(sizeof(SpriteInstanceData) == 40);
+
+// A sprite with its texture and texture coordinates resolved, so drawing it
+// needs no name lookups. See Renderer::ResolveSprite.
+struct SpriteHandle {
+  size_t texture;  // BatchRenderer texture index.
+  FVec2 size;
+  FVec2 q0, q1;  // Texture coordinates of the top-left and bottom-right.
+};
+
+// Records of Renderer::DrawBatch. Like SpriteInstanceData, Lua packs these
+// into byte buffers, so the layouts must stay packed.
+enum DrawRecordFormat : uint8_t { kSpriteRecords, kRectRecords };
+
+struct SpriteDrawRecord {
+  uint32_t sprite;  // See Renderer::SpriteId.
+  float x, y;       // Center.
+  float angle;
+  Color color;
 };
 
+struct RectDrawRecord {
+  float x1, y1, x2, y2;  // Top-left and bottom-right corners.
+  float angle;
+  Color color;
+};
+
+static_assert(sizeof(SpriteDrawRecord) == 20 && sizeof(RectDrawRecord) == 24);
+
 class BatchRenderer {
  public:
+  // Number of texture units the default shader samples from. Sprites using
+  // up to this many distinct textures batch into a single draw call.
+  inline static constexpr int kTextureSlots = 8;
+
   BatchRenderer(IVec2 viewport, Shaders* shaders, Allocator* allocator);
 
   ~BatchRenderer();
@@ -80,6 +162,46 @@ class BatchRenderer {
     default_mag_filter_ = mag_filter;
   }
 
+  // Enables binding up to kTextureSlots textures per draw call, selected per
+  // vertex. When disabled every texture change flushes the batch.
+  void SetTextureSlotBatching(bool enabled) {
+    texture_slots_ = enabled ? kTextureSlots : 1;
+  }
+
+  // Applies transforms to vertices on the CPU so transform changes do not
+  // flush the batch. Disable to upload the transform as a uniform instead,
+  // which is cheaper for very large meshes under few transforms.
+  void SetCpuTransforms(bool enabled) { cpu_transforms_ = enabled; }
+
+  // Uploads batches whose texture coordinates all lie in [0, 1] in a
+  // 20 byte vertex format instead of the 36 byte one: rotations are
+  // applied on the CPU and texture coordinates are quantized to 16 bits.
+  // Batches with repeating texture coordinates keep the full format.
+  void SetPackedVertices(bool enabled) { packed_vertices_ = enabled; }
+
+  // Fills batch vertices on `executor`'s threads. Null (the default) fills
+  // them on the calling thread.
+  void SetExecutor(Executor* executor) { executor_ = executor; }
+
+  // Draws frames on `render_thread` while the next one is recorded. Adds a
+  // second command buffer: frames are recorded into one and handed to the
+  // render thread with SwapFrames(). GL entry points called from other
+  // threads claim the context back first. Must be set before recording.
+  void SetRenderThread(RenderThread* render_thread);
+
+  // Waits for the frame in flight on the render thread, if any, and makes
+  // the GL context current on the caller. For code that releases GL
+  // objects itself, such as Canvas::Destroy.
+  void ClaimGlContext() const {
+    if (render_thread_ != nullptr) render_thread_->Claim();
+  }
+
+  // Hands the recorded frame over for Render() and starts recording into
+  // the other buffer. Particle instance data is copied into the frame, so
+  // the frame allocator it was drawn from may be reset while the render
+  // thread draws it. No-op without a render thread.
+  void SwapFrames();
+
   size_t LoadFontTexture(const void* data, size_t width, size_t height);
 
   size_t RegisterTexture(GLuint tex);
@@ -187,34 +309,79 @@ class BatchRenderer {
                ps.size() * sizeof(FVec2));
   }
 
+  // Uploads `quads` into a vertex buffer that stays on the GPU until
+  // DestroyStaticMesh, for geometry that rarely changes such as tilemap
+  // chunks. Returns a non-zero handle for DrawStaticMesh: the slot in the
+  // low 16 bits and its generation in the high 16.
+  uint32_t CreateStaticMesh(Slice<StaticQuad> quads);
+
+  // Replaces the quads of a static mesh.
+  void UpdateStaticMesh(uint32_t mesh, Slice<StaticQuad> quads);
+
+  void DestroyStaticMesh(uint32_t mesh);
+
+  // Draws a static mesh translated by `offset` with the current texture,
+  // color and transform, as one draw call regardless of its size. Draws of
+  // meshes destroyed before the frame is rendered are dropped.
+  void DrawStaticMesh(uint32_t mesh, FVec2 offset) {
+    AddCommand(kDrawStaticMesh,
+               DrawStaticMeshCmd{mesh, offset, rec_texture_, rec_color_});
+  }
+
+  // Draws `count` sprites with the current texture, color, transform and
+  // blend mode as a single instanced draw call. The instances are copied.
+  void DrawSpriteInstances(const SpriteInstanceData* instances,
+                           uint32_t count);
+
   // Pushes a single instanced draw command for particles. The instance_data
-  // pointer must remain valid until RenderBatch completes (use frame
-  // allocator).
+  // pointer must remain valid until the frame is submitted with Render() or
+  // SwapFrames() (use frame allocator).
   void DrawParticles(const ParticleInstanceData* instance_data, uint32_t count,
                      size_t texture_unit, BlendMode blend);
 
   void SetShaderProgram(std::string_view program_name) {
-    current_shader_ = StringIntern(program_name);
-    AddCommand(kSetShader, SetShader{current_shader_});
+    SetShaderByHandle(StringIntern(program_name));
   }
 
-  void SetShaderByHandle(uint32_t handle) {
-    current_shader_ = handle;
-    AddCommand(kSetShader, SetShader{handle});
-  }
+  void SetShaderByHandle(uint32_t handle);
 
   uint32_t GetCurrentShaderHandle() const { return current_shader_; }
 
+  // The draw sort key reserves 16 bits for the layer.
+  static constexpr int kMinLayer = INT16_MIN;
+  static constexpr int kMaxLayer = INT16_MAX;
+
+  // Sets the layer of subsequent draws. Layers only matter with draw
+  // sorting enabled, see SetDrawSorting.
+  void SetLayer(int layer) {
+    rec_layer_ = static_cast<int16_t>(std::clamp(layer, kMinLayer, kMaxLayer));
+    AddCommand(kSetLayer, SetLayerCmd{rec_layer_});
+  }
+
+  int16_t layer() const { return rec_layer_; }
+
+  // When enabled, quads and triangles between two barrier commands (canvas,
+  // scissor, stencil, clears, lines, particles, static meshes, sprite
+  // instances, SDF outline)
+  // are drawn by ascending layer and, within a layer, grouped by shader,
+  // blend mode, texture and transform rather than in submission order.
+  // Overlapping draws on the same layer may change order.
+  void SetDrawSorting(bool enabled);
+
+  bool draw_sorting() const { return sort_draws_; }
+
   void SetActiveLineWidth(float width) {
     rec_line_width_ = width;
     AddCommand(kSetLineWidth, SetLineWidth{width});
   }
 
   void Clear() {
-    commands_.Clear();
-    pos_ = 0;
-    needs_clear_ = true;
-    flush_overflow_ = 0;
+    recording_->commands.Clear();
+    recording_->pos = 0;
+    recording_->needs_clear = true;
+    recording_->flush_overflow = 0;
+    recording_->sprite_count = 0;
+    rec_layer_ = 0;
   }
 
   void Finish() { AddCommand(kDone, DoneCommand{}); }
@@ -223,28 +390,29 @@ class BatchRenderer {
 
   void InitializeFramebuffers();
 
-  void SetFrameTime(float t) { frame_time_ = t; }
+  void SetFrameTime(float t) { recording_->frame_time = t; }
 
   IVec2 GetViewport() const { return viewport_; }
 
   // Sets the actual window size for the post-pass. When different from the
   // viewport, the game is letterboxed to preserve aspect ratio.
-  void SetWindowSize(IVec2 size) { window_size_ = size; }
-  IVec2 GetWindowSize() const { return window_size_; }
+  void SetWindowSize(IVec2 size) { recording_->window_size = size; }
+  IVec2 GetWindowSize() const { return recording_->window_size; }
 
   GLuint GetRenderTarget() const { return render_target_; }
 
+  // Draws the submitted frame: the one being recorded, or the last one
+  // handed over with SwapFrames() when there is a render thread.
   void Render();
 
   const FrameStats& GetFrameStats() const { return frame_stats_; }
 
-  // Returns the number of bytes currently used in the command buffer.
-  size_t GetCommandBufferUsed() const { return pos_; }
+  // Returns the number of bytes used in the submitted command buffer.
+  size_t GetCommandBufferUsed() const { return submitted_->pos; }
 
   // Returns the total command buffer capacity in bytes.
   size_t GetCommandBufferCapacity() const;
 
-  // Returns the number of loaded texture units.
   // Returns the number of loaded texture units.
   size_t GetTextureCount() const { return tex_.size(); }
 
@@ -270,6 +438,9 @@ class BatchRenderer {
   Screenshot TakeScreenshot(Allocator* allocator) const;
 
  private:
+  // Exercises PlanFill and FillGeometry without a GL context.
+  friend class BatchRendererFillTest;
+
   enum CommandType : uint32_t {
     kRenderQuad = 1,
     kRenderTrig,
@@ -292,6 +463,9 @@ class BatchRenderer {
     kSetStencilTest,
     kClearStencilTest,
     kRenderParticles,
+    kSetLayer,
+    kDrawStaticMesh,
+    kRenderSpriteInstances,
     kDone
   };
 
@@ -320,6 +494,12 @@ class BatchRenderer {
 
   struct SetShader {
     uint32_t shader_handle;
+    // Resolved when recorded, so the render thread does no name lookups.
+    Shaders::ProgramInfo* program;
+    // Set for programs other than the built-in pre_pass and sdf ones. Their
+    // vertex stage may read the raw positions, so they always get the
+    // transform as a uniform, even with CPU transforms on.
+    bool custom;
   };
 
   struct StartLine {};
@@ -384,6 +564,27 @@ class BatchRenderer {
     BlendMode blend;
   };
 
+  struct SetLayerCmd {
+    int16_t layer;
+  };
+
+  // Texture and color are captured at record time, like the vertices of
+  // other draws.
+  struct DrawStaticMeshCmd {
+    uint32_t mesh;
+    FVec2 offset;
+    size_t texture_unit;
+    Color color;
+  };
+
+  // The instances live in RecordedFrame::sprites from `first` on.
+  struct RenderSpriteInstancesCmd {
+    uint32_t first;
+    uint32_t count;
+    size_t texture_unit;
+    Color color;
+  };
+
   inline static constexpr uint32_t kMaxCount = 1 << 20;
 
   struct QueueEntry {
@@ -413,6 +614,9 @@ class BatchRenderer {
     SetStencilTestCmd set_stencil_test;
     ClearStencilTestCmd clear_stencil_test;
     RenderParticlesCmd render_particles;
+    SetLayerCmd set_layer;
+    DrawStaticMeshCmd draw_static_mesh;
+    RenderSpriteInstancesCmd render_sprite_instances;
   };
 
   static_assert(std::is_trivially_copyable_v<Command>);
@@ -427,9 +631,136 @@ class BatchRenderer {
     FVec2 origin;
     float angle;
     Color color;
+    // Texture unit to sample from, see kTextureSlots.
+    int32_t tex_slot;
   };
 
+  // VertexData with the rotation applied to the position, which leaves
+  // origin and angle at zero, and texture coordinates in [0, 1] stored as
+  // normalized 16-bit integers.
+  struct PackedVertexData {
+    FVec2 position;
+    uint16_t tex_coords[2];
+    Color color;
+    int32_t tex_slot;
+  };
+
+  static_assert(sizeof(VertexData) == 36 && sizeof(PackedVertexData) == 20);
+
+  enum VertexFormat : uint8_t { kVertexFull, kVertexPacked };
+
+  // What recording a frame produces, everything Render() needs to draw it.
+  struct RecordedFrame {
+    explicit RecordedFrame(Allocator* parent);
+    ~RecordedFrame();
+
+    RecordedFrame(const RecordedFrame&) = delete;
+    RecordedFrame& operator=(const RecordedFrame&) = delete;
+
+    Allocator* allocator;
+    uint8_t* buffer;
+    size_t pos = 0;
+    FixedArray<QueueEntry> commands;
+    // Whether the framebuffer needs clearing before the next batch.
+    bool needs_clear = true;
+    // Number of mid-frame overflow flushes.
+    int flush_overflow = 0;
+    float frame_time = 0;
+    IVec2 window_size;
+    // Copies of the instance data of kRenderParticles commands, see
+    // RetainParticleData.
+    ParticleInstanceData* particles = nullptr;
+    size_t particle_capacity = 0;
+    // Instances of kRenderSpriteInstances commands, copied when recorded.
+    // Only reset by Clear(), so overflow flushes keep the offsets valid.
+    SpriteInstanceData* sprites = nullptr;
+    size_t sprite_count = 0;
+    size_t sprite_capacity = 0;
+  };
+
+  // A vertex buffer created with CreateStaticMesh. Free slots have vbo 0.
+  struct StaticMesh {
+    GLuint vbo = 0;
+    uint32_t quads = 0;
+    // Bumped when the mesh is destroyed, so handles to earlier meshes in
+    // the same slot stop resolving.
+    uint16_t generation = 0;
+  };
+
+  inline static constexpr size_t kMaxStaticMeshes = 4096;
+  static_assert(kMaxStaticMeshes < (1 << 16), "Slots are 16 bit in handles");
+
   class CommandIterator;
+  class CommandWriter;
+  struct SortScratch;
+  struct FillState;
+  struct FillChunk;
+
+  // Minimum number of commands per vertex fill task.
+  inline static constexpr size_t kFillChunkCommands = 4096;
+  // Upper bound on fill tasks per batch; larger batches get longer chunks.
+  inline static constexpr int kMaxFillChunks = 256;
+
+  // How the geometry of a batch is split for filling. Built by PlanFill,
+  // consumed by FillGeometry.
+  struct FillPlan {
+    explicit FillPlan(Allocator* parent);
+    ~FillPlan();
+
+    FillPlan(const FillPlan&) = delete;
+    FillPlan& operator=(const FillPlan&) = delete;
+
+    Allocator* allocator;
+    FillChunk* chunks;  // kMaxFillChunks entries, `count` of them in use.
+    int count = 0;
+    // Totals over all chunks.
+    size_t vertices = 0;
+    size_t indices = 0;
+    // Color in effect after the last command.
+    Color last_color = Color::White();
+    // Whether every texture coordinate is in [0, 1], so the geometry can
+    // use the packed vertex format.
+    bool packable = true;
+  };
+
+  // Walks a command stream once, counting the vertices and indices its
+  // draws expand to and recording the fill state (color, transform, texture
+  // slots) at the start of every chunk of at least `chunk_commands`
+  // commands, so chunks can be filled independently.
+  static void PlanFill(uint8_t* buffer, FixedArray<QueueEntry>* commands,
+                       int texture_slots, size_t chunk_commands,
+                       FillPlan* plan);
+
+  // Expands the draws of a planned command stream into `vertices`, an
+  // array of VertexData or PackedVertexData depending on `format`, and
+  // `indices`, adding `base_vertex` to every index. Chunks are filled in
+  // parallel on `executor`, or on the calling thread if it is null. The
+  // output is byte-identical however the stream was chunked. Needs no GL
+  // context.
+  static void FillGeometry(const FillPlan& plan, bool cpu_transforms,
+                           VertexFormat format, size_t base_vertex,
+                           void* vertices, GLuint* indices,
+                           Executor* executor);
+
+  // Fills the vertices and indices of one chunk of a plan.
+  template <typename Vertex>
+  static void FillChunkGeometry(const FillChunk& chunk, bool cpu_transforms,
+                                size_t base_vertex, Vertex* vertices,
+                                GLuint* indices);
+
+  // Copies the instance data of the frame's particle draws into the frame
+  // and points the commands at the copies.
+  static void RetainParticleData(RecordedFrame* frame);
+
+  // Copies `count` instances to the end of frame->sprites and returns the
+  // index of the first one.
+  static uint32_t AppendSpriteInstances(RecordedFrame* frame,
+                                        const SpriteInstanceData* instances,
+                                        uint32_t count);
+
+  // Applies a command that is not a draw to the fill state.
+  static void ApplyFillState(CommandType type, const Command& c,
+                             FillState* state);
 
   template <typename T>
   void AddCommand(CommandType command, const T& data) {
@@ -445,43 +776,92 @@ class BatchRenderer {
 
   // Submits the current command buffer to the GPU. Builds vertex/index
   // arrays, uploads them, and issues draw calls. Does not clear or post-pass.
-  void RenderBatch();
+  void RenderBatch(RecordedFrame* frame);
 
   // Called when AddCommand would overflow the command buffer. Submits the
   // current batch to the GPU, resets the buffer, and re-emits current state.
   void FlushAndContinue();
 
+  // Returns the program interned as `handle`, the default one for 0. Only
+  // called while recording, as it looks the name up.
+  Shaders::ProgramInfo* ResolveProgram(uint32_t handle) const;
+  // The kSetShader command for `program`, marking whether it is custom.
+  SetShader ShaderCommand(uint32_t handle, Shaders::ProgramInfo* program) const;
+
   // Re-emits current recording state into a freshly cleared command buffer.
   void ReEmitState();
 
+  // Writes the command buffer reordered by layer and render state into
+  // sort_. Returns false if the result does not fit, in which case the
+  // batch is drawn in submission order.
+  bool SortCommands(RecordedFrame* frame, FrameStats* stats);
+
   // Accumulates local batch stats into the per-frame totals.
   void AccumulateStats(const FrameStats& batch_stats, int vertices_count);
 
   // Sets up common GL state for rendering (blend, multisample, etc.).
-  void SetupGLState();
+  void SetupGLState(RecordedFrame* frame);
 
   // Initializes the particle VAO, quad VBO/EBO, and instance VBO.
   void InitializeParticleResources();
 
+  // Points the attributes of the current program at vertices of `format`
+  // in the buffer bound to GL_ARRAY_BUFFER.
+  void SetVertexAttributes(VertexFormat format);
+
+  // Returns the live mesh behind a DrawStaticMesh handle, or nullptr.
+  const StaticMesh* FindStaticMesh(uint32_t mesh) const;
+
+  // Writes `quads` into the vertex buffer of `mesh`, growing the shared
+  // index buffer if it has fewer quads.
+  void UploadStaticMesh(StaticMesh* mesh, Slice<StaticQuad> quads);
+
+  // Initializes the sprite instance VAO over the particle quad.
+  void InitializeSpriteInstanceResources();
+
+  // Draws the instances of `cmd` from `frame`. Called from within
+  // RenderBatch with the program that has to be restored afterwards.
+  void RenderSpriteInstances(const RenderSpriteInstancesCmd& cmd,
+                             const RecordedFrame& frame, int viewport_w,
+                             int viewport_h, const FMat4x4& transform,
+                             FVec4 color, FrameStats& stats);
+
   // Renders particles via instanced draw. Called from within RenderBatch.
   void RenderParticlesBatch(const RenderParticlesCmd& cmd, int viewport_w,
                             int viewport_h, const FMat4x4& transform,
                             FrameStats& stats);
 
   Allocator* allocator_;
-  uint8_t* command_buffer_ = nullptr;
-  size_t pos_ = 0;
-  float frame_time_ = 0;
+  // The frame commands are added to and the frame Render() draws. The same
+  // frame unless there is a render thread.
+  RecordedFrame* recording_;
+  RecordedFrame* submitted_;
+  RenderThread* render_thread_ = nullptr;
   uint32_t current_shader_ = 0;
+  Shaders::ProgramInfo* current_program_ = nullptr;
   FrameStats frame_stats_;
-  FixedArray<QueueEntry> commands_;
   FixedArray<GLuint> tex_;
   Shaders* shaders_;
-  GLuint ebo_, vao_, vbo_;
+  // Built-in programs, resolved at construction.
+  Shaders::ProgramInfo* pre_pass_program_;
+  Shaders::ProgramInfo* sdf_program_;
+  Shaders::ProgramInfo* post_pass_program_;
+  Shaders::ProgramInfo* particle_program_;
+  Shaders::ProgramInfo* sprite_instances_program_;
+  GLuint vao_;
+  // Ring buffers the batch geometry is written into directly.
+  StreamBuffer vertex_stream_;
+  StreamBuffer index_stream_;
   size_t noop_texture_;
   GLuint screen_quad_vao_, screen_quad_vbo_;
   GLuint particle_vao_, particle_quad_vbo_, particle_quad_ebo_,
       particle_instance_vbo_;
+  GLuint sprite_vao_ = 0, sprite_instance_vbo_ = 0;
+  // Static meshes share one vertex array and one index buffer holding the
+  // indices of static_mesh_indexed_quads_ consecutive quads.
+  FixedArray<StaticMesh> static_meshes_;
+  GLuint static_mesh_vao_ = 0, static_mesh_ebo_ = 0;
+  uint32_t static_mesh_indexed_quads_ = 0;
   GLuint render_target_, downsampled_target_, render_texture_,
       downsampled_texture_, depth_buffer_;
   // Web only: multisampled color renderbuffer standing in for
@@ -489,19 +869,19 @@ class BatchRenderer {
   GLuint render_color_rb_ = 0;
   GLint antialiasing_samples_;
   IVec2 viewport_;
-  IVec2 window_size_;
   GLenum default_min_filter_ = GL_LINEAR_MIPMAP_LINEAR;
   GLenum default_mag_filter_ = GL_LINEAR;
-
-  // Scratch arena for vertex/index arrays during RenderBatch. Allocated once,
-  // reset before each batch submission.
-  ArenaAllocator render_scratch_;
-
-  // Whether the framebuffer needs clearing before the next batch submission.
-  bool needs_clear_ = true;
-
-  // Number of mid-frame overflow flushes this frame.
-  int flush_overflow_ = 0;
+  // Texture units in use per batch; 1 means flush on every texture change.
+  int texture_slots_ = kTextureSlots;
+  bool cpu_transforms_ = true;
+  bool packed_vertices_ = true;
+  // Draw sorting (see SetDrawSorting). The scratch buffers are allocated
+  // the first time it is enabled.
+  bool sort_draws_ = false;
+  SortScratch* sort_ = nullptr;
+  // Vertex fill chunking and the pool the chunks are filled on, if any.
+  FillPlan fill_plan_;
+  Executor* executor_ = nullptr;
 
   // Recording state: tracks the last value of each state command so that
   // FlushAndContinue can re-emit them after resetting the command buffer.
@@ -518,6 +898,7 @@ class BatchRenderer {
   BeginStencilWriteCmd rec_stencil_write_ = {};
   bool rec_stencil_test_active_ = false;
   SetStencilTestCmd rec_stencil_test_ = {};
+  int16_t rec_layer_ = 0;
 };
 
 class Renderer {
@@ -538,6 +919,28 @@ class Renderer {
   ErrorOr<void> DrawSprite(const DbAssets::Sprite& asset, FVec2 position,
                            float angle);
 
+  // Looks up the sprite sheet and texture of a sprite once. The handle
+  // stays valid until the sprite sheet is reloaded.
+  ErrorOr<SpriteHandle> ResolveSprite(std::string_view sprite_name);
+  ErrorOr<SpriteHandle> ResolveSprite(const DbAssets::Sprite& asset);
+
+  // Resolves a sprite into a small integer for SpriteDrawRecord. Resolving
+  // the same name again returns the same id.
+  ErrorOr<uint32_t> SpriteId(std::string_view sprite_name);
+
+  // Draws `count` packed records of `format`, each in its own color; the
+  // current color is restored afterwards. Stops at the first record with
+  // an unknown sprite id.
+  ErrorOr<void> DrawBatch(DrawRecordFormat format, const uint8_t* records,
+                          size_t count);
+
+  void DrawSprite(const SpriteHandle& sprite, FVec2 position, float angle) {
+    SetTextureDedup(sprite.texture);
+    const FVec2 half = sprite.size / 2;
+    renderer_->PushQuad(position - half, position + half, sprite.q0,
+                        sprite.q1, position, angle);
+  }
+
   ErrorOr<void> DrawImage(std::string_view imagename, FVec2 position,
                           float angle);
   ErrorOr<void> DrawImage(const DbAssets::Image& asset, FVec2 position,
@@ -780,6 +1183,11 @@ class Renderer {
   Dictionary<DbAssets::Sprite*> loaded_sprites_table_;
   SegmentedList<DbAssets::Sprite> loaded_sprites_;
 
+  // Sprites resolved by SpriteId, indexed by id.
+  inline static constexpr size_t kMaxSpriteIds = 1 << 14;
+  Dictionary<uint32_t> sprite_ids_;
+  FixedArray<SpriteHandle> sprites_by_id_;
+
   Dictionary<DbAssets::Image*> loaded_images_table_;
   FixedArray<DbAssets::Image> loaded_images_;
 
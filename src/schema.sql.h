@@ -57,6 +57,15 @@ CREATE INDEX IF NOT EXISTS idx_compilation_cache ON
 
 CREATE INDEX IF NOT EXISTS idx_asset_metadata ON asset_metadata(name);
 
+-- Precompiled Lua bytecode written by `game package --bytecode`, stored in
+-- the blob store next to the source. source_hash is the asset_metadata hash
+-- it was compiled from; the loader falls back to source if it differs.
+CREATE TABLE IF NOT EXISTS script_bytecode(name VARCHAR(255) UNIQUE NOT NULL,
+                                           source_hash INTEGER NOT NULL,
+                                           stripped INTEGER NOT NULL,
+                                           size INTEGER NOT NULL,
+                                           blob_hash INTEGER NOT NULL);
+
 CREATE TABLE IF NOT EXISTS
 sdf_cache(id INTEGER PRIMARY KEY AUTOINCREMENT,
           font_name VARCHAR(255) UNIQUE NOT NULL,
@@ -76,7 +85,7 @@ CREATE TABLE IF NOT EXISTS
 trace_span_attribute(id INTEGER PRIMARY KEY AUTOINCREMENT, parent INTEGER,
                      key VARCHAR(255), value VARCHAR(255));
 
-PRAGMA user_version = 2;
+PRAGMA user_version = 3;
 )sql";
 
 }  // namespace G
@@ -12,6 +12,7 @@ constexpr std::string_view kPrePassVertexShader = R"(
     layout (location = 2) in vec2 origin;
     layout (location = 3) in float angle;
     layout (location = 4) in vec4 color;
+    layout (location = 5) in int tex_slot;
         
     uniform mat4x4 projection;
     uniform mat4x4 transform;    
@@ -20,6 +21,7 @@ constexpr std::string_view kPrePassVertexShader = R"(
     out vec2 tex_coord;
     out vec4 out_color;
     out vec2 screen_coord;
+    flat out int slot;
 
     mat4 RotateZ(float angle) {
       mat4 result = mat4(1.0);
@@ -43,6 +45,7 @@ constexpr std::string_view kPrePassVertexShader = R"(
         tex_coord = input_tex_coord;
         out_color = global_color * (color / 256.0);
         screen_coord = input_position.xy;
+        slot = tex_slot;
     }
   )";
 
@@ -61,6 +64,41 @@ constexpr std::string_view kPrePassFragmentShader = R"(
     }
   )";
 
+// Default batch shader. Samples from one of BatchRenderer::kTextureSlots
+// bound textures, picked per vertex, so sprites from different textures
+// share a draw call. GLSL ES only allows constant sampler array indices,
+// hence the switch; gradients are computed outside of it so mipmap
+// selection stays well defined.
+constexpr std::string_view kTextureSlotsFragmentShader = R"(
+    out vec4 frag_color;
+
+    in vec2 tex_coord;
+    in vec4 out_color;
+    in vec2 screen_coord;
+    flat in int slot;
+
+    uniform sampler2D tex_slots[8];
+
+    vec4 SampleSlot(vec2 uv) {
+        vec2 dx = dFdx(uv);
+        vec2 dy = dFdy(uv);
+        switch (slot) {
+          case 0: return textureGrad(tex_slots[0], uv, dx, dy);
+          case 1: return textureGrad(tex_slots[1], uv, dx, dy);
+          case 2: return textureGrad(tex_slots[2], uv, dx, dy);
+          case 3: return textureGrad(tex_slots[3], uv, dx, dy);
+          case 4: return textureGrad(tex_slots[4], uv, dx, dy);
+          case 5: return textureGrad(tex_slots[5], uv, dx, dy);
+          case 6: return textureGrad(tex_slots[6], uv, dx, dy);
+          default: return textureGrad(tex_slots[7], uv, dx, dy);
+        }
+    }
+
+    void main() {
+        frag_color = SampleSlot(tex_coord) * out_color;
+    }
+  )";
+
 constexpr std::string_view kParticleVertexShader = R"(
 
     // Per-vertex: static unit quad.
@@ -96,6 +134,42 @@ constexpr std::string_view kParticleVertexShader = R"(
     }
   )";
 
+// BatchRenderer::DrawSpriteInstances. Same unit quad as the particles,
+// scaled, rotated and mapped to a texture rectangle per instance.
+constexpr std::string_view kSpriteInstancesVertexShader = R"(
+
+    // Per-vertex: static unit quad.
+    layout (location = 0) in vec2 input_position;
+    layout (location = 1) in vec2 input_tex_coord;
+
+    // Per-instance, see SpriteInstanceData.
+    layout (location = 2) in vec2 instance_pos;
+    layout (location = 3) in vec2 instance_size;
+    layout (location = 4) in vec4 instance_uv;
+    layout (location = 5) in float instance_angle;
+    layout (location = 6) in vec4 instance_color;
+
+    uniform mat4x4 projection;
+    uniform mat4x4 transform;
+    uniform vec4 global_color;
+
+    out vec2 tex_coord;
+    out vec4 out_color;
+    out vec2 screen_coord;
+
+    void main() {
+        vec2 local = input_position * instance_size;
+        float c = cos(instance_angle);
+        float s = sin(instance_angle);
+        vec2 world_pos = instance_pos + vec2(local.x * c - local.y * s,
+                                             local.x * s + local.y * c);
+        gl_Position = projection * transform * vec4(world_pos, 0.0, 1.0);
+        tex_coord = mix(instance_uv.xy, instance_uv.zw, input_tex_coord);
+        out_color = global_color * instance_color;
+        screen_coord = world_pos;
+    }
+  )";
+
 constexpr std::string_view kPostPassVertexShader = R"(
   layout (location = 0) in vec2 input_position;
   layout (location = 1) in vec2 input_tex_coord;
@@ -229,6 +303,7 @@ Shaders::Shaders(Allocator* allocator)
     : allocator_(allocator),
       compiled_shaders_(allocator),
       compiled_programs_(allocator),
+      program_info_(allocator),
       gl_shader_handles_(128, allocator),
       gl_program_handles_(128, allocator) {
   // Ensure we have the basic shaders available.
@@ -236,7 +311,9 @@ Shaders::Shaders(Allocator* allocator)
                kPrePassVertexShader, kUseCache));
   MUST(Compile(DbAssets::ShaderType::kFragment, "pre_pass.frag",
                kPrePassFragmentShader, kUseCache));
-  MUST(Link("pre_pass", "pre_pass.vert", "pre_pass.frag", kUseCache));
+  MUST(Compile(DbAssets::ShaderType::kFragment, "texture_slots.frag",
+               kTextureSlotsFragmentShader, kUseCache));
+  MUST(Link("pre_pass", "pre_pass.vert", "texture_slots.frag", kUseCache));
   MUST(Compile(DbAssets::ShaderType::kFragment, "sdf.frag", kSDFFragmentShader,
                kUseCache));
   MUST(Link("sdf", "pre_pass.vert", "sdf.frag", kUseCache));
@@ -248,6 +325,10 @@ Shaders::Shaders(Allocator* allocator)
   MUST(Compile(DbAssets::ShaderType::kVertex, "particle.vert",
                kParticleVertexShader, kUseCache));
   MUST(Link("particle", "particle.vert", "pre_pass.frag", kUseCache));
+  MUST(Compile(DbAssets::ShaderType::kVertex, "sprite_instances.vert",
+               kSpriteInstancesVertexShader, kUseCache));
+  MUST(Link("sprite_instances", "sprite_instances.vert", "pre_pass.frag",
+            kUseCache));
 }
 
 Shaders::~Shaders() {
@@ -257,10 +338,14 @@ Shaders::~Shaders() {
   for (GLuint handle : gl_program_handles_) {
     glDeleteProgram(handle);
   }
+  program_info_.ForEach([&](std::string_view, ProgramInfo* info) {
+    allocator_->Destroy(info);
+  });
 }
 
 ErrorOr<void> Shaders::Compile(DbAssets::ShaderType type, std::string_view name,
                                std::string_view glsl, UseCache use_cache) {
+  ClaimGlContext();
   GLuint shader_idx;
   if (compiled_shaders_.Lookup(name, &shader_idx)) {
     if (use_cache == UseCache::kUseCache) {
@@ -319,6 +404,7 @@ ErrorOr<void> Shaders::Link(std::string_view name,
                             std::string_view vertex_shader,
                             std::string_view fragment_shader,
                             UseCache use_cache) {
+  ClaimGlContext();
   GLuint program_id;
   if (compiled_programs_.Lookup(name, &program_id)) {
     if (use_cache == UseCache::kUseCache) {
@@ -358,15 +444,114 @@ ErrorOr<void> Shaders::Link(std::string_view name,
       ") and fragment shader ", fragment, " (", fragment_shader, ")");
   gl_program_handles_.Push(shader_program);
   compiled_programs_.Insert(name, shader_program);
+  // Relinking resets uniform values, so start from a fresh cache.
+  ProgramInfo* info = nullptr;
+  if (!program_info_.Lookup(name, &info)) {
+    info = allocator_->New<ProgramInfo>();
+    info->name = InternedString(name);
+    program_info_.Insert(name, info);
+  }
+  info->id = shader_program;
+  IntrospectProgram(info);
   return {};
 }
 
+void Shaders::IntrospectProgram(ProgramInfo* info) {
+  info->uniform_count = 0;
+  info->attribute_count = 0;
+  char name[128];
+  GLint count = 0;
+  OPENGL_CALL(glGetProgramiv(info->id, GL_ACTIVE_UNIFORMS, &count));
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type;
+    glGetActiveUniform(info->id, i, sizeof(name), &length, &size, &type, name);
+    // Members of uniform blocks have no location and are not set through here.
+    const GLint location = glGetUniformLocation(info->id, name);
+    if (location == -1) continue;
+    std::string_view uniform(name, length);
+    if (uniform.size() > 3 && uniform.substr(uniform.size() - 3) == "[0]") {
+      uniform.remove_suffix(3);
+    }
+    if (info->uniform_count == kMaxUniforms) {
+      LOG("Program ", info->id, " has more than ", kMaxUniforms,
+          " uniforms, not caching the rest");
+      break;
+    }
+    info->uniforms[info->uniform_count++] = {.name = StringIntern(uniform),
+                                             .location = location};
+  }
+  OPENGL_CALL(glGetProgramiv(info->id, GL_ACTIVE_ATTRIBUTES, &count));
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type;
+    glGetActiveAttrib(info->id, i, sizeof(name), &length, &size, &type, name);
+    if (info->attribute_count == kMaxAttributes) break;
+    info->attributes[info->attribute_count++] = {
+        .name = StringIntern(std::string_view(name, length)),
+        .location = glGetAttribLocation(info->id, name)};
+  }
+}
+
+Shaders::Uniform* Shaders::FindUniform(uint32_t name) {
+  ClaimGlContext();
+  ProgramInfo* info = current_info_;
+  if (info == nullptr) return nullptr;
+  for (uint32_t i = 0; i < info->uniform_count; ++i) {
+    Uniform& uniform = info->uniforms[i];
+    if (uniform.name == name) {
+      return uniform.location == -1 ? nullptr : &uniform;
+    }
+  }
+  // Not an active uniform under its base name. Ask the driver once, which
+  // also resolves array elements such as "lights[2]", and remember the
+  // answer so names the program lacks do not hit the driver every call.
+  const std::string_view str = StringByHandle(name);
+  char buffer[128];
+  if (str.size() >= sizeof(buffer)) return nullptr;
+  std::memcpy(buffer, str.data(), str.size());
+  buffer[str.size()] = '\0';
+  const GLint location = glGetUniformLocation(info->id, buffer);
+  if (info->uniform_count == kMaxUniforms) {
+    if (location == -1) return nullptr;
+    // Cache is full: upload through a scratch entry without shadowing.
+    uncached_uniform_ = {.name = name, .location = location};
+    return &uncached_uniform_;
+  }
+  Uniform& uniform = info->uniforms[info->uniform_count++];
+  uniform = {.name = name, .location = location};
+  return location == -1 ? nullptr : &uniform;
+}
+
+GLint Shaders::AttributeLocation(uint32_t name) {
+  ClaimGlContext();
+  DCHECK(current_info_ != nullptr, "No program set");
+  for (uint32_t i = 0; i < current_info_->attribute_count; ++i) {
+    const Attribute& attribute = current_info_->attributes[i];
+    if (attribute.name == name) return attribute.location;
+  }
+  return -1;
+}
+
+Shaders::ProgramInfo* Shaders::FindProgram(std::string_view name) const {
+  ProgramInfo* info = nullptr;
+  program_info_.Lookup(name, &info);
+  return info;
+}
+
 void Shaders::UseProgram(std::string_view program) {
-  GLuint program_id;
-  CHECK(compiled_programs_.Lookup(program, &program_id),
-        " could not find program ", program);
-  current_program_ = program_id;
-  current_program_name_ = program.data();
+  ProgramInfo* info = FindProgram(program);
+  CHECK(info != nullptr, " could not find program ", program);
+  UseProgram(info);
+}
+
+void Shaders::UseProgram(ProgramInfo* program) {
+  ClaimGlContext();
+  current_program_ = program->id;
+  current_program_name_ = program->name;
+  current_info_ = program;
   OPENGL_CALL(glUseProgram(current_program_));
 }
 
@@ -2,6 +2,8 @@
 #ifndef _GAME_SHADERS_H
 #define _GAME_SHADERS_H
 
+#include <cstring>
+
 #include "array.h"
 #include "assets.h"
 #include "dictionary.h"
@@ -9,6 +11,8 @@
 #include "gl_headers.h"
 #include "logging.h"
 #include "mat.h"
+#include "render_thread.h"
+#include "string_table.h"
 #include "vec.h"
 
 namespace G {
@@ -53,64 +57,80 @@ class Shaders {
   ErrorOr<void> Link(std::string_view name, std::string_view vertex_shader,
                      std::string_view fragment_shader, UseCache use_cache);
 
+  // A linked program. Pointers stay valid when the program is relinked.
+  struct ProgramInfo;
+
+  // Returns the program linked as `name`, or nullptr. Goes through the
+  // string table, so call it where commands are recorded, never on the
+  // render thread.
+  ProgramInfo* FindProgram(std::string_view name) const;
+
   void UseProgram(std::string_view program);
 
+  // Makes `program` current without looking up any strings.
+  void UseProgram(ProgramInfo* program);
+
   ErrorOr<void> Load(const DbAssets::Shader& shader);
 
+  // Uniforms and attributes are named by StringIntern handles. Intern a
+  // name once and keep the handle rather than interning it per call.
   template <typename T, typename = std::void_t<decltype(T::kCardinality)>>
-  ErrorOr<void> SetUniform(const char* name, const T& value) {
-    if (!current_program_) return Error::Message("No program set");
-    const GLint uniform = glGetUniformLocation(current_program_, name);
-    if (uniform == -1) {
-      LOG("No uniform '", name, "' in shader '", current_program_name_, "'");
-      return Error::Message("No uniform with that name");
+  ErrorOr<void> SetUniform(uint32_t name, const T& value) {
+    Uniform* uniform = TRY(FindUniformOrError(name));
+    if (UpdateShadow(uniform, &value, sizeof(value))) {
+      internal::AsOpenglUniform(value, uniform->location);
     }
-    internal::AsOpenglUniform(value, uniform);
     return {};
   }
 
-  ErrorOr<void> SetUniform(const char* name, int value) {
-    if (!current_program_) return Error::Message("No program set");
-    const GLint uniform = glGetUniformLocation(current_program_, name);
-    if (uniform == -1) {
-      LOG("No uniform '", name, "' in shader '", current_program_name_, "'");
-      return Error::Message("No uniform with that name");
+  ErrorOr<void> SetUniform(uint32_t name, int value) {
+    Uniform* uniform = TRY(FindUniformOrError(name));
+    if (UpdateShadow(uniform, &value, sizeof(value))) {
+      OPENGL_CALL(glUniform1i(uniform->location, value));
     }
-    OPENGL_CALL(glUniform1i(uniform, value));
     return {};
   }
 
-  ErrorOr<void> SetUniformF(const char* name, float value) {
-    if (!current_program_) return Error::Message("No program set");
-    const GLint uniform = glGetUniformLocation(current_program_, name);
-    if (uniform == -1) {
-      LOG("No uniform '", name, "' in shader '", current_program_name_, "'");
-      return Error::Message("No uniform with that name");
+  ErrorOr<void> SetUniformF(uint32_t name, float value) {
+    Uniform* uniform = TRY(FindUniformOrError(name));
+    if (UpdateShadow(uniform, &value, sizeof(value))) {
+      OPENGL_CALL(glUniform1f(uniform->location, value));
     }
-    OPENGL_CALL(glUniform1f(uniform, value));
     return {};
   }
 
   template <typename T, typename = std::void_t<decltype(T::kCardinality)>>
-  void SetUniformSilent(const char* name, const T& value) {
-    if (!current_program_) return;
-    const GLint uniform = glGetUniformLocation(current_program_, name);
-    if (uniform == -1) return;
-    internal::AsOpenglUniform(value, uniform);
+  void SetUniformSilent(uint32_t name, const T& value) {
+    Uniform* uniform = FindUniform(name);
+    if (uniform == nullptr) return;
+    if (UpdateShadow(uniform, &value, sizeof(value))) {
+      internal::AsOpenglUniform(value, uniform->location);
+    }
+  }
+
+  void SetUniformSilent(uint32_t name, int value) {
+    Uniform* uniform = FindUniform(name);
+    if (uniform == nullptr) return;
+    if (UpdateShadow(uniform, &value, sizeof(value))) {
+      glUniform1i(uniform->location, value);
+    }
   }
 
-  void SetUniformSilent(const char* name, int value) {
-    if (!current_program_) return;
-    const GLint uniform = glGetUniformLocation(current_program_, name);
-    if (uniform == -1) return;
-    glUniform1i(uniform, value);
+  // Sets `count` consecutive elements of an int (or sampler) array uniform.
+  void SetUniformSilent(uint32_t name, const int* values, int count) {
+    Uniform* uniform = FindUniform(name);
+    if (uniform == nullptr) return;
+    if (UpdateShadow(uniform, values, count * sizeof(int))) {
+      glUniform1iv(uniform->location, count, values);
+    }
   }
 
-  void SetUniformSilentF(const char* name, float value) {
-    if (!current_program_) return;
-    const GLint uniform = glGetUniformLocation(current_program_, name);
-    if (uniform == -1) return;
-    glUniform1f(uniform, value);
+  void SetUniformSilentF(uint32_t name, float value) {
+    Uniform* uniform = FindUniform(name);
+    if (uniform == nullptr) return;
+    if (UpdateShadow(uniform, &value, sizeof(value))) {
+      glUniform1f(uniform->location, value);
+    }
   }
 
   // Returns the compiled programs dictionary for debug inspection.
@@ -119,24 +139,103 @@ class Shaders {
   // Returns the compiled shaders dictionary for debug inspection.
   const Dictionary<GLuint>& shaders() const { return compiled_shaders_; }
 
-  bool HasUniform(const char* name) const {
-    if (!current_program_) return false;
-    return glGetUniformLocation(current_program_, name) != -1;
-  }
+  bool HasUniform(uint32_t name) { return FindUniform(name) != nullptr; }
 
-  GLint AttributeLocation(const char* name) const {
-    DCHECK(current_program_, "No program set");
-    return glGetAttribLocation(current_program_, name);
+  GLint AttributeLocation(uint32_t name);
+
+  // Set when frames are drawn on a render thread: every call then claims
+  // the GL context first (see RenderThread::Claim).
+  void SetRenderThread(RenderThread* render_thread) {
+    render_thread_ = render_thread;
   }
 
+  // Uniform uploads skipped because the value matched the previous upload
+  // to the same program, since the last ResetStats().
+  int skipped_uploads() const { return skipped_uploads_; }
+  void ResetStats() { skipped_uploads_ = 0; }
+
  private:
+  // Values up to this size (a 4x4 matrix) are shadowed; larger uploads
+  // always go through.
+  inline static constexpr size_t kMaxShadowedBytes = 64;
+  inline static constexpr size_t kMaxUniforms = 48;
+  inline static constexpr size_t kMaxAttributes = 16;
+
+  struct Uniform {
+    uint32_t name = 0;  // Interned, without the "[0]" suffix of arrays.
+    GLint location = -1;
+    uint32_t value_size = 0;  // Bytes in `value`, 0 before the first upload.
+    alignas(16) uint8_t value[kMaxShadowedBytes] = {};
+  };
+
+  struct Attribute {
+    uint32_t name;  // Interned.
+    GLint location;
+  };
+
+  void IntrospectProgram(ProgramInfo* info);
+
+  void ClaimGlContext() {
+    if (render_thread_ != nullptr) render_thread_->Claim();
+  }
+
+  // Returns the uniform `name` of the current program, or nullptr if there
+  // is no program or it has no such uniform.
+  Uniform* FindUniform(uint32_t name);
+
+  ErrorOr<Uniform*> FindUniformOrError(uint32_t name) {
+    ClaimGlContext();
+    if (!current_program_) return Error::Message("No program set");
+    Uniform* uniform = FindUniform(name);
+    if (uniform == nullptr) {
+      LOG("No uniform '", StringByHandle(name), "' in shader '",
+          current_program_name_, "'");
+      return Error::Message("No uniform with that name");
+    }
+    return uniform;
+  }
+
+  // Stores `size` bytes as the value of `uniform`. Returns false if they
+  // match the last upload, in which case the caller skips it.
+  bool UpdateShadow(Uniform* uniform, const void* value, size_t size) {
+    if (size > kMaxShadowedBytes) {
+      uniform->value_size = 0;
+      return true;
+    }
+    if (uniform->value_size == size &&
+        std::memcmp(uniform->value, value, size) == 0) {
+      skipped_uploads_++;
+      return false;
+    }
+    std::memcpy(uniform->value, value, size);
+    uniform->value_size = size;
+    return true;
+  }
+
   Allocator* allocator_;
   Dictionary<GLuint> compiled_shaders_;
   Dictionary<GLuint> compiled_programs_;
+  Dictionary<ProgramInfo*> program_info_;
   FixedArray<GLuint> gl_shader_handles_;
   FixedArray<GLuint> gl_program_handles_;
   GLuint current_program_ = 0;
-  const char* current_program_name_ = "(none)";
+  ProgramInfo* current_info_ = nullptr;
+  Uniform uncached_uniform_;
+  std::string_view current_program_name_ = "(none)";
+  int skipped_uploads_ = 0;
+  RenderThread* render_thread_ = nullptr;
+};
+
+// Locations resolved for a linked program. Filled from the active uniforms
+// and attributes at link time; names the program does not use are looked up
+// once and cached with location -1.
+struct Shaders::ProgramInfo {
+  GLuint id = 0;
+  std::string_view name;  // Interned.
+  uint32_t uniform_count = 0;
+  uint32_t attribute_count = 0;
+  Uniform uniforms[kMaxUniforms];
+  Attribute attributes[kMaxAttributes];
 };
 
 }  // namespace G
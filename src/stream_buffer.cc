@@ -0,0 +1,136 @@
+#include "stream_buffer.h"
+
+#include "logging.h"
+
+namespace G {
+namespace {
+
+// Upper bound on a single fence wait. Hitting it means the GPU is hung.
+constexpr GLuint64 kFenceTimeoutNs = 1'000'000'000;
+
+}  // namespace
+
+StreamBuffer::StreamBuffer(GLenum target, Allocator* allocator)
+    : allocator_(allocator), target_(target) {}
+
+void StreamBuffer::Init(size_t segment_size) {
+  CHECK(buffer_ == 0, "StreamBuffer initialized twice");
+  segment_size_ = segment_size;
+  OPENGL_CALL(glGenBuffers(1, &buffer_));
+  OPENGL_CALL(glBindBuffer(target_, buffer_));
+  OPENGL_CALL(glBufferData(target_, segment_size_ * kSegments, nullptr,
+                           GL_STREAM_DRAW));
+#ifdef GAME_WEB
+  staging_ = static_cast<uint8_t*>(allocator_->Alloc(segment_size_, 16));
+  CHECK(staging_ != nullptr, "StreamBuffer: failed to allocate ",
+        segment_size_, " byte staging block");
+#endif
+}
+
+StreamBuffer::~StreamBuffer() {
+  for (GLsync& fence : fences_) {
+    if (fence != nullptr) glDeleteSync(fence);
+  }
+  if (staging_ != nullptr) allocator_->Dealloc(staging_, segment_size_);
+  if (buffer_ != 0) OPENGL_CALL(glDeleteBuffers(1, &buffer_));
+}
+
+void StreamBuffer::Grow(size_t size) {
+  size_t new_size = segment_size_;
+  while (new_size < size) new_size *= 2;
+  LOG("Growing stream buffer ", buffer_, " segments from ", segment_size_,
+      " to ", new_size, " bytes");
+  for (GLsync& fence : fences_) {
+    if (fence != nullptr) glDeleteSync(fence);
+    fence = nullptr;
+  }
+  if (staging_ != nullptr) {
+    allocator_->Dealloc(staging_, segment_size_);
+    staging_ = static_cast<uint8_t*>(allocator_->Alloc(new_size, 16));
+    CHECK(staging_ != nullptr, "StreamBuffer: failed to allocate ", new_size,
+          " byte staging block");
+  }
+  segment_size_ = new_size;
+  OPENGL_CALL(glBufferData(target_, segment_size_ * kSegments, nullptr,
+                           GL_STREAM_DRAW));
+  segment_ = 0;
+  head_ = 0;
+  stats_.orphans++;
+}
+
+void StreamBuffer::AdvanceSegment() {
+#ifdef GAME_WEB
+  segment_ = (segment_ + 1) % kSegments;
+  head_ = 0;
+  // No fences on the web path: orphan once per lap so WebGL hands us fresh
+  // storage instead of synchronizing with draws from the previous lap.
+  if (segment_ == 0) {
+    OPENGL_CALL(glBufferData(target_, segment_size_ * kSegments, nullptr,
+                             GL_STREAM_DRAW));
+    stats_.orphans++;
+  }
+#else
+  fences_[segment_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  segment_ = (segment_ + 1) % kSegments;
+  head_ = 0;
+  GLsync fence = fences_[segment_];
+  if (fence == nullptr) return;
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    stats_.stalls++;
+    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              kFenceTimeoutNs);
+  }
+  CHECK(result != GL_WAIT_FAILED && result != GL_TIMEOUT_EXPIRED,
+        "Stream buffer fence wait failed: ", result);
+  glDeleteSync(fence);
+  fences_[segment_] = nullptr;
+#endif
+}
+
+void* StreamBuffer::Map(size_t size, size_t align, size_t* offset) {
+  DCHECK(mapped_size_ == 0, "StreamBuffer::Map called twice without Unmap");
+  if (size == 0) {
+    *offset = segment_ * segment_size_ + head_;
+    return nullptr;
+  }
+  if (size > segment_size_ - align) Grow(size + align);
+  // Align the absolute offset: callers derive element indices from it, and
+  // element sizes need not be powers of two.
+  auto aligned_head = [&] {
+    const size_t base = segment_ * segment_size_;
+    return (base + head_ + align - 1) / align * align - base;
+  };
+  if (aligned_head() + size > segment_size_) AdvanceSegment();
+  head_ = aligned_head();
+  mapped_offset_ = segment_ * segment_size_ + head_;
+  mapped_size_ = size;
+  *offset = mapped_offset_;
+  head_ += size;
+  stats_.bytes_uploaded += size;
+#ifdef GAME_WEB
+  return staging_ + (mapped_offset_ - segment_ * segment_size_);
+#else
+  void* ptr = glMapBufferRange(target_, mapped_offset_, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                   GL_MAP_INVALIDATE_RANGE_BIT);
+  CHECK(ptr != nullptr, "Could not map ", size, " bytes of stream buffer ",
+        buffer_, " at offset ", mapped_offset_, ": ", glGetError());
+  return ptr;
+#endif
+}
+
+void StreamBuffer::Unmap() {
+  if (mapped_size_ == 0) return;
+#ifdef GAME_WEB
+  OPENGL_CALL(glBufferSubData(
+      target_, mapped_offset_, mapped_size_,
+      staging_ + (mapped_offset_ - segment_ * segment_size_)));
+#else
+  CHECK(glUnmapBuffer(target_) == GL_TRUE, "Stream buffer ", buffer_,
+        " storage was lost while mapped");
+#endif
+  mapped_size_ = 0;
+}
+
+}  // namespace G
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef _GAME_STREAM_BUFFER_H
+#define _GAME_STREAM_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "allocators.h"
+#include "gl_headers.h"
+
+namespace G {
+
+// A GPU buffer object that the CPU rewrites every batch. The storage is
+// split into kSegments regions used round-robin: a batch is appended to the
+// current region, and when it no longer fits the renderer moves on to the
+// next one, fencing the region it left behind. Regions are only reused once
+// their fence signals, so the CPU never overwrites data the GPU still reads
+// and the driver never has to reallocate or synchronize implicitly.
+//
+// Desktop maps the reserved range with GL_MAP_UNSYNCHRONIZED_BIT so callers
+// write vertices straight into driver-visible memory. WebGL2 cannot map
+// buffers; there the reservation points into a CPU staging block which is
+// uploaded on Unmap() after orphaning the buffer.
+class StreamBuffer {
+ public:
+  inline static constexpr size_t kSegments = 3;
+
+  // Upload counters since the last ResetStats().
+  struct Stats {
+    size_t bytes_uploaded = 0;
+    int stalls = 0;   // Map() had to block on a fence.
+    int orphans = 0;  // The buffer was reallocated (growth or web upload).
+  };
+
+  StreamBuffer(GLenum target, Allocator* allocator);
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  // Creates the buffer object with kSegments regions of `segment_size`
+  // bytes each. Needs a current GL context; on GLES the vertex array that
+  // will own an element buffer must already be bound.
+  void Init(size_t segment_size);
+
+  // Reserves `size` bytes and returns a write-only pointer to them.
+  // *offset receives the byte offset of the reservation inside the buffer
+  // object, which is a multiple of `align` (any positive value). The buffer
+  // must be bound to its target. Only one reservation may be outstanding;
+  // close it with Unmap() before issuing draw calls that read from it.
+  void* Map(size_t size, size_t align, size_t* offset);
+
+  // Makes the bytes written since Map() visible to the GPU.
+  void Unmap();
+
+  GLuint id() const { return buffer_; }
+  GLenum target() const { return target_; }
+  size_t segment_size() const { return segment_size_; }
+
+  const Stats& stats() const { return stats_; }
+  void ResetStats() { stats_ = {}; }
+
+ private:
+  // Reallocates the buffer object so a single segment holds at least
+  // `size` bytes. In-flight draws keep the old storage alive (orphaning).
+  void Grow(size_t size);
+
+  // Fences the current segment and waits for the next one to be free.
+  void AdvanceSegment();
+
+  Allocator* allocator_;
+  GLenum target_;
+  GLuint buffer_ = 0;
+  size_t segment_size_ = 0;
+  size_t segment_ = 0;
+  size_t head_ = 0;  // Write position inside the current segment.
+  size_t mapped_offset_ = 0;
+  size_t mapped_size_ = 0;
+  GLsync fences_[kSegments] = {};
+  // Web only: CPU copy of the current segment, uploaded on Unmap().
+  uint8_t* staging_ = nullptr;
+  Stats stats_;
+};
+
+}  // namespace G
+
+#endif  // _GAME_STREAM_BUFFER_H
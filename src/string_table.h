@@ -20,6 +20,11 @@ class StringTable {
 
   uint32_t Handle(std::string_view input);
 
+  // Whether `handle` was returned by Intern.
+  bool Contains(uint32_t handle) const {
+    return handle < (1u << kTotalStringsLog) && sizes_[handle] != 0;
+  }
+
   std::string_view Lookup(uint32_t handle) {
     return std::string_view(&buffer_[offsets_[handle]], sizes_[handle]);
   }
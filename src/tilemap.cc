@@ -1,5 +1,6 @@
 #include "tilemap.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <utility>
@@ -25,10 +26,13 @@ Tilemap::Tilemap(int tile_width, int tile_height, Allocator* allocator)
       tile_height_(tile_height),
       layer_count_(0),
       object_group_count_(0),
-      allocator_(allocator) {
+      allocator_(allocator),
+      mesh_renderer_(nullptr),
+      chunk_sheet_size_(0, 0) {
   tileset_name_[0] = '\0';
   std::memset(layers_, 0, sizeof(layers_));
   std::memset(object_groups_, 0, sizeof(object_groups_));
+  std::memset(chunks_, 0, sizeof(chunks_));
 }
 
 ErrorOr<void> Tilemap::LoadTmx(std::string_view xml_data,
@@ -212,6 +216,16 @@ const TilemapObjectGroup* Tilemap::FindObjectGroup(
 
 Tilemap::~Tilemap() {
   for (int i = 0; i < layer_count_; ++i) {
+    if (chunks_[i]) {
+      const int count = ChunkColumns(layers_[i]) * ChunkRows(layers_[i]);
+      for (int c = 0; c < count; ++c) {
+        if (chunks_[i][c].mesh) {
+          mesh_renderer_->DestroyStaticMesh(chunks_[i][c].mesh);
+        }
+      }
+      allocator_->Dealloc(chunks_[i], count * sizeof(Chunk));
+      chunks_[i] = nullptr;
+    }
     if (layers_[i].tiles) {
       allocator_->Dealloc(layers_[i].tiles,
                           layers_[i].width * layers_[i].height * sizeof(int));
@@ -272,6 +286,11 @@ void Tilemap::SetTile(std::string_view layer_name, int x, int y, int tile_id) {
   if (!layer) return;
   if (x < 0 || x >= layer->width || y < 0 || y >= layer->height) return;
   layer->tiles[y * layer->width + x] = tile_id;
+  Chunk* chunks = chunks_[layer - layers_];
+  if (chunks) {
+    const int cx = x / kChunkTiles, cy = y / kChunkTiles;
+    chunks[cy * ChunkColumns(*layer) + cx].dirty = true;
+  }
 }
 
 int Tilemap::GetTile(std::string_view layer_name, int x, int y) const {
@@ -423,6 +442,81 @@ void Tilemap::SetTileset(std::string_view name) {
   size_t copy_len = name.size() < 255 ? name.size() : 255;
   std::memcpy(tileset_name_, name.data(), copy_len);
   tileset_name_[copy_len] = '\0';
+  InvalidateChunks();
+}
+
+Tilemap::Chunk* Tilemap::LayerChunks(int index) const {
+  if (!chunks_[index]) {
+    const size_t count = static_cast<size_t>(ChunkColumns(layers_[index])) *
+                         ChunkRows(layers_[index]);
+    chunks_[index] = static_cast<Chunk*>(
+        allocator_->Alloc(count * sizeof(Chunk), alignof(Chunk)));
+    CHECK(chunks_[index] != nullptr, "Failed to allocate tilemap chunks");
+    std::memset(chunks_[index], 0, count * sizeof(Chunk));
+  }
+  return chunks_[index];
+}
+
+void Tilemap::InvalidateChunks() const {
+  for (int i = 0; i < layer_count_; ++i) {
+    if (!chunks_[i]) continue;
+    const int count = ChunkColumns(layers_[i]) * ChunkRows(layers_[i]);
+    for (int c = 0; c < count; ++c) chunks_[i][c].dirty = true;
+  }
+}
+
+size_t Tilemap::BuildChunkQuads(const TilemapLayer& layer, int chunk_x,
+                                int chunk_y, FVec2 sheet_size,
+                                StaticQuad* out) const {
+  const float tw = static_cast<float>(tile_width_);
+  const float th = static_cast<float>(tile_height_);
+  const float sheet_w = sheet_size.x, sheet_h = sheet_size.y;
+  const int tiles_per_row = static_cast<int>(sheet_w) / tile_width_;
+  if (tiles_per_row == 0) return 0;
+  const int start_col = chunk_x * kChunkTiles;
+  const int start_row = chunk_y * kChunkTiles;
+  const int end_col = std::min(start_col + kChunkTiles, layer.width);
+  const int end_row = std::min(start_row + kChunkTiles, layer.height);
+  size_t quads = 0;
+  for (int row = start_row; row < end_row; ++row) {
+    for (int col = start_col; col < end_col; ++col) {
+      int raw = layer.tiles[row * layer.width + col];
+      int tile_id = raw & kTileIdMask;
+      if (tile_id <= 0) continue;
+
+      // Tile position in layer space; parallax is applied when drawing.
+      float px = col * tw;
+      float py = row * th;
+
+      // UV coordinates from tile_id. Tile IDs are 1-based.
+      int tile_col = (tile_id - 1) % tiles_per_row;
+      int tile_row = (tile_id - 1) / tiles_per_row;
+
+      // Inset UVs by half a texel to prevent sampling adjacent tile edges.
+      const float half_texel_u = 0.5f / sheet_w;
+      const float half_texel_v = 0.5f / sheet_h;
+      float u0 = (tile_col * tw) / sheet_w + half_texel_u;
+      float v0 = (tile_row * th) / sheet_h + half_texel_v;
+      float u1 = ((tile_col + 1) * tw) / sheet_w - half_texel_u;
+      float v1 = ((tile_row + 1) * th) / sheet_h - half_texel_v;
+
+      // Apply flip flags by swapping UV coordinates.
+      if (raw & kTileFlipHorizontal) std::swap(u0, u1);
+      if (raw & kTileFlipVertical) std::swap(v0, v1);
+      // Diagonal flip (anti-diagonal transpose) is equivalent to a 90° CW
+      // rotation + horizontal flip. We approximate it by swapping both axes.
+      if (raw & kTileFlipDiagonal) {
+        std::swap(u0, u1);
+        std::swap(v0, v1);
+      }
+
+      out[quads++] = StaticQuad{.p0 = FVec2(px, py),
+                                .p1 = FVec2(px + tw, py + th),
+                                .q0 = FVec2(u0, v0),
+                                .q1 = FVec2(u1, v1)};
+    }
+  }
+  return quads;
 }
 
 void Tilemap::DrawTile(int tile_id, float x, float y, Renderer* renderer,
@@ -533,46 +627,42 @@ void Tilemap::DrawLayerImpl(const TilemapLayer& layer, Renderer* renderer,
   start_row = Clamp(start_row, 0, layer.height - 1);
   end_row = Clamp(end_row, 0, layer.height - 1);
 
-  for (int row = start_row; row <= end_row; ++row) {
-    for (int col = start_col; col <= end_col; ++col) {
-      int raw = layer.tiles[row * layer.width + col];
-      int tile_id = raw & kTileIdMask;
-      if (tile_id <= 0) continue;
-
-      // Tile position in world space, offset by parallax.
-      float px = col * tw + parallax_offset_x;
-      float py = row * th + parallax_offset_y;
-
-      // UV coordinates from tile_id. Tile IDs are 1-based.
-      int tile_col = (tile_id - 1) % tiles_per_row;
-      int tile_row = (tile_id - 1) / tiles_per_row;
-
-      // Inset UVs by half a texel to prevent sampling adjacent tile edges.
-      const float half_texel_u = 0.5f / sheet_w;
-      const float half_texel_v = 0.5f / sheet_h;
-      float u0 = (tile_col * tw) / sheet_w + half_texel_u;
-      float v0 = (tile_row * th) / sheet_h + half_texel_v;
-      float u1 = ((tile_col + 1) * tw) / sheet_w - half_texel_u;
-      float v1 = ((tile_row + 1) * th) / sheet_h - half_texel_v;
+  // Chunks are built against one renderer and one tileset size; a
+  // reloaded tileset of another size needs new UVs.
+  DCHECK(mesh_renderer_ == nullptr || mesh_renderer_ == batch);
+  mesh_renderer_ = batch;
+  const FVec2 sheet_size(sheet_w, sheet_h);
+  if (!(sheet_size == chunk_sheet_size_)) {
+    InvalidateChunks();
+    chunk_sheet_size_ = sheet_size;
+  }
 
-      // Apply flip flags by swapping UV coordinates.
-      if (raw & kTileFlipHorizontal) std::swap(u0, u1);
-      if (raw & kTileFlipVertical) std::swap(v0, v1);
-      // Diagonal flip (anti-diagonal transpose) is equivalent to a 90° CW
-      // rotation + horizontal flip. We approximate it by swapping both axes.
-      if (raw & kTileFlipDiagonal) {
-        std::swap(u0, u1);
-        std::swap(v0, v1);
+  Chunk* chunks = LayerChunks(static_cast<int>(&layer - layers_));
+  const int chunk_columns = ChunkColumns(layer);
+  const FVec2 parallax_offset(parallax_offset_x, parallax_offset_y);
+  StaticQuad* scratch = nullptr;
+  constexpr size_t kChunkQuads = kChunkTiles * kChunkTiles;
+  for (int cy = start_row / kChunkTiles; cy <= end_row / kChunkTiles; ++cy) {
+    for (int cx = start_col / kChunkTiles; cx <= end_col / kChunkTiles;
+         ++cx) {
+      Chunk& chunk = chunks[cy * chunk_columns + cx];
+      if (chunk.mesh == 0 || chunk.dirty) {
+        if (!scratch) scratch = allocator_->NewArray<StaticQuad>(kChunkQuads);
+        const size_t quads =
+            BuildChunkQuads(layer, cx, cy, sheet_size, scratch);
+        const Slice<StaticQuad> geometry(scratch, quads);
+        if (chunk.mesh == 0) {
+          chunk.mesh = batch->CreateStaticMesh(geometry);
+        } else {
+          batch->UpdateStaticMesh(chunk.mesh, geometry);
+        }
+        chunk.quads = quads;
+        chunk.dirty = false;
       }
-
-      FVec2 p0(px, py);
-      FVec2 p1(px + tw, py + th);
-      FVec2 q0(u0, v0);
-      FVec2 q1(u1, v1);
-      FVec2 origin(px + tw * 0.5f, py + th * 0.5f);
-      batch->PushQuad(p0, p1, q0, q1, origin, /*angle=*/0.0f);
+      if (chunk.quads > 0) batch->DrawStaticMesh(chunk.mesh, parallax_offset);
     }
   }
+  if (scratch) allocator_->DeallocArray(scratch, kChunkQuads);
 }
 
 }  // namespace G
@@ -14,6 +14,7 @@ namespace G {
 class BatchRenderer;
 class Camera;
 class Renderer;
+struct StaticQuad;
 
 // Tile flip flags stored in the upper bits of packed tile values.
 // Matches Tiled's encoding: bits 31/30/29 of the GID.
@@ -87,10 +88,17 @@ struct TilemapMoveResult {
 
 // A 2D tilemap with multiple layers, tile collision, and camera-aware
 // rendering.
+//
+// Layers are drawn from square chunks of kChunkTiles x kChunkTiles tiles
+// whose quads are kept on the GPU (see BatchRenderer::CreateStaticMesh), so
+// a visible chunk costs one draw command instead of one per tile. SetTile
+// marks the chunk holding the tile for rebuilding on its next draw; writes
+// straight into TilemapLayer::tiles are not picked up.
 class Tilemap {
  public:
   static constexpr int kMaxLayers = 16;
   static constexpr int kMaxObjectGroups = 16;
+  static constexpr int kChunkTiles = 32;
 
   // Creates an empty tilemap with the given tile dimensions.
   Tilemap(int tile_width, int tile_height, Allocator* allocator);
@@ -149,7 +157,7 @@ class Tilemap {
   void DrawLayer(std::string_view name, Renderer* renderer,
                  BatchRenderer* batch, Camera* camera) const;
 
-  // Sets the tileset spritesheet name.
+  // Sets the tileset spritesheet name. Rebuilds every chunk.
   void SetTileset(std::string_view name);
 
   // Returns the tileset spritesheet name.
@@ -185,10 +193,41 @@ class Tilemap {
   static inline Tilemap* debug_active_tilemap = nullptr;
 
  private:
+  // Checks chunk bookkeeping without a GL context.
+  friend class TilemapChunkTest;
+
+  // A chunk of a layer and the static mesh with its quads.
+  struct Chunk {
+    uint32_t mesh;   // 0 until the chunk is first drawn.
+    uint32_t quads;  // Non-empty tiles in the chunk.
+    bool dirty;      // Tiles changed since the mesh was built.
+  };
+
   // Draws a single layer with viewport culling.
   void DrawLayerImpl(const TilemapLayer& layer, Renderer* renderer,
                      BatchRenderer* batch, Camera* camera) const;
 
+  // Chunk grid dimensions of a layer.
+  static int ChunkColumns(const TilemapLayer& layer) {
+    return (layer.width + kChunkTiles - 1) / kChunkTiles;
+  }
+  static int ChunkRows(const TilemapLayer& layer) {
+    return (layer.height + kChunkTiles - 1) / kChunkTiles;
+  }
+
+  // Returns the chunks of layer `index`, row-major, allocating them on the
+  // first call.
+  Chunk* LayerChunks(int index) const;
+
+  // Marks every chunk of every layer for rebuilding.
+  void InvalidateChunks() const;
+
+  // Writes the quads of the non-empty tiles of a chunk into `out`, which
+  // has room for kChunkTiles * kChunkTiles quads, in layer space for a
+  // tileset of `sheet_size` pixels. Returns the number of quads.
+  size_t BuildChunkQuads(const TilemapLayer& layer, int chunk_x, int chunk_y,
+                         FVec2 sheet_size, StaticQuad* out) const;
+
   // Finds the first collision layer. Returns nullptr if none.
   const TilemapLayer* FindCollisionLayer() const;
 
@@ -200,6 +239,10 @@ class Tilemap {
   TilemapObjectGroup object_groups_[kMaxObjectGroups];  // Object groups.
   int object_group_count_;  // Number of object groups.
   Allocator* allocator_;    // Allocator for arrays.
+  // Chunk cache, filled in by the (const) draw calls.
+  mutable Chunk* chunks_[kMaxLayers];     // Per layer, null until drawn.
+  mutable BatchRenderer* mesh_renderer_;  // Owner of the chunk meshes.
+  mutable FVec2 chunk_sheet_size_;        // Tileset size chunks were built for.
 };
 
 }  // namespace G
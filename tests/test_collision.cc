@@ -1,7 +1,10 @@
 #include <cmath>
+#include <random>
+#include <vector>
 
 #include "collision.h"
 #include "collision_world.h"
+#include "executor.h"
 #include "test_fixture.h"
 
 namespace G {
@@ -162,6 +165,91 @@ TEST(CollisionTest, PointInAABB) {
   EXPECT_FALSE(PointInShape(FVec(15, 0), a, FVec(0, 0)));
 }
 
+// Checks OverlapShapes and OverlapShapesScalar against TestShapes for `a`
+// at `pos_a` and every candidate, in place and not.
+void ExpectOverlapsMatchTestShapes(const CollisionShape& a, FVec2 pos_a,
+                                   const std::vector<CollisionShape>& shapes,
+                                   const std::vector<FVec2>& positions) {
+  std::vector<uint32_t> ids(shapes.size());
+  std::vector<uint32_t> expected;
+  for (uint32_t i = 0; i < ids.size(); ++i) {
+    // Candidates out of order, as they come from the broad phase.
+    ids[i] = (i * 7919) % ids.size();
+    if (TestShapes(a, pos_a, shapes[ids[i]], positions[ids[i]]).hit) {
+      expected.push_back(ids[i]);
+    }
+  }
+  // Every group size, including partial groups of four.
+  const uint32_t all = static_cast<uint32_t>(ids.size());
+  for (uint32_t count : {0u, 1u, 2u, 3u, 5u, all}) {
+    if (count > all) continue;
+    std::vector<uint32_t> want;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (TestShapes(a, pos_a, shapes[ids[i]], positions[ids[i]]).hit) {
+        want.push_back(ids[i]);
+      }
+    }
+    std::vector<uint32_t> hits(count);
+    hits.resize(OverlapShapes(a, pos_a, shapes.data(), positions.data(),
+                              ids.data(), count, hits.data()));
+    ASSERT_EQ(hits, want) << count;
+    hits.resize(count);
+    hits.resize(OverlapShapesScalar(a, pos_a, shapes.data(),
+                                    positions.data(), ids.data(), count,
+                                    hits.data()));
+    ASSERT_EQ(hits, want) << count;
+  }
+  std::vector<uint32_t> in_place = ids;
+  in_place.resize(OverlapShapes(a, pos_a, shapes.data(), positions.data(),
+                                in_place.data(), in_place.size(),
+                                in_place.data()));
+  EXPECT_EQ(in_place, expected);
+}
+
+TEST(CollisionTest, OverlapShapesMatchesTestShapesOnAGrid) {
+  // Half-unit steps put many candidates exactly tangent or touching.
+  const CollisionShape kinds[] = {MakeCircle(0),   MakeCircle(1),
+                                  MakeCircle(3),   MakeCircle(7.5f),
+                                  MakeAABB(0, 0),  MakeAABB(2, 6),
+                                  MakeAABB(5, 5),  MakeAABB(10, 3)};
+  std::vector<CollisionShape> shapes;
+  std::vector<FVec2> positions;
+  for (float y = -12; y <= 12; y += 0.5f) {
+    for (float x = -12; x <= 12; x += 0.5f) {
+      for (const CollisionShape& kind : kinds) {
+        shapes.push_back(kind);
+        positions.push_back(FVec(x, y));
+      }
+    }
+  }
+  for (const CollisionShape& a : kinds) {
+    for (FVec2 pos_a : {FVec(0, 0), FVec(1.5f, -2), FVec(-0.25f, 3.75f)}) {
+      ExpectOverlapsMatchTestShapes(a, pos_a, shapes, positions);
+    }
+  }
+}
+
+TEST(CollisionTest, OverlapShapesMatchesTestShapesOnRandomShapes) {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> coord(-100, 100);
+  std::uniform_real_distribution<float> size(0, 40);
+  auto random_shape = [&] {
+    return rng() % 2 == 0 ? MakeCircle(size(rng))
+                          : MakeAABB(size(rng), size(rng));
+  };
+  std::vector<CollisionShape> shapes;
+  std::vector<FVec2> positions;
+  for (int i = 0; i < 4099; ++i) {
+    shapes.push_back(random_shape());
+    positions.push_back(FVec(coord(rng), coord(rng)));
+  }
+  for (int i = 0; i < 50; ++i) {
+    ExpectOverlapsMatchTestShapes(random_shape(),
+                                  FVec(coord(rng), coord(rng)), shapes,
+                                  positions);
+  }
+}
+
 // CollisionWorld tests (need allocator).
 
 class CollisionWorldTest : public BaseTest {};
@@ -359,4 +447,297 @@ TEST_F(CollisionWorldTest, TriggerDetection) {
   (void)h1;
 }
 
+TEST_F(CollisionWorldTest, QueriesSeeChangesWithoutUpdate) {
+  CollisionWorld world(64.0f, alloc);
+  world.Update();
+
+  CollisionShape circle = MakeCircle(10);
+  auto h = world.Add(circle, FVec(0, 0), {}, false, 0);
+  ColliderHandle results[64];
+  ASSERT_EQ(world.QueryPoint(FVec(0, 0), 0xFFFF, results, 64), 1u);
+  EXPECT_EQ(results[0], h);
+
+  // Moved across several cells.
+  world.SetPosition(h, FVec(500, 300));
+  EXPECT_EQ(world.QueryPoint(FVec(0, 0), 0xFFFF, results, 64), 0u);
+  EXPECT_EQ(world.QueryPoint(FVec(500, 300), 0xFFFF, results, 64), 1u);
+
+  // Grown to cover the origin again.
+  world.SetShape(h, MakeCircle(600));
+  EXPECT_EQ(world.QueryPoint(FVec(0, 0), 0xFFFF, results, 64), 1u);
+
+  world.Remove(h);
+  EXPECT_EQ(world.QueryPoint(FVec(500, 300), 0xFFFF, results, 64), 0u);
+}
+
+TEST_F(CollisionWorldTest, MovesRebucketTheMover) {
+  CollisionWorld world(64.0f, alloc);
+
+  CollisionShape circle = MakeCircle(10);
+  auto player = world.Add(circle, FVec(0, 0), {}, false, 0);
+  auto wall = world.Add(MakeAABB(20, 200), FVec(1000, 0), {}, false, 0);
+  world.Update();
+
+  world.MoveAndSlide(player, FVec(300, 0));
+  ColliderHandle results[64];
+  ASSERT_EQ(world.QueryPoint(FVec(300, 0), 0xFFFF, results, 64), 1u);
+  EXPECT_EQ(results[0], player);
+
+  // The wall is moved next to the player between updates.
+  world.SetPosition(wall, FVec(330, 0));
+  auto result = world.MoveAndCollide(player, FVec(15, 0));
+  ASSERT_EQ(result.contact_count, 1u);
+  EXPECT_EQ(result.contacts[0].other, wall);
+  EXPECT_NEAR(result.position.x, 310.0f, 1e-3f);
+}
+
+TEST_F(CollisionWorldTest, RemovedSlotsAreReusedInTheBroadPhase) {
+  CollisionWorld world(64.0f, alloc);
+
+  CollisionShape circle = MakeCircle(10);
+  ColliderHandle handles[100];
+  for (int round = 0; round < 50; ++round) {
+    for (int i = 0; i < 100; ++i) {
+      handles[i] = world.Add(circle, FVec(i * 30.0f, round * 30.0f), {},
+                             false, 0);
+    }
+    for (int i = 0; i < 100; i += 2) world.Remove(handles[i]);
+    for (int i = 1; i < 100; i += 2) world.Remove(handles[i]);
+  }
+  EXPECT_EQ(world.active_count(), 0u);
+  ColliderHandle results[64];
+  EXPECT_EQ(world.QueryRect(FVec(-100, -100), FVec(3000, 1500), 0xFFFF,
+                            results, 64),
+            0u);
+  auto h = world.Add(circle, FVec(15, 15), {}, false, 0);
+  ASSERT_EQ(world.QueryPoint(FVec(15, 15), 0xFFFF, results, 64), 1u);
+  EXPECT_EQ(results[0], h);
+}
+
+TEST_F(CollisionWorldTest, GrowsPastItsInitialCapacity) {
+  CollisionWorld world(64.0f, alloc, /*capacity=*/4);
+
+  // Enough colliders to grow the bucket table too.
+  constexpr int kCount = 3000;
+  ColliderHandle handles[kCount];
+  for (int i = 0; i < kCount; ++i) {
+    handles[i] = world.Add(MakeCircle(4), FVec((i % 100) * 20.0f,
+                                               (i / 100) * 20.0f),
+                           {}, false, 0);
+  }
+  CollisionWorld::Stats stats = world.stats();
+  EXPECT_EQ(stats.colliders, static_cast<uint32_t>(kCount));
+  EXPECT_EQ(stats.collider_capacity, 4096u);
+  EXPECT_GE(stats.hash_buckets, 4096u);
+  EXPECT_GE(stats.hash_entries, static_cast<uint32_t>(kCount));
+  EXPECT_LE(stats.hash_entries, stats.hash_entry_capacity);
+
+  ColliderHandle results[64];
+  for (int i = 0; i < kCount; i += 97) {
+    ASSERT_TRUE(world.IsValid(handles[i]));
+    ASSERT_EQ(world.QueryPoint(world.GetPosition(handles[i]), 0xFFFF,
+                               results, 64),
+              1u);
+    EXPECT_EQ(results[0], handles[i]);
+  }
+}
+
+TEST_F(CollisionWorldTest, HashesEveryCellOfALargeCollider) {
+  // 1.2 million cells of one unit, past what the entry pool used to cap.
+  CollisionWorld world(/*cell_size=*/1.0f, alloc, /*capacity=*/4);
+  auto h = world.Add(MakeAABB(1200, 1000), FVec(600, 500), {}, false, 0);
+  ColliderHandle results[64];
+  for (FVec2 p : {FVec(0.5f, 0.5f), FVec(600, 500), FVec(1199.5f, 999.5f)}) {
+    ASSERT_EQ(world.QueryPoint(p, 0xFFFF, results, 64), 1u);
+    EXPECT_EQ(results[0], h);
+  }
+  EXPECT_GE(world.stats().hash_entries, 1200u * 1000u);
+}
+
+TEST_F(CollisionWorldTest, ListsLiveWorlds) {
+  CollisionWorld a(64.0f, alloc);
+  const CollisionWorld* previous = CollisionWorld::first_world();
+  {
+    CollisionWorld b(64.0f, alloc);
+    EXPECT_EQ(CollisionWorld::first_world(), &b);
+    EXPECT_EQ(b.next_world(), previous);
+  }
+  EXPECT_EQ(CollisionWorld::first_world(), &a);
+}
+
+TEST_F(CollisionWorldTest, BatchMovesInOrderWithoutExecutor) {
+  CollisionWorld world(64.0f, alloc);
+
+  CollisionShape circle = MakeCircle(10);
+  ColliderHandle handles[2] = {
+      world.Add(circle, FVec(0, 0), {}, false, 0),
+      world.Add(circle, FVec(30, 0), {}, false, 0),
+  };
+  const FVec2 velocities[2] = {FVec(10, 0), FVec(-10, 0)};
+  CollisionWorld::MoveResult results[2];
+  world.MoveAndSlideBatch(handles, velocities, results, 2);
+
+  // The second mover is pushed back by the first one's new position.
+  EXPECT_NEAR(results[0].position.x, 10.0f, 1e-4f);
+  EXPECT_EQ(results[0].contact_count, 0u);
+  EXPECT_NEAR(results[1].position.x, 30.0f, 1e-4f);
+  ASSERT_EQ(results[1].contact_count, 1u);
+  EXPECT_EQ(results[1].contacts[0].other, handles[0]);
+}
+
+TEST_F(CollisionWorldTest, ParallelBatchResolvesAgainstTheWorldAtTheCall) {
+  CollisionWorld world(64.0f, alloc);
+
+  CollisionShape circle = MakeCircle(10);
+  ColliderHandle handles[2] = {
+      world.Add(circle, FVec(0, 0), {}, false, 0),
+      world.Add(circle, FVec(30, 0), {}, false, 0),
+  };
+  const FVec2 velocities[2] = {FVec(10, 0), FVec(-10, 0)};
+  CollisionWorld::MoveResult results[2];
+  InlineExecutor executor;
+  world.MoveAndSlideBatch(handles, velocities, results, 2, &executor);
+
+  EXPECT_NEAR(results[0].position.x, 10.0f, 1e-4f);
+  EXPECT_NEAR(results[1].position.x, 20.0f, 1e-4f);
+  EXPECT_EQ(results[0].contact_count, 0u);
+  EXPECT_EQ(results[1].contact_count, 0u);
+  // The moves are committed.
+  EXPECT_NEAR(world.GetPosition(handles[1]).x, 20.0f, 1e-4f);
+  ColliderHandle found[64];
+  ASSERT_EQ(world.QueryPoint(FVec(15, 0), 0xFFFF, found, 64), 2u);
+}
+
+TEST_F(CollisionWorldTest, ParallelBatchDoesNotDependOnThreads) {
+  // A crowd walking into a row of walls, moved on one thread and on four.
+  constexpr int kSide = 32;
+  constexpr int kMovers = kSide * kSide;
+  auto populate = [](CollisionWorld* world, ColliderHandle* handles) {
+    for (int i = 0; i < 8; ++i) {
+      world->Add(MakeAABB(40, 40), FVec(i * 60.0f, -30.0f), {}, false, 0);
+    }
+    for (int y = 0; y < kSide; ++y) {
+      for (int x = 0; x < kSide; ++x) {
+        handles[y * kSide + x] = world->Add(
+            MakeCircle(5), FVec(x * 12.0f, y * 12.0f), {}, false, 0);
+      }
+    }
+  };
+  FVec2 velocities[kMovers];
+  for (int i = 0; i < kMovers; ++i) {
+    velocities[i] = FVec(std::sin(i * 0.7f) * 4.0f, -3.0f - (i % 5));
+  }
+
+  CollisionWorld serial(64.0f, alloc);
+  CollisionWorld parallel(64.0f, alloc);
+  ColliderHandle serial_handles[kMovers];
+  ColliderHandle parallel_handles[kMovers];
+  populate(&serial, serial_handles);
+  populate(&parallel, parallel_handles);
+  InlineExecutor inline_executor;
+  ThreadPoolExecutor pool(alloc, 4);
+  pool.Start();
+
+  CollisionWorld::MoveResult serial_results[kMovers];
+  CollisionWorld::MoveResult parallel_results[kMovers];
+  for (int step = 0; step < 10; ++step) {
+    serial.MoveAndSlideBatch(serial_handles, velocities, serial_results,
+                             kMovers, &inline_executor);
+    parallel.MoveAndSlideBatch(parallel_handles, velocities, parallel_results,
+                               kMovers, &pool);
+    for (int i = 0; i < kMovers; ++i) {
+      ASSERT_EQ(serial_results[i].position.x, parallel_results[i].position.x);
+      ASSERT_EQ(serial_results[i].position.y, parallel_results[i].position.y);
+      ASSERT_EQ(serial_results[i].contact_count,
+                parallel_results[i].contact_count);
+    }
+  }
+  pool.Shutdown();
+}
+
+TEST_F(CollisionWorldTest, QueriesSeeEveryColliderInACrowdedCell) {
+  // More candidates than the broad phase keeps inline.
+  constexpr uint32_t kCount = 400;
+  CollisionWorld world(64.0f, alloc);
+  ColliderHandle handles[kCount];
+  for (uint32_t i = 0; i < kCount; ++i) {
+    handles[i] = world.Add(MakeCircle(10), FVec(i * 0.01f, 0), {}, false, 0);
+  }
+
+  ColliderHandle found[kCount];
+  EXPECT_EQ(world.QueryPoint(FVec(2, 0), 0xFFFF, found, kCount), kCount);
+  EXPECT_EQ(world.QueryRect(FVec(-1, -1), FVec(1, 1), 0xFFFF, found, kCount),
+            kCount);
+  EXPECT_EQ(world.QueryCircle(FVec(0, 0), 1, 0xFFFF, found, kCount), kCount);
+  CollisionWorld::OverlapResult overlaps[kCount];
+  EXPECT_EQ(world.GetOverlaps(handles[0], overlaps, kCount), kCount - 1);
+  CollisionWorld::RaycastHit hits[kCount];
+  EXPECT_EQ(world.RaycastAll(FVec(-100, 0), FVec(1, 0), 200, 0xFFFF, hits,
+                             kCount),
+            kCount);
+
+  // The mover overlaps the first collider most, which the hash lists last.
+  auto mover = world.Add(MakeCircle(10), FVec(-100, 0), {}, false, 0);
+  CollisionWorld::MoveResult moved = world.MoveAndSlide(mover, FVec(95, 0));
+  ASSERT_GE(moved.contact_count, 1u);
+  EXPECT_EQ(moved.contacts[0].other, handles[0]);
+}
+
+using CollisionWorldDeathTest = CollisionWorldTest;
+
+TEST_F(CollisionWorldDeathTest, BatchRejectsRepeatedHandles) {
+  CollisionWorld world(64.0f, alloc);
+  auto h = world.Add(MakeCircle(10), FVec(0, 0), {}, false, 0);
+  const ColliderHandle handles[2] = {h, h};
+  const FVec2 velocities[2] = {FVec(1, 0), FVec(1, 0)};
+  CollisionWorld::MoveResult results[2];
+  EXPECT_DEATH(world.MoveAndSlideBatch(handles, velocities, results, 2), "");
+}
+
+TEST_F(CollisionWorldDeathTest, BatchRejectsStaleHandles) {
+  CollisionWorld world(64.0f, alloc);
+  auto h = world.Add(MakeCircle(10), FVec(0, 0), {}, false, 0);
+  world.Remove(h);
+  const FVec2 velocity = FVec(1, 0);
+  CollisionWorld::MoveResult result;
+  EXPECT_DEATH(world.MoveAndSlideBatch(&h, &velocity, &result, 1), "");
+}
+
+TEST_F(CollisionWorldTest, ThousandsOfOverlappingTriggers) {
+  CollisionWorld world(64.0f, alloc);
+
+  // A 64x64 grid where each trigger touches its 4 closest neighbours only.
+  constexpr int kSide = 64;
+  CollisionShape circle = MakeCircle(6);
+  ColliderHandle handles[kSide * kSide];
+  for (int y = 0; y < kSide; ++y) {
+    for (int x = 0; x < kSide; ++x) {
+      handles[y * kSide + x] =
+          world.Add(circle, FVec(x * 10.0f, y * 10.0f), {}, true, 0);
+    }
+  }
+  constexpr uint32_t kPairs = 2 * kSide * (kSide - 1);
+
+  world.Update();
+  ASSERT_EQ(world.new_trigger_count(), kPairs);
+  EXPECT_EQ(world.lost_trigger_count(), 0u);
+  const auto* pairs = world.new_trigger_pairs();
+  for (uint32_t i = 1; i < kPairs; ++i) {
+    ASSERT_TRUE(pairs[i - 1] < pairs[i]) << i;
+  }
+
+  world.Update();
+  EXPECT_EQ(world.new_trigger_count(), 0u);
+  EXPECT_EQ(world.lost_trigger_count(), 0u);
+
+  // The corner loses its 2 neighbours, and an inner trigger moved onto
+  // another one's spot trades its 4 neighbours for the other's 4 and the
+  // other itself.
+  world.SetPosition(handles[0], FVec(-1000, -1000));
+  world.SetPosition(handles[10 * kSide + 10], FVec(300, 300));
+  world.Update();
+  EXPECT_EQ(world.lost_trigger_count(), 2u + 4u);
+  EXPECT_EQ(world.new_trigger_count(), 5u);
+}
+
 }  // namespace G
@@ -11,4 +11,17 @@ class BaseTest : public ::testing::Test {
   Allocator* alloc = SystemAllocator::Instance();
 };
 
+// lua_Alloc over the system allocator, for tests that open a bare
+// lua_State. The userdata is unused: Registry<T> expects the state's
+// LuaModules there.
+inline void* TestLuaAlloc(void*, void* ptr, size_t osize, size_t nsize) {
+  Allocator* allocator = SystemAllocator::Instance();
+  if (nsize == 0) {
+    if (ptr != nullptr) allocator->Dealloc(ptr, osize);
+    return nullptr;
+  }
+  if (ptr == nullptr) return allocator->Alloc(nsize, /*align=*/1);
+  return allocator->Realloc(ptr, osize, nsize, /*align=*/1);
+}
+
 }  // namespace G
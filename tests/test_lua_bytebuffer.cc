@@ -0,0 +1,156 @@
+#include "lua_bytebuffer.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "assets.h"
+#include "lua.h"
+#include "lua_graphics.h"
+#include "renderer.h"
+#include "test_fixture.h"
+
+namespace G {
+namespace {
+
+class LuaByteBufferTest : public BaseTest {
+ protected:
+  LuaByteBufferTest() : lua_(Slice<const char*>(), nullptr, nullptr, alloc) {
+    lua_.LoadLibraries();
+    AddByteBufferLibrary(&lua_);
+  }
+
+  lua_State* state() { return lua_.state(); }
+
+  // Runs `script` and returns the bytes of the buffer it returns.
+  std::vector<uint8_t> Pack(const char* script) {
+    EXPECT_EQ(luaL_dostring(state(), script), 0) << lua_tostring(state(), -1);
+    auto* buffer =
+        static_cast<ByteBuffer*>(luaL_checkudata(state(), -1, "byte_buffer"));
+    std::vector<uint8_t> bytes(buffer->contents,
+                               buffer->contents + buffer->size);
+    lua_pop(state(), 1);
+    return bytes;
+  }
+
+  // Runs `script` and returns its error message, empty if it succeeds.
+  std::string Error(const char* script) {
+    if (luaL_dostring(state(), script) == 0) return "";
+    std::string message = lua_tostring(state(), -1);
+    lua_pop(state(), 1);
+    return message;
+  }
+
+  Lua lua_;
+};
+
+template <typename T>
+void Append(std::vector<uint8_t>* bytes, T value) {
+  uint8_t raw[sizeof(T)];
+  std::memcpy(raw, &value, sizeof(T));
+  bytes->insert(bytes->end(), raw, raw + sizeof(T));
+}
+
+TEST_F(LuaByteBufferTest, PackLaysOutRecordsInOrder) {
+  const std::vector<uint8_t> bytes =
+      Pack("return G.data.pack('If B', {7, 1.5, 300, 4294967295, -2.25, -4})");
+  std::vector<uint8_t> expected;
+  Append<uint32_t>(&expected, 7);
+  Append<float>(&expected, 1.5f);
+  Append<uint8_t>(&expected, 255);
+  Append<uint32_t>(&expected, 4294967295u);
+  Append<float>(&expected, -2.25f);
+  Append<uint8_t>(&expected, 0);
+  EXPECT_EQ(bytes, expected);
+}
+
+TEST_F(LuaByteBufferTest, PackMatchesTheDrawRecordLayouts) {
+  const std::vector<uint8_t> bytes =
+      Pack("return G.data.pack('IfffBBBB', {3, 10, 20, 0.5, 1, 2, 3, 4})");
+  ASSERT_EQ(bytes.size(), sizeof(SpriteDrawRecord));
+  SpriteDrawRecord record;
+  std::memcpy(&record, bytes.data(), sizeof(record));
+  EXPECT_EQ(record.sprite, 3u);
+  EXPECT_EQ(record.x, 10.0f);
+  EXPECT_EQ(record.y, 20.0f);
+  EXPECT_EQ(record.angle, 0.5f);
+  EXPECT_EQ(record.color.r, 1);
+  EXPECT_EQ(record.color.g, 2);
+  EXPECT_EQ(record.color.b, 3);
+  EXPECT_EQ(record.color.a, 4);
+}
+
+TEST_F(LuaByteBufferTest, PackRejectsBadFormats) {
+  EXPECT_NE(Error("G.data.pack('Iq', {1, 2})").find("Invalid pack format 'q'"),
+            std::string::npos);
+  EXPECT_NE(Error("G.data.pack(' ', {})").find("Empty pack format"),
+            std::string::npos);
+  EXPECT_NE(Error("G.data.pack('fI', {1, 2, 3})")
+                .find("Got 3 values for records of 2 fields"),
+            std::string::npos);
+}
+
+TEST_F(LuaByteBufferTest, PackRejectsBadValues) {
+  EXPECT_NE(Error("G.data.pack('ff', {1, '2'})")
+                .find("bad argument #2 to 'pack' (value 2 is a string, not a "
+                      "number)"),
+            std::string::npos);
+  EXPECT_NE(Error("G.data.pack('fI', {1, 2, 3, -1})")
+                .find("(value 4 (-1) is out of range for 'I')"),
+            std::string::npos);
+  EXPECT_NE(Error("G.data.pack('I', {4294967296})")
+                .find("(value 1 (4294967296) is out of range for 'I')"),
+            std::string::npos);
+  EXPECT_NE(Error("G.data.pack('I', {0 / 0})").find("out of range for 'I'"),
+            std::string::npos);
+}
+
+// Only the paths that stop before anything is drawn: a Renderer without a
+// BatchRenderer needs no GL context.
+class DrawBatchTest : public LuaByteBufferTest {
+ protected:
+  DrawBatchTest()
+      : assets_(/*db=*/nullptr, alloc),
+        renderer_(assets_, /*renderer=*/nullptr, /*db=*/nullptr, alloc) {
+    AddGraphicsLibrary(&lua_);
+    lua_.Register(&renderer_);
+  }
+
+  DbAssets assets_;
+  Renderer renderer_;
+};
+
+TEST_F(DrawBatchTest, StopsAtAnUnknownSpriteId) {
+  SpriteDrawRecord record = {};
+  auto result = renderer_.DrawBatch(
+      kSpriteRecords, reinterpret_cast<const uint8_t*>(&record), 1);
+  ASSERT_TRUE(result.is_error());
+  EXPECT_EQ(result.error().message(), "unknown sprite id");
+
+  EXPECT_NE(Error("G.graphics.draw_batch("
+                  "G.data.pack('IfffBBBB', {0, 0, 0, 0, 1, 1, 1, 1}), 1, "
+                  "'sprite')")
+                .find("unknown sprite id"),
+            std::string::npos);
+}
+
+TEST_F(DrawBatchTest, DrawsNothingForZeroRecords) {
+  EXPECT_FALSE(renderer_.DrawBatch(kRectRecords, nullptr, 0).is_error());
+  EXPECT_EQ(Error("G.graphics.draw_batch('', 0, 'rect')"), "");
+}
+
+TEST_F(DrawBatchTest, RejectsBadArguments) {
+  EXPECT_NE(Error("G.graphics.draw_batch('', 0, 'quad')")
+                .find("Unknown draw_batch format quad"),
+            std::string::npos);
+  // One rect record is 24 bytes.
+  EXPECT_NE(Error("G.graphics.draw_batch(string.rep('x', 47), 2, 'rect')")
+                .find("Buffer of 47 bytes does not hold 2 rect records"),
+            std::string::npos);
+  EXPECT_NE(Error("G.graphics.draw_batch('', -1, 'rect')")
+                .find("does not hold -1 rect records"),
+            std::string::npos);
+}
+
+}  // namespace
+}  // namespace G
@@ -0,0 +1,223 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "assets.h"
+#include "blob_store.h"
+#include "executor.h"
+#include "libraries/sqlite3.h"
+#include "lua.h"
+#include "packer.h"
+#include "physfs.h"
+#include "platform.h"
+#include "sqlite_helpers.h"
+#include "test_fixture.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace G {
+namespace {
+
+const char* TempDir() {
+#ifdef _WIN32
+  const char* tmp = std::getenv("TEMP");
+  if (!tmp) tmp = std::getenv("TMP");
+  if (!tmp) tmp = "C:\\Temp";
+  return tmp;
+#else
+  return "/tmp";
+#endif
+}
+
+// Removes every file in dir, then dir itself.
+void RemoveDirRecursive(const char* dir) {
+  if (!DirectoryExists(dir)) return;
+  IterateDirectory(
+      dir,
+      [](const DirEntry& entry, void* ud) {
+        char path[1024];
+        std::snprintf(path, sizeof(path), "%s/%s", static_cast<const char*>(ud),
+                      entry.name);
+        std::remove(path);
+      },
+      const_cast<char*>(dir))
+      .release_value();
+  std::remove(dir);
+}
+
+// Stands in for the Fennel compiler: the scripts below are plain Lua, and
+// the output records which file it was compiled as.
+constexpr char kCompiler[] =
+    "return {compileString = function(source, options)\n"
+    "  return '-- ' .. options.filename .. '\\n' .. source\n"
+    "end}\n";
+
+constexpr int kParts = 8;
+
+constexpr char kMain[] =
+    "local parts = {}\n"
+    "for i = 1, 8 do parts[i] = require('part' .. i) end\n"
+    "return {init = function() end, update = function() end,\n"
+    "        draw = function() end}\n";
+
+using CacheRows = std::vector<std::pair<std::string, std::string>>;
+
+// Frees whatever is left when destroyed, as the engine's Lua heap does:
+// Lua never frees script contents or compilation cache entries.
+class HeapAllocator final : public Allocator {
+ public:
+  ~HeapAllocator() override {
+    for (void* p : live_) std::free(p);
+  }
+
+  void* Alloc(size_t size, size_t /*align*/) override {
+    void* p = std::malloc(size);
+    if (p != nullptr) live_.insert(p);
+    return p;
+  }
+
+  void Dealloc(void* p, size_t /*sz*/) override {
+    if (p == nullptr) return;
+    live_.erase(p);
+    std::free(p);
+  }
+
+  void* Realloc(void* p, size_t /*old_size*/, size_t new_size,
+                size_t /*align*/) override {
+    void* result = std::realloc(p, new_size);
+    if (result != nullptr) {
+      live_.erase(p);
+      live_.insert(result);
+    }
+    return result;
+  }
+
+ private:
+  std::unordered_set<void*> live_;
+};
+
+class LuaFennelTest : public BaseTest {
+ protected:
+  // DbAssets treats its allocator as an arena.
+  ArenaAllocator arena_{alloc, Megabytes(64)};
+  char root_[512] = {};
+  char source_dir_[640] = {};
+  char blobs_dir_[640] = {};
+  char db_path_[640] = {};
+  sqlite3* db_ = nullptr;
+
+  void SetUp() override {
+    const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+    std::snprintf(root_, sizeof(root_), "%s/game_fennel_test_%d_%s",
+                  TempDir(), static_cast<int>(getpid()), info->name());
+    std::snprintf(source_dir_, sizeof(source_dir_), "%s/src", root_);
+    std::snprintf(blobs_dir_, sizeof(blobs_dir_), "%s/blobs", root_);
+    std::snprintf(db_path_, sizeof(db_path_), "%s/assets.sqlite3", root_);
+    ASSERT_FALSE(MakeDirs(source_dir_).is_error());
+    ASSERT_NE(PHYSFS_init("test"), 0);
+
+    WriteSource("fennel.lua", kCompiler);
+    WriteSource("main.lua", kMain);
+    for (int i = 1; i <= kParts; ++i) {
+      char name[32], source[64];
+      std::snprintf(name, sizeof(name), "part%d.fnl", i);
+      std::snprintf(source, sizeof(source), "return {value = %d}\n", i);
+      WriteSource(name, source);
+    }
+
+    ASSERT_EQ(sqlite3_open(db_path_, &db_), SQLITE_OK);
+    InitializeAssetDb(db_);
+    BlobStore blobs = MUST(BlobStore::Create(blobs_dir_));
+    InlineExecutor executor;
+    MUST(WriteAssetsToDb(source_dir_, db_, &blobs, &arena_, &executor));
+    ASSERT_NE(PHYSFS_mount(blobs_dir_, kBlobMountPoint, /*append=*/0), 0);
+  }
+
+  void TearDown() override {
+    if (db_ != nullptr) sqlite3_close(db_);
+    PHYSFS_deinit();
+    RemoveDirRecursive(source_dir_);
+    RemoveDirRecursive(blobs_dir_);
+    std::remove(db_path_);
+    std::remove(root_);
+  }
+
+  void WriteSource(const char* name, const char* contents) {
+    char path[1024];
+    std::snprintf(path, sizeof(path), "%s/%s", source_dir_, name);
+    ASSERT_FALSE(
+        WriteEntireFile(path, MakeByteSlice(contents, strlen(contents)))
+            .is_error());
+  }
+
+  // Loads the scripts into `lua` and writes its compilation cache to the
+  // database, compiling whatever is not cached yet on the main state.
+  // With an executor, main.lua is loaded first, which compiles the scripts
+  // on it. Returns the rows written.
+  CacheRows Compile(Executor* executor) {
+    EXPECT_FALSE(SqlExec(db_, "DELETE FROM compilation_cache").is_error());
+    DbAssets assets(db_, &arena_);
+    HeapAllocator heap;
+    Lua lua(Slice<const char*>(), db_, &assets, &heap);
+    lua.LoadLibraries();
+    assets.RegisterScriptLoad(
+        [](DbAssets::Script* script, void* ud) -> ErrorOr<void> {
+          static_cast<Lua*>(ud)->LoadScript(*script);
+          return {};
+        },
+        &lua);
+    assets.Load();
+    if (executor != nullptr) {
+      lua.SetExecutor(executor);
+      lua.LoadMain();
+      // Everything main.lua required came out of the cache.
+      lua_getglobal(lua.state(), "package");
+      lua_getfield(lua.state(), -1, "loaded");
+      lua_getfield(lua.state(), -1, "fennel");
+      EXPECT_TRUE(lua_isnil(lua.state(), -1));
+      lua_pop(lua.state(), 3);
+    }
+    lua.FlushCompilationCache();
+    FixedStringBuffer<1024> error;
+    EXPECT_FALSE(lua.Error(&error)) << error.str();
+
+    CacheRows rows;
+    SqlStmt stmt(db_,
+                 "SELECT source_name, compiled FROM compilation_cache "
+                 "ORDER BY source_name");
+    EXPECT_TRUE(stmt.ok());
+    while (MUST(stmt.Step())) {
+      const ByteSlice compiled = stmt.ColumnBlob(1);
+      rows.emplace_back(
+          std::string(stmt.ColumnText(0)),
+          std::string(reinterpret_cast<const char*>(compiled.data()),
+                      compiled.size()));
+    }
+    return rows;
+  }
+};
+
+TEST_F(LuaFennelTest, ParallelCompileMatchesSerial) {
+  const CacheRows serial = Compile(/*executor=*/nullptr);
+  ASSERT_EQ(serial.size(), size_t{kParts});
+  EXPECT_EQ(serial[0].first, "part1.fnl");
+  EXPECT_EQ(serial[0].second, "-- part1.fnl\nreturn {value = 1}\n");
+
+  ThreadPoolExecutor pool(alloc, 3);
+  pool.Start();
+  const CacheRows parallel = Compile(&pool);
+  pool.Shutdown();
+  EXPECT_EQ(parallel, serial);
+}
+
+}  // namespace
+}  // namespace G
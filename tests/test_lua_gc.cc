@@ -0,0 +1,76 @@
+#include "lua.h"
+#include "test_fixture.h"
+
+namespace G {
+namespace {
+
+class LuaGcTest : public BaseTest {
+ protected:
+  LuaGcTest() : lua_(Slice<const char*>(), nullptr, nullptr, alloc) {
+    lua_.LoadLibraries();
+  }
+
+  lua_State* state() { return lua_.state(); }
+
+  // Allocates and drops `n` small tables.
+  void MakeGarbage(int n) {
+    lua_pushinteger(state(), n);
+    lua_setglobal(state(), "n");
+    ASSERT_EQ(luaL_dostring(state(),
+                            "local t = {}\n"
+                            "for i = 1, n do t[i] = {i} end\n"),
+              0)
+        << lua_tostring(state(), -1);
+  }
+
+  int KilobytesInUse() { return lua_gc(state(), LUA_GCCOUNT, 0); }
+
+  Lua lua_;
+};
+
+TEST_F(LuaGcTest, StepGcIsANoOpUnlessPaced) {
+  MakeGarbage(1000);
+  lua_.StepGc(1000);
+  EXPECT_EQ(lua_.gc_stats().steps, 0);
+  EXPECT_EQ(lua_.gc_stats().cycles, 0);
+}
+
+TEST_F(LuaGcTest, StepGcCollectsGarbage) {
+  lua_.SetGcPacing(true);
+  // RunGc, unlike a bare LUA_GCCOLLECT, keeps the automatic collector off.
+  lua_.RunGc();
+  const int baseline = KilobytesInUse();
+  MakeGarbage(50000);
+  const int with_garbage = KilobytesInUse();
+  // The automatic collector is stopped, so nothing has been freed yet.
+  ASSERT_GT(with_garbage, 2 * baseline);
+
+  // A zero budget still makes progress, one step at a time.
+  lua_.StepGc(0);
+  EXPECT_EQ(lua_.gc_stats().steps, 1);
+  EXPECT_EQ(lua_.gc_stats().budget_ms, 0);
+
+  for (int i = 0; i < 1000 && lua_.gc_stats().cycles == 0; ++i) {
+    lua_.StepGc(1);
+  }
+  EXPECT_EQ(lua_.gc_stats().cycles, 1);
+  EXPECT_EQ(lua_.gc_stats().forced, 0);
+  EXPECT_LT(KilobytesInUse(), with_garbage / 2);
+}
+
+TEST_F(LuaGcTest, StepGcFinishesTheCycleOverBudgetWhenMemoryGrows) {
+  lua_.SetGcPacing(true);
+  lua_.RunGc();
+  // The first call records the live size that later growth is measured
+  // against.
+  lua_.StepGc(0);
+  MakeGarbage(50000);
+  const int with_garbage = KilobytesInUse();
+  lua_.StepGc(0);
+  EXPECT_EQ(lua_.gc_stats().cycles, 1);
+  EXPECT_EQ(lua_.gc_stats().forced, 1);
+  EXPECT_LT(KilobytesInUse(), with_garbage / 2);
+}
+
+}  // namespace
+}  // namespace G
@@ -0,0 +1,98 @@
+#include "lua_math.h"
+
+#include "lua.h"
+#include "test_fixture.h"
+
+namespace G {
+namespace {
+
+// A frame of a particle update, written once with the allocating vector
+// operators and once with the in-place methods.
+constexpr char kScript[] =
+    "entities = {}\n"
+    "for i = 1, 1000 do\n"
+    "  entities[i] = {pos = G.math.v2(i, 0), vel = G.math.v2(0, i)}\n"
+    "end\n"
+    "function update_allocating(dt)\n"
+    "  for _, e in ipairs(entities) do\n"
+    "    e.vel = e.vel * 0.99\n"
+    "    e.pos = e.pos + e.vel * dt\n"
+    "  end\n"
+    "end\n"
+    "local step = G.math.v2(0, 0)\n"
+    "function update_in_place(dt)\n"
+    "  for _, e in ipairs(entities) do\n"
+    "    e.vel:scale_(0.99)\n"
+    "    e.pos:add_(step:set(e.vel:unpack()):scale_(dt))\n"
+    "  end\n"
+    "end\n"
+    "function checksum()\n"
+    "  local sum = 0\n"
+    "  for _, e in ipairs(entities) do\n"
+    "    local x, y = e.pos:unpack()\n"
+    "    sum = sum + x + y\n"
+    "  end\n"
+    "  return sum\n"
+    "end\n";
+
+class LuaMathTest : public BaseTest {
+ protected:
+  LuaMathTest() : lua_(Slice<const char*>(), nullptr, nullptr, alloc) {
+    lua_.LoadLibraries();
+    AddMathLibrary(&lua_);
+  }
+
+  lua_State* state() { return lua_.state(); }
+
+  void Reset() {
+    ASSERT_EQ(luaL_dostring(state(), kScript), 0) << lua_tostring(state(), -1);
+  }
+
+  // Runs `function` for `frames` frames with the collector stopped and
+  // returns the bytes it allocated.
+  size_t GcBytes(const char* function, int frames) {
+    lua_gc(state(), LUA_GCCOLLECT, 0);
+    lua_gc(state(), LUA_GCSTOP, 0);
+    const size_t before = BytesInUse();
+    for (int i = 0; i < frames; ++i) {
+      lua_getglobal(state(), function);
+      lua_pushnumber(state(), 1.0 / 60);
+      EXPECT_EQ(lua_pcall(state(), 1, 0, 0), 0) << lua_tostring(state(), -1);
+    }
+    const size_t after = BytesInUse();
+    lua_gc(state(), LUA_GCRESTART, 0);
+    return after - before;
+  }
+
+  double Checksum() {
+    lua_getglobal(state(), "checksum");
+    EXPECT_EQ(lua_pcall(state(), 0, 1, 0), 0) << lua_tostring(state(), -1);
+    const double sum = lua_tonumber(state(), -1);
+    lua_pop(state(), 1);
+    return sum;
+  }
+
+ private:
+  size_t BytesInUse() {
+    return size_t{1024} * lua_gc(state(), LUA_GCCOUNT, 0) +
+           lua_gc(state(), LUA_GCCOUNTB, 0);
+  }
+
+  Lua lua_;
+};
+
+TEST_F(LuaMathTest, InPlaceMethodsDoNotAllocate) {
+  constexpr int kFrames = 60;
+  Reset();
+  const size_t allocating = GcBytes("update_allocating", kFrames);
+  const double expected = Checksum();
+  Reset();
+  const size_t in_place = GcBytes("update_in_place", kFrames);
+  EXPECT_EQ(Checksum(), expected);
+  // Three vectors per entity and frame.
+  EXPECT_GE(allocating, size_t{3 * 1000 * kFrames * sizeof(FVec2)});
+  EXPECT_EQ(in_place, 0u);
+}
+
+}  // namespace
+}  // namespace G
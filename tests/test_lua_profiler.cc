@@ -0,0 +1,98 @@
+#include "lua_profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "test_fixture.h"
+
+namespace G {
+namespace {
+
+constexpr char kScript[] =
+    "local function inner()\n"
+    "  local x = 0\n"
+    "  for i = 1, 20000 do x = x + i end\n"
+    "  return x\n"
+    "end\n"
+    "function outer()\n"
+    "  local s = 0\n"
+    "  for i = 1, 50 do s = s + inner() end\n"
+    "  return s\n"
+    "end\n"
+    "outer()\n";
+
+class LuaProfilerTest : public BaseTest {
+ protected:
+  LuaProfilerTest()
+      : state_(lua_newstate(&TestLuaAlloc, &modules_)), profiler_(alloc) {
+    luaL_openlibs(state_);
+  }
+  ~LuaProfilerTest() override {
+    profiler_.Stop();
+    lua_close(state_);
+  }
+
+  void Run(const char* script) {
+    ASSERT_EQ(luaL_loadbuffer(state_, script, std::strlen(script), "=test"),
+              0);
+    ASSERT_EQ(lua_pcall(state_, 0, 0, 0), 0) << lua_tostring(state_, -1);
+  }
+
+  std::string Folded() {
+    FILE* f = std::tmpfile();
+    profiler_.WriteFolded(f);
+    std::string result(static_cast<size_t>(std::ftell(f)), '\0');
+    std::rewind(f);
+    result.resize(std::fread(result.data(), 1, result.size(), f));
+    std::fclose(f);
+    return result;
+  }
+
+  LuaModules modules_;
+  lua_State* state_;
+  LuaProfiler profiler_;
+};
+
+TEST_F(LuaProfilerTest, FoldsSamplesByStack) {
+  profiler_.Start(state_, /*interval_ms=*/0);
+  Run(kScript);
+  profiler_.Stop();
+  ASSERT_GT(profiler_.sample_count(), 10u);
+  const std::string folded = Folded();
+  const std::string stack = "(main chunk) test;outer test:6;inner test:1 ";
+  const size_t pos = folded.find(stack);
+  ASSERT_NE(pos, std::string::npos) << folded;
+  // Almost all the time goes to the inner loop.
+  const size_t count = std::strtoul(folded.c_str() + pos + stack.size(),
+                                    nullptr, /*base=*/10);
+  EXPECT_GT(count, profiler_.sample_count() / 2) << folded;
+  // Counts add up to the samples taken.
+  size_t total = 0;
+  for (size_t eol = folded.find('\n'), start = 0; eol != std::string::npos;
+       start = eol + 1, eol = folded.find('\n', start)) {
+    total += std::strtoul(folded.c_str() + folded.rfind(' ', eol) + 1,
+                          nullptr, /*base=*/10);
+  }
+  EXPECT_EQ(total, profiler_.sample_count());
+}
+
+TEST_F(LuaProfilerTest, TakesAtMostOneSamplePerInterval) {
+  profiler_.Start(state_, /*interval_ms=*/60'000);
+  Run(kScript);
+  profiler_.Stop();
+  EXPECT_EQ(profiler_.sample_count(), 1u);
+}
+
+TEST_F(LuaProfilerTest, StopRemovesTheHook) {
+  profiler_.Start(state_, /*interval_ms=*/0);
+  profiler_.Stop();
+  EXPECT_FALSE(profiler_.running());
+  EXPECT_EQ(lua_gethook(state_), nullptr);
+  Run(kScript);
+  EXPECT_EQ(profiler_.sample_count(), 0u);
+  EXPECT_EQ(Folded(), "");
+}
+
+}  // namespace
+}  // namespace G
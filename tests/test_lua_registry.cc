@@ -0,0 +1,39 @@
+
+#include "lua.h"
+#include "test_fixture.h"
+
+namespace G {
+namespace {
+
+struct Graphics {
+  int draws = 0;
+};
+
+struct Physics {
+  int queries = 0;
+};
+
+class LuaRegistryTest : public BaseTest {
+ protected:
+  LuaRegistryTest() : state_(lua_newstate(&TestLuaAlloc, &modules_)) {}
+  ~LuaRegistryTest() override { lua_close(state_); }
+
+  LuaModules modules_;
+  lua_State* state_;
+};
+
+TEST_F(LuaRegistryTest, ModulesAreFoundPerType) {
+  Graphics graphics;
+  Physics physics;
+  Registry<Graphics>::Register(state_, &graphics);
+  Registry<Physics>::Register(state_, &physics);
+  EXPECT_EQ(Registry<Graphics>::Retrieve(state_), &graphics);
+  EXPECT_EQ(Registry<Physics>::Retrieve(state_), &physics);
+  // Coroutines share the modules of their state.
+  lua_State* coroutine = lua_newthread(state_);
+  EXPECT_EQ(Registry<Physics>::Retrieve(coroutine), &physics);
+  lua_pop(state_, 1);
+}
+
+}  // namespace
+}  // namespace G
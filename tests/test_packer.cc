@@ -1,7 +1,10 @@
-#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
+extern "C" {
+#include <lauxlib.h>
+}
+
 #include "assets.h"
 #include "blob_store.h"
 #include "executor.h"
@@ -252,6 +255,7 @@ TEST_F(PackerTest, LegacySchemaIsWipedAndRebuilt) {
 struct CapturedAssets {
   char script_contents[256] = {};
   size_t script_size = 0;
+  uint64_t script_blob_hash = 0;
   int script_loads = 0;
   int shader_loads = 0;
   DbAssets::ShaderType shader_type = DbAssets::ShaderType::kFragment;
@@ -261,11 +265,20 @@ ErrorOr<void> CaptureScript(DbAssets::Script* script, void* ud) {
   auto* captured = static_cast<CapturedAssets*>(ud);
   captured->script_loads++;
   captured->script_size = script->size;
-  std::memcpy(captured->script_contents, script->contents,
-              std::min(script->size + 1, sizeof(captured->script_contents)));
+  captured->script_blob_hash = script->blob_hash;
   return {};
 }
 
+// Reads the captured script from the blob store, as Lua does on first use.
+void ReadCapturedScript(CapturedAssets* captured) {
+  ASSERT_LT(captured->script_size, sizeof(captured->script_contents));
+  ASSERT_FALSE(ReadBlob(captured->script_blob_hash,
+                        reinterpret_cast<uint8_t*>(captured->script_contents),
+                        captured->script_size)
+                   .is_error());
+  captured->script_contents[captured->script_size] = '\0';
+}
+
 ErrorOr<void> CaptureShader(DbAssets::Shader* shader, void* ud) {
   auto* captured = static_cast<CapturedAssets*>(ud);
   captured->shader_loads++;
@@ -285,7 +298,7 @@ TEST_F(PackerTest, DbAssetsLoadsFromBlobStore) {
 
   EXPECT_EQ(captured.script_loads, 1);
   EXPECT_EQ(captured.script_size, sizeof(kMainLua) - 1);
-  // Contents round-trip NUL-terminated.
+  ReadCapturedScript(&captured);
   EXPECT_STREQ(captured.script_contents, kMainLua);
   EXPECT_EQ(captured.shader_loads, 1);
   EXPECT_EQ(captured.shader_type, DbAssets::ShaderType::kVertex);
@@ -308,6 +321,70 @@ TEST_F(PackerTest, DbAssetsLoadsFromBlobStore) {
   ASSERT_NE(PHYSFS_unmount(blobs_dir_), 0);
 }
 
+TEST_F(PackerTest, ScriptBlobsAreNotReadOnLoad) {
+  Pack();
+  // Without its blob main.lua still loads: only its metadata is read.
+  char blob_name[17];
+  FormatBlobName(rapidhash(kMainLua, sizeof(kMainLua) - 1), blob_name);
+  char blob_path[1024];
+  std::snprintf(blob_path, sizeof(blob_path), "%s/%s", blobs_dir_, blob_name);
+  ASSERT_EQ(std::remove(blob_path), 0);
+  ASSERT_NE(PHYSFS_mount(blobs_dir_, kBlobMountPoint, /*append=*/0), 0);
+  DbAssets assets(db_, &arena_);
+  CapturedAssets captured;
+  assets.RegisterScriptLoad(CaptureScript, &captured);
+  assets.Load();
+  EXPECT_EQ(captured.script_loads, 1);
+  EXPECT_EQ(captured.script_size, sizeof(kMainLua) - 1);
+  EXPECT_TRUE(ReadBlob(captured.script_blob_hash,
+                       reinterpret_cast<uint8_t*>(captured.script_contents),
+                       captured.script_size)
+                  .is_error());
+  ASSERT_NE(PHYSFS_unmount(blobs_dir_), 0);
+}
+
+TEST_F(PackerTest, BytecodeIsLoadedInsteadOfSource) {
+  Pack();
+  BlobStore blobs = MUST(BlobStore::Create(blobs_dir_));
+  EXPECT_EQ(MUST(WriteScriptBytecode(db_, &blobs, ScriptBytecode::kStripped,
+                                     &arena_)),
+            1u);
+  ASSERT_NE(PHYSFS_mount(blobs_dir_, kBlobMountPoint, /*append=*/0), 0);
+  {
+    DbAssets assets(db_, &arena_);
+    CapturedAssets captured;
+    assets.RegisterScriptLoad(CaptureScript, &captured);
+    assets.Load();
+    ASSERT_EQ(captured.script_loads, 1);
+    ReadCapturedScript(&captured);
+    EXPECT_EQ(std::string_view(captured.script_contents, 4), LUA_SIGNATURE);
+    // The checksum is still the one of the source.
+    EXPECT_EQ(assets.GetChecksum("main.lua"),
+              rapidhash(kMainLua, sizeof(kMainLua) - 1));
+    lua_State* state = luaL_newstate();
+    ASSERT_EQ(luaL_loadbuffer(state, captured.script_contents,
+                              captured.script_size, "@main.lua"),
+              0);
+    ASSERT_EQ(lua_pcall(state, 0, 1, 0), 0);
+    lua_getfield(state, -1, "init");
+    EXPECT_TRUE(lua_isfunction(state, -1));
+    lua_close(state);
+  }
+  // Repackaging without bytecode goes back to source.
+  EXPECT_EQ(
+      MUST(WriteScriptBytecode(db_, &blobs, ScriptBytecode::kNone, &arena_)),
+      0u);
+  {
+    DbAssets assets(db_, &arena_);
+    CapturedAssets captured;
+    assets.RegisterScriptLoad(CaptureScript, &captured);
+    assets.Load();
+    ReadCapturedScript(&captured);
+    EXPECT_STREQ(captured.script_contents, kMainLua);
+  }
+  ASSERT_NE(PHYSFS_unmount(blobs_dir_), 0);
+}
+
 TEST_F(PackerTest, PackagedZipFormatEndToEnd) {
   Pack();
 
@@ -343,6 +420,7 @@ TEST_F(PackerTest, PackagedZipFormatEndToEnd) {
   assets.RegisterScriptLoad(CaptureScript, &captured);
   assets.Load();
   EXPECT_EQ(captured.script_loads, 1);
+  ReadCapturedScript(&captured);
   EXPECT_STREQ(captured.script_contents, kMainLua);
   ASSERT_NE(PHYSFS_unmount(zip_path), 0);
   std::remove(zip_path);
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "radix_sort.h"
+
+namespace G {
+namespace {
+
+struct Item {
+  uint64_t key;
+  uint32_t order;
+};
+
+uint64_t KeyOf(const Item& item) { return item.key; }
+
+std::vector<Item> SortedCopy(std::vector<Item> items) {
+  std::stable_sort(items.begin(), items.end(),
+                   [](const Item& a, const Item& b) { return a.key < b.key; });
+  return items;
+}
+
+void ExpectSame(const std::vector<Item>& a, const std::vector<Item>& b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_EQ(a[i].key, b[i].key) << "at " << i;
+    EXPECT_EQ(a[i].order, b[i].order) << "at " << i;
+  }
+}
+
+TEST(RadixSortTest, EmptyAndSingle) {
+  Item one = {42, 0};
+  Item scratch;
+  RadixSort<Item>(nullptr, nullptr, 0, KeyOf);
+  RadixSort(&one, &scratch, 1, KeyOf);
+  EXPECT_EQ(one.key, 42u);
+}
+
+TEST(RadixSortTest, MatchesStableSortOnRandomKeys) {
+  std::mt19937_64 rng(1234);
+  std::vector<Item> items(5000);
+  for (uint32_t i = 0; i < items.size(); ++i) items[i] = {rng(), i};
+  std::vector<Item> expected = SortedCopy(items);
+  std::vector<Item> scratch(items.size());
+  RadixSort(items.data(), scratch.data(), items.size(), KeyOf);
+  ExpectSame(items, expected);
+}
+
+TEST(RadixSortTest, IsStableForEqualKeys) {
+  std::mt19937 rng(7);
+  std::vector<Item> items(1000);
+  for (uint32_t i = 0; i < items.size(); ++i) items[i] = {rng() % 4, i};
+  std::vector<Item> expected = SortedCopy(items);
+  std::vector<Item> scratch(items.size());
+  RadixSort(items.data(), scratch.data(), items.size(), KeyOf);
+  ExpectSame(items, expected);
+}
+
+TEST(RadixSortTest, SparseKeyBytes) {
+  // Only the top and bottom bytes vary; the skipped middle passes must not
+  // disturb the order produced by the others.
+  std::mt19937 rng(99);
+  std::vector<Item> items(777);
+  for (uint32_t i = 0; i < items.size(); ++i) {
+    const uint64_t top = rng() % 3, bottom = rng() % 200;
+    items[i] = {(top << 56) | (uint64_t{0x5A} << 24) | bottom, i};
+  }
+  std::vector<Item> expected = SortedCopy(items);
+  std::vector<Item> scratch(items.size());
+  RadixSort(items.data(), scratch.data(), items.size(), KeyOf);
+  ExpectSame(items, expected);
+}
+
+TEST(RadixSortTest, AlreadyUniformKeysAreUntouched) {
+  std::vector<Item> items(64);
+  for (uint32_t i = 0; i < items.size(); ++i) items[i] = {0xABCDEF, i};
+  std::vector<Item> scratch(items.size());
+  RadixSort(items.data(), scratch.data(), items.size(), KeyOf);
+  for (uint32_t i = 0; i < items.size(); ++i) EXPECT_EQ(items[i].order, i);
+}
+
+}  // namespace
+}  // namespace G
@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bits.h"
+#include "executor.h"
+#include "renderer.h"
+#include "test_fixture.h"
+#include "transformations.h"
+
+namespace G {
+
+// Records command streams the way BatchRenderer does and expands them with
+// PlanFill/FillGeometry, which need no GL context.
+class BatchRendererFillTest : public BaseTest {
+ protected:
+  using R = BatchRenderer;
+  using Vertex = R::VertexData;
+  using PackedVertex = R::PackedVertexData;
+
+  struct Output {
+    int chunks = 0;
+    bool packable = false;
+    std::vector<uint8_t> vertices;
+    std::vector<GLuint> indices;
+  };
+
+  static constexpr size_t kBufferSize = 1 << 22;
+  static constexpr int kMaxChunks = R::kMaxFillChunks;
+
+  BatchRendererFillTest() : frame_(alloc) {}
+
+  void AddQuad(FVec2 p0, FVec2 p1, FVec2 origin, float angle,
+               FVec2 q0 = FVec(0, 0), FVec2 q1 = FVec(1, 1)) {
+    Write(R::kRenderQuad, R::RenderQuad{p0, p1, q0, q1, origin, angle});
+  }
+
+  void AddTriangle(FVec2 p0, FVec2 p1, FVec2 p2) {
+    Write(R::kRenderTrig, R::RenderTriangle{p0, p1, p2, FVec(0, 0),
+                                            FVec(1, 0), FVec(0, 1)});
+  }
+
+  void AddLinePoint(FVec2 p) { Write(R::kAddLinePoint, R::AddLinePoint{p}); }
+
+  void SetColor(Color color) { Write(R::kSetColor, R::SetColor{color}); }
+
+  void SetTransform(const FMat4x4& transform) {
+    Write(R::kSetTransform, R::SetTransform{transform});
+  }
+
+  void SetTexture(size_t texture) {
+    Write(R::kSetTexture, R::SetTexture{texture});
+  }
+
+  void SetCanvas() { Write(R::kSetCanvas, R::SetCanvas{0, 64, 64}); }
+
+  void SetBlendMode() { Write(R::kSetBlendMode, R::SetBlendMode{BLEND_ADD}); }
+
+  // The fill only reads whether the program is custom.
+  void SetShader(bool custom) {
+    Write(R::kSetShader, R::SetShader{custom ? 1u : 0u, nullptr, custom});
+  }
+
+  void AddParticles(const ParticleInstanceData* data, uint32_t count) {
+    Write(R::kRenderParticles,
+          R::RenderParticlesCmd{data, count, /*texture_unit=*/0, BLEND_ADD});
+  }
+
+  struct ParticleDraw {
+    const ParticleInstanceData* data;
+    uint32_t count;
+  };
+
+  // The particle draws of the stream, in order.
+  std::vector<ParticleDraw> ParticleDraws() const {
+    std::vector<ParticleDraw> result;
+    for (size_t offset : particle_offsets_) {
+      R::RenderParticlesCmd cmd;
+      std::memcpy(&cmd, &frame_.buffer[offset], sizeof(cmd));
+      result.push_back({cmd.data, cmd.count});
+    }
+    return result;
+  }
+
+  void RetainParticleData() { R::RetainParticleData(&frame_); }
+
+  uint32_t AppendSprites(const std::vector<SpriteInstanceData>& sprites) {
+    return R::AppendSpriteInstances(&frame_, sprites.data(), sprites.size());
+  }
+
+  std::vector<SpriteInstanceData> Sprites() const {
+    EXPECT_GE(frame_.sprite_capacity, frame_.sprite_count);
+    return {frame_.sprites, frame_.sprites + frame_.sprite_count};
+  }
+
+  Output Expand(size_t chunk_commands, Executor* executor,
+                bool cpu_transforms = true,
+                R::VertexFormat format = R::kVertexFull) {
+    R::FillPlan plan(alloc);
+    R::PlanFill(frame_.buffer, &frame_.commands, R::kTextureSlots,
+                chunk_commands, &plan);
+    Output out;
+    out.chunks = plan.count;
+    out.packable = plan.packable;
+    out.vertices.resize(plan.vertices * (format == R::kVertexPacked
+                                             ? sizeof(R::PackedVertexData)
+                                             : sizeof(R::VertexData)));
+    out.indices.resize(plan.indices);
+    R::FillGeometry(plan, cpu_transforms, format, /*base_vertex=*/100,
+                    out.vertices.data(), out.indices.data(), executor);
+    return out;
+  }
+
+  Output ExpandPacked(size_t chunk_commands, Executor* executor,
+                      bool cpu_transforms = true) {
+    return Expand(chunk_commands, executor, cpu_transforms, R::kVertexPacked);
+  }
+
+  static R::PackedVertexData Packed(const Output& out, size_t vertex) {
+    R::PackedVertexData v;
+    std::memcpy(&v, &out.vertices[vertex * sizeof(v)], sizeof(v));
+    return v;
+  }
+
+  static FVec2 Position(const Output& out, size_t vertex) {
+    R::VertexData v;
+    std::memcpy(&v, &out.vertices[vertex * sizeof(v)], sizeof(v));
+    return v.position;
+  }
+
+  static int TexSlot(const Output& out, size_t vertex) {
+    R::VertexData v;
+    std::memcpy(&v, &out.vertices[vertex * sizeof(v)], sizeof(v));
+    return v.tex_slot;
+  }
+
+  // A long stream mixing every command the fill looks at.
+  void AddRandomScene(int commands, uint32_t seed) {
+    std::mt19937 rng(seed);
+    auto coord = [&] { return static_cast<float>(rng() % 1000) / 3.f; };
+    for (int i = 0; i < commands; ++i) {
+      switch (rng() % 16) {
+        case 0:
+          SetColor(Color{static_cast<uint8_t>(rng()), 10, 20, 255});
+          break;
+        case 1:
+          SetTransform(rng() % 3 == 0 ? FMat4x4::Identity()
+                                      : TranslationXY(coord(), coord()) *
+                                            RotationZ(coord()));
+          break;
+        case 2:
+          SetTexture(rng() % 12);
+          break;
+        case 3:
+          if (rng() % 8 == 0) SetCanvas();
+          break;
+        case 4:
+          SetBlendMode();
+          break;
+        case 5:
+          AddTriangle(FVec(coord(), coord()), FVec(coord(), coord()),
+                      FVec(coord(), coord()));
+          break;
+        case 6:
+          for (int p = rng() % 5; p >= 0; --p) {
+            AddLinePoint(FVec(coord(), coord()));
+          }
+          break;
+        default:
+          AddQuad(FVec(coord(), coord()), FVec(coord(), coord()),
+                  FVec(coord(), coord()), rng() % 2 ? coord() : 0);
+          break;
+      }
+    }
+  }
+
+ private:
+  template <typename T>
+  void Write(R::CommandType type, const T& data) {
+    const size_t aligned = Align(sizeof(data), alignof(R::Command));
+    ASSERT_LE(frame_.pos + aligned, kBufferSize);
+    if (type == R::kRenderParticles) particle_offsets_.push_back(frame_.pos);
+    std::memcpy(&frame_.buffer[frame_.pos], &data, sizeof(data));
+    frame_.pos += aligned;
+    FixedArray<R::QueueEntry>& commands = frame_.commands;
+    if (!commands.empty() && commands.back().type == type) {
+      commands.back().count++;
+    } else {
+      commands.Push(R::QueueEntry{.type = type, .count = 1});
+    }
+  }
+
+  R::RecordedFrame frame_;
+  std::vector<size_t> particle_offsets_;
+};
+
+namespace {
+
+void ExpectSameBytes(const std::vector<uint8_t>& a,
+                     const std::vector<uint8_t>& b) {
+  ASSERT_EQ(a.size(), b.size());
+  EXPECT_EQ(std::memcmp(a.data(), b.data(), a.size()), 0);
+}
+
+}  // namespace
+
+TEST_F(BatchRendererFillTest, EmptyStream) {
+  Output out = Expand(/*chunk_commands=*/16, /*executor=*/nullptr);
+  EXPECT_EQ(out.chunks, 0);
+  EXPECT_TRUE(out.vertices.empty());
+  EXPECT_TRUE(out.indices.empty());
+}
+
+TEST_F(BatchRendererFillTest, QuadIndicesAreOffsetByBaseVertex) {
+  AddQuad(FVec(0, 0), FVec(10, 10), FVec(0, 0), 0);
+  AddQuad(FVec(20, 20), FVec(30, 30), FVec(0, 0), 0);
+  Output out = Expand(/*chunk_commands=*/1, /*executor=*/nullptr);
+  EXPECT_EQ(out.chunks, 2);
+  const std::vector<GLuint> expected = {100, 101, 103, 101, 102, 103,
+                                        104, 105, 107, 105, 106, 107};
+  EXPECT_EQ(out.indices, expected);
+  EXPECT_EQ(Position(out, 4), FVec(20, 30));
+}
+
+TEST_F(BatchRendererFillTest, ChunksResumeTransformAndTextureState) {
+  SetTexture(3);
+  SetTransform(TranslationXY(5, 7));
+  AddQuad(FVec(0, 0), FVec(1, 1), FVec(0, 0), 0);
+  SetTexture(4);
+  AddTriangle(FVec(1, 1), FVec(2, 1), FVec(1, 2));
+  // One command per chunk: every draw starts from a snapshot.
+  Output out = Expand(/*chunk_commands=*/1, /*executor=*/nullptr);
+  EXPECT_EQ(out.chunks, 5);
+  EXPECT_EQ(Position(out, 0), FVec(5, 8));
+  EXPECT_EQ(TexSlot(out, 0), 1);
+  EXPECT_EQ(Position(out, 4), FVec(6, 8));
+  EXPECT_EQ(TexSlot(out, 4), 2);
+}
+
+TEST_F(BatchRendererFillTest, CustomShadersGetUntransformedVertices) {
+  SetTransform(TranslationXY(5, 7));
+  AddQuad(FVec(0, 0), FVec(1, 1), FVec(0, 0), 0);
+  SetShader(/*custom=*/true);
+  AddQuad(FVec(0, 0), FVec(1, 1), FVec(0, 0), 0);
+  SetShader(/*custom=*/false);
+  AddQuad(FVec(0, 0), FVec(1, 1), FVec(0, 0), 0);
+  Output out = Expand(/*chunk_commands=*/1, /*executor=*/nullptr);
+  EXPECT_EQ(Position(out, 0), FVec(5, 8));
+  // The custom program applies the transform uniform itself.
+  EXPECT_EQ(Position(out, 4), FVec(0, 1));
+  EXPECT_EQ(Position(out, 8), FVec(5, 8));
+}
+
+TEST_F(BatchRendererFillTest, ParallelFillMatchesSerial) {
+  AddRandomScene(/*commands=*/40000, /*seed=*/1705);
+  const Output serial = Expand(/*chunk_commands=*/1 << 30, nullptr);
+  EXPECT_EQ(serial.chunks, 1);
+  ThreadPoolExecutor pool(alloc, 4);
+  pool.Start();
+  for (size_t chunk_commands : {1, 7, 64, 1000, 4096}) {
+    SCOPED_TRACE(chunk_commands);
+    const Output parallel = Expand(chunk_commands, &pool);
+    EXPECT_GT(parallel.chunks, 1);
+    EXPECT_LE(parallel.chunks, kMaxChunks);
+    ExpectSameBytes(parallel.vertices, serial.vertices);
+    EXPECT_EQ(parallel.indices, serial.indices);
+  }
+  pool.Shutdown();
+}
+
+TEST_F(BatchRendererFillTest, ParallelFillMatchesSerialWithGpuTransforms) {
+  AddRandomScene(/*commands=*/10000, /*seed=*/42);
+  const Output serial = Expand(/*chunk_commands=*/1 << 30, nullptr,
+                               /*cpu_transforms=*/false);
+  ThreadPoolExecutor pool(alloc, 3);
+  pool.Start();
+  const Output parallel =
+      Expand(/*chunk_commands=*/100, &pool, /*cpu_transforms=*/false);
+  ExpectSameBytes(parallel.vertices, serial.vertices);
+  EXPECT_EQ(parallel.indices, serial.indices);
+  pool.Shutdown();
+}
+
+TEST_F(BatchRendererFillTest, RetainedParticleDataOutlivesTheSource) {
+  std::vector<ParticleInstanceData> first(3), second(70);
+  for (size_t i = 0; i < first.size(); ++i) first[i].x = i;
+  for (size_t i = 0; i < second.size(); ++i) second[i].x = 100 + i;
+  AddParticles(first.data(), first.size());
+  AddQuad(FVec(0, 0), FVec(1, 1), FVec(0, 0), 0);
+  AddParticles(second.data(), second.size());
+  AddParticles(first.data(), 1);
+  RetainParticleData();
+  // The frame allocator the data came from is reset for the next frame.
+  std::fill(first.begin(), first.end(), ParticleInstanceData{});
+  std::fill(second.begin(), second.end(), ParticleInstanceData{});
+  const std::vector<ParticleDraw> draws = ParticleDraws();
+  ASSERT_EQ(draws.size(), 3u);
+  EXPECT_EQ(draws[0].count, 3u);
+  EXPECT_EQ(draws[1].count, 70u);
+  EXPECT_EQ(draws[2].count, 1u);
+  EXPECT_EQ(draws[0].data[2].x, 2);
+  EXPECT_EQ(draws[1].data[0].x, 100);
+  EXPECT_EQ(draws[1].data[69].x, 169);
+  EXPECT_EQ(draws[2].data[0].x, 0);
+  EXPECT_EQ(draws[1].data, draws[0].data + 3);
+}
+
+TEST_F(BatchRendererFillTest, SpriteInstancesKeepTheirOffsetsWhenGrowing) {
+  std::vector<SpriteInstanceData> first(3), second(70);
+  for (size_t i = 0; i < first.size(); ++i) first[i].x = i;
+  for (size_t i = 0; i < second.size(); ++i) second[i].x = 100 + i;
+  EXPECT_EQ(AppendSprites(first), 0u);
+  EXPECT_EQ(AppendSprites(second), 3u);
+  EXPECT_EQ(AppendSprites(first), 73u);
+  const std::vector<SpriteInstanceData> sprites = Sprites();
+  ASSERT_EQ(sprites.size(), 76u);
+  EXPECT_EQ(sprites[2].x, 2);
+  EXPECT_EQ(sprites[3].x, 100);
+  EXPECT_EQ(sprites[72].x, 169);
+  EXPECT_EQ(sprites[75].x, 2);
+}
+
+TEST_F(BatchRendererFillTest, PackedVerticesAreRotatedOnTheCpu) {
+  const float kQuarterTurn = static_cast<float>(M_PI / 2);
+  AddQuad(FVec(0, 0), FVec(10, 20), FVec(5, 10), kQuarterTurn,
+          FVec(0.25, 0.5), FVec(0.5, 1));
+  for (bool cpu_transforms : {true, false}) {
+    SCOPED_TRACE(cpu_transforms);
+    const Output out = ExpandPacked(/*chunk_commands=*/16, nullptr,
+                                    cpu_transforms);
+    ASSERT_EQ(out.vertices.size(), 4 * sizeof(PackedVertex));
+    // Corner (0, 20) turns a quarter around (5, 10).
+    const PackedVertex v = Packed(out, 0);
+    EXPECT_NEAR(v.position.x, -5, 1e-4);
+    EXPECT_NEAR(v.position.y, 5, 1e-4);
+    EXPECT_EQ(v.tex_coords[0], 16384);
+    EXPECT_EQ(v.tex_coords[1], 65535);
+    EXPECT_EQ(Packed(out, 3).tex_coords[1], 32768);
+  }
+}
+
+TEST_F(BatchRendererFillTest, RepeatingTexCoordsAreNotPackable) {
+  AddQuad(FVec(0, 0), FVec(10, 10), FVec(0, 0), 0);
+  EXPECT_TRUE(Expand(/*chunk_commands=*/16, nullptr).packable);
+  AddQuad(FVec(0, 0), FVec(10, 10), FVec(0, 0), 0, FVec(0, 0), FVec(4, 1));
+  EXPECT_FALSE(Expand(/*chunk_commands=*/16, nullptr).packable);
+}
+
+TEST_F(BatchRendererFillTest, PackedFillMatchesFullFill) {
+  AddRandomScene(/*commands=*/20000, /*seed=*/7);
+  const Output full = Expand(/*chunk_commands=*/1 << 30, nullptr);
+  ASSERT_TRUE(full.packable);
+  const Output packed = ExpandPacked(/*chunk_commands=*/1 << 30, nullptr);
+  EXPECT_EQ(packed.indices, full.indices);
+  ThreadPoolExecutor pool(alloc, 4);
+  pool.Start();
+  ExpectSameBytes(ExpandPacked(/*chunk_commands=*/64, &pool).vertices,
+                  packed.vertices);
+  pool.Shutdown();
+  // Full vertices still carry the rotation of quads drawn without a
+  // transform, which packed ones have applied. Everything else was written
+  // by the same code, so those positions agree exactly.
+  const size_t count = full.vertices.size() / sizeof(Vertex);
+  ASSERT_EQ(packed.vertices.size(), count * sizeof(PackedVertex));
+  int rotated = 0;
+  for (size_t i = 0; i < count; ++i) {
+    Vertex v;
+    std::memcpy(&v, &full.vertices[i * sizeof(v)], sizeof(v));
+    const PackedVertex p = Packed(packed, i);
+    ASSERT_EQ(p.tex_slot, v.tex_slot) << i;
+    if (v.angle == 0) {
+      ASSERT_EQ(p.position, v.position) << i;
+      continue;
+    }
+    // What the vertex shader does with the full vertex.
+    const float cs = std::cos(v.angle), sn = std::sin(v.angle);
+    const FVec2 d = v.position - v.origin;
+    ASSERT_NEAR(p.position.x, v.origin.x + d.x * cs - d.y * sn, 1e-3) << i;
+    ASSERT_NEAR(p.position.y, v.origin.y + d.x * sn + d.y * cs, 1e-3) << i;
+    rotated++;
+  }
+  EXPECT_GT(rotated, 0);
+}
+
+}  // namespace G
@@ -199,4 +199,13 @@ TEST(StringTableTest, InternAndLookup) {
   EXPECT_EQ(handle1, handle3);
 }
 
+TEST(StringTableTest, ContainsOnlyInternedHandles) {
+  auto s = std::make_unique<StringTable>();
+  const uint32_t handle = s->Intern("foo");
+  EXPECT_TRUE(s->Contains(handle));
+  EXPECT_FALSE(s->Contains(handle ^ 1));
+  EXPECT_FALSE(s->Contains(s->Handle("bar")));
+  EXPECT_FALSE(s->Contains(UINT32_MAX));
+}
+
 }  // namespace G
@@ -0,0 +1,82 @@
+#include "tilemap.h"
+
+#include <vector>
+
+#include "renderer.h"
+#include "test_fixture.h"
+
+namespace G {
+
+// Chunk geometry and invalidation, which need no GL context as long as
+// nothing is drawn.
+class TilemapChunkTest : public BaseTest {
+ protected:
+  using Chunk = Tilemap::Chunk;
+
+  static constexpr int kChunk = Tilemap::kChunkTiles;
+
+  TilemapChunkTest() : tilemap_(/*tile_width=*/16, /*tile_height=*/8, alloc) {}
+
+  std::vector<StaticQuad> Quads(std::string_view layer, int chunk_x,
+                                int chunk_y, FVec2 sheet_size) {
+    std::vector<StaticQuad> quads(kChunk * kChunk);
+    const size_t count = tilemap_.BuildChunkQuads(
+        *tilemap_.FindLayer(layer), chunk_x, chunk_y, sheet_size, quads.data());
+    quads.resize(count);
+    return quads;
+  }
+
+  Chunk* Chunks(std::string_view layer) {
+    return tilemap_.LayerChunks(
+        static_cast<int>(tilemap_.FindLayer(layer) - tilemap_.layer(0)));
+  }
+
+  Tilemap tilemap_;
+};
+
+TEST_F(TilemapChunkTest, QuadsAreInLayerSpace) {
+  tilemap_.AddLayer("ground", /*width=*/40, /*height=*/40, false);
+  tilemap_.SetTile("ground", 33, 2, 2);
+  tilemap_.SetTile("ground", 35, 3, 1 | kTileFlipHorizontal);
+  tilemap_.SetTile("ground", 3, 3, 1);
+  // 64x16 sheet: 4 tiles per row, two rows.
+  const std::vector<StaticQuad> quads =
+      Quads("ground", /*chunk_x=*/1, /*chunk_y=*/0, FVec(64, 16));
+  ASSERT_EQ(quads.size(), 2u);
+  EXPECT_EQ(quads[0].p0, FVec(33 * 16, 2 * 8));
+  EXPECT_EQ(quads[0].p1, FVec(34 * 16, 3 * 8));
+  EXPECT_FLOAT_EQ(quads[0].q0.x, 0.25f + 0.5f / 64);
+  EXPECT_FLOAT_EQ(quads[0].q1.y, 0.5f - 0.5f / 16);
+  // Flipped horizontally: u runs backwards.
+  EXPECT_GT(quads[1].q0.x, quads[1].q1.x);
+  EXPECT_TRUE(Quads("ground", 1, 1, FVec(64, 16)).empty());
+}
+
+TEST_F(TilemapChunkTest, EdgeChunksStopAtTheLayerBounds) {
+  tilemap_.AddLayer("ground", /*width=*/kChunk + 3, /*height=*/5, false);
+  for (int x = 0; x < kChunk + 3; ++x) {
+    for (int y = 0; y < 5; ++y) tilemap_.SetTile("ground", x, y, 1);
+  }
+  EXPECT_EQ(Quads("ground", 0, 0, FVec(16, 8)).size(), size_t{kChunk * 5});
+  EXPECT_EQ(Quads("ground", 1, 0, FVec(16, 8)).size(), 3u * 5);
+}
+
+TEST_F(TilemapChunkTest, SetTileDirtiesItsChunk) {
+  tilemap_.AddLayer("ground", /*width=*/70, /*height=*/40, false);
+  tilemap_.AddLayer("decor", /*width=*/70, /*height=*/40, false);
+  Chunk* ground = Chunks("ground");
+  Chunk* decor = Chunks("decor");
+  // 3 columns by 2 rows of chunks.
+  tilemap_.SetTile("ground", 65, 33, 1);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(ground[i].dirty, i == 5) << i;
+    EXPECT_FALSE(decor[i].dirty) << i;
+  }
+  tilemap_.SetTileset("other");
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_TRUE(ground[i].dirty) << i;
+    EXPECT_TRUE(decor[i].dirty) << i;
+  }
+}
+
+}  // namespace G